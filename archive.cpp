@@ -0,0 +1,600 @@
+#include "archive.h"
+#include "io_scheduler.h"
+#include "profiler.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <deque>
+#include <fcntl.h>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sys/stat.h>
+#include <sys/sysmacros.h>
+#include <thread>
+#include <unistd.h>
+#include <zlib.h>
+
+// Размер записи tar и объем словаря deflate, который блок берет из конца предыдущего
+#define TAR_BLOCK 512
+#define DEFLATE_DICTIONARY 32768
+// Буфер чтения файлов при сборке tar-потока
+#define PACK_READ_BUFFER (256 * 1024)
+
+static bool write_all(int fd, const unsigned char* data, size_t size) {
+    while (size > 0) {
+        ssize_t written = write(fd, data, size);
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        data += written;
+        size -= static_cast<size_t>(written);
+    }
+    return true;
+}
+
+// Сжатие потока gzip блоками в пуле потоков. Блок - сырой поток deflate, закрытый Z_SYNC_FLUSH,
+// поэтому блоки можно просто склеить; последний закрыт Z_FINISH. Контрольные суммы блоков
+// объединяются через crc32_combine. Поток записи выводит готовые блоки строго по порядку,
+// а число блоков в работе ограничено, чтобы память не росла, если диск медленнее чтения
+class GzipPipeline {
+public:
+    GzipPipeline(int fd, const PackOptions& options, PackProgress* progress);
+    ~GzipPipeline();
+
+    // Дописывает данные в поток; false, если запись архива уже завершилась ошибкой
+    bool write(const char* data, size_t size);
+    // Сжимает остаток, дожидается записи всех блоков и заголовка с контрольной суммой
+    bool finish(std::string& error);
+
+private:
+    struct Block {
+        std::vector<char> input;
+        std::vector<char> dictionary;
+        std::vector<unsigned char> output;
+        uint32_t crc;
+        bool last;
+        bool done;
+        bool ok;
+    };
+
+    static void compress(Block& block, int level);
+    void submit_block(bool last);
+    void run_writer();
+
+    int fd;
+    int level;
+    size_t block_size;
+    size_t max_blocks;
+    PackProgress* progress;
+    std::shared_ptr<Block> current;
+
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::shared_ptr<Block> > queue;
+    bool stopping;
+    bool failed;
+    int write_error;
+
+    // Пул объявлен после очереди и мьютекса: его деструктор дожидается задач, которые к ним обращаются
+    WorkerPool pool;
+    std::thread writer;
+};
+
+GzipPipeline::GzipPipeline(int fd, const PackOptions& options, PackProgress* progress)
+        : fd(fd), level(options.level), block_size(std::max<size_t>(options.block_size, DEFLATE_DICTIONARY)),
+          max_blocks(0), progress(progress), current(std::make_shared<Block>()), stopping(false), failed(false),
+          write_error(0), pool(options.threads > 0 ? options.threads : default_worker_count()) {
+    // Очередь вмещает по паре блоков на поток сжатия: всем потокам хватает работы, пока пишется готовый блок
+    max_blocks = pool.size() * 2 + 2;
+    current->input.reserve(block_size);
+    writer = std::thread(&GzipPipeline::run_writer, this);
+}
+
+GzipPipeline::~GzipPipeline() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    changed.notify_all();
+    writer.join();
+}
+
+bool GzipPipeline::write(const char* data, size_t size) {
+    while (size > 0) {
+        size_t part = std::min(size, block_size - current->input.size());
+        current->input.insert(current->input.end(), data, data + part);
+        data += part;
+        size -= part;
+        if (current->input.size() == block_size) {
+            submit_block(false);
+        }
+    }
+    std::lock_guard<std::mutex> lock(mutex);
+    return !failed;
+}
+
+void GzipPipeline::compress(Block& block, int level) {
+    PROFILE_SCOPE("pack_compress");
+    z_stream stream;
+    memset(&stream, 0, sizeof(stream));
+    // Отрицательное число бит окна - сырой deflate без заголовка zlib
+    block.ok = deflateInit2(&stream, level, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) == Z_OK;
+    if (!block.ok) {
+        return;
+    }
+    if (!block.dictionary.empty()) {
+        deflateSetDictionary(&stream, reinterpret_cast<const Bytef*>(&block.dictionary[0]),
+                             static_cast<uInt>(block.dictionary.size()));
+    }
+    stream.next_in = reinterpret_cast<Bytef*>(block.input.empty() ? nullptr : &block.input[0]);
+    stream.avail_in = static_cast<uInt>(block.input.size());
+    int flush = block.last ? Z_FINISH : Z_SYNC_FLUSH;
+    size_t produced = 0;
+    block.output.resize(deflateBound(&stream, block.input.size()) + 64);
+    while (true) {
+        stream.next_out = &block.output[produced];
+        stream.avail_out = static_cast<uInt>(block.output.size() - produced);
+        int ret = deflate(&stream, flush);
+        produced = block.output.size() - stream.avail_out;
+        if (ret == Z_STREAM_ERROR) {
+            block.ok = false;
+            break;
+        }
+        if (stream.avail_out != 0 && (flush != Z_FINISH || ret == Z_STREAM_END)) {
+            break;
+        }
+        block.output.resize(block.output.size() * 2);
+    }
+    block.output.resize(produced);
+    deflateEnd(&stream);
+    block.crc = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(block.input.empty() ? nullptr : &block.input[0]),
+                                            static_cast<uInt>(block.input.size())));
+}
+
+void GzipPipeline::submit_block(bool last) {
+    std::shared_ptr<Block> block = current;
+    block->last = last;
+    block->done = false;
+    block->ok = true;
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+        while (queue.size() >= max_blocks && !failed) {
+            changed.wait(lock);
+        }
+        // После ошибки записи писатель завершился и очередь никто не разберет: блок отбрасывается,
+        // иначе каждый следующий блок оставался бы в памяти до конца упаковки
+        if (failed) {
+            current->input.clear();
+            current->dictionary.clear();
+            return;
+        }
+        queue.push_back(block);
+    }
+    int block_level = level;
+    pool.submit([this, block, block_level]() {
+        compress(*block, block_level);
+        std::lock_guard<std::mutex> lock(mutex);
+        block->done = true;
+        changed.notify_all();
+    });
+
+    // Следующий блок сжимается со словарем из конца этого, почти не теряя в степени сжатия
+    current = std::make_shared<Block>();
+    current->input.reserve(block_size);
+    if (!last) {
+        size_t tail = std::min<size_t>(block->input.size(), DEFLATE_DICTIONARY);
+        current->dictionary.assign(block->input.end() - tail, block->input.end());
+    }
+}
+
+void GzipPipeline::run_writer() {
+    // Заголовок gzip: сжатие deflate, время создания, ОС - Unix
+    uint32_t now = static_cast<uint32_t>(time(nullptr));
+    unsigned char header[10] = {0x1f, 0x8b, 8, 0, static_cast<unsigned char>(now), static_cast<unsigned char>(now >> 8),
+                                static_cast<unsigned char>(now >> 16), static_cast<unsigned char>(now >> 24), 0, 3};
+    bool ok = write_all(fd, header, sizeof(header));
+    uLong crc = crc32(0, nullptr, 0);
+    uint64_t length = 0;
+    if (progress != nullptr) {
+        progress->written_bytes += sizeof(header);
+    }
+
+    while (ok) {
+        std::shared_ptr<Block> block;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while ((queue.empty() || !queue.front()->done) && !stopping) {
+                changed.wait(lock);
+            }
+            if (queue.empty() || !queue.front()->done) {
+                return;
+            }
+            block = queue.front();
+        }
+        ok = block->ok && write_all(fd, block->output.empty() ? nullptr : &block->output[0], block->output.size());
+        crc = crc32_combine(crc, block->crc, static_cast<z_off_t>(block->input.size()));
+        length += block->input.size();
+        if (progress != nullptr) {
+            progress->written_bytes += block->output.size();
+        }
+        if (ok && block->last) {
+            // Окончание gzip: CRC32 и длина несжатых данных по модулю 2^32, младшим байтом вперед
+            unsigned char trailer[8];
+            for (int i = 0; i < 4; ++i) {
+                trailer[i] = static_cast<unsigned char>(crc >> (8 * i));
+                trailer[4 + i] = static_cast<unsigned char>(length >> (8 * i));
+            }
+            ok = write_all(fd, trailer, sizeof(trailer));
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (!ok) {
+                failed = true;
+                write_error = block->ok ? errno : 0;
+                // Остальные блоки уже не будут записаны; задачи сжатия держат свои блоки сами
+                queue.clear();
+            } else {
+                queue.pop_front();
+            }
+            changed.notify_all();
+        }
+        if (block->last) {
+            return;
+        }
+    }
+}
+
+bool GzipPipeline::finish(std::string& error) {
+    submit_block(true);
+    std::unique_lock<std::mutex> lock(mutex);
+    while (!queue.empty() && !failed) {
+        changed.wait(lock);
+    }
+    if (failed) {
+        error = write_error != 0 ? strerror(write_error) : "compression failed";
+        return false;
+    }
+    return true;
+}
+
+// Пишет число в восьмеричное поле заголовка tar с завершающим нулем; не поместившееся
+// значение записывается в двоичном виде с установленным старшим битом, как это делает GNU tar
+static void put_number(char* field, size_t width, uint64_t value) {
+    if (value < (static_cast<uint64_t>(1) << (3 * (width - 1)))) {
+        // Буфер вмещает любое 64-битное число, поэтому с оптимизацией компилятор не видит усечения
+        char digits[32];
+        snprintf(digits, sizeof(digits), "%0*llo", static_cast<int>(width - 1), static_cast<unsigned long long>(value));
+        memcpy(field, digits, width);
+        return;
+    }
+    memset(field, 0, width);
+    for (size_t i = width - 1; i > 0; --i) {
+        field[i] = static_cast<char>(value & 0xff);
+        value >>= 8;
+    }
+    field[0] = static_cast<char>(0x80);
+}
+
+// Записи архива tar в формате GNU из обхода дерева. Обход последовательный, поэтому записи
+// идут в порядке обхода, а каталог всегда предшествует своему содержимому
+class TarVisitor : public TreeVisitor {
+public:
+    TarVisitor(GzipPipeline& output, const std::string& root, const std::string& root_name, const struct stat& archive,
+               PackProgress* progress, OperationResult& result)
+        : output(output), root(root), root_name(root_name), archive(archive), progress(progress), result(result),
+          buffer(PACK_READ_BUFFER), output_failed(false) {}
+
+    bool is_writing() const {
+        return !output_failed;
+    }
+
+    bool enter_directory(const std::string& path, const struct stat& st) {
+        if (stopped()) {
+            return false;
+        }
+        write_header(archive_name(path) + "/", st, '5', "", 0);
+        return !stopped();
+    }
+
+    void visit_files(const std::string& dir, int dir_fd, const std::vector<WalkEntry>& files) {
+        for (size_t i = 0; i < files.size() && !stopped(); ++i) {
+            const WalkEntry& entry = files[i];
+            const struct stat& st = entry.st;
+            std::string name = dir.empty() ? root_name : archive_name(walk_path(dir, entry.name));
+            // Сам архив в него не попадает, даже если пишется внутрь упаковываемого каталога
+            if (st.st_dev == archive.st_dev && st.st_ino == archive.st_ino) {
+                continue;
+            }
+            if (S_ISREG(st.st_mode)) {
+                add_file(dir_fd, entry.name, name, st);
+            } else if (S_ISLNK(st.st_mode)) {
+                std::vector<char> target(PATH_MAX + 1);
+                ssize_t length = readlinkat(dir_fd, entry.name.c_str(), &target[0], PATH_MAX);
+                if (length < 0) {
+                    walk_error(walk_path(dir, entry.name), errno);
+                    continue;
+                }
+                write_header(name, st, '2', std::string(&target[0], length), 0);
+            } else if (S_ISFIFO(st.st_mode)) {
+                write_header(name, st, '6', "", 0);
+            } else if (S_ISCHR(st.st_mode) || S_ISBLK(st.st_mode)) {
+                write_header(name, st, S_ISCHR(st.st_mode) ? '3' : '4', "", 0);
+            }
+            // Сокеты, как и tar, пропускаем
+        }
+    }
+
+    void walk_error(const std::string& path, int error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        if (result.ok) {
+            result.error = path + ": " + strerror(error);
+        }
+        result.ok = false;
+    }
+
+private:
+    // Упаковка отменена или архив больше не пишется: обход прекращается, чтобы не читать
+    // и не сжимать дерево впустую
+    bool stopped() const {
+        return output_failed || (progress != nullptr && progress->cancel);
+    }
+
+    void emit(const char* data, size_t size) {
+        if (!output_failed && !output.write(data, size)) {
+            output_failed = true;
+        }
+    }
+
+    std::string archive_name(const std::string& path) const {
+        return root_name + path.substr(root.size());
+    }
+
+    // Длинное имя или цель ссылки записывается отдельной записью GNU перед основным заголовком
+    void write_long_name(char type, const std::string& value) {
+        char header[TAR_BLOCK];
+        memset(header, 0, sizeof(header));
+        strcpy(header, "././@LongLink");
+        fill_header(header, 0644, 0, 0, value.size() + 1, 0, type, "", 0, 0);
+        emit(header, sizeof(header));
+        emit(value.c_str(), value.size() + 1);
+        pad(value.size() + 1);
+    }
+
+    void fill_header(char* header, mode_t mode, uid_t uid, gid_t gid, uint64_t size, time_t mtime, char type,
+                     const std::string& link, unsigned major_number, unsigned minor_number) {
+        put_number(header + 100, 8, mode & 07777);
+        put_number(header + 108, 8, uid);
+        put_number(header + 116, 8, gid);
+        put_number(header + 124, 12, size);
+        put_number(header + 136, 12, mtime < 0 ? 0 : static_cast<uint64_t>(mtime));
+        header[156] = type;
+        memcpy(header + 157, link.data(), std::min<size_t>(link.size(), 100));
+        memcpy(header + 257, "ustar  ", 8);
+        if (type == '3' || type == '4') {
+            put_number(header + 329, 8, major_number);
+            put_number(header + 337, 8, minor_number);
+        }
+        // Контрольная сумма считается при поле суммы, заполненном пробелами
+        memset(header + 148, ' ', 8);
+        unsigned sum = 0;
+        for (int i = 0; i < TAR_BLOCK; ++i) {
+            sum += static_cast<unsigned char>(header[i]);
+        }
+        snprintf(header + 148, 8, "%06o", sum);
+    }
+
+    void write_header(const std::string& name, const struct stat& st, char type, const std::string& link, uint64_t size) {
+        if (link.size() > 100) {
+            write_long_name('K', link);
+        }
+        if (name.size() > 100) {
+            write_long_name('L', name);
+        }
+        char header[TAR_BLOCK];
+        memset(header, 0, sizeof(header));
+        memcpy(header, name.data(), std::min<size_t>(name.size(), 100));
+        fill_header(header, st.st_mode, st.st_uid, st.st_gid, size, st.st_mtime, type, link, major(st.st_rdev),
+                    minor(st.st_rdev));
+        emit(header, sizeof(header));
+    }
+
+    void pad(uint64_t size) {
+        static const char zeros[TAR_BLOCK] = {0};
+        size_t remainder = size % TAR_BLOCK;
+        if (remainder != 0) {
+            emit(zeros, TAR_BLOCK - remainder);
+        }
+    }
+
+    void add_file(int dir_fd, const std::string& file, const std::string& name, const struct stat& st) {
+        // Повторные жесткие ссылки на файл записываются ссылкой на первое имя, без данных
+        if (st.st_nlink > 1) {
+            std::pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+            std::map<std::pair<dev_t, ino_t>, std::string>::const_iterator it = links.find(key);
+            if (it != links.end()) {
+                write_header(name, st, '1', it->second, 0);
+                return;
+            }
+            links[key] = name;
+        }
+
+        int fd = openat(dir_fd, file.c_str(), O_RDONLY | O_CLOEXEC | O_NOFOLLOW);
+        if (fd < 0) {
+            walk_error(name, errno);
+            return;
+        }
+        posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+        uint64_t size = static_cast<uint64_t>(st.st_size);
+        write_header(name, st, '0', "", size);
+        // В архив попадает ровно объявленный в заголовке размер: если файл укоротился во время
+        // чтения, недостающее дополняется нулями, как в GNU tar
+        uint64_t remaining = size;
+        while (remaining > 0 && !stopped()) {
+            ssize_t length = read(fd, &buffer[0], std::min<uint64_t>(remaining, io_chunk_size(buffer.size())));
+            if (length <= 0) {
+                if (length < 0 && errno == EINTR) {
+                    continue;
+                }
+                if (length < 0) {
+                    walk_error(name, errno);
+                } else {
+                    std::lock_guard<std::mutex> lock(mutex);
+                    if (result.ok) {
+                        result.error = name + ": file shrank while being packed";
+                    }
+                    result.ok = false;
+                }
+                break;
+            }
+            emit(&buffer[0], static_cast<size_t>(length));
+            remaining -= static_cast<uint64_t>(length);
+            if (progress != nullptr) {
+                progress->read_bytes += static_cast<uint64_t>(length);
+            }
+            PROFILE_COUNT(COUNTER_BYTES_COPIED, length);
+            io_throttle(static_cast<uint64_t>(length), 1);
+        }
+        close(fd);
+        if (stopped()) {
+            return;
+        }
+        if (remaining > 0) {
+            std::fill(buffer.begin(), buffer.end(), 0);
+            while (remaining > 0 && !output_failed) {
+                size_t part = static_cast<size_t>(std::min<uint64_t>(remaining, buffer.size()));
+                emit(&buffer[0], part);
+                remaining -= part;
+            }
+        }
+        pad(size);
+        result.files++;
+        result.bytes += size;
+    }
+
+    GzipPipeline& output;
+    std::string root;
+    std::string root_name;
+    struct stat archive;
+    PackProgress* progress;
+    OperationResult& result;
+    std::mutex mutex;
+    std::vector<char> buffer;
+    std::map<std::pair<dev_t, ino_t>, std::string> links;
+    bool output_failed;
+};
+
+// Предварительный обход: объем данных файлов для индикатора хода упаковки
+class PackSizeVisitor : public TreeVisitor {
+public:
+    PackSizeVisitor() : total(0) {}
+
+    bool enter_directory(const std::string&, const struct stat&) {
+        return true;
+    }
+
+    void visit_files(const std::string&, int, const std::vector<WalkEntry>& files) {
+        uint64_t sum = 0;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (S_ISREG(files[i].st.st_mode)) {
+                sum += static_cast<uint64_t>(files[i].st.st_size);
+            }
+        }
+        total += sum;
+    }
+
+    void walk_error(const std::string&, int) {}
+
+    std::atomic<uint64_t> total;
+};
+
+OperationResult pack_paths(const std::vector<std::string>& sources, const std::string& archive,
+                           OverwritePolicy policy, const PackOptions& options, PackProgress* progress) {
+    PROFILE_SCOPE("pack");
+    OperationResult result;
+    result.ok = true;
+    result.files = 0;
+    result.bytes = 0;
+    result.skipped = 0;
+
+    struct stat st;
+    if (lstat(archive.c_str(), &st) == 0) {
+        if (policy == OVERWRITE_SKIP) {
+            result.skipped = 1;
+            return result;
+        }
+        if (policy == OVERWRITE_FAIL) {
+            result.ok = false;
+            result.error = archive + ": already exists";
+            return result;
+        }
+    }
+
+    std::string temporary = archive + ".part";
+    int fd = open(temporary.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        result.ok = false;
+        result.error = temporary + ": " + strerror(errno);
+        return result;
+    }
+    struct stat archive_st;
+    fstat(fd, &archive_st);
+
+    if (progress != nullptr) {
+        PackSizeVisitor sizes;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            walk_tree(sources[i], WalkOptions(), sizes);
+        }
+        progress->total_bytes = sizes.total.load();
+    }
+
+    std::string error;
+    bool written;
+    {
+        GzipPipeline pipeline(fd, options, progress);
+        // Поток tar собирается в этом потоке, который заодно читает файлы
+        WalkOptions walk_options;
+        walk_options.parallel = false;
+        for (size_t i = 0; i < sources.size(); ++i) {
+            std::string root = sources[i];
+            while (root.size() > 1 && root[root.size() - 1] == '/') {
+                root.erase(root.size() - 1);
+            }
+            std::string root_name = root.substr(root.find_last_of('/') + 1);
+            TarVisitor visitor(pipeline, root, root_name, archive_st, progress, result);
+            walk_tree(root, walk_options, visitor);
+            if (!visitor.is_writing()) {
+                break;
+            }
+        }
+        // Конец архива - две пустые записи
+        static const char end[TAR_BLOCK * 2] = {0};
+        pipeline.write(end, sizeof(end));
+        written = pipeline.finish(error);
+    }
+
+    bool cancelled = progress != nullptr && progress->cancel;
+    if (close(fd) != 0 && written) {
+        written = false;
+        error = strerror(errno);
+    }
+    if (!written || cancelled) {
+        unlink(temporary.c_str());
+        result.ok = false;
+        result.error = cancelled ? "cancelled" : archive + ": " + error;
+        return result;
+    }
+    if (rename(temporary.c_str(), archive.c_str()) != 0) {
+        result.ok = false;
+        result.error = archive + ": " + strerror(errno);
+        unlink(temporary.c_str());
+    }
+    return result;
+}
@@ -0,0 +1,38 @@
+#ifndef ARCHIVE_H
+#define ARCHIVE_H
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "file_engine.h"
+
+// Параметры упаковки в tar.gz
+struct PackOptions {
+    PackOptions() : level(6), threads(0), block_size(128 * 1024) {}
+
+    int level;         // Уровень сжатия gzip, 1-9
+    unsigned threads;  // Потоков сжатия; 0 - по числу процессоров
+    size_t block_size; // Размер блока tar-потока, который сжимается одной задачей
+};
+
+// Ход упаковки, общий для потока упаковки и интерфейса
+struct PackProgress {
+    PackProgress() : total_bytes(0), read_bytes(0), written_bytes(0), cancel(false) {}
+
+    std::atomic<uint64_t> total_bytes;   // Объем данных файлов, известен после предварительного обхода
+    std::atomic<uint64_t> read_bytes;    // Прочитано данных файлов
+    std::atomic<uint64_t> written_bytes; // Записано сжатого архива
+    std::atomic<bool> cancel;            // Запрос прервать упаковку; недописанный архив удаляется
+};
+
+// Упаковывает пути в архив tar формата GNU (длинные имена отдельными записями), сжатый gzip. Чтение файлов и
+// сборка tar-потока, сжатие блоков в пуле потоков и запись архива идут одновременно, как в pigz:
+// блоки сжимаются независимо со словарем из конца предыдущего блока, а поток записи выводит их
+// по порядку. Каждый путь попадает в архив под своим именем без родительских каталогов.
+// Архив пишется во временный файл рядом и переименовывается после успешного завершения
+OperationResult pack_paths(const std::vector<std::string>& sources, const std::string& archive,
+                           OverwritePolicy policy, const PackOptions& options = PackOptions(),
+                           PackProgress* progress = nullptr);
+
+#endif // ARCHIVE_H
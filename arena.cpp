@@ -0,0 +1,25 @@
+#include "arena.h"
+#include <algorithm>
+
+ScratchArena::ScratchArena(size_t block_size) : block_size(block_size), current(0), used(0) {}
+
+char* ScratchArena::allocate(size_t size) {
+    // Переходим к следующему блоку, пока не найдется достаточно места; новый блок заводится,
+    // только если все прежние малы
+    while (current < blocks.size() && blocks[current].size() - used < size) {
+        ++current;
+        used = 0;
+    }
+    if (current == blocks.size()) {
+        blocks.push_back(std::vector<char>(std::max(block_size, size)));
+        used = 0;
+    }
+    char* memory = &blocks[current][used];
+    used += size;
+    return memory;
+}
+
+void ScratchArena::reset() {
+    current = 0;
+    used = 0;
+}
@@ -0,0 +1,25 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <cstddef>
+#include <vector>
+
+// Арена для временных строк одного кадра. Память выделяется блоками и не возвращается:
+// reset в начале кадра снова делает все блоки свободными, поэтому после первых кадров
+// отрисовка не обращается к куче
+class ScratchArena {
+public:
+    explicit ScratchArena(size_t block_size = 4096);
+
+    // Выделяет size байт; память действительна до следующего reset
+    char* allocate(size_t size);
+    void reset();
+
+private:
+    size_t block_size;
+    std::vector<std::vector<char> > blocks;
+    size_t current; // Блок, из которого сейчас выделяется память
+    size_t used;    // Занято в текущем блоке
+};
+
+#endif // ARENA_H
@@ -0,0 +1,358 @@
+#include "batch.h"
+#include "archive.h"
+#include "copy_journal.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <sys/stat.h>
+#include <vector>
+
+// Разобранная строка сценария
+struct BatchCommand {
+    int line;
+    std::string name;
+    std::vector<std::string> args;
+    OverwritePolicy overwrite;
+    CopyOptions copy_options;     // copy --verify[=ALGORITHM]
+    bool resume;                  // copy --resume
+    AttributeChange attributes;   // chmod, chown: --recursive
+    HashAlgorithm hash_algorithm; // hash --algorithm=ALGORITHM
+    WalkOptions walk_options;     // du, find: --one-file-system, --follow-links
+    PackOptions pack_options;     // pack --level=N
+    IoLimits io_limits;           // --bwlimit=RATE, --iops=RATE
+    bool background;
+};
+
+// Общее состояние выполнения: вывод команд не перемешивается благодаря мьютексу
+struct BatchState {
+    std::mutex output_mutex;
+    std::atomic<int> failures;
+};
+
+// Делит строку на слова с учетом кавычек и экранирования обратной косой чертой
+static bool split_words(const std::string& line, std::vector<std::string>& words, std::string& error) {
+    std::string word;
+    bool in_word = false;
+    char quote = 0;
+    for (size_t i = 0; i < line.size(); ++i) {
+        char c = line[i];
+        if (quote != 0) {
+            if (c == quote) {
+                quote = 0;
+            } else if (c == '\\' && quote == '"' && i + 1 < line.size()) {
+                word += line[++i];
+            } else {
+                word += c;
+            }
+        } else if (c == '\'' || c == '"') {
+            quote = c;
+            in_word = true;
+        } else if (c == '\\' && i + 1 < line.size()) {
+            word += line[++i];
+            in_word = true;
+        } else if (c == ' ' || c == '\t' || c == '\r') {
+            if (in_word) {
+                words.push_back(word);
+                word.clear();
+                in_word = false;
+            }
+        } else if (c == '#' && !in_word) {
+            break;
+        } else {
+            word += c;
+            in_word = true;
+        }
+    }
+    if (quote != 0) {
+        error = "unterminated quote";
+        return false;
+    }
+    if (in_word) {
+        words.push_back(word);
+    }
+    return true;
+}
+
+// Число обязательных аргументов команды, -1 для неизвестной команды
+static int command_arity(const std::string& name) {
+    if (name == "copy" || name == "move" || name == "find" || name == "pack" || name == "chmod" || name == "chown") {
+        return 2;
+    }
+    if (name == "delete" || name == "mkdir" || name == "touch" || name == "du" || name == "hash") {
+        return 1;
+    }
+    if (name == "wait") {
+        return 0;
+    }
+    return -1;
+}
+
+static bool parse_command(const std::string& line, int line_number, const BatchOptions& options,
+                          std::vector<BatchCommand>& commands, std::string& error) {
+    std::vector<std::string> words;
+    if (!split_words(line, words, error)) {
+        return false;
+    }
+    if (words.empty()) {
+        return true;
+    }
+
+    BatchCommand command;
+    command.line = line_number;
+    command.name = words[0];
+    command.overwrite = options.overwrite;
+    command.hash_algorithm = HASH_SHA256;
+    command.resume = false;
+    command.attributes.recursive = false;
+    command.io_limits = options.io_limits;
+    command.background = false;
+    if (words.size() > 1 && words.back() == "&") {
+        command.background = true;
+        words.pop_back();
+    }
+
+    int arity = command_arity(command.name);
+    if (arity < 0) {
+        error = "unknown command '" + command.name + "'";
+        return false;
+    }
+    for (size_t i = 1; i < words.size(); ++i) {
+        if (words[i].compare(0, 12, "--overwrite=") == 0) {
+            if (!parse_overwrite_policy(words[i].substr(12), command.overwrite)) {
+                error = "unknown overwrite policy '" + words[i].substr(12) + "'";
+                return false;
+            }
+        } else if (command.name == "copy" && (words[i] == "--verify" || words[i].compare(0, 9, "--verify=") == 0)) {
+            command.copy_options.verify = true;
+            if (words[i].size() > 8 &&
+                !parse_hash_algorithm(words[i].substr(9), command.copy_options.verify_algorithm)) {
+                error = "unknown hash algorithm '" + words[i].substr(9) + "'";
+                return false;
+            }
+        } else if ((command.name == "chmod" || command.name == "chown") && (words[i] == "-R" || words[i] == "--recursive")) {
+            command.attributes.recursive = true;
+        } else if (command.name == "copy" && words[i] == "--resume") {
+            command.resume = true;
+        } else if ((command.name == "du" || command.name == "find") && words[i] == "--one-file-system") {
+            command.walk_options.one_filesystem = true;
+        } else if ((command.name == "du" || command.name == "find") && words[i] == "--follow-links") {
+            command.walk_options.follow_links = true;
+        } else if (command.name == "hash" && words[i].compare(0, 12, "--algorithm=") == 0) {
+            if (!parse_hash_algorithm(words[i].substr(12), command.hash_algorithm)) {
+                error = "unknown hash algorithm '" + words[i].substr(12) + "'";
+                return false;
+            }
+        } else if (arity > 0 && command.name != "mkdir" && command.name != "touch" &&
+                   words[i].compare(0, 10, "--bwlimit=") == 0) {
+            if (!parse_rate(words[i].substr(10), command.io_limits.bytes_per_second)) {
+                error = "invalid rate '" + words[i].substr(10) + "'";
+                return false;
+            }
+        } else if (arity > 0 && command.name != "mkdir" && command.name != "touch" &&
+                   words[i].compare(0, 7, "--iops=") == 0) {
+            if (!parse_rate(words[i].substr(7), command.io_limits.ops_per_second)) {
+                error = "invalid rate '" + words[i].substr(7) + "'";
+                return false;
+            }
+        } else if (command.name == "pack" && words[i].compare(0, 8, "--level=") == 0) {
+            std::string level = words[i].substr(8);
+            if (level.size() != 1 || level[0] < '1' || level[0] > '9') {
+                error = "compression level must be 1-9";
+                return false;
+            }
+            command.pack_options.level = level[0] - '0';
+        } else {
+            command.args.push_back(words[i]);
+        }
+    }
+    if (static_cast<int>(command.args.size()) != arity) {
+        error = command.name + " expects " + std::to_string(arity) + " argument(s)";
+        return false;
+    }
+    // Права и владелец разбираются сразу: ошибка в них - ошибка сценария, а не команды
+    if (command.name == "chmod" && !parse_mode_change(command.args[0], command.attributes.mode)) {
+        error = "invalid mode '" + command.args[0] + "'";
+        return false;
+    }
+    command.attributes.change_mode = command.name == "chmod";
+    if (command.name == "chown" && !parse_owner(command.args[0], command.attributes.uid, command.attributes.gid)) {
+        error = "unknown owner '" + command.args[0] + "'";
+        return false;
+    }
+    if (command.name == "wait" && command.background) {
+        error = "wait cannot run in the background";
+        return false;
+    }
+
+    commands.push_back(command);
+    return true;
+}
+
+// Если цель - существующий каталог (или путь с / на конце), ресурс копируется внутрь него
+static std::string resolve_target(const std::string& source, const std::string& target) {
+    struct stat st;
+    bool into_directory = (!target.empty() && target[target.size() - 1] == '/') ||
+                          (stat(target.c_str(), &st) == 0 && S_ISDIR(st.st_mode));
+    if (!into_directory) {
+        return target;
+    }
+    std::string name = source;
+    while (name.size() > 1 && name[name.size() - 1] == '/') {
+        name.erase(name.size() - 1);
+    }
+    name = name.substr(name.find_last_of('/') + 1);
+    std::string directory = target;
+    while (directory.size() > 1 && directory[directory.size() - 1] == '/') {
+        directory.erase(directory.size() - 1);
+    }
+    return directory + "/" + name;
+}
+
+static std::string describe(const OperationResult& result) {
+    return "files=" + std::to_string(result.files) + " bytes=" + std::to_string(result.bytes) +
+           " skipped=" + std::to_string(result.skipped);
+}
+
+static void execute(const BatchCommand& command, const std::string& source_name, BatchState& state) {
+    // Фоновая команда - задание планировщика ввода-вывода с пониженным приоритетом в потоке,
+    // который пакетный пул держит только для фоновых команд. Команда переднего плана
+    // становится заданием, только если для нее заданы ограничения
+    std::shared_ptr<IoJob> job;
+    if (command.background || command.io_limits.bytes_per_second > 0 || command.io_limits.ops_per_second > 0) {
+        IoLimits limits = command.io_limits;
+        limits.low_priority = command.background;
+        job = std::make_shared<IoJob>(limits);
+    }
+    BackgroundIoScope io_scope(job, command.background);
+
+    std::string output;
+    OperationResult result;
+    if (command.name == "copy" || command.name == "move") {
+        std::string target = resolve_target(command.args[0], command.args[1]);
+        // Прерванный запуск мог сам создать каталог цели, и теперь он выглядит как каталог
+        // назначения. Журнал рядом с ним показывает, что копирование продолжается в него, а не внутрь
+        if (command.resume && !CopyJournal::exists(command.args[0], target) &&
+            CopyJournal::exists(command.args[0], command.args[1])) {
+            target = command.args[1];
+        }
+        // Копирование идет по плану: нехватка места обнаруживается до начала, жесткие ссылки
+        // внутри источника сохраняются
+        CopyPlan plan;
+        CopyOptions options = command.copy_options;
+        options.plan = &plan;
+        // Журнал того же копирования, оставшийся от прерванного запуска, продолжается поверх цели,
+        // и уже скопированное не требует места заново
+        OverwritePolicy policy = command.overwrite;
+        if (command.resume && CopyJournal::exists(command.args[0], target)) {
+            policy = OVERWRITE_REPLACE;
+        }
+        if (command.name == "copy") {
+            result = plan_copy(command.args[0], target, plan, policy);
+            result.files = result.bytes = 0;
+        }
+        if (command.name == "copy" && !result.ok) {
+            // План не удался: копирование не начиналось
+        } else if (command.resume) {
+            CopyJournal journal;
+            if (journal.open(command.args[0], target)) {
+                options.journal = &journal;
+            }
+            result = copy_path(command.args[0], target, policy, options);
+            if (result.ok || journal.is_empty()) {
+                journal.finish();
+            }
+        } else if (command.name == "copy") {
+            result = copy_path(command.args[0], target, command.overwrite, options);
+        } else {
+            result = move_path(command.args[0], target, command.overwrite);
+        }
+        output = command.name + " " + command.args[0] + " -> " + target + " " + describe(result) + "\n";
+    } else if (command.name == "delete") {
+        result = delete_path(command.args[0]);
+        output = "delete " + command.args[0] + " " + describe(result) + "\n";
+    } else if (command.name == "mkdir" || command.name == "touch") {
+        result = command.name == "mkdir" ? make_directory(command.args[0], command.overwrite)
+                                         : make_file(command.args[0], command.overwrite);
+        output = command.name + " " + command.args[0] + " " + describe(result) + "\n";
+    } else if (command.name == "find") {
+        std::vector<std::string> matches;
+        result = find_paths(command.args[0], command.args[1], matches, command.walk_options);
+        for (size_t i = 0; i < matches.size(); ++i) {
+            output += matches[i] + "\n";
+        }
+    } else if (command.name == "du") {
+        result = disk_usage(command.args[0], command.walk_options);
+        output = std::to_string(result.bytes) + "\t" + command.args[0] + "\n";
+    } else if (command.name == "chmod" || command.name == "chown") {
+        result = change_attributes(command.args[1], command.attributes);
+        output = command.name + " " + command.args[1] + " " + describe(result) + "\n";
+    } else if (command.name == "pack") {
+        std::vector<std::string> sources(1, command.args[0]);
+        result = pack_paths(sources, command.args[1], command.overwrite, command.pack_options);
+        output = "pack " + command.args[0] + " -> " + command.args[1] + " " + describe(result) + "\n";
+    } else if (command.name == "hash") {
+        // Формат вывода как у sha256sum, чтобы результат можно было проверить им же
+        std::vector<FileHash> hashes;
+        hash_paths(command.args, command.hash_algorithm, hashes);
+        result.ok = true;
+        result.files = result.bytes = result.skipped = 0;
+        for (size_t i = 0; i < hashes.size(); ++i) {
+            if (!hashes[i].error.empty()) {
+                if (result.ok) {
+                    result.error = hashes[i].path + ": " + hashes[i].error;
+                }
+                result.ok = false;
+                continue;
+            }
+            output += hashes[i].digest + "  " + hashes[i].path + "\n";
+            result.files++;
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(state.output_mutex);
+    fwrite(output.data(), 1, output.size(), stdout);
+    fflush(stdout);
+    if (!result.ok) {
+        fprintf(stderr, "%s:%d: %s: %s\n", source_name.c_str(), command.line, command.name.c_str(),
+                result.error.c_str());
+        state.failures++;
+    }
+}
+
+int run_batch(std::istream& input, const std::string& source_name, const BatchOptions& options) {
+    // Сценарий разбирается целиком до начала выполнения, чтобы опечатка в конце
+    // не оставила работу сделанной наполовину
+    std::vector<BatchCommand> commands;
+    bool valid = true;
+    std::string line;
+    for (int line_number = 1; std::getline(input, line); ++line_number) {
+        std::string error;
+        if (!parse_command(line, line_number, options, commands, error)) {
+            fprintf(stderr, "%s:%d: %s\n", source_name.c_str(), line_number, error.c_str());
+            valid = false;
+        }
+    }
+    if (!valid) {
+        return 2;
+    }
+
+    BatchState state;
+    state.failures = 0;
+    WorkerPool pool(options.jobs);
+    for (size_t i = 0; i < commands.size(); ++i) {
+        const BatchCommand& command = commands[i];
+        if (command.name == "wait") {
+            pool.wait_idle();
+        } else if (command.background) {
+            BatchState* shared = &state;
+            const std::string* name = &source_name;
+            pool.submit([command, name, shared]() { execute(command, *name, *shared); });
+        } else {
+            execute(command, source_name, state);
+        }
+    }
+    pool.wait_idle();
+
+    return state.failures > 0 ? 1 : 0;
+}
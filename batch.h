@@ -0,0 +1,40 @@
+#ifndef BATCH_H
+#define BATCH_H
+
+#include "file_engine.h"
+#include "io_scheduler.h"
+#include <istream>
+#include <string>
+
+// Параметры пакетного режима
+struct BatchOptions {
+    OverwritePolicy overwrite;  // политика по умолчанию для команд без --overwrite
+    unsigned jobs;              // число потоков для команд, запущенных в фоне
+    IoLimits io_limits;         // ограничения ввода-вывода для команд без --bwlimit и --iops
+};
+
+// Выполняет сценарий без ncurses. Формат сценария - по одной команде в строке:
+//   copy [--overwrite=fail|skip|replace] [--verify[=sha256|blake3|crc32c]] [--resume] SRC DST
+//   move [--overwrite=fail|skip|replace] SRC DST
+//   delete PATH
+//   mkdir [--overwrite=...] PATH
+//   touch [--overwrite=...] PATH
+//   chmod [--recursive] MODE PATH
+//   chown [--recursive] USER[:GROUP] PATH
+//   find [--one-file-system] [--follow-links] ROOT PATTERN
+//   du [--one-file-system] [--follow-links] PATH
+//   hash [--algorithm=sha256|blake3|crc32c] PATH
+//   pack [--overwrite=...] [--level=1-9] SRC ARCHIVE.tar.gz
+//   wait
+// MODE записывается как у chmod: 755 или u+x,go-w,a=rX.
+// copy сначала обходит источник: при нехватке места в цели копирование не начинается, а жесткие
+// ссылки внутри источника воссоздаются ссылками. copy --resume ведет журнал рядом с целью
+// и при повторном запуске продолжает прерванное копирование.
+// Команды copy, move, delete, find, du, hash, pack, chmod и chown принимают --bwlimit=RATE
+// (байт в секунду, с суффиксами K, M, G) и --iops=RATE - ограничения своего задания.
+// Команда с & в конце выполняется в фоне параллельно со следующими с пониженным приоритетом
+// ввода-вывода, wait дожидается завершения фоновых команд. Пустые строки и строки, начинающиеся с #, пропускаются.
+// Возвращает код завершения процесса: 0 - успех, 1 - ошибка команды, 2 - ошибка сценария
+int run_batch(std::istream& input, const std::string& source_name, const BatchOptions& options);
+
+#endif // BATCH_H
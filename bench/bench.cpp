@@ -0,0 +1,972 @@
+// Набор замеров производительности FilePanel без терминала.
+// Панели работают на "нулевом" экране ncurses, вывод которого уходит в /dev/null,
+// а каталоги-образцы генерируются при первом запуске и переиспользуются.
+#include "file_panel.h"
+#include "archive.h"
+#include "copy_journal.h"
+#include "file_operations.h"
+#include "file_engine.h"
+#include "file_compare.h"
+#include "path_completion.h"
+#include "io_ring.h"
+#include "io_scheduler.h"
+#include "hash.h"
+#include "preview.h"
+#include "worker_pool.h"
+#include "dir_watch.h"
+#include "dir_tree.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <future>
+#include <map>
+#include <new>
+#include <ncurses.h>
+#include <string>
+#include <sys/resource.h>
+#include <thread>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+
+// Один результат замера
+struct BenchResult {
+    std::string name;
+    double value;
+    std::string unit;
+    bool higher_is_better;
+};
+
+// Параметры набора образцов
+struct BenchConfig {
+    std::string fixtures_dir;
+    std::vector<std::pair<std::string, int> > flat_dirs;
+    int tree_depth;
+    int tree_fanout;
+    int tree_files;
+    size_t large_file_mb;
+    long walk_inodes; // Размер дерева для замеров обхода
+    int tree_view_dirs; // Подкаталогов в каждом из 100 каталогов образца для режима дерева
+};
+
+static std::vector<BenchResult> results;
+
+// Все выделения памяти процесса проходят через этот счетчик: по нему проверяется,
+// что кадр отрисовки не обращается к куче
+static std::atomic<unsigned long> allocation_count(0);
+
+void* operator new(size_t size) {
+    allocation_count++;
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept {
+    free(memory);
+}
+
+static double now_ms() {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void add_result(const std::string& name, double value, const std::string& unit, bool higher_is_better) {
+    BenchResult result = {name, value, unit, higher_is_better};
+    results.push_back(result);
+    fprintf(stderr, "  %-28s %14.3f %s\n", name.c_str(), value, unit.c_str());
+}
+
+static double median(std::vector<double> values) {
+    std::sort(values.begin(), values.end());
+    return values[values.size() / 2];
+}
+
+static bool exists(const std::string& path) {
+    struct stat st;
+    return stat(path.c_str(), &st) == 0;
+}
+
+// Создает каталог с заданным числом пустых файлов, если он еще не создан
+static void make_flat_dir(const std::string& path, int count) {
+    std::string marker = path + "/.complete";
+    if (exists(marker)) {
+        return;
+    }
+    fprintf(stderr, "generating %s (%d entries)\n", path.c_str(), count);
+    mkdir(path.c_str(), 0755);
+    int dir_fd = open(path.c_str(), O_RDONLY | O_DIRECTORY);
+    char name[64];
+    for (int i = 0; i < count; ++i) {
+        snprintf(name, sizeof(name), "file_%07d.dat", i);
+        int fd = openat(dir_fd, name, O_WRONLY | O_CREAT, 0644);
+        if (fd >= 0) {
+            // Разные размеры нужны, чтобы сортировка по размеру что-то переставляла
+            if (ftruncate(fd, (i * 7919) % 4096) != 0) {
+                perror("ftruncate");
+            }
+            close(fd);
+        }
+    }
+    close(dir_fd);
+    close(open(marker.c_str(), O_WRONLY | O_CREAT, 0644));
+}
+
+// Рекурсивно создает дерево каталогов с небольшими файлами
+static void make_tree_level(const std::string& path, int depth, const BenchConfig& config) {
+    mkdir(path.c_str(), 0755);
+    std::string data(4096, 'x');
+    for (int i = 0; i < config.tree_files; ++i) {
+        std::string file = path + "/f" + std::to_string(i) + ".txt";
+        int fd = open(file.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            if (write(fd, data.data(), data.size()) < 0) {
+                perror("write");
+            }
+            close(fd);
+        }
+    }
+    if (depth > 0) {
+        for (int i = 0; i < config.tree_fanout; ++i) {
+            make_tree_level(path + "/d" + std::to_string(i), depth - 1, config);
+        }
+    }
+}
+
+static int count_tree_files(const std::string& path) {
+    int count = 0;
+    DIR* dir = opendir(path.c_str());
+    if (!dir) {
+        return 0;
+    }
+    dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        count++;
+        if (entry->d_type == DT_DIR) {
+            count += count_tree_files(path + "/" + entry->d_name);
+        }
+    }
+    closedir(dir);
+    return count;
+}
+
+static void make_fixtures(const BenchConfig& config) {
+    mkdir(config.fixtures_dir.c_str(), 0755);
+    for (size_t i = 0; i < config.flat_dirs.size(); ++i) {
+        make_flat_dir(config.fixtures_dir + "/flat_" + config.flat_dirs[i].first, config.flat_dirs[i].second);
+    }
+
+    std::string tree = config.fixtures_dir + "/tree";
+    if (!exists(tree + "/.complete")) {
+        fprintf(stderr, "generating %s\n", tree.c_str());
+        make_tree_level(tree, config.tree_depth, config);
+        close(open((tree + "/.complete").c_str(), O_WRONLY | O_CREAT, 0644));
+    }
+
+    std::string large_dir = config.fixtures_dir + "/large";
+    std::string large = large_dir + "/large_" + std::to_string(config.large_file_mb) + "mb.bin";
+    if (!exists(large)) {
+        fprintf(stderr, "generating %s\n", large.c_str());
+        mkdir(large_dir.c_str(), 0755);
+        int fd = open(large.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        std::vector<char> block(1 << 20);
+        for (size_t i = 0; i < block.size(); ++i) {
+            block[i] = static_cast<char>(i * 31 + 7);
+        }
+        for (size_t i = 0; i < config.large_file_mb; ++i) {
+            if (write(fd, block.data(), block.size()) < 0) {
+                perror("write");
+                break;
+            }
+        }
+        close(fd);
+    }
+}
+
+// Метка размера дерева обхода: 100k, 10m
+static std::string inode_label(long inodes) {
+    if (inodes >= 1000000 && inodes % 1000000 == 0) {
+        return std::to_string(inodes / 1000000) + "m";
+    }
+    if (inodes >= 1000 && inodes % 1000 == 0) {
+        return std::to_string(inodes / 1000) + "k";
+    }
+    return std::to_string(inodes);
+}
+
+// Дерево для обхода: 100 каталогов по 100 подкаталогов с пустыми файлами, всего около
+// walk_inodes элементов, и символическая ссылка на корень, замыкающая петлю
+static std::string make_walk_tree(const BenchConfig& config) {
+    std::string root = config.fixtures_dir + "/walk_" + inode_label(config.walk_inodes);
+    if (exists(root + "/.complete")) {
+        return root;
+    }
+    long files_per_dir = std::max(1L, config.walk_inodes / 10000 - 1);
+    fprintf(stderr, "generating %s (%ld files per directory)\n", root.c_str(), files_per_dir);
+    mkdir(root.c_str(), 0755);
+    char name[64];
+    for (int top = 0; top < 100; ++top) {
+        std::string top_dir = root + "/t" + std::to_string(top);
+        mkdir(top_dir.c_str(), 0755);
+        for (int sub = 0; sub < 100; ++sub) {
+            std::string dir = top_dir + "/s" + std::to_string(sub);
+            mkdir(dir.c_str(), 0755);
+            int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+            for (long i = 0; i < files_per_dir; ++i) {
+                snprintf(name, sizeof(name), "f%ld", i);
+                close(openat(dir_fd, name, O_WRONLY | O_CREAT, 0644));
+            }
+            close(dir_fd);
+        }
+    }
+    if (symlink("..", (root + "/t0/loop").c_str()) != 0) {
+        perror("symlink");
+    }
+    close(open((root + "/.complete").c_str(), O_WRONLY | O_CREAT, 0644));
+    return root;
+}
+
+static PanelState state_for(const std::string& dir) {
+    PanelState state = empty_panel_state();
+    state.current_dir = dir;
+    return state;
+}
+
+// Чтение каталогов разного размера
+static void bench_listing(const BenchConfig& config) {
+    for (size_t i = 0; i < config.flat_dirs.size(); ++i) {
+        const std::string& label = config.flat_dirs[i].first;
+        int count = config.flat_dirs[i].second;
+        std::string dir = config.fixtures_dir + "/flat_" + label;
+        FilePanel panel(0, 0, LINES, COLS, state_for(dir));
+
+        int runs = count >= 1000000 ? 3 : count >= 100000 ? 5 : 20;
+        std::vector<double> samples;
+        for (int run = 0; run < runs; ++run) {
+            double start = now_ms();
+            panel.update();
+            doupdate();
+            samples.push_back(now_ms() - start);
+        }
+        add_result("list_" + label + "_ms", median(samples), "ms", false);
+    }
+}
+
+// Память на запись списка каталога: массив записей и пул имен
+static void bench_entry_memory(const BenchConfig& config) {
+    const std::string& label = config.flat_dirs.back().first;
+    EntryList entries;
+    int64_t mtime_ns;
+    read_directory(config.fixtures_dir + "/flat_" + label, SORT_NONE, "", entries, mtime_ns);
+    add_result("entry_bytes_" + label, static_cast<double>(entries.memory_usage()) / entries.size(), "B/entry", false);
+}
+
+// Кадры без выделений памяти: у всех записей уже есть метаданные, поэтому прокрутка
+// и перерисовка только форматируют строки в буферы кеша строк и арены кадра.
+// Возвращает false, если кадры обращались к куче
+static bool bench_frame_allocations(const BenchConfig& config) {
+    const std::string& label = config.flat_dirs.front().first;
+    PanelState state = state_for(config.fixtures_dir + "/flat_" + label);
+    // Сортировка по размеру запрашивает метаданные всех записей при чтении каталога
+    state.sort_mode = SORT_SIZE;
+    FilePanel panel(0, 0, LINES, COLS, state);
+    panel.set_selected(true);
+
+    // Первый проход прогревает буферы, второй считается
+    const int steps = std::min(2000, panel.get_files_size() - 1);
+    unsigned long allocations = 0;
+    int frames = 0;
+    for (int pass = 0; pass < 2; ++pass) {
+        unsigned long before = allocation_count.load();
+        for (int i = 0; i < steps; ++i) {
+            panel.move_selection(1);
+            doupdate();
+        }
+        for (int i = 0; i < steps; ++i) {
+            panel.move_selection(-1);
+            doupdate();
+        }
+        for (int i = 0; i < 100; ++i) {
+            panel.draw();
+            doupdate();
+        }
+        allocations = allocation_count.load() - before;
+        frames = 2 * steps + 100;
+    }
+    add_result("draw_allocations_per_frame", static_cast<double>(allocations) / frames, "allocs", false);
+    return allocations == 0;
+}
+
+// Прокрутка, сортировка и фильтрация в самом большом каталоге
+static void bench_view(const BenchConfig& config) {
+    const std::string& label = config.flat_dirs.back().first;
+    std::string dir = config.fixtures_dir + "/flat_" + label;
+    FilePanel panel(0, 0, LINES, COLS, state_for(dir));
+    panel.set_selected(true);
+
+    // Прокрутка: каждое перемещение курсора перерисовывает панель и выводит кадр
+    int steps = std::min(20000, panel.get_files_size());
+    double start = now_ms();
+    for (int i = 0; i < steps; ++i) {
+        panel.move_selection(1);
+        doupdate();
+    }
+    double elapsed = now_ms() - start;
+    add_result("scroll_" + label + "_rows_per_sec", steps / (elapsed / 1000.0), "rows/s", true);
+
+    // Та же прокрутка с предпросмотром во второй панели, как в основном цикле интерфейса
+    FilePanel preview_panel(0, 0, LINES, COLS, state_for(dir));
+    PreviewLoader preview_loader;
+    start = now_ms();
+    for (int i = 0; i < steps; ++i) {
+        panel.move_selection(-1);
+        std::string path = dir + "/" + panel.get_selected_file();
+        preview_loader.request(path, panel.get_selected_entry());
+        preview_loader.poll();
+        preview_panel.draw_preview(path, preview_loader.current());
+        doupdate();
+    }
+    elapsed = now_ms() - start;
+    add_result("scroll_preview_" + label + "_rows_per_sec", steps / (elapsed / 1000.0), "rows/s", true);
+
+    // Изменение размера: пересчет раскладки колонок и перерисовка всех видимых строк
+    const int resizes = 200;
+    start = now_ms();
+    for (int i = 0; i < resizes; ++i) {
+        panel.set_size(LINES - (i % 2) * 10, i % 2 == 0 ? COLS : COLS / 2);
+        panel.draw();
+        doupdate();
+    }
+    add_result("resize_" + label + "_ms", (now_ms() - start) / resizes, "ms", false);
+    panel.set_size(LINES, COLS);
+
+    // Время до появления размеров и дат видимых строк и страниц упреждающего запроса
+    panel.update();
+    start = now_ms();
+    while (panel.has_background_work()) {
+        panel.poll_background();
+        usleep(100);
+    }
+    add_result("metadata_visible_" + label + "_ms", now_ms() - start, "ms", false);
+
+    // Сортировка: режимы по очереди, каждый с перечитыванием каталога
+    const char* sort_names[] = {"name", "size", "mtime", "none"};
+    for (int i = 0; i < 4; ++i) {
+        start = now_ms();
+        panel.cycle_sort_mode();
+        doupdate();
+        add_result(std::string("sort_") + sort_names[i] + "_" + label + "_ms", now_ms() - start, "ms", false);
+    }
+
+    // Фильтрация и ее сброс
+    start = now_ms();
+    panel.set_filter("7");
+    doupdate();
+    add_result("filter_" + label + "_ms", now_ms() - start, "ms", false);
+    panel.set_filter("");
+}
+
+// Копирование и удаление через те же действия, что и в интерфейсе
+// Вставка в панели идет в фоне: замер ждет, пока панель не заберет результат, как цикл ввода
+static void wait_operations(FilePanel& panel) {
+    while (panel.has_operations()) {
+        panel.poll_background();
+        usleep(100);
+    }
+}
+
+static void bench_file_operations(const BenchConfig& config) {
+    std::string work = config.fixtures_dir + "/work";
+    run_command("rm -rf '" + work + "'");
+    mkdir(work.c_str(), 0755);
+
+    FilePanel destination(0, 0, LINES, COLS, state_for(work));
+
+    // Копирование большого файла
+    FilePanel large_source(0, 0, LINES, COLS, state_for(config.fixtures_dir + "/large"));
+    std::string large_name = "large_" + std::to_string(config.large_file_mb) + "mb.bin";
+    large_source.select_file(large_name);
+    large_source.copy_file_or_directory();
+    double start = now_ms();
+    destination.paste_file_or_directory();
+    wait_operations(destination);
+    double elapsed = now_ms() - start;
+    add_result("copy_large_mb_per_sec", config.large_file_mb / (elapsed / 1000.0), "MB/s", true);
+
+    // Копирование дерева с множеством мелких файлов
+    int tree_files = count_tree_files(config.fixtures_dir + "/tree");
+    FilePanel tree_source(0, 0, LINES, COLS, state_for(config.fixtures_dir));
+    tree_source.select_file("tree");
+    tree_source.copy_file_or_directory();
+    start = now_ms();
+    destination.paste_file_or_directory();
+    wait_operations(destination);
+    elapsed = now_ms() - start;
+    add_result("copy_tree_files_per_sec", tree_files / (elapsed / 1000.0), "files/s", true);
+
+    // То же копирование с журналом для продолжения после сбоя: цена записей и пакетных syncfs
+    CopyJournal journal;
+    CopyOptions journal_options;
+    if (journal.open(config.fixtures_dir + "/tree", work + "/tree_journaled")) {
+        journal_options.journal = &journal;
+    }
+    start = now_ms();
+    copy_path(config.fixtures_dir + "/tree", work + "/tree_journaled", OVERWRITE_FAIL, journal_options);
+    journal.flush();
+    elapsed = now_ms() - start;
+    journal.finish();
+    add_result("copy_tree_journal_files_per_sec", tree_files / (elapsed / 1000.0), "files/s", true);
+    delete_path(work + "/tree_journaled");
+
+    // Удаление дерева тем же способом, что и клавиша Delete
+    start = now_ms();
+    delete_path(work + "/tree");
+    elapsed = now_ms() - start;
+    add_result("delete_tree_files_per_sec", tree_files / (elapsed / 1000.0), "files/s", true);
+
+    run_command("rm -rf '" + work + "'");
+}
+
+// Обход большого дерева: du одним потоком и в пуле, find по имени и find с переходом по ссылкам,
+// которому петля из ссылки не должна мешать завершиться
+static void bench_walk(const BenchConfig& config) {
+    std::string root = make_walk_tree(config);
+    std::string label = inode_label(config.walk_inodes);
+
+    WalkOptions serial;
+    serial.parallel = false;
+    double start = now_ms();
+    disk_usage(root, serial);
+    add_result("walk_" + label + "_serial_ms", now_ms() - start, "ms", false);
+
+    start = now_ms();
+    disk_usage(root);
+    add_result("walk_" + label + "_parallel_ms", now_ms() - start, "ms", false);
+
+    std::vector<std::string> matches;
+    start = now_ms();
+    find_paths(root, "f1?", matches);
+    add_result("find_" + label + "_ms", now_ms() - start, "ms", false);
+
+    WalkOptions follow;
+    follow.follow_links = true;
+    matches.clear();
+    start = now_ms();
+    find_paths(root, "f1?", matches, follow);
+    add_result("find_" + label + "_follow_links_ms", now_ms() - start, "ms", false);
+
+    // chmod -R по всему дереву и повторный проход, в котором менять уже нечего
+    AttributeChange change;
+    change.change_mode = true;
+    parse_mode_change("g+w", change.mode);
+    start = now_ms();
+    change_attributes(root, change);
+    add_result("chmod_" + label + "_ms", now_ms() - start, "ms", false);
+    start = now_ms();
+    change_attributes(root, change);
+    add_result("chmod_" + label + "_unchanged_ms", now_ms() - start, "ms", false);
+    parse_mode_change("g-w", change.mode);
+    change_attributes(root, change);
+}
+
+// Задержка задачи в пуле ввода-вывода, занятом медленной фоновой работой других панелей:
+// задача панели в фокусе должна начаться, не дожидаясь, пока очередь разберется
+static double queued_task_latency_ms(TaskPriority priority) {
+    WorkerPool& pool = io_pool();
+    for (unsigned i = 0; i < pool.size() * 16; ++i) {
+        pool.submit([]() { usleep(2000); }, PRIORITY_LOW);
+    }
+    std::promise<double> started;
+    double start = now_ms();
+    pool.submit([&started]() { started.set_value(now_ms()); }, priority);
+    double latency = started.get_future().get() - start;
+    pool.wait_idle();
+    return latency;
+}
+
+static void bench_panel_priority() {
+    add_result("focused_task_latency_ms", queued_task_latency_ms(PRIORITY_HIGH), "ms", false);
+    add_result("unfocused_task_latency_ms", queued_task_latency_ms(PRIORITY_LOW), "ms", false);
+}
+
+// Наблюдение за каталогом, в который файлы поступают потоком: стоимость разбора одного
+// события и память наблюдения, которая не должна зависеть от числа файлов в каталоге
+static void bench_watch(const BenchConfig& config) {
+    std::string spool = config.fixtures_dir + "/watch_spool";
+    run_command("rm -rf '" + spool + "'");
+    mkdir(spool.c_str(), 0755);
+    const int arrivals = 20000;
+    const int poll_every = 1000;
+
+    DirectoryWatch watch;
+    watch.start(spool);
+    double poll_ms = 0;
+    char name[64];
+    char data[100];
+    memset(data, 'x', sizeof(data));
+    for (int i = 0; i < arrivals; ++i) {
+        snprintf(name, sizeof(name), "%s/in_%06d", spool.c_str(), i);
+        int fd = open(name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+        if (fd >= 0) {
+            ssize_t written = write(fd, data, sizeof(data));
+            (void)written;
+            close(fd);
+        }
+        // Опрос между пачками, как его делает цикл интерфейса, чтобы очередь inotify не переполнилась
+        if ((i + 1) % poll_every == 0) {
+            double start = now_ms();
+            watch.poll();
+            poll_ms += now_ms() - start;
+        }
+    }
+    add_result("watch_poll_ns_per_arrival", poll_ms * 1e6 / arrivals, "ns", false);
+    add_result("watch_memory_kb", watch.memory_usage() / 1024.0, "KiB", false);
+    if (watch.get_count() != WATCH_DEFAULT_CAPACITY ||
+        strcmp(watch.get_arrival(0).name, "in_019999") != 0) {
+        fprintf(stderr, "watch ring lost arrivals\n");
+    }
+    watch.stop();
+    run_command("rm -rf '" + spool + "'");
+}
+
+static void wait_tree(DirectoryTree& tree) {
+    while (tree.has_background_work()) {
+        usleep(1000);
+        tree.poll();
+    }
+    tree.poll();
+}
+
+// Режим дерева: 100 каталогов по tree_view_dirs подкаталогов. Раскрытие всех каталогов читает
+// списки в пуле; свернуть и повторно раскрыть их из кеша и свернуть корень с освобождением
+// всего поддерева должно быть мгновенно
+static void bench_tree(const BenchConfig& config) {
+    std::string root = config.fixtures_dir + "/tree_view_" + std::to_string(config.tree_view_dirs);
+    std::string marker = root + "/.complete";
+    if (!exists(marker)) {
+        fprintf(stderr, "generating %s (%d directories)\n", root.c_str(), 100 * config.tree_view_dirs);
+        mkdir(root.c_str(), 0755);
+        for (int i = 0; i < 100; ++i) {
+            std::string dir = root + "/dir_" + std::to_string(i);
+            mkdir(dir.c_str(), 0755);
+            for (int j = 0; j < config.tree_view_dirs; ++j) {
+                mkdir((dir + "/sub_" + std::to_string(j)).c_str(), 0755);
+            }
+        }
+        close(open(marker.c_str(), O_WRONLY | O_CREAT, 0644));
+    }
+
+    DirectoryTree tree;
+    tree.open(root);
+    wait_tree(tree);
+    size_t top = tree.row_count() - 1;
+
+    // Снизу вверх, чтобы вставленные строки не сдвигали еще не раскрытые
+    double start = now_ms();
+    for (size_t row = top; row > 0; --row) {
+        tree.expand(row);
+    }
+    wait_tree(tree);
+    add_result("tree_expand_all_ms", now_ms() - start, "ms", false);
+    add_result("tree_memory_expanded_kb", tree.memory_usage() / 1024.0, "KiB", false);
+
+    std::vector<size_t> tops;
+    for (size_t row = 1; row < tree.row_count(); ++row) {
+        if (tree.row_node(row).depth == 1) {
+            tops.push_back(row);
+        }
+    }
+    start = now_ms();
+    for (size_t i = tops.size(); i > 0; --i) {
+        tree.collapse(tops[i - 1]);
+    }
+    add_result("tree_collapse_children_ms", now_ms() - start, "ms", false);
+    start = now_ms();
+    for (size_t row = top; row > 0; --row) {
+        tree.expand(row);
+    }
+    add_result("tree_reexpand_cached_ms", now_ms() - start, "ms", false);
+    wait_tree(tree);
+
+    start = now_ms();
+    tree.collapse(0);
+    add_result("tree_collapse_root_ms", now_ms() - start, "ms", false);
+    add_result("tree_memory_collapsed_kb", tree.memory_usage() / 1024.0, "KiB", false);
+    if (tree.row_count() != 1 || tree.node_count() != top + 1) {
+        fprintf(stderr, "tree kept %zu rows and %zu nodes after collapse\n", tree.row_count(), tree.node_count());
+    }
+}
+
+// Сравнение путей ввода-вывода: обычные системные вызовы и пачки io_uring, если он доступен
+static void bench_io_backends(const BenchConfig& config) {
+    const std::string& label = config.flat_dirs.back().first;
+    std::string flat = config.fixtures_dir + "/flat_" + label;
+    std::string work = config.fixtures_dir + "/work";
+    int tree_files = count_tree_files(config.fixtures_dir + "/tree");
+    mkdir(work.c_str(), 0755);
+
+    // Предварительный план копирования: обход источника с lstat и проверка места
+    CopyPlan plan;
+    double plan_start = now_ms();
+    plan_copy(config.fixtures_dir + "/tree", work + "/planned", plan);
+    add_result("copy_plan_tree_ms", now_ms() - plan_start, "ms", false);
+
+    // План продолжения поверх уже скопированной цели: копии на месте не требуют места заново,
+    // поэтому продолжение на почти заполненный диск не упирается в проверку места
+    copy_path(config.fixtures_dir + "/tree", work + "/planned", OVERWRITE_FAIL);
+    CopyPlan resumed;
+    plan_start = now_ms();
+    plan_copy(config.fixtures_dir + "/tree", work + "/planned", resumed, OVERWRITE_REPLACE);
+    add_result("copy_plan_resume_tree_ms", now_ms() - plan_start, "ms", false);
+    add_result("copy_plan_resume_required_kb", resumed.required_bytes / 1024.0, "KiB", false);
+    if (resumed.required_bytes * 10 > plan.required_bytes) {
+        fprintf(stderr, "resume plan still requires %llu of %llu bytes\n",
+                static_cast<unsigned long long>(resumed.required_bytes),
+                static_cast<unsigned long long>(plan.required_bytes));
+    }
+    delete_path(work + "/planned");
+
+    bool uring = io_uring_available();
+    for (int pass = 0; pass < (uring ? 2 : 1); ++pass) {
+        std::string backend = pass == 0 ? "sync" : "uring";
+        set_io_uring_enabled(pass == 1);
+
+        EntryList entries;
+        int64_t mtime_ns;
+        read_directory(flat, SORT_NONE, "", entries, mtime_ns);
+        double start = now_ms();
+        fill_entries_info(flat, entries);
+        add_result("stat_" + label + "_" + backend + "_ms", now_ms() - start, "ms", false);
+
+        std::string copy = work + "/tree_" + backend;
+        start = now_ms();
+        copy_path(config.fixtures_dir + "/tree", copy, OVERWRITE_FAIL);
+        add_result("copy_tree_" + backend + "_files_per_sec", tree_files / ((now_ms() - start) / 1000.0), "files/s", true);
+
+        start = now_ms();
+        delete_path(copy);
+        add_result("delete_tree_" + backend + "_files_per_sec", tree_files / ((now_ms() - start) / 1000.0), "files/s", true);
+    }
+    set_io_uring_enabled(false);
+    delete_path(work);
+}
+
+// Скорость алгоритмов контрольных сумм на данных в памяти и копирование со сверкой
+static void bench_hashing(const BenchConfig& config) {
+    std::vector<char> block(1 << 20);
+    for (size_t i = 0; i < block.size(); ++i) {
+        block[i] = static_cast<char>(i * 31 + 7);
+    }
+    for (int i = 0; i < HASH_ALGORITHM_COUNT; ++i) {
+        HashAlgorithm algorithm = static_cast<HashAlgorithm>(i);
+        Hasher hasher(algorithm);
+        double start = now_ms();
+        for (size_t mb = 0; mb < config.large_file_mb; ++mb) {
+            hasher.update(block.data(), block.size());
+        }
+        hasher.hex_digest();
+        double elapsed = now_ms() - start;
+        add_result(std::string("hash_") + hash_algorithm_name(algorithm) + "_mb_per_sec",
+                   config.large_file_mb / (elapsed / 1000.0), "MB/s", true);
+    }
+
+    std::string work = config.fixtures_dir + "/work";
+    mkdir(work.c_str(), 0755);
+    std::string large = config.fixtures_dir + "/large/large_" + std::to_string(config.large_file_mb) + "mb.bin";
+    CopyOptions options;
+    options.verify = true;
+    double start = now_ms();
+    copy_path(large, work + "/verified.bin", OVERWRITE_REPLACE, options);
+    double elapsed = now_ms() - start;
+    add_result("copy_large_verify_mb_per_sec", config.large_file_mb / (elapsed / 1000.0), "MB/s", true);
+    delete_path(work);
+}
+
+// Упаковка дерева образцов и большого файла в tar.gz: скорость по объему исходных данных
+static void bench_pack(const BenchConfig& config) {
+    std::string work = config.fixtures_dir + "/work";
+    mkdir(work.c_str(), 0755);
+    std::vector<std::string> sources;
+    sources.push_back(config.fixtures_dir + "/tree");
+    sources.push_back(config.fixtures_dir + "/large");
+    double start = now_ms();
+    OperationResult result = pack_paths(sources, work + "/fixtures.tar.gz", OVERWRITE_REPLACE);
+    double elapsed = now_ms() - start;
+    add_result("pack_mb_per_sec", result.bytes / (1024.0 * 1024.0) / (elapsed / 1000.0), "MB/s", true);
+    delete_path(work);
+}
+
+// Дополнение пути в самом большом каталоге: первый ответ приходит, когда список прочитан
+// в фоне, следующие ищутся в кеше
+static void bench_completion(const BenchConfig& config) {
+    const std::string& label = config.flat_dirs.back().first;
+    std::string dir = config.fixtures_dir + "/flat_" + label;
+    CompletionResult result;
+    double start = now_ms();
+    while (!result.ready) {
+        path_completer().complete(dir, "file_00", 16, result);
+        if (!result.ready) {
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+    add_result("complete_" + label + "_first_ms", now_ms() - start, "ms", false);
+    const int runs = 1000;
+    start = now_ms();
+    for (int run = 0; run < runs; ++run) {
+        path_completer().complete(dir, "file_000" + std::to_string(run % 10), 16, result);
+    }
+    add_result("complete_" + label + "_cached_us", (now_ms() - start) * 1000 / runs, "us", false);
+}
+
+// Сравнение большого файла с его копией: файлы совпадают, поэтому читаются целиком
+static void bench_compare(const BenchConfig& config) {
+    std::string work = config.fixtures_dir + "/work";
+    mkdir(work.c_str(), 0755);
+    std::string large = config.fixtures_dir + "/large/large_" + std::to_string(config.large_file_mb) + "mb.bin";
+    copy_path(large, work + "/copy.bin", OVERWRITE_REPLACE);
+    MappedFile left, right;
+    std::string error;
+    if (open_compared_file(large, left, error) && open_compared_file(work + "/copy.bin", right, error)) {
+        double start = now_ms();
+        compare_files(left, right);
+        double elapsed = now_ms() - start;
+        add_result("compare_large_mb_per_sec", config.large_file_mb / (elapsed / 1000.0), "MB/s", true);
+    }
+    delete_path(work);
+}
+
+// Фоновые задания: точность ограничения скорости копирования и задержка чтения каталога,
+// пока в фоне без ограничений копируется большой файл
+static void bench_io_throttle(const BenchConfig& config) {
+    std::string work = config.fixtures_dir + "/work";
+    mkdir(work.c_str(), 0755);
+    std::string large = config.fixtures_dir + "/large/large_" + std::to_string(config.large_file_mb) + "mb.bin";
+
+    // Ограничение вдвое меньше объема файла: копирование должно занять около двух секунд
+    // за вычетом запаса ведра
+    IoLimits limits;
+    limits.bytes_per_second = static_cast<uint64_t>(config.large_file_mb) * 1024 * 1024 / 2;
+    double start = now_ms();
+    {
+        BackgroundIoScope scope(std::make_shared<IoJob>(limits));
+        copy_path(large, work + "/throttled.bin", OVERWRITE_REPLACE);
+    }
+    double elapsed = now_ms() - start;
+    double expected = 1000.0 * (config.large_file_mb * 1024.0 * 1024.0 - limits.bytes_per_second / 4.0) /
+                      limits.bytes_per_second;
+    add_result("copy_throttle_error_pct", std::abs(elapsed - expected) / expected * 100, "%", false);
+
+    const std::string& label = config.flat_dirs.front().first;
+    std::string flat = config.fixtures_dir + "/flat_" + label;
+    std::atomic<bool> stop(false);
+    uint64_t backoffs = io_scheduler().backoff_count();
+    std::thread copier([&stop, &large, &work]() {
+        BackgroundIoScope scope(std::make_shared<IoJob>(IoLimits()), true);
+        while (!stop) {
+            copy_path(large, work + "/background.bin", OVERWRITE_REPLACE);
+        }
+    });
+    std::vector<double> samples;
+    for (int run = 0; run < 50; ++run) {
+        EntryList entries;
+        int64_t mtime_ns;
+        start = now_ms();
+        read_directory(flat, SORT_NAME, "", entries, mtime_ns);
+        samples.push_back(now_ms() - start);
+    }
+    stop = true;
+    copier.join();
+    add_result("list_" + label + "_during_copy_ms", median(samples), "ms", false);
+    add_result("io_backoffs", io_scheduler().backoff_count() - backoffs, "count", false);
+    delete_path(work);
+}
+
+// Записывает результаты в JSON, по одному результату на строку
+static bool write_results(const std::string& path) {
+    FILE* file = path.empty() ? stdout : fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+    fprintf(file, "{\"results\": [\n");
+    for (size_t i = 0; i < results.size(); ++i) {
+        fprintf(file, "  {\"name\": \"%s\", \"value\": %.6f, \"unit\": \"%s\", \"better\": \"%s\"}%s\n", results[i].name.c_str(),
+                results[i].value, results[i].unit.c_str(), results[i].higher_is_better ? "higher" : "lower",
+                i + 1 < results.size() ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    return file == stdout || fclose(file) == 0;
+}
+
+// Читает результаты, записанные write_results
+static std::map<std::string, double> read_results(const std::string& path) {
+    std::map<std::string, double> values;
+    FILE* file = fopen(path.c_str(), "r");
+    if (file == nullptr) {
+        return values;
+    }
+    char line[1024];
+    while (fgets(line, sizeof(line), file) != nullptr) {
+        char name[256];
+        double value;
+        if (sscanf(line, " {\"name\": \"%255[^\"]\", \"value\": %lf", name, &value) == 2) {
+            values[name] = value;
+        }
+    }
+    fclose(file);
+    return values;
+}
+
+// Сравнивает результаты с базовыми и возвращает число регрессий
+static int compare_with_baseline(const std::string& path, double tolerance) {
+    std::map<std::string, double> baseline = read_results(path);
+    if (baseline.empty()) {
+        fprintf(stderr, "baseline %s is missing or empty\n", path.c_str());
+        return 0;
+    }
+
+    int regressions = 0;
+    fprintf(stderr, "\ncomparison with %s (tolerance %.0f%%):\n", path.c_str(), tolerance * 100);
+    for (size_t i = 0; i < results.size(); ++i) {
+        std::map<std::string, double>::const_iterator it = baseline.find(results[i].name);
+        if (it == baseline.end() || it->second <= 0) {
+            continue;
+        }
+        double ratio = results[i].value / it->second;
+        bool regressed = results[i].higher_is_better ? ratio < 1.0 - tolerance : ratio > 1.0 + tolerance;
+        fprintf(stderr, "  %-28s %+8.1f%% %s\n", results[i].name.c_str(), (ratio - 1.0) * 100, regressed ? "REGRESSION" : "");
+        if (regressed) {
+            regressions++;
+        }
+    }
+    return regressions;
+}
+
+static void usage(const char* program) {
+    fprintf(stderr,
+            "usage: %s [--quick] [--fixtures DIR] [--output FILE] [--baseline FILE] [--tolerance PERCENT]\n"
+            "          [--walk-inodes N]\n"
+            "  --quick      smaller fixtures (1k/10k/100k entries, 32 MB file, 100k-inode walk tree)\n"
+            "  --fixtures   where generated fixtures are kept (default /tmp/file_manager_bench)\n"
+            "  --output     write JSON results to FILE instead of stdout\n"
+            "  --baseline   compare with earlier results, exit with 1 on regression\n"
+            "  --tolerance  allowed slowdown before a result counts as a regression (default 20)\n"
+            "  --walk-inodes size of the tree for the traversal benchmark (default 10000000)\n",
+            program);
+}
+
+int main(int argc, char* argv[]) {
+    BenchConfig config;
+    config.fixtures_dir = "/tmp/file_manager_bench";
+    bool quick = false;
+    std::string output;
+    std::string baseline;
+    double tolerance = 0.20;
+    long walk_inodes = 0;
+
+    for (int i = 1; i < argc; ++i) {
+        std::string arg = argv[i];
+        if (arg == "--quick") {
+            quick = true;
+        } else if (arg == "--fixtures" && i + 1 < argc) {
+            config.fixtures_dir = argv[++i];
+        } else if (arg == "--output" && i + 1 < argc) {
+            output = argv[++i];
+        } else if (arg == "--baseline" && i + 1 < argc) {
+            baseline = argv[++i];
+        } else if (arg == "--tolerance" && i + 1 < argc) {
+            tolerance = atof(argv[++i]) / 100.0;
+        } else if (arg == "--walk-inodes" && i + 1 < argc) {
+            walk_inodes = atol(argv[++i]);
+        } else {
+            usage(argv[0]);
+            return 2;
+        }
+    }
+
+    if (quick) {
+        config.flat_dirs.push_back(std::make_pair("1k", 1000));
+        config.flat_dirs.push_back(std::make_pair("10k", 10000));
+        config.flat_dirs.push_back(std::make_pair("100k", 100000));
+        config.tree_depth = 3;
+        config.large_file_mb = 32;
+        config.walk_inodes = 100000;
+        config.tree_view_dirs = 100;
+    } else {
+        config.flat_dirs.push_back(std::make_pair("1k", 1000));
+        config.flat_dirs.push_back(std::make_pair("100k", 100000));
+        config.flat_dirs.push_back(std::make_pair("1m", 1000000));
+        config.tree_depth = 5;
+        config.large_file_mb = 256;
+        config.walk_inodes = 10000000;
+        config.tree_view_dirs = 1000;
+    }
+    if (walk_inodes > 0) {
+        config.walk_inodes = walk_inodes;
+    }
+    config.tree_fanout = 5;
+    config.tree_files = 4;
+    make_fixtures(config);
+
+    // Нулевой экран: ncurses работает как обычно, но вывод уходит в /dev/null
+    FILE* null_output = fopen("/dev/null", "w");
+    FILE* null_input = fopen("/dev/null", "r");
+    SCREEN* screen = newterm(getenv("TERM") != nullptr ? getenv("TERM") : "xterm", null_output, null_input);
+    if (screen == nullptr) {
+        screen = newterm("vt100", null_output, null_input);
+    }
+    if (screen == nullptr) {
+        fprintf(stderr, "cannot initialise a null ncurses screen\n");
+        return 2;
+    }
+    resizeterm(50, 200);
+
+    fprintf(stderr, "running benchmarks:\n");
+    bench_listing(config);
+    // Листинг идет первым, поэтому пиковая память процесса сейчас - это чтение самого большого каталога
+    struct rusage usage_info;
+    getrusage(RUSAGE_SELF, &usage_info);
+    add_result("list_peak_rss_kb", usage_info.ru_maxrss, "KiB", false);
+    bench_entry_memory(config);
+    bool frames_allocate = !bench_frame_allocations(config);
+    bench_view(config);
+    bench_file_operations(config);
+    bench_io_backends(config);
+    bench_hashing(config);
+    bench_pack(config);
+    bench_compare(config);
+    bench_completion(config);
+    bench_io_throttle(config);
+    bench_walk(config);
+    bench_panel_priority();
+    bench_watch(config);
+    bench_tree(config);
+
+    getrusage(RUSAGE_SELF, &usage_info);
+    add_result("peak_rss_kb", usage_info.ru_maxrss, "KiB", false);
+
+    endwin();
+    delscreen(screen);
+
+    if (!write_results(output)) {
+        fprintf(stderr, "cannot write %s\n", output.c_str());
+        return 2;
+    }
+    if (frames_allocate) {
+        fprintf(stderr, "frame rendering allocated heap memory\n");
+        return 1;
+    }
+    if (!baseline.empty() && compare_with_baseline(baseline, tolerance) > 0) {
+        return 1;
+    }
+    return 0;
+}
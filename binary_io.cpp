@@ -0,0 +1,76 @@
+#include "binary_io.h"
+#include <cstdio>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : mapped(nullptr), length(0) {}
+
+MappedFile::~MappedFile() {
+    if (mapped != nullptr) {
+        munmap(mapped, length);
+    }
+}
+
+// Отображает файл в память целиком, пустые файлы считаются ошибкой
+bool MappedFile::open(const std::string& path) {
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    void* result = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (result == MAP_FAILED) {
+        return false;
+    }
+
+    mapped = static_cast<char*>(result);
+    length = st.st_size;
+    return true;
+}
+
+// Записывает данные во временный файл и атомарно подменяет им целевой файл
+bool write_file_atomic(const std::string& path, const std::string& data) {
+    if (path.empty()) {
+        return false;
+    }
+
+    // Записываем буфер во временный файл рядом с целевым
+    std::string temp_path = path + ".tmp." + std::to_string(getpid());
+    int fd = ::open(temp_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) {
+        return false;
+    }
+
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            close(fd);
+            unlink(temp_path.c_str());
+            return false;
+        }
+        written += result;
+    }
+
+    // Сбрасываем данные на диск до переименования, чтобы не получить пустой файл после сбоя
+    if (fsync(fd) != 0 || close(fd) != 0) {
+        unlink(temp_path.c_str());
+        return false;
+    }
+
+    // Атомарно заменяем старый файл новым
+    if (rename(temp_path.c_str(), path.c_str()) != 0) {
+        unlink(temp_path.c_str());
+        return false;
+    }
+    return true;
+}
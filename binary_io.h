@@ -0,0 +1,137 @@
+#ifndef BINARY_IO_H
+#define BINARY_IO_H
+
+#include <string>
+#include <cstring>
+#include <cstdint>
+#include <cstddef>
+
+// Последовательная запись значений в буфер двоичного файла
+class BinaryWriter {
+public:
+    void put_u8(uint8_t value) {
+        buffer.push_back(static_cast<char>(value));
+    }
+
+    void put_u16(uint16_t value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void put_u32(uint32_t value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void put_i64(int64_t value) {
+        buffer.append(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    void put_string(const std::string& value) {
+        put_u32(static_cast<uint32_t>(value.size()));
+        buffer.append(value);
+    }
+
+    // Короткая строка с 16-битной длиной для компактных форматов
+    void put_short_string(const std::string& value) {
+        put_u16(static_cast<uint16_t>(value.size()));
+        buffer.append(value, 0, static_cast<uint16_t>(value.size()));
+    }
+
+    const std::string& data() const {
+        return buffer;
+    }
+
+private:
+    std::string buffer;
+};
+
+// Последовательное чтение значений из буфера двоичного файла с проверкой границ
+class BinaryReader {
+public:
+    BinaryReader(const char* data, size_t size) : pos(data), end(data + size), ok(true) {}
+
+    uint8_t get_u8() {
+        uint8_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    uint16_t get_u16() {
+        uint16_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    uint32_t get_u32() {
+        uint32_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    int64_t get_i64() {
+        int64_t value = 0;
+        read(&value, sizeof(value));
+        return value;
+    }
+
+    std::string get_string() {
+        return get_bytes(get_u32());
+    }
+
+    std::string get_short_string() {
+        return get_bytes(get_u16());
+    }
+
+    bool good() const {
+        return ok;
+    }
+
+private:
+    void read(void* out, size_t size) {
+        if (!ok || static_cast<size_t>(end - pos) < size) {
+            ok = false;
+            return;
+        }
+        memcpy(out, pos, size);
+        pos += size;
+    }
+
+    std::string get_bytes(size_t length) {
+        if (!ok || static_cast<size_t>(end - pos) < length) {
+            ok = false;
+            return "";
+        }
+        std::string value(pos, length);
+        pos += length;
+        return value;
+    }
+
+    const char* pos;
+    const char* end;
+    bool ok;
+};
+
+// Файл, отображенный в память только для чтения
+class MappedFile {
+public:
+    MappedFile();
+    ~MappedFile();
+
+    bool open(const std::string& path);
+    const char* data() const {
+        return mapped;
+    }
+    size_t size() const {
+        return length;
+    }
+
+private:
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+
+    char* mapped;
+    size_t length;
+};
+
+bool write_file_atomic(const std::string& path, const std::string& data);
+
+#endif // BINARY_IO_H
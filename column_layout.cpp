@@ -0,0 +1,102 @@
+#include "column_layout.h"
+#include <cstdio>
+#include <cstring>
+
+// Ширина колонок размера и даты: "1023.9K" и "YYYY-MM-DD HH:MM"
+#define SIZE_COLUMN_WIDTH 7
+#define DATE_COLUMN_WIDTH 16
+// Минимальная ширина имени, при которой еще показываются размер и дата
+#define MIN_NAME_WIDTH 12
+#define COLUMN_GAP 2
+
+ColumnLayout compute_column_layout(int panel_width) {
+    ColumnLayout layout;
+    layout.width = panel_width;
+    // Колонки располагаются внутри рамки окна
+    int inner = panel_width - 2;
+    layout.name_x = 1;
+    layout.size_width = 0;
+    layout.date_width = 0;
+    layout.size_x = layout.date_x = 0;
+
+    // Сначала жертвуем датой, затем размером, чтобы имени всегда оставалось место
+    bool with_size = inner >= MIN_NAME_WIDTH + COLUMN_GAP + SIZE_COLUMN_WIDTH;
+    bool with_date = inner >= MIN_NAME_WIDTH + 2 * COLUMN_GAP + SIZE_COLUMN_WIDTH + DATE_COLUMN_WIDTH;
+    int right = layout.name_x + inner;
+    if (with_date) {
+        layout.date_width = DATE_COLUMN_WIDTH;
+        layout.date_x = right - DATE_COLUMN_WIDTH;
+        right = layout.date_x - COLUMN_GAP;
+    }
+    if (with_size) {
+        layout.size_width = SIZE_COLUMN_WIDTH;
+        layout.size_x = right - SIZE_COLUMN_WIDTH;
+        right = layout.size_x - COLUMN_GAP;
+    }
+    layout.name_width = right > layout.name_x ? right - layout.name_x : 0;
+    return layout;
+}
+
+void fit_column(const char* text, size_t length, int width, char* out) {
+    size_t limit = width > 0 ? static_cast<size_t>(width) : 0;
+    if (length <= limit) {
+        memcpy(out, text, length);
+        out[length] = '\0';
+        return;
+    }
+    if (limit <= 3) {
+        memcpy(out, text, limit);
+        out[limit] = '\0';
+        return;
+    }
+    // Многоточие из трех точек: ncurses без поддержки широких символов считает байты, а не символы
+    size_t keep = limit - 3;
+    // Не разрезаем многобайтовый символ UTF-8 посередине
+    while (keep > 0 && (static_cast<unsigned char>(text[keep]) & 0xC0) == 0x80) {
+        --keep;
+    }
+    memcpy(out, text, keep);
+    memcpy(out + keep, "...", 4);
+}
+
+void format_size_column(off_t size, int width, char* out) {
+    if (width <= 0) {
+        out[0] = '\0';
+        return;
+    }
+    char buffer[32];
+    if (size < 1024) {
+        snprintf(buffer, sizeof(buffer), "%lld", static_cast<long long>(size));
+    } else {
+        static const char units[] = "KMGTPE";
+        double value = static_cast<double>(size) / 1024;
+        int unit = 0;
+        while (value >= 1024 && unit < 5) {
+            value /= 1024;
+            ++unit;
+        }
+        // Как ls -h: один знак после запятой для значений меньше 10
+        snprintf(buffer, sizeof(buffer), value < 10 ? "%.1f%c" : "%.0f%c", value, units[unit]);
+    }
+    size_t length = strlen(buffer);
+    size_t limit = static_cast<size_t>(width);
+    if (length >= limit) {
+        memcpy(out, buffer, limit);
+        out[limit] = '\0';
+        return;
+    }
+    memset(out, ' ', limit - length);
+    memcpy(out + limit - length, buffer, length + 1);
+}
+
+void format_date_column(time_t mtime, int width, char* out) {
+    if (width <= 0) {
+        out[0] = '\0';
+        return;
+    }
+    char buffer[32];
+    struct tm time_info;
+    localtime_r(&mtime, &time_info);
+    size_t length = strftime(buffer, sizeof(buffer), "%Y-%m-%d %H:%M", &time_info);
+    fit_column(buffer, length, width, out);
+}
@@ -0,0 +1,31 @@
+#ifndef COLUMN_LAYOUT_H
+#define COLUMN_LAYOUT_H
+
+#include <cstddef>
+#include <sys/types.h>
+#include <ctime>
+
+// Расположение колонок строки панели. Вычисляется один раз при изменении ширины панели;
+// ширина 0 означает, что колонка не помещается и не выводится
+struct ColumnLayout {
+    int width;       // Ширина панели, для которой вычислена раскладка
+    int name_x;
+    int name_width;
+    int size_x;
+    int size_width;
+    int date_x;
+    int date_width;
+};
+
+ColumnLayout compute_column_layout(int panel_width);
+// Функции форматирования пишут в буфер вызывающего не больше width байт и завершающий ноль,
+// поэтому буфер должен вмещать width + 1 байт. Кучей они не пользуются
+
+// Обрезает имя до ширины колонки, заменяя конец многоточием. Пробелами не дополняет:
+// каждый выведенный символ стоит времени отрисовки, а фон строки и так уже очищен
+void fit_column(const char* text, size_t length, int width, char* out);
+// Размер в виде 512, 1.5K, 23M, 4.0G, выровненный по правому краю колонки
+void format_size_column(off_t size, int width, char* out);
+void format_date_column(time_t mtime, int width, char* out);
+
+#endif // COLUMN_LAYOUT_H
@@ -0,0 +1,394 @@
+#include "compare_window.h"
+#include "column_layout.h"
+#include "file_type.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <ncurses.h>
+#include <string>
+
+// Сколько строк над найденным отличием остается видно при переходе к нему
+#define COMPARE_CONTEXT_ROWS 2
+// Ширина колонки номеров строк в текстовом режиме
+#define COMPARE_LINE_DIGITS 7
+
+// Конструктор класса CompareWindow, инициализирует ncurses и создает окно сравнения
+CompareWindow::CompareWindow(int height, int width) : bytes_per_row(16), offset_digits(8) {
+    initscr();
+    raw();
+    keypad(stdscr, TRUE);
+    noecho();
+    start_color();
+
+    init_pair(2, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(3, COLOR_WHITE, COLOR_BLACK);
+
+    x = (COLS - width) / 2;
+    y = (LINES - height) / 2;
+
+    win = newwin(height, width, y, x);
+    keypad(win, TRUE);
+    box(win, 0, 0);
+}
+
+// Деструктор класса CompareWindow, удаляет окно и завершает ncurses
+CompareWindow::~CompareWindow() {
+    delwin(win);
+    endwin();
+}
+
+bool CompareWindow::ensure_line(const MappedFile& file, LineIndex& index, uint64_t line) {
+    while (index.starts.size() <= line && !index.complete) {
+        if (index.starts.empty()) {
+            if (file.size() == 0) {
+                index.complete = true;
+            } else {
+                index.starts.push_back(0);
+            }
+            continue;
+        }
+        uint64_t last = index.starts.back();
+        const void* newline = memchr(mapped_bytes(file) + last, '\n', file.size() - last);
+        uint64_t next = newline != nullptr ? static_cast<const unsigned char*>(newline) - mapped_bytes(file) + 1 : file.size();
+        if (next >= file.size()) {
+            index.complete = true;
+        } else {
+            index.starts.push_back(next);
+        }
+    }
+    return line < index.starts.size();
+}
+
+uint64_t CompareWindow::line_of_offset(const MappedFile& file, LineIndex& index, uint64_t offset) {
+    while (!index.complete && (index.starts.empty() || index.starts.back() <= offset)) {
+        ensure_line(file, index, index.starts.size());
+    }
+    std::vector<uint64_t>::const_iterator found = std::upper_bound(index.starts.begin(), index.starts.end(), offset);
+    return found == index.starts.begin() ? 0 : static_cast<uint64_t>(found - index.starts.begin() - 1);
+}
+
+// Границы строки без перевода строки
+static void line_bounds(const MappedFile& file, uint64_t start, uint64_t& end) {
+    const void* newline = memchr(mapped_bytes(file) + start, '\n', file.size() - start);
+    end = newline != nullptr ? static_cast<const unsigned char*>(newline) - mapped_bytes(file) : file.size();
+}
+
+bool CompareWindow::has_line(uint64_t line) {
+    bool left = ensure_line(files[0], lines[0], line);
+    bool right = ensure_line(files[1], lines[1], line);
+    return left || right;
+}
+
+bool CompareWindow::lines_differ(uint64_t line) {
+    bool left = ensure_line(files[0], lines[0], line);
+    bool right = ensure_line(files[1], lines[1], line);
+    if (left != right) {
+        return true;
+    }
+    if (!left) {
+        return false;
+    }
+    uint64_t left_start = lines[0].starts[line];
+    uint64_t right_start = lines[1].starts[line];
+    uint64_t left_end, right_end;
+    line_bounds(files[0], left_start, left_end);
+    line_bounds(files[1], right_start, right_end);
+    uint64_t length = left_end - left_start;
+    return length != right_end - right_start ||
+           find_difference(mapped_bytes(files[0]) + left_start, mapped_bytes(files[1]) + right_start, length) < length;
+}
+
+uint64_t CompareWindow::find_differing_line(uint64_t from, bool forward) {
+    if (!forward) {
+        for (uint64_t line = from; line > 0; --line) {
+            if (lines_differ(line - 1)) {
+                return line - 1;
+            }
+        }
+        return from;
+    }
+    uint64_t common = std::min(files[0].size(), files[1].size());
+    uint64_t line = from + 1;
+    while (has_line(line)) {
+        bool both = ensure_line(files[0], lines[0], line) && ensure_line(files[1], lines[1], line);
+        if (both && lines[0].starts[line] == lines[1].starts[line]) {
+            // Пока строки начинаются с одного смещения, совпадающий участок пропускается сравнением
+            // байтов, а не строк: отличающаяся строка - та, в которой лежит первое отличие
+            uint64_t start = lines[0].starts[line];
+            uint64_t difference = start + find_difference(mapped_bytes(files[0]) + start, mapped_bytes(files[1]) + start,
+                                                          common - start);
+            if (difference >= files[0].size() && difference >= files[1].size()) {
+                return from;
+            }
+            int side = difference < files[0].size() ? 0 : 1;
+            uint64_t candidate = line_of_offset(files[side], lines[side], difference);
+            if (candidate > line) {
+                line = candidate;
+                continue;
+            }
+        }
+        if (lines_differ(line)) {
+            return line;
+        }
+        line++;
+    }
+    return from;
+}
+
+uint64_t CompareWindow::find_differing_offset(uint64_t from, bool forward) {
+    uint64_t common = std::min(files[0].size(), files[1].size());
+    int64_t block = find_differing_block(files[0], files[1], from, forward);
+    if (block >= 0) {
+        uint64_t start = static_cast<uint64_t>(block);
+        size_t length = static_cast<size_t>(std::min<uint64_t>(COMPARE_BLOCK_SIZE, common - start));
+        return start + find_difference(mapped_bytes(files[0]) + start, mapped_bytes(files[1]) + start, length);
+    }
+    // За общей частью отличается все, что есть только в большем файле
+    if (forward && files[0].size() != files[1].size() && from < common) {
+        return common;
+    }
+    return from;
+}
+
+// Байт, который можно показать в колонке символов, или точка
+static char printable(unsigned char c) {
+    return c >= 32 && c < 127 ? static_cast<char>(c) : '.';
+}
+
+void CompareWindow::draw_hex(int rows, uint64_t top) {
+    uint64_t total = std::max(files[0].size(), files[1].size());
+    int left_x = 2 + offset_digits + 1;
+    int side_width = 4 * bytes_per_row;
+    for (int row = 0; row < rows; ++row) {
+        uint64_t offset = top + static_cast<uint64_t>(row) * bytes_per_row;
+        if (offset >= total) {
+            break;
+        }
+        mvwprintw(win, 6 + row, 2, "%0*llx", offset_digits, static_cast<unsigned long long>(offset));
+        mvwaddch(win, 6 + row, left_x + side_width + 1, '|');
+        for (int side = 0; side < 2; ++side) {
+            const MappedFile& file = files[side];
+            const MappedFile& other = files[1 - side];
+            int hex_x = left_x + side * (side_width + 3);
+            int text_x = hex_x + 3 * bytes_per_row;
+            for (int i = 0; i < bytes_per_row; ++i) {
+                uint64_t position = offset + i;
+                if (position >= file.size()) {
+                    break;
+                }
+                unsigned char c = mapped_bytes(file)[position];
+                bool differs = position >= other.size() || mapped_bytes(other)[position] != c;
+                if (differs) {
+                    wattron(win, A_REVERSE);
+                }
+                mvwprintw(win, 6 + row, hex_x + 3 * i, "%02x", c);
+                mvwaddch(win, 6 + row, text_x + i, printable(c));
+                if (differs) {
+                    wattroff(win, A_REVERSE);
+                }
+            }
+        }
+    }
+}
+
+void CompareWindow::draw_text(int rows, uint64_t top) {
+    int side_width = (getmaxx(win) - 4 - (COMPARE_LINE_DIGITS + 1) - 3) / 2;
+    if (side_width <= 0) {
+        return;
+    }
+    int left_x = 2 + COMPARE_LINE_DIGITS + 1;
+    std::vector<char> buffer(side_width + 2);
+    std::vector<char> out(side_width + 1);
+    for (int row = 0; row < rows; ++row) {
+        uint64_t line = top + row;
+        if (!has_line(line)) {
+            break;
+        }
+        bool differs = lines_differ(line);
+        mvwprintw(win, 6 + row, 2, "%*llu", COMPARE_LINE_DIGITS, static_cast<unsigned long long>(line + 1));
+        mvwaddch(win, 6 + row, left_x + side_width + 1, differs ? '*' : '|');
+        for (int side = 0; side < 2; ++side) {
+            if (!ensure_line(files[side], lines[side], line)) {
+                continue;
+            }
+            uint64_t start = lines[side].starts[line];
+            uint64_t end;
+            line_bounds(files[side], start, end);
+            // Управляющие символы заменяются, чтобы не сбить вывод; байтом больше ширины хватает,
+            // чтобы fit_column поставил многоточие
+            size_t length = static_cast<size_t>(std::min<uint64_t>(end - start, side_width + 1));
+            for (size_t i = 0; i < length; ++i) {
+                unsigned char c = mapped_bytes(files[side])[start + i];
+                buffer[i] = c == '\t' ? ' ' : (c < 32 || c == 127 ? '.' : static_cast<char>(c));
+            }
+            fit_column(buffer.data(), length, side_width, out.data());
+            if (differs) {
+                wattron(win, A_REVERSE);
+            }
+            mvwprintw(win, 6 + row, left_x + side * (side_width + 3), "%s", out.data());
+            if (differs) {
+                wattroff(win, A_REVERSE);
+            }
+        }
+    }
+}
+
+// Метод класса CompareWindow, сравнивает файлы и показывает сводку и отличия с прокруткой
+void CompareWindow::show(const std::string& left_path, const std::string& right_path) {
+    int width = getmaxx(win);
+    werase(win);
+    box(win, 0, 0);
+    wattron(win, COLOR_PAIR(2));
+    mvwprintw(win, 1, 1, "Compare:");
+    wattroff(win, COLOR_PAIR(2));
+    wattron(win, COLOR_PAIR(3));
+
+    std::string error;
+    paths[0] = left_path;
+    paths[1] = right_path;
+    if (!open_compared_file(left_path, files[0], error) || !open_compared_file(right_path, files[1], error)) {
+        mvwprintw(win, 3, 2, "error: %.*s", width - 11, error.c_str());
+        mvwprintw(win, 5, 2, "Press any key to close.");
+        wattroff(win, COLOR_PAIR(3));
+        wrefresh(win);
+        wgetch(win);
+        return;
+    }
+    mvwprintw(win, 3, 2, "Comparing...");
+    wattroff(win, COLOR_PAIR(3));
+    wrefresh(win);
+
+    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+    CompareResult result = compare_files(files[0], files[1]);
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+
+    char summary[256];
+    unsigned long long first = result.first_difference;
+    if (result.identical) {
+        snprintf(summary, sizeof(summary), "Files are identical, %.3f s", seconds);
+    } else if (result.size_mismatch && result.first_difference == std::min(files[0].size(), files[1].size())) {
+        snprintf(summary, sizeof(summary), "Sizes differ; the smaller file matches the start of the larger one");
+    } else if (result.size_mismatch) {
+        snprintf(summary, sizeof(summary), "Sizes differ; first difference at offset %llu (0x%llx)", first, first);
+    } else {
+        snprintf(summary, sizeof(summary), "First difference at offset %llu (0x%llx), %llu differing block(s) of %d bytes, %.3f s",
+                 first, first, static_cast<unsigned long long>(result.differing_blocks), COMPARE_BLOCK_SIZE, seconds);
+    }
+
+    // Текстовый вид выбирается, если начала обоих файлов похожи на текст
+    bool text_mode = true;
+    for (int side = 0; side < 2; ++side) {
+        size_t sniff = static_cast<size_t>(std::min<uint64_t>(files[side].size(), FILE_TYPE_SNIFF_BYTES));
+        if (sniff > 0 && looks_binary(reinterpret_cast<const char*>(mapped_bytes(files[side])), sniff)) {
+            text_mode = false;
+        }
+    }
+
+    // Наибольшее число байт в строке, при котором обе стороны помещаются в окно
+    uint64_t total = std::max(files[0].size(), files[1].size());
+    while (offset_digits < 16 && (total >> (4 * offset_digits)) != 0) {
+        offset_digits++;
+    }
+    bytes_per_row = 32;
+    while (bytes_per_row > 4 && offset_digits + 4 + 8 * bytes_per_row > width - 4) {
+        bytes_per_row /= 2;
+    }
+
+    int rows = getmaxy(win) - 9;
+    // Отличие, к которому перешли последним; от него ищется следующее
+    uint64_t cursor = text_mode ? line_of_offset(files[0], lines[0], result.first_difference) : result.first_difference;
+    if (result.identical) {
+        cursor = 0;
+    }
+    uint64_t top = 0;
+    bool place = true;
+    while (true) {
+        uint64_t total_rows = (total + bytes_per_row - 1) / bytes_per_row;
+        uint64_t max_top = total_rows > static_cast<uint64_t>(rows) ? (total_rows - rows) * bytes_per_row : 0;
+        if (place) {
+            uint64_t row = text_mode ? cursor : cursor / bytes_per_row;
+            row = row > COMPARE_CONTEXT_ROWS ? row - COMPARE_CONTEXT_ROWS : 0;
+            top = text_mode ? row : std::min(row * bytes_per_row, max_top);
+            place = false;
+        }
+
+        werase(win);
+        box(win, 0, 0);
+        wattron(win, COLOR_PAIR(2));
+        mvwprintw(win, 1, 1, "Compare (%s):", text_mode ? "text" : "hex");
+        wattroff(win, COLOR_PAIR(2));
+
+        wattron(win, COLOR_PAIR(3));
+        std::vector<char> name(width);
+        for (int side = 0; side < 2; ++side) {
+            const std::string& path = paths[side];
+            fit_column(path.c_str(), path.size(), width - 30, name.data());
+            mvwprintw(win, 2 + side, 2, "%c: %s, %llu bytes", side == 0 ? 'A' : 'B', name.data(),
+                      static_cast<unsigned long long>(files[side].size()));
+        }
+        mvwprintw(win, 4, 2, "%.*s", width - 4, summary);
+        mvwhline(win, 5, 1, '-', width - 2);
+        if (text_mode) {
+            draw_text(rows, top);
+        } else {
+            draw_hex(rows, top);
+        }
+        mvwhline(win, 6 + rows, 1, '-', width - 2);
+        char status[160];
+        snprintf(status, sizeof(status), text_mode ? "Line %llu." : "Offset 0x%llx.",
+                 static_cast<unsigned long long>(text_mode ? top + 1 : top));
+        std::string help = std::string(status) +
+                           " Up/Down/PgUp/PgDn/Home/End to scroll, n/N next/previous difference, x hex/text, q to close.";
+        mvwprintw(win, 7 + rows, 2, "%.*s", width - 4, help.c_str());
+        wattroff(win, COLOR_PAIR(3));
+        wrefresh(win);
+
+        int ch = wgetch(win);
+        uint64_t step = text_mode ? 1 : bytes_per_row;
+        int count = ch == KEY_PPAGE || ch == KEY_NPAGE ? rows : 1;
+        if (ch == KEY_UP || ch == KEY_PPAGE) {
+            for (int i = 0; i < count && top > 0; ++i) {
+                top -= step;
+            }
+        } else if (ch == KEY_DOWN || ch == KEY_NPAGE) {
+            for (int i = 0; i < count; ++i) {
+                if (text_mode ? !has_line(top + rows) : top + step > max_top) {
+                    break;
+                }
+                top += step;
+            }
+        } else if (ch == KEY_HOME) {
+            top = 0;
+        } else if (ch == KEY_END) {
+            if (text_mode) {
+                ensure_line(files[0], lines[0], UINT64_MAX);
+                ensure_line(files[1], lines[1], UINT64_MAX);
+                uint64_t count_lines = std::max(lines[0].starts.size(), lines[1].starts.size());
+                top = count_lines > static_cast<uint64_t>(rows) ? count_lines - rows : 0;
+            } else {
+                top = max_top;
+            }
+        } else if (ch == 'n' || ch == 'N') {
+            cursor = text_mode ? find_differing_line(cursor, ch == 'n') : find_differing_offset(cursor, ch == 'n');
+            place = true;
+            continue;
+        } else if (ch == 'x') {
+            // Переход между видами сохраняет место: строка, в которой лежит смещение, и наоборот
+            if (text_mode) {
+                int side = ensure_line(files[0], lines[0], cursor) ? 0 : 1;
+                cursor = ensure_line(files[side], lines[side], cursor) ? lines[side].starts[cursor] : 0;
+            } else {
+                int side = cursor < files[0].size() ? 0 : 1;
+                cursor = line_of_offset(files[side], lines[side], cursor);
+            }
+            text_mode = !text_mode;
+            place = true;
+            continue;
+        } else if (ch == 'q' || ch == 27 || ch == ERR) {
+            break;
+        }
+        // После прокрутки следующее отличие ищется от показанного места
+        uint64_t row = (text_mode ? top : top / bytes_per_row) + COMPARE_CONTEXT_ROWS;
+        cursor = text_mode ? row : row * bytes_per_row;
+    }
+}
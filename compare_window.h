@@ -0,0 +1,50 @@
+#ifndef COMPARE_WINDOW_H
+#define COMPARE_WINDOW_H
+
+#include <ncurses.h>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "file_compare.h"
+
+// Окно сравнения двух файлов: сводка и просмотр бок о бок в шестнадцатеричном или текстовом
+// виде. Файлы отображены в память, поэтому с диска читаются только показанные строки,
+// а начала строк текста ищутся по мере прокрутки
+class CompareWindow {
+public:
+    CompareWindow(int height, int width);
+    ~CompareWindow();
+
+    void show(const std::string& left_path, const std::string& right_path);
+
+private:
+    // Начала строк текстового файла, найденные до сих пор
+    struct LineIndex {
+        LineIndex() : complete(false) {}
+        std::vector<uint64_t> starts;
+        bool complete;
+    };
+
+    // Дополняет индекс, пока в нем не окажется строка line или файл не кончится
+    static bool ensure_line(const MappedFile& file, LineIndex& index, uint64_t line);
+    static uint64_t line_of_offset(const MappedFile& file, LineIndex& index, uint64_t offset);
+    bool has_line(uint64_t line);
+    bool lines_differ(uint64_t line);
+    // Номер следующей или предыдущей отличающейся строки после from, или from, если ее нет
+    uint64_t find_differing_line(uint64_t from, bool forward);
+    // Смещение первого отличия в следующем или предыдущем блоке с отличиями, или from
+    uint64_t find_differing_offset(uint64_t from, bool forward);
+
+    void draw_hex(int rows, uint64_t top);
+    void draw_text(int rows, uint64_t top);
+
+    WINDOW* win;
+    int x, y;
+    std::string paths[2];
+    MappedFile files[2];
+    LineIndex lines[2];
+    int bytes_per_row;
+    int offset_digits;
+};
+
+#endif // COMPARE_WINDOW_H
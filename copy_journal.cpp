@@ -0,0 +1,218 @@
+#include "copy_journal.h"
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <utility>
+#include <zlib.h>
+
+// Сигнатура и версия формата журнала копирования
+static const uint32_t JOURNAL_MAGIC = 0x4a434d46; // "FMCJ"
+static const uint32_t JOURNAL_VERSION = 1;
+
+// Пороги вывода накопленных записей: число записей, объем скопированных данных и время.
+// Чем реже вывод, тем меньше syncfs, но тем больше работы повторится после сбоя
+#define JOURNAL_BATCH_RECORDS 4096
+#define JOURNAL_BATCH_BYTES (256ULL * 1024 * 1024)
+#define JOURNAL_BATCH_MS 1000
+
+enum JournalRecordType {
+    RECORD_PROGRESS = 1,
+    RECORD_DONE = 2
+};
+
+static int64_t mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000 + st.st_mtim.tv_nsec;
+}
+
+static std::string header(const std::string& source, const std::string& target) {
+    BinaryWriter writer;
+    writer.put_u32(JOURNAL_MAGIC);
+    writer.put_u32(JOURNAL_VERSION);
+    writer.put_string(source);
+    writer.put_string(target);
+    return writer.data();
+}
+
+// Запись журнала: тип, путь, размер и время источника, смещение и CRC32 всего перечисленного
+static void put_record(BinaryWriter& writer, uint8_t type, const std::string& key, int64_t size, int64_t mtime,
+                       uint64_t offset) {
+    BinaryWriter record;
+    record.put_u8(type);
+    record.put_short_string(key);
+    record.put_i64(size);
+    record.put_i64(mtime);
+    record.put_i64(static_cast<int64_t>(offset));
+    const std::string& data = record.data();
+    uint32_t crc = static_cast<uint32_t>(crc32(0, reinterpret_cast<const Bytef*>(data.data()),
+                                               static_cast<uInt>(data.size())));
+    for (size_t i = 0; i < data.size(); ++i) {
+        writer.put_u8(static_cast<uint8_t>(data[i]));
+    }
+    writer.put_u32(crc);
+}
+
+CopyJournal::CopyJournal()
+        : fd(-1), resuming(false), recorded(false), pending_records(0), pending_bytes(0), last_flush(std::chrono::steady_clock::now()) {}
+
+CopyJournal::~CopyJournal() {
+    if (fd >= 0) {
+        flush();
+        close(fd);
+    }
+}
+
+std::string CopyJournal::path_for(const std::string& target) {
+    size_t slash = target.find_last_of('/');
+    std::string dir = slash == std::string::npos ? "." : target.substr(0, slash);
+    std::string name = slash == std::string::npos ? target : target.substr(slash + 1);
+    return dir + "/." + name + ".copy-journal";
+}
+
+bool CopyJournal::exists(const std::string& source, const std::string& target) {
+    MappedFile file;
+    std::string expected = header(source, target);
+    return file.open(path_for(target)) && file.size() >= expected.size() &&
+           memcmp(file.data(), expected.data(), expected.size()) == 0;
+}
+
+bool CopyJournal::open(const std::string& source, const std::string& target) {
+    path = path_for(target);
+    this->source = source;
+    std::string expected = header(source, target);
+
+    // Журнал той же пары читается до первой поврежденной записи: ее и все после нее
+    // могли записать не полностью
+    MappedFile file;
+    if (file.open(path) && file.size() >= expected.size() &&
+        memcmp(file.data(), expected.data(), expected.size()) == 0) {
+        size_t position = expected.size();
+        while (position < file.size()) {
+            BinaryReader reader(file.data() + position, file.size() - position);
+            uint8_t type = reader.get_u8();
+            std::string key = reader.get_short_string();
+            Entry entry;
+            entry.size = reader.get_i64();
+            entry.mtime_ns = reader.get_i64();
+            entry.offset = static_cast<uint64_t>(reader.get_i64());
+            uint32_t crc = reader.get_u32();
+            size_t length = 1 + 2 + key.size() + 3 * sizeof(int64_t);
+            if (!reader.good() || (type != RECORD_PROGRESS && type != RECORD_DONE) ||
+                crc != crc32(0, reinterpret_cast<const Bytef*>(file.data() + position), static_cast<uInt>(length))) {
+                break;
+            }
+            entry.complete = type == RECORD_DONE;
+            entries[key] = entry;
+            position += length + sizeof(uint32_t);
+        }
+    }
+    resuming = !entries.empty();
+
+    // Журнал переписывается сжатым: по одной записи на файл
+    BinaryWriter compacted;
+    for (std::unordered_map<std::string, Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        put_record(compacted, it->second.complete ? RECORD_DONE : RECORD_PROGRESS, it->first, it->second.size,
+                   it->second.mtime_ns, it->second.offset);
+    }
+    if (!write_file_atomic(path, expected + compacted.data())) {
+        return false;
+    }
+    fd = ::open(path.c_str(), O_WRONLY | O_APPEND | O_CLOEXEC);
+    return fd >= 0;
+}
+
+bool CopyJournal::is_resuming() const {
+    return resuming;
+}
+
+bool CopyJournal::is_empty() const {
+    return !resuming && !recorded;
+}
+
+JournalFile CopyJournal::lookup(const std::string& source_path, const struct stat& st) const {
+    return lookup(source_path, st.st_size, mtime_ns(st));
+}
+
+JournalFile CopyJournal::lookup(const std::string& source_path, int64_t size, int64_t mtime) const {
+    JournalFile file;
+    file.key = source_path.compare(0, source.size(), source) == 0 ? source_path.substr(source.size()) : source_path;
+    file.size = size;
+    file.mtime_ns = mtime;
+    file.offset = 0;
+    file.complete = false;
+    std::unordered_map<std::string, Entry>::const_iterator it = entries.find(file.key);
+    if (it != entries.end() && it->second.size == size && it->second.mtime_ns == mtime) {
+        file.offset = it->second.offset;
+        file.complete = it->second.complete;
+    }
+    return file;
+}
+
+void CopyJournal::record_progress(const JournalFile& file, uint64_t offset) {
+    append(RECORD_PROGRESS, file, offset, JOURNAL_CHUNK_SIZE);
+}
+
+void CopyJournal::record_done(const JournalFile& file) {
+    append(RECORD_DONE, file, static_cast<uint64_t>(file.size), static_cast<uint64_t>(file.size) - file.offset);
+}
+
+void CopyJournal::append(uint8_t type, const JournalFile& file, uint64_t offset, uint64_t copied) {
+    if (fd < 0) {
+        return;
+    }
+    recorded = true;
+    bool due;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        put_record(pending, type, file.key, file.size, file.mtime_ns, offset);
+        pending_records++;
+        pending_bytes += copied;
+        due = pending_records >= JOURNAL_BATCH_RECORDS || pending_bytes >= JOURNAL_BATCH_BYTES ||
+              std::chrono::steady_clock::now() - last_flush >= std::chrono::milliseconds(JOURNAL_BATCH_MS);
+    }
+    if (due) {
+        flush();
+    }
+}
+
+bool CopyJournal::flush() {
+    std::lock_guard<std::mutex> flush_lock(flush_mutex);
+    BinaryWriter batch;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        std::swap(batch, pending);
+        pending_records = 0;
+        pending_bytes = 0;
+        last_flush = std::chrono::steady_clock::now();
+    }
+    const std::string& data = batch.data();
+    if (fd < 0 || data.empty()) {
+        return fd >= 0;
+    }
+    // Данные и каталоги копии должны попасть на диск раньше записей о них. Журнал лежит
+    // рядом с целью, поэтому syncfs по нему сбрасывает файловую систему копии
+    if (syncfs(fd) != 0) {
+        return false;
+    }
+    size_t written = 0;
+    while (written < data.size()) {
+        ssize_t result = write(fd, data.data() + written, data.size() - written);
+        if (result < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        written += result;
+    }
+    return fdatasync(fd) == 0;
+}
+
+void CopyJournal::finish() {
+    if (fd < 0) {
+        return;
+    }
+    close(fd);
+    fd = -1;
+    unlink(path.c_str());
+}
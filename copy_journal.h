@@ -0,0 +1,88 @@
+#ifndef COPY_JOURNAL_H
+#define COPY_JOURNAL_H
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <sys/stat.h>
+#include "binary_io.h"
+
+// Через сколько скопированных байтов большого файла в журнал попадает достигнутое смещение
+#define JOURNAL_CHUNK_SIZE (64ULL * 1024 * 1024)
+
+// Файл копирования в журнале: путь относительно корня копирования и размер с временем
+// изменения источника, по которым запись журнала относится именно к этому содержимому
+struct JournalFile {
+    std::string key;
+    int64_t size;
+    int64_t mtime_ns;
+    uint64_t offset; // Сколько байтов копии гарантированно на диске
+    bool complete;
+};
+
+// Журнал вставки, по которому прерванное копирование продолжается с места остановки.
+// Журнал лежит рядом с целью и состоит из заголовка и записей о завершенных файлах и смещениях
+// больших файлов; каждая запись защищена CRC32, поэтому оборванный хвост отбрасывается.
+// Записи копятся в памяти и выводятся пачкой: сначала syncfs сбрасывает на диск данные всех
+// отмеченных файлов, затем записи дописываются в журнал и сбрасываются fdatasync. Так запись
+// на диске никогда не опережает данные, которые она описывает, а fsync не идет на каждый файл.
+// Методы записи потокобезопасны: их вызывают параллельные потоки обхода
+class CopyJournal {
+public:
+    CopyJournal();
+    ~CopyJournal();
+
+    // Открывает журнал копирования source в target. Журнал той же пары продолжается
+    // (предварительно сжимается до последней записи на файл), иначе создается новый
+    bool open(const std::string& source, const std::string& target);
+    // Журнал содержал записи прерванного копирования
+    bool is_resuming() const;
+    // В журнале нет ни одной записи: копирование не успело ничего сделать
+    bool is_empty() const;
+
+    // Состояние файла источника по журналу; запись о другой версии файла не учитывается
+    JournalFile lookup(const std::string& source_path, const struct stat& st) const;
+    JournalFile lookup(const std::string& source_path, int64_t size, int64_t mtime_ns) const;
+    void record_progress(const JournalFile& file, uint64_t offset);
+    void record_done(const JournalFile& file);
+    // Выводит накопленные записи на диск
+    bool flush();
+    // Копирование завершено: журнал больше не нужен и удаляется
+    void finish();
+
+    static std::string path_for(const std::string& target);
+    // Есть ли журнал прерванного копирования source в target
+    static bool exists(const std::string& source, const std::string& target);
+
+private:
+    CopyJournal(const CopyJournal&);
+    CopyJournal& operator=(const CopyJournal&);
+
+    struct Entry {
+        int64_t size;
+        int64_t mtime_ns;
+        uint64_t offset;
+        bool complete;
+    };
+
+    void append(uint8_t type, const JournalFile& file, uint64_t offset, uint64_t copied);
+
+    std::string path;
+    std::string source;
+    int fd;
+    bool resuming;
+    std::atomic<bool> recorded;
+    std::unordered_map<std::string, Entry> entries; // Состояние на момент открытия
+
+    std::mutex mutex;
+    BinaryWriter pending;
+    size_t pending_records;
+    uint64_t pending_bytes; // Скопировано данных со времени последнего вывода
+    std::chrono::steady_clock::time_point last_flush;
+    std::mutex flush_mutex; // Выводы журнала идут по одному и в порядке накопления
+};
+
+#endif // COPY_JOURNAL_H
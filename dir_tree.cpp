@@ -0,0 +1,485 @@
+#include "dir_tree.h"
+#include "file_entry.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// Уплотнение запускается, когда мусорных узлов больше этого числа и больше, чем живых
+#define TREE_COMPACT_MIN_GARBAGE 4096
+
+// Читает подкаталоги path: имена через нули, отсортированные по strcmp. Символические ссылки
+// на каталоги не раскрываются, чтобы дерево не зацикливалось. Если время изменения каталога
+// совпало с известным, список не читается и changed остается false
+static bool read_subdirectories(const std::string& path, bool check_mtime, int64_t known_mtime_ns,
+                                int64_t& mtime_ns, bool& changed, std::vector<char>& names, uint32_t& count) {
+    PROFILE_COUNT(COUNTER_OPENDIR, 1);
+    int fd = open(path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    PROFILE_COUNT(COUNTER_STAT, 1);
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    // Время берется до чтения: изменение во время чтения заметит следующая сверка
+    mtime_ns = stat_mtime_ns(st);
+    changed = !check_mtime || mtime_ns != known_mtime_ns;
+    if (!changed) {
+        close(fd);
+        return true;
+    }
+    DIR* dir = fdopendir(fd);
+    if (dir == nullptr) {
+        close(fd);
+        return false;
+    }
+
+    std::vector<char> pool;
+    std::vector<uint32_t> offsets;
+    dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        PROFILE_COUNT(COUNTER_READDIR, 1);
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        bool directory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN) {
+            struct stat child;
+            PROFILE_COUNT(COUNTER_STAT, 1);
+            directory = fstatat(dirfd(dir), name, &child, AT_SYMLINK_NOFOLLOW) == 0 && S_ISDIR(child.st_mode);
+        }
+        if (directory) {
+            offsets.push_back(static_cast<uint32_t>(pool.size()));
+            pool.insert(pool.end(), name, name + strlen(name) + 1);
+        }
+    }
+    closedir(dir);
+
+    const char* base = pool.data();
+    std::sort(offsets.begin(), offsets.end(), [base](uint32_t a, uint32_t b) {
+        return strcmp(base + a, base + b) < 0;
+    });
+    names.reserve(pool.size());
+    for (size_t i = 0; i < offsets.size(); ++i) {
+        const char* name = base + offsets[i];
+        names.insert(names.end(), name, name + strlen(name) + 1);
+    }
+    count = static_cast<uint32_t>(offsets.size());
+    return true;
+}
+
+// Сравнение имен в порядке strcmp: имена не содержат нулей, поэтому достаточно memcmp и длины
+static int compare_names(const char* a, size_t a_length, const char* b, size_t b_length) {
+    int result = memcmp(a, b, std::min(a_length, b_length));
+    if (result != 0) {
+        return result;
+    }
+    return a_length < b_length ? -1 : a_length > b_length ? 1 : 0;
+}
+
+DirectoryTree::DirectoryTree()
+        : selected(0), garbage_nodes(0), garbage_names(0), next_serial(0), priority(PRIORITY_NORMAL),
+          inbox(std::make_shared<Inbox>()) {}
+
+void DirectoryTree::open(const std::string& root) {
+    close();
+    TreeNode node;
+    node.mtime_ns = 0;
+    node.parent = 0;
+    node.first_child = 0;
+    node.child_count = 0;
+    node.name_offset = 0;
+    node.serial = 0;
+    node.name_length = static_cast<uint16_t>(root.size());
+    node.depth = 0;
+    node.state = TREE_NODE_UNLOADED;
+    node.expanded = true;
+    nodes.push_back(node);
+    names.assign(root.begin(), root.end());
+    rows.push_back(0);
+    request(0, false);
+}
+
+void DirectoryTree::close() {
+    // Задачи пула допишут ответы в прежнюю очередь, которую уже никто не читает
+    inbox = std::make_shared<Inbox>();
+    std::vector<TreeNode>().swap(nodes);
+    std::vector<char>().swap(names);
+    std::vector<uint32_t>().swap(rows);
+    selected = 0;
+    garbage_nodes = 0;
+    garbage_names = 0;
+}
+
+bool DirectoryTree::is_open() const {
+    return !nodes.empty();
+}
+
+void DirectoryTree::set_priority(TaskPriority priority) {
+    this->priority = priority;
+}
+
+void DirectoryTree::request(uint32_t index, bool revalidation) {
+    TreeNode& node = nodes[index];
+    node.serial = ++next_serial;
+    if (!revalidation) {
+        node.state = TREE_NODE_LOADING;
+    }
+
+    std::shared_ptr<Inbox> shared = inbox;
+    std::string path = path_of(index);
+    uint32_t serial = node.serial;
+    int64_t known_mtime_ns = node.mtime_ns;
+    shared->in_flight++;
+    io_pool().submit([shared, path, index, serial, revalidation, known_mtime_ns]() {
+        Listing listing;
+        listing.node = index;
+        listing.serial = serial;
+        listing.changed = true;
+        listing.mtime_ns = 0;
+        listing.count = 0;
+        listing.ok = read_subdirectories(path, revalidation, known_mtime_ns, listing.mtime_ns, listing.changed,
+                                         listing.names, listing.count);
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        shared->results.push_back(std::move(listing));
+    }, priority);
+}
+
+bool DirectoryTree::poll() {
+    std::vector<Listing> results;
+    {
+        std::lock_guard<std::mutex> lock(inbox->mutex);
+        results.swap(inbox->results);
+    }
+    inbox->in_flight -= results.size();
+
+    bool changed = false;
+    for (size_t i = 0; i < results.size(); ++i) {
+        changed = apply(results[i]) || changed;
+    }
+    if (changed && garbage_nodes > TREE_COMPACT_MIN_GARBAGE && garbage_nodes > nodes.size() / 2 &&
+        inbox->in_flight == 0) {
+        compact();
+    }
+    return changed;
+}
+
+bool DirectoryTree::has_background_work() const {
+    return inbox->in_flight > 0;
+}
+
+bool DirectoryTree::apply(const Listing& listing) {
+    // Ответ для узла, который с тех пор освободили или запросили заново, устарел
+    if (listing.node >= nodes.size() || nodes[listing.node].serial != listing.serial ||
+        nodes[listing.node].state == TREE_NODE_UNLOADED) {
+        return false;
+    }
+    uint32_t index = listing.node;
+    if (!listing.ok) {
+        // Каталог пропал или недоступен: его поддерево больше не показывается
+        release_children(index);
+        nodes[index].state = TREE_NODE_FAILED;
+        refresh_rows(index);
+        return true;
+    }
+    if (!listing.changed) {
+        return false;
+    }
+
+    // Новый список занимает новый блок в конце массива. Подкаталоги, которые были и раньше,
+    // переносятся вместе со своими списками и раскрытием, остальные освобождаются
+    uint32_t old_first = nodes[index].first_child;
+    uint32_t old_count = nodes[index].child_count;
+    uint32_t first = static_cast<uint32_t>(nodes.size());
+    uint16_t depth = static_cast<uint16_t>(nodes[index].depth + 1);
+    const char* name = listing.names.data();
+    uint32_t old = 0;
+    for (uint32_t i = 0; i < listing.count; ++i) {
+        size_t length = strlen(name);
+        while (old < old_count) {
+            const TreeNode& previous = nodes[old_first + old];
+            if (compare_names(&names[previous.name_offset], previous.name_length, name, length) >= 0) {
+                break;
+            }
+            release_children(old_first + old);
+            garbage_names += previous.name_length;
+            ++old;
+        }
+
+        TreeNode child;
+        if (old < old_count && compare_names(&names[nodes[old_first + old].name_offset],
+                                             nodes[old_first + old].name_length, name, length) == 0) {
+            child = nodes[old_first + old];
+            ++old;
+        } else {
+            child.mtime_ns = 0;
+            child.first_child = 0;
+            child.child_count = 0;
+            child.name_offset = static_cast<uint32_t>(names.size());
+            child.serial = 0;
+            child.name_length = static_cast<uint16_t>(length);
+            child.depth = depth;
+            child.state = TREE_NODE_UNLOADED;
+            child.expanded = false;
+            names.insert(names.end(), name, name + length);
+        }
+        child.parent = index;
+        uint32_t child_index = static_cast<uint32_t>(nodes.size());
+        nodes.push_back(child);
+        for (uint32_t k = 0; k < child.child_count; ++k) {
+            nodes[child.first_child + k].parent = child_index;
+        }
+        name += length + 1;
+    }
+    for (; old < old_count; ++old) {
+        release_children(old_first + old);
+        garbage_names += nodes[old_first + old].name_length;
+    }
+    garbage_nodes += old_count;
+
+    TreeNode& node = nodes[index];
+    node.first_child = first;
+    node.child_count = listing.count;
+    node.mtime_ns = listing.mtime_ns;
+    node.state = TREE_NODE_LOADED;
+    refresh_rows(index);
+    return true;
+}
+
+void DirectoryTree::release_children(uint32_t index) {
+    // Обход без рекурсии: глубина дерева ограничена только длиной пути
+    std::vector<uint32_t> stack(1, index);
+    while (!stack.empty()) {
+        TreeNode& node = nodes[stack.back()];
+        stack.pop_back();
+        for (uint32_t i = 0; i < node.child_count; ++i) {
+            TreeNode& child = nodes[node.first_child + i];
+            if (child.child_count > 0) {
+                stack.push_back(node.first_child + i);
+            }
+            // Освобожденный узел не примет ответ пула, даже если запрос к нему еще идет
+            child.state = TREE_NODE_UNLOADED;
+            garbage_names += child.name_length;
+        }
+        garbage_nodes += node.child_count;
+        node.first_child = 0;
+        node.child_count = 0;
+        node.state = TREE_NODE_UNLOADED;
+        node.expanded = false;
+    }
+}
+
+void DirectoryTree::append_visible(uint32_t index, std::vector<uint32_t>& out) const {
+    std::vector<uint32_t> stack(1, index);
+    while (!stack.empty()) {
+        uint32_t current = stack.back();
+        stack.pop_back();
+        out.push_back(current);
+        const TreeNode& node = nodes[current];
+        if (node.expanded && node.state == TREE_NODE_LOADED) {
+            for (uint32_t i = node.child_count; i > 0; --i) {
+                stack.push_back(node.first_child + i - 1);
+            }
+        }
+    }
+}
+
+size_t DirectoryTree::subtree_end(size_t row) const {
+    uint16_t depth = nodes[rows[row]].depth;
+    size_t end = row + 1;
+    while (end < rows.size() && nodes[rows[end]].depth > depth) {
+        ++end;
+    }
+    return end;
+}
+
+void DirectoryTree::refresh_rows(uint32_t index) {
+    size_t row = row_of(index);
+    if (row == rows.size()) {
+        return;
+    }
+    // Видимые потомки узла заменяются заново собранными; курсор остается на своем узле,
+    // а если тот исчез - на ближайшем видимом предке
+    uint32_t selected_node = rows[selected];
+    size_t end = subtree_end(row);
+    std::vector<uint32_t> visible;
+    append_visible(index, visible);
+    rows.erase(rows.begin() + row, rows.begin() + end);
+    rows.insert(rows.begin() + row, visible.begin(), visible.end());
+    if (selected >= row) {
+        selected = row_of(selected_node);
+        for (uint32_t node = selected_node; selected == rows.size() && node != 0;) {
+            node = nodes[node].parent;
+            selected = row_of(node);
+        }
+        if (selected == rows.size()) {
+            selected = 0;
+        }
+    }
+}
+
+size_t DirectoryTree::row_of(uint32_t index) const {
+    std::vector<uint32_t>::const_iterator it = std::find(rows.begin(), rows.end(), index);
+    return static_cast<size_t>(it - rows.begin());
+}
+
+void DirectoryTree::expand(size_t row) {
+    if (row >= rows.size()) {
+        return;
+    }
+    uint32_t index = rows[row];
+    TreeNode& node = nodes[index];
+    if (node.expanded) {
+        return;
+    }
+    node.expanded = true;
+    if (node.state == TREE_NODE_LOADED) {
+        // Список из кеша показывается сразу, а время изменения каталога сверяется в фоне
+        std::vector<uint32_t> visible;
+        append_visible(index, visible);
+        rows.insert(rows.begin() + row + 1, visible.begin() + 1, visible.end());
+        if (selected > row) {
+            selected += visible.size() - 1;
+        }
+        request(index, true);
+    } else if (node.state != TREE_NODE_LOADING) {
+        request(index, false);
+    }
+}
+
+void DirectoryTree::collapse(size_t row) {
+    if (row >= rows.size() || !nodes[rows[row]].expanded) {
+        return;
+    }
+    uint32_t index = rows[row];
+    size_t end = subtree_end(row);
+    rows.erase(rows.begin() + row + 1, rows.begin() + end);
+    if (selected > row && selected < end) {
+        selected = row;
+    } else if (selected >= end) {
+        selected -= end - row - 1;
+    }
+
+    // Собственный список узла остается в кеше для повторного раскрытия, а списки
+    // вложенных каталогов освобождаются
+    TreeNode& node = nodes[index];
+    node.expanded = false;
+    for (uint32_t i = 0; i < node.child_count; ++i) {
+        release_children(nodes[index].first_child + i);
+    }
+    if (garbage_nodes > TREE_COMPACT_MIN_GARBAGE && garbage_nodes > nodes.size() / 2 && inbox->in_flight == 0) {
+        compact();
+    }
+}
+
+void DirectoryTree::revalidate() {
+    for (size_t row = 0; row < rows.size(); ++row) {
+        const TreeNode& node = nodes[rows[row]];
+        if (node.expanded && node.state == TREE_NODE_LOADED) {
+            request(rows[row], true);
+        }
+    }
+}
+
+void DirectoryTree::compact() {
+    // Живые узлы переписываются в новый массив в порядке обхода в ширину: дети каждого узла
+    // по-прежнему лежат подряд. Номера в строках переводятся по таблице соответствия
+    std::vector<TreeNode> packed;
+    std::vector<char> packed_names;
+    packed.reserve(nodes.size() - garbage_nodes);
+    packed_names.reserve(names.size() - garbage_names);
+    std::vector<uint32_t> remap(nodes.size(), 0);
+
+    packed.push_back(nodes[0]);
+    packed[0].name_offset = 0;
+    packed_names.insert(packed_names.end(), names.begin(), names.begin() + nodes[0].name_length);
+    for (size_t i = 0; i < packed.size(); ++i) {
+        uint32_t old_first = packed[i].first_child;
+        uint32_t count = packed[i].child_count;
+        packed[i].first_child = count > 0 ? static_cast<uint32_t>(packed.size()) : 0;
+        for (uint32_t k = 0; k < count; ++k) {
+            TreeNode child = nodes[old_first + k];
+            remap[old_first + k] = static_cast<uint32_t>(packed.size());
+            child.parent = static_cast<uint32_t>(i);
+            child.name_offset = static_cast<uint32_t>(packed_names.size());
+            packed_names.insert(packed_names.end(), names.begin() + nodes[old_first + k].name_offset,
+                                names.begin() + nodes[old_first + k].name_offset + child.name_length);
+            packed.push_back(child);
+        }
+    }
+    for (size_t row = 0; row < rows.size(); ++row) {
+        rows[row] = remap[rows[row]];
+    }
+    std::vector<uint32_t>(rows).swap(rows);
+    nodes.swap(packed);
+    names.swap(packed_names);
+    garbage_nodes = 0;
+    garbage_names = 0;
+}
+
+size_t DirectoryTree::row_count() const {
+    return rows.size();
+}
+
+const TreeNode& DirectoryTree::row_node(size_t row) const {
+    return nodes[rows[row]];
+}
+
+const char* DirectoryTree::node_name(const TreeNode& node) const {
+    return &names[node.name_offset];
+}
+
+std::string DirectoryTree::path_of(uint32_t index) const {
+    std::vector<uint32_t> chain;
+    for (uint32_t node = index; node != 0; node = nodes[node].parent) {
+        chain.push_back(node);
+    }
+    std::string path(&names[nodes[0].name_offset], nodes[0].name_length);
+    for (size_t i = chain.size(); i > 0; --i) {
+        const TreeNode& node = nodes[chain[i - 1]];
+        if (path.empty() || path[path.size() - 1] != '/') {
+            path += '/';
+        }
+        path.append(&names[node.name_offset], node.name_length);
+    }
+    return path;
+}
+
+std::string DirectoryTree::row_path(size_t row) const {
+    return path_of(rows[row]);
+}
+
+size_t DirectoryTree::parent_row(size_t row) const {
+    // Родитель - ближайшая строка выше с меньшей глубиной
+    uint16_t depth = nodes[rows[row]].depth;
+    while (row > 0 && nodes[rows[row]].depth >= depth) {
+        --row;
+    }
+    return row;
+}
+
+size_t DirectoryTree::get_selected() const {
+    return selected;
+}
+
+void DirectoryTree::select(size_t row) {
+    if (row < rows.size()) {
+        selected = row;
+    }
+}
+
+size_t DirectoryTree::node_count() const {
+    return nodes.size() - garbage_nodes;
+}
+
+size_t DirectoryTree::memory_usage() const {
+    return nodes.capacity() * sizeof(TreeNode) + names.capacity() + rows.capacity() * sizeof(uint32_t);
+}
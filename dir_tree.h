@@ -0,0 +1,123 @@
+#ifndef DIR_TREE_H
+#define DIR_TREE_H
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+#include "worker_pool.h"
+
+// Состояние списка подкаталогов узла
+enum TreeNodeState {
+    TREE_NODE_UNLOADED = 0, // Список не читался или освобожден при сворачивании
+    TREE_NODE_LOADING,      // Список читается в пуле ввода-вывода
+    TREE_NODE_LOADED,
+    TREE_NODE_FAILED        // Каталог не удалось прочитать
+};
+
+// Узел дерева каталогов. Узлы лежат в одном массиве и ссылаются друг на друга номерами, а не
+// указателями; подкаталоги узла занимают подряд child_count записей начиная с first_child и
+// отсортированы по имени. Имя хранится в общем пуле имен дерева без завершающего нуля
+struct TreeNode {
+    int64_t mtime_ns;     // Время изменения каталога, при котором прочитан список подкаталогов
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t child_count;
+    uint32_t name_offset;
+    uint32_t serial;      // Номер последнего запроса к пулу: по нему ответ находит свой узел
+    uint16_t name_length;
+    uint16_t depth;
+    uint8_t state;        // TreeNodeState
+    bool expanded;
+};
+
+// Дерево каталогов для режима дерева панели. Подкаталоги узла читаются в пуле ввода-вывода при
+// первом раскрытии и остаются в дереве как кеш: повторное раскрытие показывает их сразу, а в
+// фоне сверяет время изменения каталога и перечитывает список, только если оно изменилось.
+// Узлы и имена выделяются подряд в общих массивах, как в арене; при сворачивании списки всех
+// вложенных каталогов освобождаются, а когда мусора становится больше живых узлов, массивы
+// уплотняются. Видимые строки хранятся отдельным массивом номеров узлов, поэтому раскрытие
+// и сворачивание - вставка и удаление диапазона в нем без обхода остального дерева.
+// Все методы вызываются из потока интерфейса
+class DirectoryTree {
+public:
+    DirectoryTree();
+
+    // Строит дерево с корнем root и начинает чтение его подкаталогов
+    void open(const std::string& root);
+    // Освобождает все дерево
+    void close();
+    bool is_open() const;
+    void set_priority(TaskPriority priority);
+
+    // Применяет прочитанные списки; true, если видимые строки изменились
+    bool poll();
+    bool has_background_work() const;
+
+    size_t row_count() const;
+    const TreeNode& row_node(size_t row) const;
+    const char* node_name(const TreeNode& node) const;
+    std::string row_path(size_t row) const;
+    // Строка родителя или сама строка для корня
+    size_t parent_row(size_t row) const;
+    // Строка под курсором. Курсор хранится в дереве, потому что строки сдвигаются, когда
+    // приходят списки подкаталогов
+    size_t get_selected() const;
+    void select(size_t row);
+
+    void expand(size_t row);
+    void collapse(size_t row);
+    // Ставит в очередь сверку времени изменения всех раскрытых каталогов
+    void revalidate();
+
+    // Число живых узлов и занятая деревом память
+    size_t node_count() const;
+    size_t memory_usage() const;
+
+private:
+    DirectoryTree(const DirectoryTree&);
+    DirectoryTree& operator=(const DirectoryTree&);
+
+    // Прочитанный в пуле список подкаталогов. Имена лежат подряд через нули в порядке сортировки
+    struct Listing {
+        uint32_t node;
+        uint32_t serial;
+        bool ok;
+        bool changed; // false: время изменения совпало с известным, список не читался
+        int64_t mtime_ns;
+        std::vector<char> names;
+        uint32_t count;
+    };
+    // Очередь ответов общая с задачами пула и переживает дерево
+    struct Inbox {
+        Inbox() : in_flight(0) {}
+        std::mutex mutex;
+        std::vector<Listing> results;
+        std::atomic<size_t> in_flight;
+    };
+
+    void request(uint32_t index, bool revalidation);
+    bool apply(const Listing& listing);
+    void release_children(uint32_t index);
+    void append_visible(uint32_t index, std::vector<uint32_t>& out) const;
+    // Конец диапазона строк потомков строки row
+    size_t subtree_end(size_t row) const;
+    void refresh_rows(uint32_t index);
+    size_t row_of(uint32_t index) const;
+    std::string path_of(uint32_t index) const;
+    void compact();
+
+    std::vector<TreeNode> nodes;
+    std::vector<char> names;
+    std::vector<uint32_t> rows; // Номера видимых узлов сверху вниз
+    size_t selected;
+    size_t garbage_nodes;       // Узлы и байты имен освобожденных списков до уплотнения
+    size_t garbage_names;
+    uint32_t next_serial;
+    TaskPriority priority;
+    std::shared_ptr<Inbox> inbox;
+};
+
+#endif // DIR_TREE_H
@@ -0,0 +1,378 @@
+#include "dir_watch.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "profiler.h"
+
+// События, из которых складываются поступления и счетчик записей каталога
+#define WATCH_MASK (IN_CREATE | IN_MOVED_TO | IN_CLOSE_WRITE | IN_DELETE | IN_MOVED_FROM | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+// Раз в сколько секунд наблюдение сверяется с полным чтением каталога
+#define WATCH_RECONCILE_SECONDS 30
+// Сколько последних поступлений просматривается в поисках файла, запись в который закончилась
+#define WATCH_WRITE_LOOKBACK 64
+
+DirectoryWatch::DirectoryWatch(size_t capacity)
+        : inotify_fd(-1), dir_fd(-1), lost(false), priority(PRIORITY_NORMAL), ring_start(0), ring_count(0),
+          next_sequence(0), started(0), now(0), counted(false), file_count(0), count_delta(0), reconcile_sequence(0),
+          reconcile_delta(0), last_reconcile(0), overflowed(false) {
+    set_capacity(capacity);
+}
+
+DirectoryWatch::~DirectoryWatch() {
+    stop();
+}
+
+bool DirectoryWatch::start(const std::string& new_dir) {
+    stop();
+    inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd < 0) {
+        return false;
+    }
+    if (inotify_add_watch(inotify_fd, new_dir.c_str(), WATCH_MASK) < 0) {
+        stop();
+        return false;
+    }
+    // Метаданные поступлений запрашиваются относительно открытого каталога
+    dir_fd = open(new_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    dir = new_dir;
+    lost = false;
+
+    ring_start = 0;
+    ring_count = 0;
+    memset(buckets, 0, sizeof(buckets));
+    started = now = time(nullptr);
+    counted = false;
+    file_count = 0;
+    count_delta = 0;
+    overflowed = false;
+    // Первая сверка сразу наполняет кольцо самыми новыми файлами каталога
+    start_reconcile();
+    return true;
+}
+
+void DirectoryWatch::stop() {
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+        inotify_fd = -1;
+    }
+    if (dir_fd >= 0) {
+        close(dir_fd);
+        dir_fd = -1;
+    }
+    // Задача сверки владеет своими данными, поэтому ждать ее не нужно
+    reconcile = std::future<Snapshot>();
+    dir.clear();
+}
+
+bool DirectoryWatch::is_active() const {
+    return inotify_fd >= 0;
+}
+
+const std::string& DirectoryWatch::get_dir() const {
+    return dir;
+}
+
+void DirectoryWatch::set_capacity(size_t capacity) {
+    ring.assign(std::max<size_t>(1, capacity), WatchArrival());
+    ring_start = 0;
+    ring_count = 0;
+}
+
+void DirectoryWatch::set_priority(TaskPriority priority) {
+    this->priority = priority;
+}
+
+WatchArrival& DirectoryWatch::push_arrival() {
+    // Полное кольцо перезаписывает самое старое поступление
+    size_t index;
+    if (ring_count < ring.size()) {
+        index = (ring_start + ring_count) % ring.size();
+        ring_count++;
+    } else {
+        index = ring_start;
+        ring_start = (ring_start + 1) % ring.size();
+    }
+    WatchArrival& arrival = ring[index];
+    arrival.size = 0;
+    arrival.mtime = 0;
+    arrival.mode = 0;
+    arrival.has_info = false;
+    arrival.sequence = next_sequence++;
+    return arrival;
+}
+
+WatchArrival* DirectoryWatch::find_recent(const char* name) {
+    size_t lookback = std::min<size_t>(ring_count, WATCH_WRITE_LOOKBACK);
+    for (size_t i = 0; i < lookback; ++i) {
+        WatchArrival& arrival = ring[(ring_start + ring_count - 1 - i) % ring.size()];
+        if (strcmp(arrival.name, name) == 0) {
+            return &arrival;
+        }
+    }
+    return nullptr;
+}
+
+void DirectoryWatch::fill_info(WatchArrival& arrival) {
+    struct stat st;
+    PROFILE_COUNT(COUNTER_STAT, 1);
+    arrival.has_info = dir_fd >= 0 && fstatat(dir_fd, arrival.name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+    if (arrival.has_info) {
+        arrival.size = st.st_size;
+        arrival.mtime = st.st_mtime;
+        arrival.mode = static_cast<uint16_t>(st.st_mode);
+    }
+}
+
+void DirectoryWatch::count_rate(uint64_t files, uint64_t bytes) {
+    RateBucket& bucket = buckets[now % (WATCH_RATE_SECONDS + 1)];
+    if (bucket.second != now) {
+        bucket.second = now;
+        bucket.files = 0;
+        bucket.bytes = 0;
+    }
+    bucket.files += files;
+    bucket.bytes += bytes;
+}
+
+bool DirectoryWatch::poll() {
+    if (inotify_fd < 0) {
+        return false;
+    }
+    now = time(nullptr);
+
+    // Вычитываем все накопившиеся события. Буфер вмещает сотни событий, поэтому даже при тысячах
+    // поступлений в секунду на кадр приходится несколько вызовов read
+    bool changed = false;
+    alignas(struct inotify_event) char buffer[64 * 1024];
+    while (true) {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            ptr += sizeof(struct inotify_event) + event->len;
+            changed = true;
+
+            if (event->mask & IN_Q_OVERFLOW) {
+                // Часть событий потеряна: кольцо и счетчик восстановит внеочередная сверка
+                overflowed = true;
+                continue;
+            }
+            if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+                lost = true;
+                continue;
+            }
+            if (event->len == 0) {
+                continue;
+            }
+
+            if (event->mask & (IN_CREATE | IN_MOVED_TO)) {
+                WatchArrival& arrival = push_arrival();
+                strncpy(arrival.name, event->name, NAME_MAX);
+                arrival.name[NAME_MAX] = '\0';
+                // Только что созданный файл еще пуст, его размер придет с IN_CLOSE_WRITE, поэтому
+                // stat нужен лишь файлам, перемещенным в каталог уже готовыми
+                if (event->mask & IN_MOVED_TO) {
+                    fill_info(arrival);
+                } else if (event->mask & IN_ISDIR) {
+                    arrival.mode = S_IFDIR;
+                }
+                count_delta++;
+                count_rate(1, arrival.has_info ? static_cast<uint64_t>(arrival.size) : 0);
+            } else if (event->mask & IN_CLOSE_WRITE) {
+                // Запись в файл закончилась: его размер теперь окончательный
+                WatchArrival* arrival = find_recent(event->name);
+                if (arrival != nullptr) {
+                    off_t previous = arrival->has_info ? arrival->size : 0;
+                    fill_info(*arrival);
+                    if (arrival->has_info && arrival->size > previous) {
+                        count_rate(0, static_cast<uint64_t>(arrival->size - previous));
+                    }
+                }
+            } else if (event->mask & (IN_DELETE | IN_MOVED_FROM)) {
+                count_delta--;
+            }
+        }
+    }
+
+    // Забираем результат сверки, не дожидаясь его
+    if (reconcile.valid() && reconcile.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+        apply_snapshot(reconcile.get());
+        changed = true;
+    }
+    if (!lost && !reconcile.valid() && (overflowed || now - last_reconcile >= WATCH_RECONCILE_SECONDS)) {
+        start_reconcile();
+    }
+    return changed;
+}
+
+// Читает каталог целиком, оставляя в куче только capacity файлов с наибольшим временем изменения
+static bool read_newest(const std::string& dir, size_t capacity, std::vector<WatchArrival>& newest, long& count) {
+    PROFILE_COUNT(COUNTER_OPENDIR, 1);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* handle = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (handle == nullptr) {
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+
+    // Вершина кучи - самый старый из отобранных файлов, его и вытесняет более новый
+    struct Older {
+        bool operator()(const WatchArrival& a, const WatchArrival& b) const {
+            return a.mtime > b.mtime;
+        }
+    };
+    newest.reserve(capacity);
+    count = 0;
+    struct dirent* entry;
+    while ((entry = readdir(handle)) != nullptr) {
+        PROFILE_COUNT(COUNTER_READDIR, 1);
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        count++;
+        struct stat st;
+        PROFILE_COUNT(COUNTER_STAT, 1);
+        if (fstatat(fd, entry->d_name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+            continue;
+        }
+        if (newest.size() == capacity) {
+            if (st.st_mtime <= newest.front().mtime) {
+                continue;
+            }
+            std::pop_heap(newest.begin(), newest.end(), Older());
+            newest.pop_back();
+        }
+        WatchArrival arrival;
+        strncpy(arrival.name, entry->d_name, NAME_MAX);
+        arrival.name[NAME_MAX] = '\0';
+        arrival.size = st.st_size;
+        arrival.mtime = st.st_mtime;
+        arrival.mode = static_cast<uint16_t>(st.st_mode);
+        arrival.has_info = true;
+        arrival.sequence = 0;
+        newest.push_back(arrival);
+        std::push_heap(newest.begin(), newest.end(), Older());
+    }
+    closedir(handle);
+
+    std::sort_heap(newest.begin(), newest.end(), Older());
+    // sort_heap упорядочил по убыванию времени, а кольцо заполняется от старых к новым
+    std::reverse(newest.begin(), newest.end());
+    return true;
+}
+
+void DirectoryWatch::start_reconcile() {
+    std::string path = dir;
+    size_t capacity = ring.size();
+    // Поступления с этого момента сверка может не увидеть, их потом добавим поверх ее результата
+    reconcile_sequence = next_sequence;
+    reconcile_delta = count_delta;
+    last_reconcile = now;
+    overflowed = false;
+
+    typedef std::packaged_task<Snapshot()> ReconcileTask;
+    std::shared_ptr<ReconcileTask> task = std::make_shared<ReconcileTask>([path, capacity]() {
+        Snapshot snapshot;
+        snapshot.ok = read_newest(path, capacity, snapshot.newest, snapshot.count);
+        return snapshot;
+    });
+    reconcile = task->get_future();
+    io_pool().submit([task]() { (*task)(); }, priority);
+}
+
+void DirectoryWatch::apply_snapshot(const Snapshot& snapshot) {
+    if (!snapshot.ok) {
+        return;
+    }
+    // События, пришедшие во время сверки, учитываются поверх прочитанного числа записей
+    file_count = snapshot.count - reconcile_delta;
+    counted = true;
+
+    // Поступления во время сверки остаются самыми новыми записями кольца
+    std::vector<WatchArrival> recent;
+    for (size_t i = 0; i < ring_count; ++i) {
+        const WatchArrival& arrival = ring[(ring_start + i) % ring.size()];
+        if (arrival.sequence >= reconcile_sequence) {
+            recent.push_back(arrival);
+        }
+    }
+
+    ring_start = 0;
+    ring_count = 0;
+    for (size_t i = 0; i < snapshot.newest.size(); ++i) {
+        bool duplicate = false;
+        for (size_t j = 0; j < recent.size() && !duplicate; ++j) {
+            duplicate = strcmp(recent[j].name, snapshot.newest[i].name) == 0;
+        }
+        if (!duplicate) {
+            WatchArrival& arrival = push_arrival();
+            uint64_t sequence = arrival.sequence;
+            arrival = snapshot.newest[i];
+            arrival.sequence = sequence;
+        }
+    }
+    for (size_t i = 0; i < recent.size(); ++i) {
+        WatchArrival& arrival = push_arrival();
+        uint64_t sequence = arrival.sequence;
+        arrival = recent[i];
+        arrival.sequence = sequence;
+    }
+}
+
+size_t DirectoryWatch::get_count() const {
+    return ring_count;
+}
+
+const WatchArrival& DirectoryWatch::get_arrival(size_t index) const {
+    return ring[(ring_start + ring_count - 1 - index) % ring.size()];
+}
+
+double DirectoryWatch::get_arrival_rate() const {
+    // Текущая секунда еще не закончилась, поэтому в среднее входят только полные секунды
+    uint64_t files = 0;
+    for (size_t i = 0; i <= WATCH_RATE_SECONDS; ++i) {
+        if (buckets[i].second < now && buckets[i].second >= now - WATCH_RATE_SECONDS) {
+            files += buckets[i].files;
+        }
+    }
+    time_t seconds = std::min<time_t>(WATCH_RATE_SECONDS, now - started);
+    return seconds > 0 ? static_cast<double>(files) / seconds : 0.0;
+}
+
+double DirectoryWatch::get_byte_rate() const {
+    uint64_t bytes = 0;
+    for (size_t i = 0; i <= WATCH_RATE_SECONDS; ++i) {
+        if (buckets[i].second < now && buckets[i].second >= now - WATCH_RATE_SECONDS) {
+            bytes += buckets[i].bytes;
+        }
+    }
+    time_t seconds = std::min<time_t>(WATCH_RATE_SECONDS, now - started);
+    return seconds > 0 ? static_cast<double>(bytes) / seconds : 0.0;
+}
+
+long DirectoryWatch::get_file_count() const {
+    if (!counted) {
+        return -1;
+    }
+    return std::max(0L, file_count + count_delta);
+}
+
+bool DirectoryWatch::is_reconciling() const {
+    return reconcile.valid();
+}
+
+bool DirectoryWatch::is_lost() const {
+    return lost;
+}
+
+size_t DirectoryWatch::memory_usage() const {
+    return ring.capacity() * sizeof(WatchArrival);
+}
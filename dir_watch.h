@@ -0,0 +1,115 @@
+#ifndef DIR_WATCH_H
+#define DIR_WATCH_H
+
+#include <cstdint>
+#include <ctime>
+#include <future>
+#include <limits.h>
+#include <string>
+#include <sys/types.h>
+#include <vector>
+#include "worker_pool.h"
+
+// Число последних поступлений, которые показывает наблюдение, если не задано другое
+#define WATCH_DEFAULT_CAPACITY 256
+// За сколько последних секунд усредняется скорость поступления
+#define WATCH_RATE_SECONDS 5
+
+// Поступивший в каталог файл. Имя хранится в самой записи, поэтому память кольца
+// определяется только его емкостью
+struct WatchArrival {
+    char name[NAME_MAX + 1];
+    off_t size;
+    time_t mtime;
+    uint16_t mode;
+    bool has_info;
+    uint64_t sequence; // Порядковый номер поступления, по нему сверка отличает новые записи
+};
+
+// Наблюдение за каталогом, в который файлы поступают тысячами в секунду. Вместо перечитывания
+// каталога события inotify складываются в кольцо последних поступлений фиксированной емкости,
+// а по секундным корзинам считается скорость в файлах и байтах. Время от времени и после
+// переполнения очереди inotify каталог сверяется полным чтением в пуле ввода-вывода; сверка
+// держит в памяти только емкость кольца самых новых файлов, каким бы большим ни был каталог.
+// Все методы вызываются из потока интерфейса
+class DirectoryWatch {
+public:
+    explicit DirectoryWatch(size_t capacity = WATCH_DEFAULT_CAPACITY);
+    ~DirectoryWatch();
+
+    // Начинает наблюдение за каталогом, сбрасывая прежнее; false, если inotify недоступен
+    bool start(const std::string& dir);
+    void stop();
+    bool is_active() const;
+    const std::string& get_dir() const;
+    // Емкость кольца; при смене содержимое кольца сбрасывается
+    void set_capacity(size_t capacity);
+    // Приоритет фоновой сверки в пуле ввода-вывода
+    void set_priority(TaskPriority priority);
+
+    // Вычитывает события и забирает результат сверки; true, если показ изменился
+    bool poll();
+
+    // Число записей в кольце и запись по номеру: 0 - самое новое поступление
+    size_t get_count() const;
+    const WatchArrival& get_arrival(size_t index) const;
+    // Средняя скорость поступления за последние полные секунды
+    double get_arrival_rate() const;
+    double get_byte_rate() const;
+    // Оценка числа записей в каталоге: результат последней сверки плюс события после нее, или -1
+    long get_file_count() const;
+    bool is_reconciling() const;
+    // Каталог перестал существовать или был перемещен
+    bool is_lost() const;
+    size_t memory_usage() const;
+
+private:
+    DirectoryWatch(const DirectoryWatch&);
+    DirectoryWatch& operator=(const DirectoryWatch&);
+
+    // Результат полного чтения каталога: самые новые файлы по времени изменения, от старых к новым
+    struct Snapshot {
+        bool ok;
+        long count;
+        std::vector<WatchArrival> newest;
+    };
+    // Поступления за одну секунду
+    struct RateBucket {
+        time_t second;
+        uint64_t files;
+        uint64_t bytes;
+    };
+
+    WatchArrival& push_arrival();
+    WatchArrival* find_recent(const char* name);
+    void fill_info(WatchArrival& arrival);
+    void count_rate(uint64_t files, uint64_t bytes);
+    void start_reconcile();
+    void apply_snapshot(const Snapshot& snapshot);
+
+    std::string dir;
+    int inotify_fd;
+    int dir_fd;
+    bool lost;
+    TaskPriority priority;
+
+    std::vector<WatchArrival> ring;
+    size_t ring_start; // Номер самой старой записи кольца
+    size_t ring_count;
+    uint64_t next_sequence;
+
+    RateBucket buckets[WATCH_RATE_SECONDS + 1];
+    time_t started;
+    time_t now;
+
+    bool counted;        // Была ли хоть одна сверка
+    long file_count;     // Число записей по сверке за вычетом count_delta на момент ее начала
+    long count_delta;    // Созданные минус удаленные с начала наблюдения
+    std::future<Snapshot> reconcile;
+    uint64_t reconcile_sequence; // Первое поступление, которого сверка могла не увидеть
+    long reconcile_delta;
+    time_t last_reconcile;
+    bool overflowed;
+};
+
+#endif // DIR_WATCH_H
@@ -0,0 +1,195 @@
+#include "file_compare.h"
+#include "profiler.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define COMPARE_X86 1
+#endif
+
+// С какого размера файлы сравниваются параллельно и каким куском на задачу пула
+#define COMPARE_PARALLEL_MIN (64ULL * 1024 * 1024)
+#define COMPARE_CHUNK_SIZE (8ULL * 1024 * 1024)
+
+bool open_compared_file(const std::string& path, MappedFile& file, std::string& error) {
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    if (!S_ISREG(st.st_mode)) {
+        error = path + ": not a regular file";
+        return false;
+    }
+    if (st.st_size > 0 && !file.open(path)) {
+        error = path + ": " + strerror(errno);
+        return false;
+    }
+    return true;
+}
+
+const unsigned char* mapped_bytes(const MappedFile& file) {
+    return reinterpret_cast<const unsigned char*>(file.data());
+}
+
+static size_t find_difference_portable(const unsigned char* a, const unsigned char* b, size_t size) {
+    // memcmp по кускам быстро отсеивает совпадающие, байты ищутся только в отличающемся куске
+    size_t offset = 0;
+    while (offset < size) {
+        size_t part = std::min<size_t>(size - offset, 256);
+        if (memcmp(a + offset, b + offset, part) != 0) {
+            while (a[offset] == b[offset]) {
+                ++offset;
+            }
+            return offset;
+        }
+        offset += part;
+    }
+    return size;
+}
+
+#ifdef COMPARE_X86
+// По 64 байта за шаг: два сравнения по 32 байта и одна проверка их общей маски
+__attribute__((target("avx2")))
+static size_t find_difference_avx2(const unsigned char* a, const unsigned char* b, size_t size) {
+    size_t offset = 0;
+    for (; offset + 64 <= size; offset += 64) {
+        __m256i low = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + offset)),
+                                        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + offset)));
+        __m256i high = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + offset + 32)),
+                                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + offset + 32)));
+        if (static_cast<unsigned>(_mm256_movemask_epi8(_mm256_and_si256(low, high))) != 0xFFFFFFFFu) {
+            unsigned mask = ~static_cast<unsigned>(_mm256_movemask_epi8(low));
+            if (mask != 0) {
+                return offset + __builtin_ctz(mask);
+            }
+            return offset + 32 + __builtin_ctz(~static_cast<unsigned>(_mm256_movemask_epi8(high)));
+        }
+    }
+    return offset + find_difference_portable(a + offset, b + offset, size - offset);
+}
+
+__attribute__((target("sse2")))
+static size_t find_difference_sse2(const unsigned char* a, const unsigned char* b, size_t size) {
+    size_t offset = 0;
+    for (; offset + 16 <= size; offset += 16) {
+        __m128i equal = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + offset)),
+                                       _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + offset)));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(equal)) ^ 0xFFFFu;
+        if (mask != 0) {
+            return offset + __builtin_ctz(mask);
+        }
+    }
+    return offset + find_difference_portable(a + offset, b + offset, size - offset);
+}
+#endif
+
+size_t find_difference(const unsigned char* a, const unsigned char* b, size_t size) {
+#ifdef COMPARE_X86
+    // Проверка учитывает и поддержку регистров AVX операционной системой
+    static const bool avx2 = __builtin_cpu_supports("avx2");
+    static const bool sse2 = __builtin_cpu_supports("sse2");
+    if (avx2) {
+        return find_difference_avx2(a, b, size);
+    }
+    if (sse2) {
+        return find_difference_sse2(a, b, size);
+    }
+#endif
+    return find_difference_portable(a, b, size);
+}
+
+// Сравнивает [begin, end) по блокам: число блоков с отличиями и первое отличие
+static void compare_range(const unsigned char* a, const unsigned char* b, uint64_t begin, uint64_t end,
+                          uint64_t& blocks, uint64_t& first) {
+    blocks = 0;
+    first = end;
+    uint64_t offset = begin;
+    while (offset < end) {
+        // Совпадающий участок пропускается одним вызовом, а блок с отличием считается целиком
+        size_t same = find_difference(a + offset, b + offset, end - offset);
+        offset += same;
+        if (offset >= end) {
+            break;
+        }
+        if (first == end) {
+            first = offset;
+        }
+        blocks++;
+        offset = std::min(end, (offset / COMPARE_BLOCK_SIZE + 1) * COMPARE_BLOCK_SIZE);
+    }
+}
+
+CompareResult compare_files(const MappedFile& a, const MappedFile& b) {
+    PROFILE_SCOPE("compare");
+    CompareResult result;
+    result.size_mismatch = a.size() != b.size();
+    result.differing_blocks = 0;
+    uint64_t common = std::min(a.size(), b.size());
+    result.first_difference = common;
+    if (common > 0) {
+        madvise(const_cast<char*>(a.data()), a.size(), MADV_SEQUENTIAL);
+        madvise(const_cast<char*>(b.data()), b.size(), MADV_SEQUENTIAL);
+    }
+
+    if (result.size_mismatch) {
+        // Разные размеры уже означают, что файлы разные: дальше первого отличия не читаем
+        result.first_difference = find_difference(mapped_bytes(a), mapped_bytes(b), common);
+        result.identical = false;
+        return result;
+    }
+
+    if (common < COMPARE_PARALLEL_MIN) {
+        compare_range(mapped_bytes(a), mapped_bytes(b), 0, common, result.differing_blocks, result.first_difference);
+    } else {
+        // Куски кратны блоку, поэтому блок с отличием не считается в двух кусках
+        std::atomic<uint64_t> blocks(0);
+        std::atomic<uint64_t> first(common);
+        size_t chunks = static_cast<size_t>((common + COMPARE_CHUNK_SIZE - 1) / COMPARE_CHUNK_SIZE);
+        const unsigned char* left = mapped_bytes(a);
+        const unsigned char* right = mapped_bytes(b);
+        io_pool().parallel_for(chunks, 1, [left, right, common, &blocks, &first](size_t begin, size_t end) {
+            for (size_t chunk = begin; chunk < end; ++chunk) {
+                uint64_t chunk_begin = chunk * COMPARE_CHUNK_SIZE;
+                uint64_t chunk_end = std::min<uint64_t>(common, chunk_begin + COMPARE_CHUNK_SIZE);
+                uint64_t chunk_blocks;
+                uint64_t chunk_first;
+                compare_range(left, right, chunk_begin, chunk_end, chunk_blocks, chunk_first);
+                blocks += chunk_blocks;
+                uint64_t current = first;
+                while (chunk_blocks > 0 && chunk_first < current && !first.compare_exchange_weak(current, chunk_first)) {
+                }
+            }
+        });
+        result.differing_blocks = blocks;
+        result.first_difference = first;
+    }
+    result.identical = result.differing_blocks == 0;
+    return result;
+}
+
+int64_t find_differing_block(const MappedFile& a, const MappedFile& b, uint64_t offset, bool forward) {
+    uint64_t common = std::min(a.size(), b.size());
+    uint64_t block = offset / COMPARE_BLOCK_SIZE * COMPARE_BLOCK_SIZE;
+    if (forward) {
+        uint64_t start = block + COMPARE_BLOCK_SIZE;
+        if (start >= common) {
+            return -1;
+        }
+        uint64_t found = start + find_difference(mapped_bytes(a) + start, mapped_bytes(b) + start, common - start);
+        return found < common ? static_cast<int64_t>(found / COMPARE_BLOCK_SIZE * COMPARE_BLOCK_SIZE) : -1;
+    }
+    while (block > 0) {
+        block -= COMPARE_BLOCK_SIZE;
+        uint64_t length = std::min<uint64_t>(COMPARE_BLOCK_SIZE, common - std::min(common, block));
+        if (length > 0 && find_difference(mapped_bytes(a) + block, mapped_bytes(b) + block, length) < length) {
+            return static_cast<int64_t>(block);
+        }
+    }
+    return -1;
+}
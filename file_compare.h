@@ -0,0 +1,36 @@
+#ifndef FILE_COMPARE_H
+#define FILE_COMPARE_H
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include "binary_io.h"
+
+// Размер блока, которыми считаются различия
+#define COMPARE_BLOCK_SIZE 4096
+
+// Итог сравнения двух файлов
+struct CompareResult {
+    bool identical;
+    bool size_mismatch;        // Размеры разные: блоки не считаются, ищется только первое отличие
+    uint64_t first_difference; // Смещение первого отличающегося байта; при равном начале разного
+                               // размера - размер меньшего файла
+    uint64_t differing_blocks; // Блоки по COMPARE_BLOCK_SIZE байт, в которых есть отличия
+};
+
+// Смещение первого отличающегося байта в [0, size) или size, если данные совпадают.
+// Использует AVX2 или SSE2, если процессор их поддерживает
+size_t find_difference(const unsigned char* a, const unsigned char* b, size_t size);
+// Открывает обычный файл для сравнения. Пустой файл не отображается (mmap нулевой длины
+// недопустим) и остается пустым MappedFile
+bool open_compared_file(const std::string& path, MappedFile& file, std::string& error);
+// Данные отображенного файла как байты без знака
+const unsigned char* mapped_bytes(const MappedFile& file);
+// Сравнивает файлы. Файлы от COMPARE_PARALLEL_MIN байт сравниваются кусками параллельно
+// в пуле ввода-вывода
+CompareResult compare_files(const MappedFile& a, const MappedFile& b);
+// Начало следующего (forward) или предыдущего блока с отличиями относительно блока, в котором
+// лежит offset, или -1, если таких блоков нет. Сравнивается только общая часть файлов
+int64_t find_differing_block(const MappedFile& a, const MappedFile& b, uint64_t offset, bool forward);
+
+#endif // FILE_COMPARE_H
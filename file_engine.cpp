@@ -0,0 +1,1541 @@
+#include "file_engine.h"
+#include "column_layout.h"
+#include "copy_journal.h"
+#include "profiler.h"
+#include "io_ring.h"
+#include "io_scheduler.h"
+#include "tree_walker.h"
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <grp.h>
+#include <map>
+#include <mutex>
+#include <pwd.h>
+#include <sys/stat.h>
+#include <sys/statvfs.h>
+#include <unistd.h>
+#include <unordered_map>
+
+// Размер буфера для копирования через read/write, когда copy_file_range недоступен
+#define COPY_BUFFER_SIZE (1024 * 1024)
+
+// Файлы не больше этого размера копируются через io_uring одним чтением и одной записью,
+// более крупные - через copy_file_range
+#define RING_COPY_MAX_SIZE (256 * 1024)
+
+bool parse_overwrite_policy(const std::string& name, OverwritePolicy& policy) {
+    if (name == "fail") {
+        policy = OVERWRITE_FAIL;
+    } else if (name == "skip") {
+        policy = OVERWRITE_SKIP;
+    } else if (name == "replace") {
+        policy = OVERWRITE_REPLACE;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+static OperationResult make_result() {
+    OperationResult result;
+    result.ok = true;
+    result.files = 0;
+    result.bytes = 0;
+    result.skipped = 0;
+    return result;
+}
+
+// Отмечает операцию неуспешной, сохраняя только первую ошибку
+static void fail(OperationResult& result, const std::string& path, const std::string& message) {
+    if (result.ok) {
+        result.error = path + ": " + message;
+    }
+    result.ok = false;
+}
+
+static void fail_errno(OperationResult& result, const std::string& path, int error) {
+    fail(result, path, strerror(error));
+}
+
+static bool lstat_path(const std::string& path, struct stat& st) {
+    PROFILE_COUNT(COUNTER_STAT, 1);
+    return lstat(path.c_str(), &st) == 0;
+}
+
+// Добавляет к итогу операции итог ее части; первая ошибка остается первой
+static void merge_result(OperationResult& result, const OperationResult& part) {
+    result.files += part.files;
+    result.bytes += part.bytes;
+    result.skipped += part.skipped;
+    if (!part.ok && result.ok) {
+        result.ok = false;
+        result.error = part.error;
+    }
+}
+
+// Посетитель обхода для файловой операции. Вызовы посетителя идут параллельно, поэтому каждый
+// копит свою часть итога без блокировок и добавляет ее к общему итогу под мьютексом
+class OperationVisitor : public TreeVisitor {
+public:
+    OperationVisitor() : result(make_result()) {}
+
+    void walk_error(const std::string& path, int error) {
+        OperationResult part = make_result();
+        fail_errno(part, path, error);
+        merge(part);
+    }
+
+    OperationResult result;
+
+protected:
+    void merge(const OperationResult& part) {
+        std::lock_guard<std::mutex> lock(mutex);
+        merge_result(result, part);
+    }
+
+    std::mutex mutex;
+};
+
+// Удаляет файлы одного каталога пачками unlinkat через io_uring
+static void unlink_batched(IoRing& ring, int dir_fd, const std::string& dir, const std::vector<std::string>& names,
+                           OperationResult& result) {
+    std::vector<IoCompletion> completions;
+    for (size_t done = 0; done < names.size();) {
+        size_t batch = std::min(names.size() - done, static_cast<size_t>(ring.space()));
+        for (size_t i = 0; i < batch; ++i) {
+            ring.prep_unlinkat(dir_fd, names[done + i].c_str(), 0, done + i);
+        }
+        if (!ring.submit_and_wait(completions)) {
+            // Кольцо сломалось: оставшиеся файлы удаляем по одному
+            for (size_t i = done; i < names.size(); ++i) {
+                if (unlinkat(dir_fd, names[i].c_str(), 0) == 0) {
+                    result.files++;
+                } else if (errno != ENOENT) {
+                    fail_errno(result, walk_path(dir, names[i]), errno);
+                }
+            }
+            break;
+        }
+        for (size_t i = 0; i < completions.size(); ++i) {
+            if (completions[i].result == 0) {
+                result.files++;
+            } else {
+                fail_errno(result, walk_path(dir, names[completions[i].user_data]), -completions[i].result);
+            }
+        }
+        done += batch;
+    }
+}
+
+// Удаление дерева: файлы удаляются относительно открытого каталога без lstat (тип известен
+// из d_type), каталоги - после всего содержимого
+class DeleteVisitor : public OperationVisitor {
+public:
+    bool enter_directory(const std::string&, const struct stat&) {
+        return true;
+    }
+
+    void visit_files(const std::string& dir, int dir_fd, const std::vector<WalkEntry>& files) {
+        OperationResult part = make_result();
+        IoRing* ring = thread_io_ring();
+        if (ring != nullptr && dir_fd != AT_FDCWD) {
+            std::vector<std::string> names(files.size());
+            for (size_t i = 0; i < files.size(); ++i) {
+                names[i] = files[i].name;
+            }
+            unlink_batched(*ring, dir_fd, dir, names, part);
+            io_throttle(0, files.size());
+        } else {
+            for (size_t i = 0; i < files.size(); ++i) {
+                if (unlinkat(dir_fd, files[i].name.c_str(), 0) == 0) {
+                    part.files++;
+                } else {
+                    fail_errno(part, walk_path(dir, files[i].name), errno);
+                }
+                io_throttle(0, 1);
+            }
+        }
+        merge(part);
+    }
+
+    void leave_directory(const std::string& path, const struct stat&) {
+        if (rmdir(path.c_str()) != 0) {
+            walk_error(path, errno);
+        }
+    }
+};
+
+static void delete_tree(const std::string& path, OperationResult& result) {
+    WalkOptions options;
+    options.stat_files = false;
+    DeleteVisitor visitor;
+    walk_tree(path, options, visitor);
+    merge_result(result, visitor.result);
+}
+
+// Удаляет ресурс, мешающий созданию нового; удаленные файлы в итог операции не входят
+static bool remove_existing(const std::string& path, OperationResult& result) {
+    OperationResult removed = make_result();
+    delete_tree(path, removed);
+    if (!removed.ok && result.ok) {
+        result.ok = false;
+        result.error = removed.error;
+    }
+    return removed.ok;
+}
+
+// Копирует содержимое файла с текущих смещений: сначала copy_file_range (копирование внутри ядра),
+// при его недоступности для пары файловых систем - обычными read/write. С журналом каждые
+// JOURNAL_CHUNK_SIZE байт достигнутое смещение отмечается в нем
+static bool copy_data(int source_fd, int target_fd, OperationResult& result, const CopyOptions& options,
+                      const JournalFile* file) {
+    CopyJournal* journal = options.journal;
+    bool use_copy_range = true;
+    std::vector<char> buffer;
+    uint64_t position = journal != nullptr ? static_cast<uint64_t>(lseek(source_fd, 0, SEEK_CUR)) : 0;
+    uint64_t recorded = position;
+    while (true) {
+        ssize_t copied;
+        if (use_copy_range) {
+            copied = copy_file_range(source_fd, nullptr, target_fd, nullptr, io_chunk_size(COPY_BUFFER_SIZE * 16), 0);
+            if (copied < 0 && (errno == ENOSYS || errno == EXDEV || errno == EINVAL || errno == EOPNOTSUPP)) {
+                use_copy_range = false;
+                continue;
+            }
+        } else {
+            if (buffer.empty()) {
+                buffer.resize(COPY_BUFFER_SIZE);
+            }
+            copied = read(source_fd, &buffer[0], io_chunk_size(buffer.size()));
+            for (ssize_t written = 0; copied > 0 && written < copied;) {
+                ssize_t chunk = write(target_fd, &buffer[written], copied - written);
+                if (chunk < 0) {
+                    if (errno == EINTR) {
+                        continue;
+                    }
+                    return false;
+                }
+                written += chunk;
+            }
+        }
+
+        if (copied < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        if (copied == 0) {
+            return true;
+        }
+        result.bytes += copied;
+        PROFILE_COUNT(COUNTER_BYTES_COPIED, copied);
+        if (options.progress != nullptr) {
+            options.progress->copied_bytes += copied;
+        }
+        io_throttle(copied, 1);
+        position += copied;
+        if (journal != nullptr && position - recorded >= JOURNAL_CHUNK_SIZE) {
+            journal->record_progress(*file, position);
+            recorded = position;
+        }
+    }
+}
+
+// Копирует содержимое через буфер, считая сумму источника по ходу, без повторного чтения.
+// Затем сбрасывает цель на диск, вытесняет ее из кеша страниц и сверяет сумму прочитанной цели
+static bool copy_data_verified(int source_fd, int target_fd, const std::string& source, const std::string& target,
+                               HashAlgorithm algorithm, CopyProgress* progress, OperationResult& result) {
+    PROFILE_SCOPE("copy_verify");
+    struct stat source_st;
+    if (fstat(source_fd, &source_st) != 0) {
+        fail_errno(result, source, errno);
+        return false;
+    }
+    posix_fadvise(source_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    std::vector<char> buffer(COPY_BUFFER_SIZE);
+    Hasher source_hash(algorithm);
+    uint64_t copied_bytes = 0;
+    while (true) {
+        ssize_t copied = read(source_fd, &buffer[0], io_chunk_size(buffer.size()));
+        if (copied < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail_errno(result, source, errno);
+            return false;
+        }
+        if (copied == 0) {
+            break;
+        }
+        source_hash.update(&buffer[0], copied);
+        for (ssize_t written = 0; written < copied;) {
+            ssize_t chunk = write(target_fd, &buffer[written], copied - written);
+            if (chunk < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                fail_errno(result, target, errno);
+                return false;
+            }
+            written += chunk;
+        }
+        copied_bytes += copied;
+        result.bytes += copied;
+        PROFILE_COUNT(COUNTER_BYTES_COPIED, copied);
+        if (progress != nullptr) {
+            progress->copied_bytes += copied;
+        }
+        io_throttle(copied, 1);
+    }
+    std::string source_digest = source_hash.hex_digest();
+
+    // Без fdatasync грязные страницы из кеша не вытеснить, и сверка прочитала бы их же
+    if (fdatasync(target_fd) != 0) {
+        fail_errno(result, target, errno);
+        return false;
+    }
+    posix_fadvise(target_fd, 0, 0, POSIX_FADV_DONTNEED);
+    Hasher target_hash(algorithm);
+    uint64_t verified_bytes = 0;
+    while (true) {
+        ssize_t got = pread(target_fd, &buffer[0], io_chunk_size(buffer.size()), verified_bytes);
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            fail_errno(result, target, errno);
+            return false;
+        }
+        if (got == 0) {
+            break;
+        }
+        target_hash.update(&buffer[0], got);
+        verified_bytes += got;
+        io_throttle(got, 1);
+    }
+    if (verified_bytes != copied_bytes || target_hash.hex_digest() != source_digest) {
+        fail(result, target, std::string(hash_algorithm_name(algorithm)) + " mismatch after copy");
+        return false;
+    }
+
+    // Посчитанные суммы сразу попадают в кеш хешей для источника и копии
+    remember_hash(source_st, algorithm, source_digest);
+    struct stat target_st;
+    if (fstat(target_fd, &target_st) == 0) {
+        remember_hash(target_st, algorithm, source_digest);
+    }
+    return true;
+}
+
+static void copy_regular_file(const std::string& source, const std::string& target, const struct stat& st,
+                              const CopyOptions& options, OperationResult& result) {
+    // По журналу прерванного копирования файл пропускается, если он уже скопирован целиком,
+    // или докопируется с сохраненного смещения. Сверке нужна сумма всего источника, поэтому
+    // при ней начатый файл копируется заново
+    JournalFile journal_file;
+    uint64_t offset = 0;
+    if (options.journal != nullptr) {
+        journal_file = options.journal->lookup(source, st);
+        struct stat target_st;
+        bool target_regular = lstat_path(target, target_st) && S_ISREG(target_st.st_mode);
+        if (journal_file.complete && target_regular && target_st.st_size == st.st_size) {
+            result.skipped++;
+            // Ход считается от объема всего плана, поэтому скопированное раньше засчитывается сразу
+            if (options.progress != nullptr) {
+                options.progress->copied_files++;
+                options.progress->copied_bytes += static_cast<uint64_t>(st.st_size);
+            }
+            return;
+        }
+        if (!journal_file.complete && !options.verify && target_regular &&
+            static_cast<uint64_t>(target_st.st_size) >= journal_file.offset) {
+            offset = journal_file.offset;
+        }
+        journal_file.offset = offset;
+        if (options.progress != nullptr) {
+            options.progress->copied_bytes += offset;
+        }
+    }
+
+    int source_fd = open(source.c_str(), O_RDONLY | O_CLOEXEC);
+    if (source_fd < 0) {
+        fail_errno(result, source, errno);
+        return;
+    }
+    // Для сверки цель открывается и на чтение
+    int target_fd = open(target.c_str(), (options.verify ? O_RDWR : O_WRONLY) | O_CREAT | (offset > 0 ? 0 : O_TRUNC) |
+                         O_CLOEXEC, st.st_mode & 07777);
+    if (target_fd < 0) {
+        fail_errno(result, target, errno);
+        close(source_fd);
+        return;
+    }
+    // Все, что записано после сохраненного смещения, могло не дойти до диска и отбрасывается
+    if (offset > 0 && (ftruncate(target_fd, offset) != 0 || lseek(source_fd, offset, SEEK_SET) < 0 ||
+                       lseek(target_fd, offset, SEEK_SET) < 0)) {
+        fail_errno(result, target, errno);
+        close(source_fd);
+        close(target_fd);
+        return;
+    }
+
+    bool copied = false;
+    if (options.verify) {
+        if (copy_data_verified(source_fd, target_fd, source, target, options.verify_algorithm, options.progress,
+                               result)) {
+            if (fchmod(target_fd, st.st_mode & 07777) != 0) {
+                fail_errno(result, target, errno);
+            } else {
+                copied = true;
+            }
+        }
+    } else if (!copy_data(source_fd, target_fd, result, options, &journal_file)) {
+        fail_errno(result, source, errno);
+    } else if (fchmod(target_fd, st.st_mode & 07777) != 0) {
+        fail_errno(result, target, errno);
+    } else {
+        copied = true;
+    }
+    if (copied) {
+        result.files++;
+        if (options.progress != nullptr) {
+            options.progress->copied_files++;
+        }
+        if (options.journal != nullptr) {
+            options.journal->record_done(journal_file);
+        }
+    }
+    close(source_fd);
+    if (close(target_fd) != 0) {
+        fail_errno(result, target, errno);
+    }
+}
+
+// Маска прав процесса: с ней создаются файлы, и fchmod нужен, только если она что-то убрала
+static mode_t process_umask() {
+    static std::once_flag checked;
+    static mode_t mask = 022;
+    std::call_once(checked, []() {
+        FILE* status = fopen("/proc/self/status", "r");
+        if (status != nullptr) {
+            char line[256];
+            unsigned value;
+            while (fgets(line, sizeof(line), status) != nullptr) {
+                if (sscanf(line, "Umask: %o", &value) == 1) {
+                    mask = value;
+                    break;
+                }
+            }
+            fclose(status);
+        }
+    });
+    return mask;
+}
+
+static void copy_tree(const std::string& source, const std::string& target, OverwritePolicy policy,
+                      const CopyOptions& options, OperationResult& result);
+
+// Состояние файла в пачке копирования через io_uring
+struct RingCopyFile {
+    const std::string* name;
+    struct statx stx;
+    int source_fd;
+    int target_fd;
+    std::vector<char> buffer;
+    int64_t copied;
+    bool failed;
+    bool done;
+};
+
+// Копирует обычные файлы одного каталога во вновь созданный каталог. Каждый этап
+// (statx, openat источников и целей, read, write, close) выполняется пачкой на всю группу
+// одним вызовом io_uring_enter. Группа ограничена глубиной очереди кольца
+static void copy_files_batched(IoRing& ring, const std::string& source_dir, const std::string& target_dir,
+                               const std::vector<std::string>& names, const CopyOptions& options,
+                               OperationResult& result) {
+    // Файлы, которые не удалось скопировать пачкой, копируются обычным путем с тем же журналом
+    CopyJournal* journal = options.journal;
+    CopyOptions fallback;
+    fallback.journal = journal;
+    fallback.progress = options.progress;
+    int source_dir_fd = open(source_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    int target_dir_fd = open(target_dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (source_dir_fd < 0 || target_dir_fd < 0) {
+        for (size_t i = 0; i < names.size(); ++i) {
+            copy_tree(source_dir + "/" + names[i], target_dir + "/" + names[i], OVERWRITE_FAIL, fallback, result);
+        }
+    }
+
+    std::vector<IoCompletion> completions;
+    std::vector<RingCopyFile> group;
+    // На каждый файл нужно по две операции открытия и закрытия
+    size_t group_size = std::max<size_t>(1, ring.space() / 2);
+    for (size_t first = 0; source_dir_fd >= 0 && target_dir_fd >= 0 && first < names.size(); first += group_size) {
+        size_t count = std::min(group_size, names.size() - first);
+        group.assign(count, RingCopyFile());
+        for (size_t i = 0; i < count; ++i) {
+            group[i].name = &names[first + i];
+            group[i].source_fd = group[i].target_fd = -1;
+            group[i].copied = 0;
+            group[i].failed = false;
+            group[i].done = false;
+            ring.prep_statx(source_dir_fd, names[first + i].c_str(), AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME,
+                            &group[i].stx, i);
+        }
+        bool ring_ok = ring.submit_and_wait(completions);
+        PROFILE_COUNT(COUNTER_STAT, count);
+        for (size_t i = 0; ring_ok && i < completions.size(); ++i) {
+            RingCopyFile& file = group[completions[i].user_data];
+            if (completions[i].result < 0) {
+                fail_errno(result, source_dir + "/" + *file.name, -completions[i].result);
+                file.failed = true;
+            }
+        }
+
+        // Открываем источники и создаем цели с правами источника
+        for (size_t i = 0; ring_ok && i < count; ++i) {
+            RingCopyFile& file = group[i];
+            if (!file.failed && S_ISREG(file.stx.stx_mode)) {
+                ring.prep_openat(source_dir_fd, file.name->c_str(), O_RDONLY | O_CLOEXEC, 0, i * 2);
+                ring.prep_openat(target_dir_fd, file.name->c_str(), O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC,
+                                 file.stx.stx_mode & 07777, i * 2 + 1);
+            }
+        }
+        ring_ok = ring_ok && ring.submit_and_wait(completions);
+        for (size_t i = 0; ring_ok && i < completions.size(); ++i) {
+            RingCopyFile& file = group[completions[i].user_data / 2];
+            bool is_target = completions[i].user_data % 2 == 1;
+            if (completions[i].result < 0) {
+                fail_errno(result, (is_target ? target_dir : source_dir) + "/" + *file.name, -completions[i].result);
+                file.failed = true;
+            } else {
+                (is_target ? file.target_fd : file.source_fd) = completions[i].result;
+            }
+        }
+
+        // Небольшие файлы читаем целиком; лишний байт в буфере покажет, что файл успел вырасти
+        for (size_t i = 0; ring_ok && i < count; ++i) {
+            RingCopyFile& file = group[i];
+            if (!file.failed && file.source_fd >= 0 && file.target_fd >= 0 && file.stx.stx_size > 0 &&
+                file.stx.stx_size <= RING_COPY_MAX_SIZE) {
+                file.buffer.resize(file.stx.stx_size + 1);
+                ring.prep_read(file.source_fd, &file.buffer[0], file.buffer.size(), 0, i);
+            }
+        }
+        ring_ok = ring_ok && ring.submit_and_wait(completions);
+        for (size_t i = 0; ring_ok && i < completions.size(); ++i) {
+            RingCopyFile& file = group[completions[i].user_data];
+            if (completions[i].result < 0) {
+                fail_errno(result, source_dir + "/" + *file.name, -completions[i].result);
+                file.failed = true;
+            } else {
+                file.buffer.resize(completions[i].result);
+            }
+        }
+        for (size_t i = 0; ring_ok && i < count; ++i) {
+            RingCopyFile& file = group[i];
+            if (!file.failed && !file.buffer.empty()) {
+                ring.prep_write(file.target_fd, &file.buffer[0], file.buffer.size(), 0, i);
+            }
+        }
+        ring_ok = ring_ok && ring.submit_and_wait(completions);
+        for (size_t i = 0; ring_ok && i < completions.size(); ++i) {
+            RingCopyFile& file = group[completions[i].user_data];
+            if (completions[i].result < 0) {
+                fail_errno(result, target_dir + "/" + *file.name, -completions[i].result);
+                file.failed = true;
+            } else {
+                file.copied = completions[i].result;
+            }
+        }
+
+        // Крупные, выросшие и недописанные файлы докопируются с достигнутого смещения обычным путем
+        for (size_t i = 0; i < count; ++i) {
+            RingCopyFile& file = group[i];
+            if (file.failed || file.source_fd < 0 || file.target_fd < 0) {
+                continue;
+            }
+            PROFILE_COUNT(COUNTER_BYTES_COPIED, file.copied);
+            bool complete = ring_ok && file.copied == static_cast<int64_t>(file.stx.stx_size) &&
+                            file.buffer.size() == file.stx.stx_size;
+            JournalFile journal_file;
+            if (journal != nullptr) {
+                journal_file = journal->lookup(source_dir + "/" + *file.name, file.stx.stx_size,
+                                               static_cast<int64_t>(file.stx.stx_mtime.tv_sec) * 1000000000 +
+                                                   file.stx.stx_mtime.tv_nsec);
+                journal_file.offset = 0;
+            }
+            if (!complete && (lseek(file.source_fd, file.copied, SEEK_SET) < 0 ||
+                              lseek(file.target_fd, file.copied, SEEK_SET) < 0 ||
+                              !copy_data(file.source_fd, file.target_fd, result, fallback, &journal_file))) {
+                fail_errno(result, source_dir + "/" + *file.name, errno);
+                continue;
+            }
+            mode_t mode = file.stx.stx_mode & 07777;
+            if ((mode & ~process_umask()) != mode && fchmod(file.target_fd, mode) != 0) {
+                fail_errno(result, target_dir + "/" + *file.name, errno);
+                continue;
+            }
+            result.files++;
+            result.bytes += file.copied;
+            file.done = true;
+            if (options.progress != nullptr) {
+                options.progress->copied_files++;
+            }
+            if (journal != nullptr) {
+                journal->record_done(journal_file);
+            }
+        }
+
+        // Закрываем все открытые дескрипторы одной пачкой
+        for (size_t i = 0; i < count; ++i) {
+            if (group[i].source_fd >= 0) {
+                ring_ok ? ring.prep_close(group[i].source_fd, i * 2) : static_cast<void>(close(group[i].source_fd));
+            }
+            if (group[i].target_fd >= 0) {
+                ring_ok ? ring.prep_close(group[i].target_fd, i * 2 + 1) : static_cast<void>(close(group[i].target_fd));
+            }
+        }
+        if (ring_ok) {
+            ring_ok = ring.submit_and_wait(completions);
+            // При сбое кольца ответы, полученные до него, остаются в completions: по ним видно,
+            // какие дескрипторы уже закрыты, остальные закрываются обычным вызовом
+            std::vector<bool> closed(count * 2, false);
+            for (size_t i = 0; i < completions.size(); ++i) {
+                closed[completions[i].user_data] = true;
+                if (completions[i].result < 0 && completions[i].user_data % 2 == 1) {
+                    fail_errno(result, target_dir + "/" + *group[completions[i].user_data / 2].name, -completions[i].result);
+                }
+            }
+            for (size_t i = 0; !ring_ok && i < count; ++i) {
+                if (group[i].source_fd >= 0 && !closed[i * 2]) {
+                    close(group[i].source_fd);
+                }
+                if (group[i].target_fd >= 0 && !closed[i * 2 + 1]) {
+                    close(group[i].target_fd);
+                }
+            }
+        }
+
+        // Пачка учитывается в ограничениях фонового задания целиком: по операции на файл.
+        // В прогресс идут только скопированные файлы: остальные копируются заново ниже
+        uint64_t group_bytes = 0;
+        uint64_t done_bytes = 0;
+        for (size_t i = 0; i < count; ++i) {
+            group_bytes += group[i].copied;
+            if (group[i].done) {
+                done_bytes += group[i].copied;
+            }
+        }
+        if (options.progress != nullptr) {
+            options.progress->copied_bytes += done_bytes;
+        }
+        io_throttle(group_bytes, count);
+
+        // Файлы, оказавшиеся не обычными (заменены во время копирования) или не обработанные
+        // из-за сбоя кольца, копируем обычным путем. Каталог новый, поэтому заменять в нем можно
+        for (size_t i = 0; i < count; ++i) {
+            if (!group[i].failed && !group[i].done) {
+                copy_tree(source_dir + "/" + *group[i].name, target_dir + "/" + *group[i].name, OVERWRITE_REPLACE,
+                          fallback, result);
+            }
+        }
+        if (!ring_ok) {
+            // Кольцо больше непригодно: остаток каталога копируется без него
+            for (size_t i = first + count; i < names.size(); ++i) {
+                copy_tree(source_dir + "/" + names[i], target_dir + "/" + names[i], OVERWRITE_REPLACE, fallback,
+                          result);
+            }
+            break;
+        }
+    }
+
+    if (source_dir_fd >= 0) {
+        close(source_dir_fd);
+    }
+    if (target_dir_fd >= 0) {
+        close(target_dir_fd);
+    }
+}
+
+// Разрешает конфликт с уже существующей целью. Возвращает false, если копировать не нужно
+// (цель пропущена или произошла ошибка); merge - каталог копируется в существующий каталог
+static bool resolve_conflict(const std::string& target, const struct stat& st, OverwritePolicy policy, bool& merge,
+                             OperationResult& result) {
+    merge = false;
+    struct stat target_st;
+    if (!lstat_path(target, target_st)) {
+        return true;
+    }
+    if (target_st.st_dev == st.st_dev && target_st.st_ino == st.st_ino) {
+        fail(result, target, "source and destination are the same");
+        return false;
+    }
+    if (policy == OVERWRITE_FAIL) {
+        fail(result, target, "already exists");
+        return false;
+    }
+    if (policy == OVERWRITE_SKIP) {
+        result.skipped++;
+        return false;
+    }
+    // Каталог поверх каталога объединяется, обычный файл поверх файла перезаписывается,
+    // в остальных случаях существующий ресурс удаляется
+    merge = S_ISDIR(st.st_mode) && S_ISDIR(target_st.st_mode);
+    return merge || (S_ISREG(st.st_mode) && S_ISREG(target_st.st_mode)) || remove_existing(target, result);
+}
+
+// Копирует один элемент, не являющийся каталогом
+static void copy_entry(const std::string& source, const std::string& target, const struct stat& st,
+                       OverwritePolicy policy, const CopyOptions& options, OperationResult& result) {
+    bool merge;
+    if (!resolve_conflict(target, st, policy, merge, result)) {
+        return;
+    }
+    if (S_ISLNK(st.st_mode)) {
+        // Символические ссылки копируются как ссылки, как это делает cp -r
+        std::vector<char> link(st.st_size > 0 ? st.st_size + 1 : PATH_MAX);
+        ssize_t length = readlink(source.c_str(), &link[0], link.size());
+        if (length < 0) {
+            fail_errno(result, source, errno);
+        } else if (symlink(std::string(&link[0], length).c_str(), target.c_str()) != 0) {
+            fail_errno(result, target, errno);
+        } else {
+            result.files++;
+        }
+    } else if (S_ISREG(st.st_mode)) {
+        copy_regular_file(source, target, st, options, result);
+    } else {
+        fail(result, source, "unsupported file type");
+    }
+}
+
+// Копирование дерева каталогов: каталог цели создается при входе, файлы копируются
+// по каталогам, права каталога выставляются после всего содержимого
+class CopyVisitor : public OperationVisitor {
+public:
+    CopyVisitor(const std::string& source, const std::string& target, OverwritePolicy policy,
+                const CopyOptions& options)
+        : source(source), target(target), policy(policy), options(options) {}
+
+    bool enter_directory(const std::string& path, const struct stat& st) {
+        std::string target_dir = target_path(path);
+        OperationResult part = make_result();
+        bool existing;
+        bool enter = resolve_conflict(target_dir, st, policy, existing, part);
+        // Права выставляются после копирования, чтобы каталог без записи можно было заполнить
+        if (enter && !existing && mkdir(target_dir.c_str(), 0700) != 0) {
+            fail_errno(part, target_dir, errno);
+            enter = false;
+        }
+        merge(part);
+        if (enter) {
+            std::lock_guard<std::mutex> lock(mutex);
+            fresh[path] = !existing;
+        }
+        return enter;
+    }
+
+    void visit_files(const std::string& dir, int, const std::vector<WalkEntry>& files) {
+        std::string target_dir = target_path(dir);
+        bool fresh_dir;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fresh_dir = fresh[dir];
+        }
+        // В новый каталог обычные файлы копируются пачками через io_uring: конфликтов с
+        // существующими целями там быть не может. Остальное и объединение - по одному.
+        // Сверка копирует через буфер, поэтому кольцо при ней не используется
+        OperationResult part = make_result();
+        IoRing* ring = fresh_dir && !options.verify ? thread_io_ring() : nullptr;
+        bool has_links = options.plan != nullptr && !options.plan->links.empty();
+        std::vector<std::string> batch;
+        std::vector<std::string> deferred;
+        for (size_t i = 0; i < files.size(); ++i) {
+            if (has_links && S_ISREG(files[i].st.st_mode)) {
+                std::string path = walk_path(dir, files[i].name);
+                if (options.plan->links.count(path) != 0) {
+                    deferred.push_back(path);
+                    continue;
+                }
+            }
+            if (ring != nullptr && S_ISREG(files[i].st.st_mode)) {
+                batch.push_back(files[i].name);
+            } else {
+                copy_tree(walk_path(dir, files[i].name), walk_path(target_dir, files[i].name), policy, options, part);
+            }
+        }
+        if (!batch.empty()) {
+            copy_files_batched(*ring, dir, target_dir, batch, options, part);
+        }
+        merge(part);
+        if (!deferred.empty()) {
+            std::lock_guard<std::mutex> lock(mutex);
+            links.insert(links.end(), deferred.begin(), deferred.end());
+        }
+    }
+
+    void leave_directory(const std::string& path, const struct stat& st) {
+        std::string target_dir = target_path(path);
+        // Отложенные жесткие ссылки создаются после обхода, и каталог без права записи не должен
+        // закрыться раньше них: тогда права выставляются в restore_modes
+        bool defer = options.plan != nullptr && !options.plan->links.empty();
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            fresh.erase(path);
+            if (defer) {
+                modes.push_back(std::make_pair(target_dir, static_cast<mode_t>(st.st_mode & 07777)));
+            }
+        }
+        if (!defer && chmod(target_dir.c_str(), st.st_mode & 07777) != 0) {
+            walk_error(target_dir, errno);
+        }
+    }
+
+    // Повторные имена жестких ссылок создаются после обхода, когда первые копии уже на месте.
+    // Если первую копию сделать не удалось, имя копируется отдельным файлом
+    void create_links() {
+        OperationResult part = make_result();
+        for (size_t i = 0; i < links.size(); ++i) {
+            std::string target_file = target_path(links[i]);
+            std::string primary = target_path(options.plan->links.find(links[i])->second);
+            struct stat st;
+            bool merge_dir;
+            if (!lstat_path(links[i], st)) {
+                fail_errno(part, links[i], errno);
+                continue;
+            }
+            if (!resolve_conflict(target_file, st, policy, merge_dir, part)) {
+                continue;
+            }
+            // Заменяемый обычный файл resolve_conflict оставляет на месте, а link поверх него не пишет
+            if (unlink(target_file.c_str()) != 0 && errno != ENOENT) {
+                fail_errno(part, target_file, errno);
+                continue;
+            }
+            if (link(primary.c_str(), target_file.c_str()) != 0) {
+                copy_regular_file(links[i], target_file, st, options, part);
+                continue;
+            }
+            part.files++;
+            if (options.progress != nullptr) {
+                options.progress->copied_files++;
+            }
+        }
+        merge(part);
+    }
+
+    // Права каталогов, отложенные до создания ссылок. Каталоги записаны при выходе из них,
+    // поэтому вложенный каталог закрывается раньше родителя
+    void restore_modes() {
+        OperationResult part = make_result();
+        for (size_t i = 0; i < modes.size(); ++i) {
+            if (chmod(modes[i].first.c_str(), modes[i].second) != 0) {
+                fail_errno(part, modes[i].first, errno);
+            }
+        }
+        merge(part);
+    }
+
+private:
+    // Путь в цели, соответствующий пути внутри копируемого каталога
+    std::string target_path(const std::string& path) const {
+        std::string rest = path.substr(source.size());
+        if (!rest.empty() && rest[0] != '/') {
+            rest = "/" + rest;
+        }
+        return target + rest;
+    }
+
+    std::string source;
+    std::string target;
+    OverwritePolicy policy;
+    const CopyOptions& options;
+    std::unordered_map<std::string, bool> fresh; // Каталоги, которые создала эта операция
+    std::vector<std::string> links;              // Отложенные повторные имена жестких ссылок
+    std::vector<std::pair<std::string, mode_t> > modes; // Отложенные права каталогов цели
+};
+
+static void copy_tree(const std::string& source, const std::string& target, OverwritePolicy policy,
+                      const CopyOptions& options, OperationResult& result) {
+    struct stat st;
+    if (!lstat_path(source, st)) {
+        fail_errno(result, source, errno);
+        return;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        copy_entry(source, target, st, policy, options, result);
+        return;
+    }
+    WalkOptions walk;
+    walk.stat_files = false;
+    CopyVisitor visitor(source, target, policy, options);
+    walk_tree(source, walk, visitor);
+    visitor.create_links();
+    visitor.restore_modes();
+    merge_result(result, visitor.result);
+}
+
+// Обход источника для плана копирования: lstat всех элементов, повторы inode с несколькими
+// жесткими ссылками запоминаются вместе с первым встреченным именем
+class PlanVisitor : public OperationVisitor {
+public:
+    PlanVisitor(CopyPlan& plan, uint64_t block_size, const std::string& source, const std::string& target,
+                bool reuse_target)
+        : plan(plan), block_size(block_size), source(source), target(target), reuse_target(reuse_target) {}
+
+    bool enter_directory(const std::string& path, const struct stat&) {
+        // Каталог, который уже есть в цели, места не займет
+        struct stat existing;
+        bool exists = reuse_target && lstat_path(target_path(path), existing) && S_ISDIR(existing.st_mode);
+        std::lock_guard<std::mutex> lock(mutex);
+        plan.directories++;
+        if (!exists) {
+            plan.required_bytes += block_size;
+        }
+        return true;
+    }
+
+    void visit_files(const std::string& dir, int, const std::vector<WalkEntry>& files) {
+        // При продолжении или замене файлы цели открываются относительно ее каталога: занятое
+        // ими место освободится или уже содержит копию, поэтому вычитается из потребности
+        int target_dir_fd = -1;
+        if (reuse_target && !dir.empty()) {
+            target_dir_fd = open(target_path(dir).c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        }
+        uint64_t bytes = 0;
+        uint64_t required = 0;
+        uint64_t reused = 0;
+        std::vector<std::pair<std::string, const WalkEntry*> > linked;
+        for (size_t i = 0; i < files.size(); ++i) {
+            const struct stat& st = files[i].st;
+            if (!S_ISREG(st.st_mode)) {
+                continue;
+            }
+            if (st.st_nlink > 1) {
+                linked.push_back(std::make_pair(walk_path(dir, files[i].name), &files[i]));
+                continue;
+            }
+            bytes += static_cast<uint64_t>(st.st_size);
+            required += round_up(static_cast<uint64_t>(st.st_size));
+            reused += reusable(dir, target_dir_fd, files[i]);
+        }
+
+        std::lock_guard<std::mutex> lock(mutex);
+        plan.files += files.size();
+        for (size_t i = 0; i < linked.size(); ++i) {
+            const struct stat& st = linked[i].second->st;
+            std::pair<std::map<std::pair<dev_t, ino_t>, std::string>::iterator, bool> first =
+                inodes.insert(std::make_pair(std::make_pair(st.st_dev, st.st_ino), linked[i].first));
+            if (first.second) {
+                bytes += static_cast<uint64_t>(st.st_size);
+                required += round_up(static_cast<uint64_t>(st.st_size));
+                reused += reusable(dir, target_dir_fd, *linked[i].second);
+            } else {
+                plan.links[linked[i].first] = first.first->second;
+                plan.hardlinks++;
+            }
+        }
+        plan.bytes += bytes;
+        plan.required_bytes += required;
+        plan.reused_bytes += reused;
+        if (target_dir_fd >= 0) {
+            close(target_dir_fd);
+        }
+    }
+
+    // Нечитаемый элемент внутри источника не мешает скопировать остальное: копирование
+    // встретит ту же ошибку и сообщит о ней. План неуспешен, только если не читается сам корень
+    void walk_error(const std::string& path, int error) {
+        if (path == source) {
+            OperationVisitor::walk_error(path, error);
+            return;
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        plan.unreadable++;
+    }
+
+private:
+    uint64_t round_up(uint64_t size) const {
+        return (size + block_size - 1) / block_size * block_size;
+    }
+
+    // Путь в цели, соответствующий пути source_path в источнике
+    std::string target_path(const std::string& source_path) const {
+        return target + source_path.substr(source.size());
+    }
+
+    // Место, которое уже занимает в цели копия обычного файла, но не больше, чем нужно копии
+    uint64_t reusable(const std::string& dir, int target_dir_fd, const WalkEntry& file) const {
+        if (!reuse_target) {
+            return 0;
+        }
+        struct stat existing;
+        bool found = dir.empty() ? lstat_path(target, existing)
+                                 : target_dir_fd >= 0 &&
+                                       fstatat(target_dir_fd, file.name.c_str(), &existing, AT_SYMLINK_NOFOLLOW) == 0;
+        if (!found || !S_ISREG(existing.st_mode)) {
+            return 0;
+        }
+        return std::min(static_cast<uint64_t>(existing.st_blocks) * 512, round_up(static_cast<uint64_t>(file.st.st_size)));
+    }
+
+    CopyPlan& plan;
+    uint64_t block_size;
+    std::string source;
+    std::string target;
+    bool reuse_target;
+    std::map<std::pair<dev_t, ino_t>, std::string> inodes; // Первое имя каждого inode со ссылками
+};
+
+// Размер для сообщения: как в колонке панели, но без выравнивания
+static std::string format_size(uint64_t bytes) {
+    char text[16];
+    format_size_column(static_cast<off_t>(bytes), sizeof(text) - 1, text);
+    return text + strspn(text, " ");
+}
+
+OperationResult plan_copy(const std::string& source, const std::string& target, CopyPlan& plan,
+                          OverwritePolicy policy) {
+    PROFILE_SCOPE("copy_plan");
+    OperationResult result = make_result();
+    plan = CopyPlan();
+    // Место проверяется в каталоге, где появится цель. При замене и продолжении по журналу
+    // файлы, уже лежащие в цели, будут перезаписаны или докопированы, поэтому их место
+    // вычитается из потребности
+    std::string parent = target.substr(0, target.find_last_of('/'));
+    struct statvfs fs;
+    uint64_t block_size = 4096;
+    if (statvfs(parent.empty() ? "/" : parent.c_str(), &fs) == 0) {
+        block_size = fs.f_frsize > 0 ? fs.f_frsize : fs.f_bsize;
+        plan.available_bytes = static_cast<uint64_t>(fs.f_bavail) * block_size;
+        plan.space_known = true;
+    }
+
+    WalkOptions walk;
+    walk.stat_files = true;
+    PlanVisitor visitor(plan, block_size, source, target, policy == OVERWRITE_REPLACE);
+    walk_tree(source, walk, visitor);
+    merge_result(result, visitor.result);
+    result.files = plan.files;
+    result.bytes = plan.bytes;
+    plan.required_bytes -= std::min(plan.reused_bytes, plan.required_bytes);
+    if (result.ok && plan.space_known && plan.required_bytes > plan.available_bytes) {
+        fail(result, target, "not enough space: needs " + format_size(plan.required_bytes) + ", " +
+                                 format_size(plan.available_bytes) + " available");
+    }
+    return result;
+}
+
+// Проверяет, что цель копирования не находится внутри копируемого каталога
+static bool target_inside_source(const std::string& source, const std::string& target) {
+    char resolved_source[PATH_MAX];
+    char resolved_parent[PATH_MAX];
+    std::string parent = target.substr(0, target.find_last_of('/'));
+    if (parent.empty()) {
+        parent = "/";
+    }
+    if (realpath(source.c_str(), resolved_source) == nullptr || realpath(parent.c_str(), resolved_parent) == nullptr) {
+        return false;
+    }
+    std::string source_path = resolved_source;
+    std::string parent_path = resolved_parent;
+    return parent_path == source_path || parent_path.compare(0, source_path.size() + 1, source_path + "/") == 0;
+}
+
+OperationResult copy_path(const std::string& source, const std::string& target, OverwritePolicy policy,
+                          const CopyOptions& options) {
+    PROFILE_SCOPE("copy");
+    OperationResult result = make_result();
+    struct stat st;
+    if (!lstat_path(source, st)) {
+        fail_errno(result, source, errno);
+        return result;
+    }
+    if (S_ISDIR(st.st_mode) && target_inside_source(source, target)) {
+        fail(result, target, "cannot copy a directory into itself");
+        return result;
+    }
+    const CopyPlan* plan = options.plan;
+    if (plan != nullptr && plan->space_known && plan->required_bytes > plan->available_bytes) {
+        fail(result, target, "not enough space for the planned copy");
+        return result;
+    }
+    copy_tree(source, target, policy, options, result);
+    return result;
+}
+
+OperationResult move_path(const std::string& source, const std::string& target, OverwritePolicy policy) {
+    PROFILE_SCOPE("move");
+    OperationResult result = make_result();
+    struct stat st;
+    if (!lstat_path(source, st)) {
+        fail_errno(result, source, errno);
+        return result;
+    }
+    if (S_ISDIR(st.st_mode) && target_inside_source(source, target)) {
+        fail(result, target, "cannot move a directory into itself");
+        return result;
+    }
+
+    struct stat target_st;
+    if (lstat_path(target, target_st)) {
+        if (target_st.st_dev == st.st_dev && target_st.st_ino == st.st_ino) {
+            fail(result, target, "source and destination are the same");
+            return result;
+        }
+        if (policy == OVERWRITE_FAIL) {
+            fail(result, target, "already exists");
+            return result;
+        }
+        if (policy == OVERWRITE_SKIP) {
+            result.skipped++;
+            return result;
+        }
+        // Каталоги объединяются копированием, остальное заменяется переименованием
+        if (!(S_ISDIR(st.st_mode) && S_ISDIR(target_st.st_mode))) {
+            if (!remove_existing(target, result)) {
+                return result;
+            }
+        } else {
+            copy_tree(source, target, policy, CopyOptions(), result);
+            if (result.ok) {
+                remove_existing(source, result);
+            }
+            return result;
+        }
+    }
+
+    if (rename(source.c_str(), target.c_str()) == 0) {
+        result.files++;
+        return result;
+    }
+    if (errno != EXDEV) {
+        fail_errno(result, source, errno);
+        return result;
+    }
+
+    // Между файловыми системами перемещение выполняется копированием и удалением источника.
+    // План проверяет место до начала и сохраняет жесткие ссылки внутри источника
+    CopyPlan plan;
+    OperationResult planned = plan_copy(source, target, plan);
+    if (!planned.ok) {
+        merge_result(result, planned);
+        result.files = result.bytes = 0;
+        return result;
+    }
+    CopyOptions options;
+    options.plan = &plan;
+    copy_tree(source, target, OVERWRITE_FAIL, options, result);
+    if (result.ok) {
+        remove_existing(source, result);
+    }
+    return result;
+}
+
+OperationResult delete_path(const std::string& path) {
+    PROFILE_SCOPE("delete");
+    OperationResult result = make_result();
+    delete_tree(path, result);
+    return result;
+}
+
+// Разрешает конфликт с существующим ресурсом перед созданием нового. Возвращает false,
+// если создавать ничего не нужно (ресурс пропущен или произошла ошибка)
+static bool prepare_target(const std::string& path, OverwritePolicy policy, bool keep_regular_file,
+                           OperationResult& result) {
+    struct stat st;
+    if (!lstat_path(path, st)) {
+        return true;
+    }
+    if (policy == OVERWRITE_FAIL) {
+        fail(result, path, "already exists");
+        return false;
+    }
+    if (policy == OVERWRITE_SKIP) {
+        result.skipped++;
+        return false;
+    }
+    if (keep_regular_file && S_ISREG(st.st_mode)) {
+        return true;
+    }
+    return remove_existing(path, result);
+}
+
+OperationResult make_file(const std::string& path, OverwritePolicy policy) {
+    OperationResult result = make_result();
+    if (!prepare_target(path, policy, true, result)) {
+        return result;
+    }
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        fail_errno(result, path, errno);
+        return result;
+    }
+    close(fd);
+    result.files++;
+    return result;
+}
+
+OperationResult make_directory(const std::string& path, OverwritePolicy policy) {
+    OperationResult result = make_result();
+    if (!prepare_target(path, policy, false, result)) {
+        return result;
+    }
+    if (mkdir(path.c_str(), 0777) != 0) {
+        fail_errno(result, path, errno);
+        return result;
+    }
+    result.files++;
+    return result;
+}
+
+static std::string base_name(const std::string& path) {
+    size_t end = path.find_last_not_of('/');
+    if (end == std::string::npos) {
+        return "/";
+    }
+    size_t start = path.find_last_of('/', end);
+    return path.substr(start == std::string::npos ? 0 : start + 1, end - (start == std::string::npos ? 0 : start + 1) + 1);
+}
+
+// Подсчет места на диске по числу выделенных блоков, как это делает du: файл с несколькими
+// жесткими ссылками учитывается один раз
+class UsageVisitor : public OperationVisitor {
+public:
+    bool enter_directory(const std::string&, const struct stat& st) {
+        OperationResult part = make_result();
+        count(st, part);
+        merge(part);
+        return true;
+    }
+
+    void visit_files(const std::string&, int, const std::vector<WalkEntry>& files) {
+        OperationResult part = make_result();
+        for (size_t i = 0; i < files.size(); ++i) {
+            count(files[i].st, part);
+        }
+        merge(part);
+    }
+
+private:
+    void count(const struct stat& st, OperationResult& part) {
+        part.files++;
+        if (st.st_nlink <= 1 || S_ISDIR(st.st_mode) || links.insert(st.st_dev, st.st_ino)) {
+            part.bytes += static_cast<uint64_t>(st.st_blocks) * 512;
+        }
+    }
+
+    InodeSet links;
+};
+
+OperationResult disk_usage(const std::string& path, const WalkOptions& options) {
+    PROFILE_SCOPE("du");
+    WalkOptions walk = options;
+    walk.stat_files = true;
+    UsageVisitor visitor;
+    walk_tree(path, walk, visitor);
+    return visitor.result;
+}
+
+// Отбор путей, имя которых подходит под шаблон оболочки (*, ?, [...])
+class FindVisitor : public OperationVisitor {
+public:
+    FindVisitor(const std::string& pattern, std::vector<std::string>& matches) : pattern(pattern), matches(matches) {}
+
+    bool enter_directory(const std::string& path, const struct stat&) {
+        std::lock_guard<std::mutex> lock(mutex);
+        result.files++;
+        if (fnmatch(pattern.c_str(), base_name(path).c_str(), 0) == 0) {
+            matches.push_back(path);
+        }
+        return true;
+    }
+
+    void visit_files(const std::string& dir, int, const std::vector<WalkEntry>& files) {
+        std::vector<std::string> found;
+        for (size_t i = 0; i < files.size(); ++i) {
+            // Корень, не являющийся каталогом, приходит полным путем
+            std::string name = dir.empty() ? base_name(files[i].name) : files[i].name;
+            if (fnmatch(pattern.c_str(), name.c_str(), 0) == 0) {
+                found.push_back(walk_path(dir, files[i].name));
+            }
+        }
+        std::lock_guard<std::mutex> lock(mutex);
+        result.files += files.size();
+        matches.insert(matches.end(), found.begin(), found.end());
+    }
+
+private:
+    const std::string& pattern;
+    std::vector<std::string>& matches;
+};
+
+OperationResult find_paths(const std::string& root, const std::string& pattern, std::vector<std::string>& matches,
+                           const WalkOptions& options) {
+    PROFILE_SCOPE("find");
+    WalkOptions walk = options;
+    walk.stat_files = false;
+    size_t first = matches.size();
+    FindVisitor visitor(pattern, matches);
+    walk_tree(root, walk, visitor);
+    // Параллельный обход находит пути в произвольном порядке
+    std::sort(matches.begin() + first, matches.end());
+    return visitor.result;
+}
+
+// Биты прав, к которым относятся u, g и o, вместе со своими особыми битами
+static mode_t mode_who_bits(char who) {
+    switch (who) {
+    case 'u':
+        return 04700;
+    case 'g':
+        return 02070;
+    case 'o':
+        return 01007;
+    default:
+        return 07777;
+    }
+}
+
+bool parse_mode_change(const std::string& spec, ModeChange& change) {
+    change = ModeChange();
+    if (spec.empty()) {
+        return false;
+    }
+    if (spec.find_first_not_of("01234567") == std::string::npos) {
+        if (spec.size() > 4) {
+            return false;
+        }
+        change.absolute = true;
+        change.mode = static_cast<mode_t>(strtoul(spec.c_str(), nullptr, 8));
+        return true;
+    }
+
+    size_t i = 0;
+    while (true) {
+        mode_t who = 0;
+        for (; i < spec.size() && strchr("ugoa", spec[i]) != nullptr; ++i) {
+            who |= mode_who_bits(spec[i]);
+        }
+        bool masked = who == 0;
+        if (masked) {
+            who = 07777;
+        }
+        if (i == spec.size() || strchr("+-=", spec[i]) == nullptr) {
+            return false;
+        }
+        // В одном условии может быть несколько действий подряд: u+r-w
+        while (i < spec.size() && strchr("+-=", spec[i]) != nullptr) {
+            ModeChange::Clause clause;
+            clause.who = who;
+            clause.masked = masked;
+            clause.op = spec[i++];
+            clause.perms = 0;
+            clause.conditional_x = false;
+            for (; i < spec.size() && strchr("rwxXst", spec[i]) != nullptr; ++i) {
+                switch (spec[i]) {
+                case 'r':
+                    clause.perms |= 0444;
+                    break;
+                case 'w':
+                    clause.perms |= 0222;
+                    break;
+                case 'x':
+                    clause.perms |= 0111;
+                    break;
+                case 'X':
+                    clause.conditional_x = true;
+                    break;
+                case 's':
+                    clause.perms |= 06000;
+                    break;
+                case 't':
+                    clause.perms |= 01000;
+                    break;
+                }
+            }
+            change.clauses.push_back(clause);
+        }
+        if (i == spec.size()) {
+            return true;
+        }
+        if (spec[i] != ',') {
+            return false;
+        }
+        ++i;
+    }
+}
+
+mode_t apply_mode_change(const ModeChange& change, mode_t mode, bool is_dir) {
+    if (change.absolute) {
+        return change.mode;
+    }
+    for (size_t i = 0; i < change.clauses.size(); ++i) {
+        const ModeChange::Clause& clause = change.clauses[i];
+        mode_t perms = clause.perms;
+        if (clause.conditional_x && (is_dir || (mode & 0111) != 0)) {
+            perms |= 0111;
+        }
+        mode_t bits = perms & clause.who;
+        if (clause.masked) {
+            bits &= ~process_umask();
+        }
+        if (clause.op == '+') {
+            mode |= bits;
+        } else if (clause.op == '-') {
+            mode &= ~bits;
+        } else {
+            // Как и chmod, = не снимает у каталога неупомянутые биты setuid и setgid
+            mode_t cleared = is_dir ? clause.who & ~06000 : clause.who;
+            mode = (mode & ~cleared) | bits;
+        }
+    }
+    return mode & 07777;
+}
+
+// Разбирает имя пользователя или группы; число принимается как идентификатор
+static bool parse_id(const std::string& name, bool group, unsigned& id) {
+    char* end = nullptr;
+    unsigned long value = strtoul(name.c_str(), &end, 10);
+    if (!name.empty() && *end == '\0') {
+        id = static_cast<unsigned>(value);
+        return true;
+    }
+    if (group) {
+        struct group* entry = getgrnam(name.c_str());
+        if (entry != nullptr) {
+            id = entry->gr_gid;
+        }
+        return entry != nullptr;
+    }
+    struct passwd* entry = getpwnam(name.c_str());
+    if (entry != nullptr) {
+        id = entry->pw_uid;
+    }
+    return entry != nullptr;
+}
+
+bool parse_owner(const std::string& spec, uid_t& uid, gid_t& gid) {
+    uid = static_cast<uid_t>(-1);
+    gid = static_cast<gid_t>(-1);
+    size_t colon = spec.find(':');
+    std::string user = spec.substr(0, colon);
+    std::string group = colon == std::string::npos ? "" : spec.substr(colon + 1);
+    if (user.empty() && group.empty()) {
+        return false;
+    }
+    unsigned id;
+    if (!user.empty()) {
+        if (!parse_id(user, false, id)) {
+            return false;
+        }
+        uid = id;
+    }
+    if (!group.empty()) {
+        if (!parse_id(group, true, id)) {
+            return false;
+        }
+        gid = id;
+    }
+    return true;
+}
+
+static bool same_time(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+// Выставляет атрибуты элемента name относительно каталога dir_fd. Совпадающие атрибуты не
+// записываются, поэтому повторный проход по уже исправленному дереву делает только stat
+static void apply_attributes(int dir_fd, const char* name, const std::string& path, const struct stat& st,
+                             const AttributeChange& change, OperationResult& result) {
+    bool changed = false;
+    uid_t uid = change.uid == st.st_uid ? static_cast<uid_t>(-1) : change.uid;
+    gid_t gid = change.gid == st.st_gid ? static_cast<gid_t>(-1) : change.gid;
+    // Смена владельца сбрасывает setuid и setgid, поэтому она идет раньше прав
+    if (uid != static_cast<uid_t>(-1) || gid != static_cast<gid_t>(-1)) {
+        if (fchownat(dir_fd, name, uid, gid, AT_SYMLINK_NOFOLLOW) != 0) {
+            fail_errno(result, path, errno);
+            return;
+        }
+        changed = true;
+    }
+    // Права символических ссылок в Linux не используются, и fchmodat их не меняет
+    if (change.change_mode && !S_ISLNK(st.st_mode)) {
+        mode_t mode = apply_mode_change(change.mode, st.st_mode & 07777, S_ISDIR(st.st_mode));
+        if (mode != (st.st_mode & 07777) || (changed && (mode & 06000) != 0)) {
+            if (fchmodat(dir_fd, name, mode, 0) != 0) {
+                fail_errno(result, path, errno);
+                return;
+            }
+            changed = true;
+        }
+    }
+    if (change.touch && (!same_time(st.st_atim, change.time) || !same_time(st.st_mtim, change.time))) {
+        struct timespec times[2] = {change.time, change.time};
+        if (utimensat(dir_fd, name, times, AT_SYMLINK_NOFOLLOW) != 0) {
+            fail_errno(result, path, errno);
+            return;
+        }
+        changed = true;
+    }
+    if (changed) {
+        result.files++;
+    } else {
+        result.skipped++;
+    }
+}
+
+// Изменение атрибутов дерева. Подкаталог меняется до входа в него, как у chmod -R, чтобы новые
+// права успели открыть его для обхода. И файлы, и подкаталоги меняются относительно открытого
+// дескриптора родителя, поэтому путь не разбирается заново от корня на каждый элемент
+class AttributeVisitor : public OperationVisitor {
+public:
+    explicit AttributeVisitor(const AttributeChange& change) : change(change) {}
+
+    bool enter_directory(const std::string&, const struct stat&) {
+        return true;
+    }
+
+    void visit_directories(const std::string& dir, int dir_fd, const std::vector<WalkEntry>& directories) {
+        visit_files(dir, dir_fd, directories);
+    }
+
+    void visit_files(const std::string& dir, int dir_fd, const std::vector<WalkEntry>& files) {
+        OperationResult part = make_result();
+        for (size_t i = 0; i < files.size(); ++i) {
+            apply_attributes(dir_fd, files[i].name.c_str(), walk_path(dir, files[i].name), files[i].st, change, part);
+        }
+        merge(part);
+    }
+
+private:
+    const AttributeChange& change;
+};
+
+OperationResult change_attributes(const std::string& path, const AttributeChange& change) {
+    PROFILE_SCOPE("attributes");
+    OperationResult result = make_result();
+    struct stat st;
+    if (!lstat_path(path, st)) {
+        fail_errno(result, path, errno);
+        return result;
+    }
+    if (!change.recursive || !S_ISDIR(st.st_mode)) {
+        apply_attributes(AT_FDCWD, path.c_str(), path, st, change, result);
+        return result;
+    }
+    // Корень меняется до обхода, остальное - относительно дескрипторов родителей
+    apply_attributes(AT_FDCWD, path.c_str(), path, st, change, result);
+    AttributeVisitor visitor(change);
+    walk_tree(path, WalkOptions(), visitor);
+    merge_result(result, visitor.result);
+    return result;
+}
@@ -0,0 +1,143 @@
+#ifndef FILE_ENGINE_H
+#define FILE_ENGINE_H
+
+#include <atomic>
+#include <cstdint>
+#include <ctime>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "hash.h"
+#include "tree_walker.h"
+
+// Что делать, если целевой файл или каталог уже существует
+enum OverwritePolicy {
+    OVERWRITE_FAIL,     // считать операцию неуспешной
+    OVERWRITE_SKIP,     // оставить существующий ресурс как есть
+    OVERWRITE_REPLACE   // заменить существующий ресурс (каталоги объединяются)
+};
+
+// Итог файловой операции: число обработанных файлов, байтов и первая ошибка
+struct OperationResult {
+    bool ok;
+    uint64_t files;
+    uint64_t bytes;
+    uint64_t skipped;
+    std::string error;
+};
+
+class CopyJournal;
+
+// Предварительный план копирования: объем источника по одному параллельному обходу и место
+// в файловой системе цели. Файл с несколькими жесткими ссылками внутри источника учитывается
+// один раз, а при копировании по плану его остальные имена становятся жесткими ссылками на
+// первую копию, а не отдельными копиями данных
+struct CopyPlan {
+    CopyPlan() : files(0), directories(0), bytes(0), required_bytes(0), reused_bytes(0), hardlinks(0),
+                 available_bytes(0), space_known(false), unreadable(0) {}
+
+    uint64_t files;           // Все элементы, кроме каталогов, включая повторные жесткие ссылки
+    uint64_t directories;
+    uint64_t bytes;           // Данные обычных файлов без повторов
+    uint64_t required_bytes;  // Те же данные и каталоги, округленные до блоков файловой системы цели,
+                              // за вычетом места, которое уже занимают их копии в цели
+    uint64_t reused_bytes;    // Место копий в цели, которое будет перезаписано или докопировано
+    uint64_t hardlinks;       // Имена, которые будут созданы жесткими ссылками
+    uint64_t available_bytes; // Свободно для непривилегированного пользователя по statvfs
+    bool space_known;
+    uint64_t unreadable;      // Элементы источника, которые не удалось прочитать при обходе
+    // Повторное имя файла в источнике -> первое встреченное имя того же inode
+    std::unordered_map<std::string, std::string> links;
+};
+
+// Ход копирования, общий для потока копирования и интерфейса
+struct CopyProgress {
+    CopyProgress() : copied_files(0), copied_bytes(0) {}
+
+    std::atomic<uint64_t> copied_files;
+    std::atomic<uint64_t> copied_bytes;
+};
+
+// Дополнительные параметры копирования
+struct CopyOptions {
+    CopyOptions() : verify(false), verify_algorithm(HASH_CRC32C), journal(nullptr), plan(nullptr), progress(nullptr) {}
+
+    // Сверять копию с источником: сумма источника считается по ходу записи,
+    // цель перечитывается мимо кеша страниц после fdatasync
+    bool verify;
+    HashAlgorithm verify_algorithm;
+    // Журнал для продолжения прерванного копирования: скопированные по журналу файлы
+    // пропускаются, начатые докопируются с последнего сохраненного смещения
+    CopyJournal* journal;
+    // План, по которому повторные жесткие ссылки воссоздаются ссылками; без плана каждое имя
+    // копируется отдельным файлом
+    const CopyPlan* plan;
+    CopyProgress* progress;
+};
+
+// Изменение прав в записи chmod: восьмеричное число или символьные условия вида u+x,go-w,a=rX
+struct ModeChange {
+    ModeChange() : absolute(false), mode(0) {}
+
+    struct Clause {
+        mode_t who;         // Биты, к которым относится условие (u, g, o, a)
+        bool masked;        // Кому не указано: биты, закрытые umask, не выставляются
+        char op;            // '+', '-' или '='
+        mode_t perms;
+        bool conditional_x; // X: выполнение только каталогам и уже исполняемым файлам
+    };
+
+    bool absolute;
+    mode_t mode;
+    std::vector<Clause> clauses;
+};
+
+// Изменение атрибутов. Поля, которые не нужно менять, выключены: uid и gid равны -1
+struct AttributeChange {
+    AttributeChange()
+        : change_mode(false), uid(static_cast<uid_t>(-1)), gid(static_cast<gid_t>(-1)), touch(false), recursive(true) {
+        time.tv_sec = 0;
+        time.tv_nsec = 0;
+    }
+
+    bool change_mode;
+    ModeChange mode;
+    uid_t uid;
+    gid_t gid;
+    bool touch;            // Выставить время доступа и изменения равным time
+    struct timespec time;
+    bool recursive;        // Для каталога менять и все его содержимое
+};
+
+bool parse_overwrite_policy(const std::string& name, OverwritePolicy& policy);
+bool parse_mode_change(const std::string& spec, ModeChange& change);
+mode_t apply_mode_change(const ModeChange& change, mode_t mode, bool is_dir);
+// Владелец в записи chown: ПОЛЬЗОВАТЕЛЬ[:ГРУППА] или :ГРУППА, имена или числа
+bool parse_owner(const std::string& spec, uid_t& uid, gid_t& gid);
+
+// Файловые операции без интерфейса: не спрашивают пользователя и не используют ncurses,
+// поэтому вызываются и из панелей, и из пакетного режима. Пути к целям указываются полностью
+// Обходит источник и проверяет место для копии source в target. Неуспешен, если не читается
+// корень источника или копия заведомо не помещается; план при этом все равно заполнен.
+// Нечитаемые элементы внутри источника только подсчитываются в плане.
+// С политикой замены (так идет и продолжение по журналу) место, которое уже занимают в цели
+// копии файлов, считается свободным
+OperationResult plan_copy(const std::string& source, const std::string& target, CopyPlan& plan,
+                          OverwritePolicy policy = OVERWRITE_FAIL);
+// С планом в options копирование не начинается, если план показал нехватку места
+OperationResult copy_path(const std::string& source, const std::string& target, OverwritePolicy policy,
+                          const CopyOptions& options = CopyOptions());
+OperationResult move_path(const std::string& source, const std::string& target, OverwritePolicy policy);
+OperationResult delete_path(const std::string& path);
+OperationResult make_file(const std::string& path, OverwritePolicy policy);
+OperationResult make_directory(const std::string& path, OverwritePolicy policy);
+// Обход для du и find настраивается: по умолчанию он не идет по символическим ссылкам
+// и пересекает границы файловых систем
+OperationResult disk_usage(const std::string& path, const WalkOptions& options = WalkOptions());
+OperationResult find_paths(const std::string& root, const std::string& pattern, std::vector<std::string>& matches,
+                           const WalkOptions& options = WalkOptions());
+// Меняет права, владельца и время, как chmod -R, chown -R и touch, за один параллельный обход.
+// Элементы, у которых атрибуты уже такие, как нужно, не трогаются и считаются пропущенными
+OperationResult change_attributes(const std::string& path, const AttributeChange& change);
+
+#endif // FILE_ENGINE_H
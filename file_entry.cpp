@@ -0,0 +1,276 @@
+#include "file_entry.h"
+#include <algorithm>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "profiler.h"
+#include "worker_pool.h"
+#include "io_ring.h"
+#include "io_scheduler.h"
+#include <atomic>
+
+// Сколько записей обрабатывает одна задача при полном запросе метаданных
+#define STAT_BATCH_SIZE 256
+
+// Возвращает название режима сортировки для заголовка панели
+const char* sort_mode_name(SortMode mode) {
+    switch (mode) {
+        case SORT_NAME:
+            return "name";
+        case SORT_SIZE:
+            return "size";
+        case SORT_MTIME:
+            return "date";
+        default:
+            return "none";
+    }
+}
+
+// Номера пулов имен; 0 означает, что пула нет
+static std::atomic<uint64_t> name_pool_counter(0);
+
+EntryList::EntryList() : id(0) {}
+
+size_t EntryList::find(const std::string& name) const {
+    for (size_t i = 0; i < entries.size(); ++i) {
+        if (name == this->name(i)) {
+            return i;
+        }
+    }
+    return entries.size();
+}
+
+FileEntry EntryList::append_name(const char* name, size_t length) {
+    // В общий пул дописывать нельзя: копия списка увидела бы чужие имена по своим смещениям
+    if (!names || names.use_count() > 1) {
+        std::shared_ptr<NamePool> own = names ? std::make_shared<NamePool>(*names) : std::make_shared<NamePool>();
+        names.swap(own);
+        id = ++name_pool_counter;
+    }
+    FileEntry entry;
+    entry.size = 0;
+    entry.mtime = 0;
+    entry.name_offset = static_cast<uint32_t>(names->size());
+    entry.mode = 0;
+    entry.has_info = false;
+    entry.info_valid = false;
+    entry.type = 0;
+    names->insert(names->end(), name, name + length);
+    names->push_back('\0');
+    return entry;
+}
+
+void EntryList::push_back(const char* name, size_t length) {
+    entries.push_back(append_name(name, length));
+}
+
+void EntryList::push_front(const char* name, size_t length) {
+    entries.insert(entries.begin(), append_name(name, length));
+}
+
+void EntryList::clear() {
+    entries.clear();
+    if (names && names.use_count() == 1) {
+        // Свой пул переиспользуется, но под новым номером: старые смещения больше не действительны
+        names->clear();
+        id = ++name_pool_counter;
+    } else {
+        names.reset();
+        id = 0;
+    }
+}
+
+void EntryList::release() {
+    std::vector<FileEntry>().swap(entries);
+    names.reset();
+    id = 0;
+}
+
+void EntryList::swap(EntryList& other) {
+    entries.swap(other.entries);
+    names.swap(other.names);
+    std::swap(id, other.id);
+}
+
+size_t EntryList::memory_usage() const {
+    return entries.capacity() * sizeof(FileEntry) + (names ? names->capacity() : 0);
+}
+
+// Переводит время модификации из struct stat в наносекунды
+int64_t stat_mtime_ns(const struct stat& st) {
+    return static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+}
+
+static void set_entry_info(FileEntry& entry, bool valid, const struct stat& st) {
+    entry.has_info = true;
+    entry.info_valid = valid;
+    if (valid) {
+        entry.size = st.st_size;
+        entry.mtime = st.st_mtime;
+        entry.mode = static_cast<uint16_t>(st.st_mode);
+    }
+}
+
+// Заполняет метаданные записи через stat относительно открытого каталога:
+// ядру не нужно заново разбирать весь путь. Ссылки не разыменовываются, иначе панель
+// не смогла бы отличить их от файлов и каталогов, на которые они указывают
+void fill_entry_info_at(int dir_fd, const char* name, FileEntry& entry) {
+    struct stat st;
+    PROFILE_COUNT(COUNTER_STAT, 1);
+    bool valid = dir_fd >= 0 && fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0;
+    set_entry_info(entry, valid, st);
+}
+
+// Заполняет метаданные группы записей. При доступном io_uring запросы statx уходят
+// пачками по глубине очереди кольца, иначе выполняется fstatat для каждой записи
+void fill_entries_info_at(int dir_fd, const char* name_pool, FileEntry* const* entries, size_t count) {
+    IoRing* ring = thread_io_ring();
+    size_t done = 0;
+    if (ring != nullptr && dir_fd >= 0) {
+        std::vector<struct statx> buffers;
+        std::vector<IoCompletion> completions;
+        while (done < count) {
+            size_t batch = std::min(count - done, static_cast<size_t>(ring->space()));
+            buffers.resize(batch);
+            for (size_t i = 0; i < batch; ++i) {
+                ring->prep_statx(dir_fd, name_pool + entries[done + i]->name_offset, AT_SYMLINK_NOFOLLOW, STATX_TYPE | STATX_MODE | STATX_SIZE | STATX_MTIME,
+                                 &buffers[i], i);
+            }
+            if (!ring->submit_and_wait(completions)) {
+                break;
+            }
+            PROFILE_COUNT(COUNTER_STAT, batch);
+            for (size_t i = 0; i < completions.size(); ++i) {
+                FileEntry& entry = *entries[done + completions[i].user_data];
+                const struct statx& stx = buffers[completions[i].user_data];
+                entry.has_info = true;
+                entry.info_valid = completions[i].result == 0;
+                if (entry.info_valid) {
+                    entry.size = stx.stx_size;
+                    entry.mtime = stx.stx_mtime.tv_sec;
+                    entry.mode = stx.stx_mode;
+                }
+            }
+            done += batch;
+        }
+    }
+    for (size_t i = done; i < count; ++i) {
+        fill_entry_info_at(dir_fd, name_pool + entries[i]->name_offset, *entries[i]);
+    }
+}
+
+// Заполняет метаданные всех записей, распределяя stat по пулу ввода-вывода
+void fill_entries_info(const std::string& dir, EntryList& entries) {
+    PROFILE_SCOPE("stat_all");
+    int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    io_pool().parallel_for(entries.size(), STAT_BATCH_SIZE, [&entries, dir_fd](size_t begin, size_t end) {
+        std::vector<FileEntry*> batch;
+        for (size_t i = begin; i < end; ++i) {
+            batch.push_back(&entries[i]);
+        }
+        fill_entries_info_at(dir_fd, entries.name_pool(), &batch[0], batch.size());
+    });
+    if (dir_fd >= 0) {
+        close(dir_fd);
+    }
+}
+
+// Сортирует записи согласно режиму, оставляя ".." первым элементом
+void sort_entries(EntryList& entries, SortMode mode) {
+    if (mode == SORT_NONE || entries.empty()) {
+        return;
+    }
+
+    std::vector<FileEntry>::iterator begin = entries.begin();
+    if (strcmp(entries.name(0), "..") == 0) {
+        ++begin;
+    }
+
+    // Сортируются записи фиксированного размера, имена в пуле остаются на месте
+    const char* names = entries.name_pool();
+    switch (mode) {
+        case SORT_NAME:
+            std::stable_sort(begin, entries.end(), [names](const FileEntry& a, const FileEntry& b) {
+                return strcmp(names + a.name_offset, names + b.name_offset) < 0;
+            });
+            break;
+        case SORT_SIZE:
+            // Самые большие файлы выводим первыми
+            std::stable_sort(begin, entries.end(), [](const FileEntry& a, const FileEntry& b) {
+                return a.size > b.size;
+            });
+            break;
+        case SORT_MTIME:
+            // Самые новые файлы выводим первыми
+            std::stable_sort(begin, entries.end(), [](const FileEntry& a, const FileEntry& b) {
+                return a.mtime > b.mtime;
+            });
+            break;
+        default:
+            break;
+    }
+}
+
+// Считывает содержимое каталога с учетом фильтра и режима сортировки
+bool read_directory(const std::string& path, SortMode sort_mode, const std::string& filter,
+                    EntryList& entries, int64_t& mtime_ns) {
+    PROFILE_SCOPE("list_directory");
+    uint64_t start_ns = profiler_now_ns();
+
+    // Запоминаем время модификации каталога, по нему потом проверяется актуальность кеша
+    struct stat dir_st;
+    PROFILE_COUNT(COUNTER_STAT, 1);
+    if (stat(path.c_str(), &dir_st) != 0) {
+        return false;
+    }
+    mtime_ns = stat_mtime_ns(dir_st);
+
+    // Открываем каталог
+    PROFILE_COUNT(COUNTER_OPENDIR, 1);
+    DIR* dir = opendir(path.c_str());
+    // Если не удалось открыть каталог, выходим из функции
+    if (!dir) {
+        return false;
+    }
+
+    // Читаем содержимое каталога по одному элементу за раз
+    dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        PROFILE_COUNT(COUNTER_READDIR, 1);
+        // Элемент "." не показываем
+        if (strcmp(entry->d_name, ".") == 0) {
+            continue;
+        }
+
+        bool is_parent = strcmp(entry->d_name, "..") == 0;
+        // Если задан фильтр, оставляем только имена, содержащие подстроку фильтра
+        if (!is_parent && !filter.empty() && strstr(entry->d_name, filter.c_str()) == nullptr) {
+            continue;
+        }
+
+        // Если элемент является "..", добавляем его в начало списка
+        if (is_parent) {
+            entries.push_front(entry->d_name, 2);
+        } else {
+            entries.push_back(entry->d_name, strlen(entry->d_name));
+        }
+    }
+
+    // Закрываем каталог
+    closedir(dir);
+    // Время чтения каталога для интерфейса - мера его отзывчивости: по нему планировщик
+    // ввода-вывода замедляет фоновые задания. Чтение внутри самого задания не учитывается
+    if (!in_io_job()) {
+        io_scheduler().record_listing(profiler_now_ns() - start_ns, entries.size());
+    }
+
+    // Для сортировки по размеру или времени нужны метаданные всех записей,
+    // в остальных режимах они запрашиваются позже только для видимых строк
+    if (sort_mode == SORT_SIZE || sort_mode == SORT_MTIME) {
+        fill_entries_info(path, entries);
+    }
+    sort_entries(entries, sort_mode);
+    return true;
+}
@@ -0,0 +1,109 @@
+#ifndef FILE_ENTRY_H
+#define FILE_ENTRY_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+#include <memory>
+#include <ctime>
+#include <sys/types.h>
+#include <sys/stat.h>
+
+// Режимы сортировки содержимого панели
+enum SortMode {
+    SORT_NONE = 0, // Порядок, в котором записи вернул readdir
+    SORT_NAME,
+    SORT_SIZE,
+    SORT_MTIME,
+    SORT_MODE_COUNT
+};
+
+// Запись каталога: метаданные фиксированного размера без указателей. Имя хранится
+// в пуле имен списка EntryList и доступно через него по смещению
+struct FileEntry {
+    off_t size;
+    time_t mtime;
+    uint32_t name_offset; // Смещение имени, завершенного нулем, в пуле имен списка
+    uint16_t mode;        // Тип и права помещаются в 16 бит, и запись занимает 24 байта
+    bool has_info : 1;   // Метаданные уже запрашивались
+    bool info_valid : 1; // stat завершился успешно
+    uint8_t type;        // FileType содержимого обычного файла, FILE_TYPE_NONE - еще не определялся
+};
+
+// Список записей каталога. Записи лежат одним массивом, имена - подряд в одном буфере,
+// поэтому на запись не приходится отдельных выделений памяти. Пул имен общий у копий
+// списка (копия вкладки, снимок сеанса) и копируется, только если в копию добавляют имена
+class EntryList {
+public:
+    typedef std::vector<char> NamePool;
+
+    EntryList();
+
+    size_t size() const {
+        return entries.size();
+    }
+    bool empty() const {
+        return entries.empty();
+    }
+    FileEntry& operator[](size_t index) {
+        return entries[index];
+    }
+    const FileEntry& operator[](size_t index) const {
+        return entries[index];
+    }
+    std::vector<FileEntry>::iterator begin() {
+        return entries.begin();
+    }
+    std::vector<FileEntry>::iterator end() {
+        return entries.end();
+    }
+    const char* name(size_t index) const {
+        return &(*names)[entries[index].name_offset];
+    }
+    const char* name_of(const FileEntry& entry) const {
+        return &(*names)[entry.name_offset];
+    }
+    // Начало пула имен, к которому прибавляются смещения name_offset
+    const char* name_pool() const {
+        return names ? names->data() : nullptr;
+    }
+    // Пул имен для задач, которые читают имена, пока список может быть заменен
+    std::shared_ptr<const NamePool> shared_names() const {
+        return names;
+    }
+    // Номер пула имен: пара (номер, смещение) однозначно определяет имя
+    uint64_t names_id() const {
+        return id;
+    }
+    // Индекс записи с таким именем или size(), если ее нет
+    size_t find(const std::string& name) const;
+
+    // Добавляет запись с еще не запрошенными метаданными
+    void push_back(const char* name, size_t length);
+    void push_front(const char* name, size_t length);
+    void clear();
+    // Очищает список и возвращает занятую им память
+    void release();
+    void swap(EntryList& other);
+    // Оценка занятой памяти; общий с другими копиями пул учитывается полностью
+    size_t memory_usage() const;
+
+private:
+    FileEntry append_name(const char* name, size_t length);
+
+    std::vector<FileEntry> entries;
+    std::shared_ptr<NamePool> names;
+    uint64_t id;
+};
+
+const char* sort_mode_name(SortMode mode);
+int64_t stat_mtime_ns(const struct stat& st);
+void fill_entry_info_at(int dir_fd, const char* name, FileEntry& entry);
+// Имена записей берутся по смещениям из пула name_pool
+void fill_entries_info_at(int dir_fd, const char* name_pool, FileEntry* const* entries, size_t count);
+void fill_entries_info(const std::string& dir, EntryList& entries);
+void sort_entries(EntryList& entries, SortMode mode);
+bool read_directory(const std::string& path, SortMode sort_mode, const std::string& filter,
+                    EntryList& entries, int64_t& mtime_ns);
+
+#endif // FILE_ENTRY_H
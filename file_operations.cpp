@@ -1,24 +1,25 @@
 #include "file_operations.h"
 #include "input_window.h"
+#include "file_engine.h"
+#include "profiler.h"
 #include <iostream>
 #include <string>
 #include <experimental/filesystem>
-#include <fstream>
 
 namespace fs = std::experimental::filesystem;
 
 // Функция для создания файла
 void create_file(const std::string &path) {
+    // Без конфликта с существующим ресурсом создаем файл, не спрашивая пользователя
+    OverwritePolicy policy = OVERWRITE_FAIL;
     // Проверяем, существует ли ресурс с таким же именем
-    if (fs::exists(path)) {
+    if (fs::exists(fs::symlink_status(path))) {
         // Если ресурс является каталогом, запрашиваем у пользователя разрешение на удаление
-        if (fs::is_directory(path)) {
+        if (fs::is_directory(fs::symlink_status(path))) {
             InputWindow input_window(120, 8);
             std::string message = "Resourse with the same name exists. Delete it? (y/n)";
             std::string response = input_window.show(message);
-            if (response == "y" || response == "Y") {
-                fs::remove_all(path);
-            } else {
+            if (response != "y" && response != "Y") {
                 return;
             }
         }
@@ -31,33 +32,44 @@ void create_file(const std::string &path) {
                 return;
             }
         }
+        policy = OVERWRITE_REPLACE;
     }
 
     // Создаем файл
-    std::ofstream file(path, std::ios::trunc);
+    OperationResult result = make_file(path, policy);
     // Если не удалось создать файл, выводим сообщение об ошибке
-    if (!file) {
-        printw("Error: Unable to create resourse.\n");
+    if (!result.ok) {
+        printw("Error: Unable to create resourse: %s\n", result.error.c_str());
         refresh();
     }
 }
 
 // Функция для создания каталога
 void create_directory(const std::string &path) {
+    OverwritePolicy policy = OVERWRITE_FAIL;
     // Проверяем, существует ли ресурс с таким же именем
-    if (fs::exists(path)) {
+    if (fs::exists(fs::symlink_status(path))) {
         // Если ресурс существует, запрашиваем у пользователя разрешение на перезапись
         InputWindow input_window(120, 8);
         std::string message = "Resourse already exists. Overwrite? (y/n)";
         std::string response = input_window.show(message);
-        if (response == "y" || response == "Y") {
-            // Если пользователь разрешил перезапись, удаляем существующий ресурс и создаем новый каталог
-            std::string command = "rm -r '" + path + "' && mkdir '" + path + "'";
-            system(command.c_str());
+        if (response != "y" && response != "Y") {
+            return;
         }
-    } else {
-        // Если ресурс не существует, создаем новый каталог
-        std::string command = "mkdir '" + path + "'";
-        system(command.c_str());
+        // Если пользователь разрешил перезапись, существующий ресурс удаляется перед созданием каталога
+        policy = OVERWRITE_REPLACE;
+    }
+
+    OperationResult result = make_directory(path, policy);
+    if (!result.ok) {
+        printw("Error: Unable to create directory: %s\n", result.error.c_str());
+        refresh();
     }
 }
+
+// Функция для выполнения команды оболочки с учетом в статистике профилировщика
+int run_command(const std::string &command) {
+    PROFILE_SCOPE("system");
+    PROFILE_COUNT(COUNTER_SUBPROCESS, 1);
+    return system(command.c_str());
+}
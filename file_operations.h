@@ -6,5 +6,6 @@
 
 void create_file(const std::string &path);
 void create_directory(const std::string &path);
+int run_command(const std::string &command);
 
 #endif // FILE_OPERATIONS_H
@@ -1,5 +1,6 @@
 #include "file_panel.h"
 #include <algorithm>
+#include <cerrno>
 #include <cstring>
 #include <dirent.h>
 #include <limits.h>
@@ -9,11 +10,44 @@
 #include <fcntl.h>
 #include "input_window.h"
 #include <ctime>
-
-#define MAX_TABS 10
+#include <chrono>
+#include <sys/inotify.h>
+#include <grp.h>
+#include <pwd.h>
+#include "frecency.h"
+#include "file_operations.h"
+#include "file_engine.h"
+#include "copy_journal.h"
+#include "profiler.h"
+#include "io_scheduler.h"
+#include "worker_pool.h"
+#include "preview.h"
+#include "file_type.h"
+
+// Объем памяти по умолчанию, который могут занимать кеши неактивных вкладок
+#define DEFAULT_TAB_CACHE_BUDGET (64u * 1024 * 1024)
+
+// Глубина истории переходов панели и число каталогов, для которых запоминается позиция курсора
+#define MAX_HISTORY 256
+#define MAX_POSITIONS 512
+
+// События inotify, после которых кеш вкладки считается устаревшим
+#define TAB_WATCH_MASK (IN_CREATE | IN_DELETE | IN_MOVED_FROM | IN_MOVED_TO | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE_SELF | IN_MOVE_SELF)
+
+// На сколько страниц вперед по направлению прокрутки запрашиваются метаданные
+// и сколько записей обрабатывает одна задача пула ввода-вывода
+#define METADATA_PREFETCH_PAGES 2
+#define METADATA_BATCH_SIZE 32
 
 CopiedFile copied_file_or_directory;
 
+// Каталог существует и его содержимое можно прочитать
+static bool is_readable_directory(const std::string& path) {
+    struct stat st;
+    return !path.empty() && path.size() < PATH_MAX && stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode) &&
+           access(path.c_str(), R_OK | X_OK) == 0;
+}
+
 int FilePanel::get_selected_file_index() const {
     return selected_file;
 }
@@ -28,31 +62,172 @@ std::string FilePanel::get_current_dir() const {
 
 std::string FilePanel::get_selected_file() const {
     if (selected_file >= 0 && selected_file < static_cast<int>(files.size())) {
-        return files[selected_file];
+        return files.name(selected_file);
     }
     return "";
 }
 
+const FileEntry* FilePanel::get_selected_entry() const {
+    if (selected_file >= 0 && selected_file < static_cast<int>(files.size())) {
+        return &files[selected_file];
+    }
+    return nullptr;
+}
+
+bool FilePanel::select_file(const std::string& name) {
+    // Ставим курсор на файл с заданным именем, если он есть в списке
+    size_t index = files.find(name);
+    if (index == files.size()) {
+        return false;
+    }
+    selected_file = static_cast<int>(index);
+    clamp_scroll();
+    return true;
+}
+
 FilePanel::FilePanel(int start_y, int start_x, int height, int width)
-        : y(start_y), x(start_x), h(height), w(width), selected(false), scroll_position(0), max_scroll_position(0) {
+        : y(start_y), x(start_x), h(height), w(width), selected(false), priority(PRIORITY_NORMAL), current_tab_index(0), inotify_fd(-1),
+          tab_clock(0), tab_cache_budget(DEFAULT_TAB_CACHE_BUDGET), scroll_position(0), max_scroll_position(0),
+          sort_mode(SORT_NONE), dir_mtime_ns(0), listing_generation(0),
+          metadata_inbox(std::make_shared<MetadataInbox>()), metadata_generation(0), scroll_direction(1),
+          history_index(0), position_clock(0), layout(compute_column_layout(width)), tree_scroll(0), pack_percent(-1) {
     win = newwin(h, w, y, x);
     selected_file = 0;
     getcwd(current_dir_cstr, PATH_MAX);
     current_dir = current_dir_cstr;
-    current_tab_index = 0;
 
     init_pair(1, COLOR_WHITE, COLOR_BLACK); // Цвет для файлов
     init_pair(2, COLOR_CYAN, COLOR_BLACK); // Цвет для директорий
     init_pair(3, COLOR_YELLOW, COLOR_BLACK); // Цвет для символических ссылок
     init_pair(4, COLOR_WHITE, COLOR_BLACK); // Новая цветовая пара с более темным фоном
+    init_pair(6, COLOR_MAGENTA, COLOR_BLACK); // Изображения, звук и видео
+    init_pair(7, COLOR_RED, COLOR_BLACK); // Архивы
+    init_pair(8, COLOR_GREEN, COLOR_BLACK); // Исполняемые файлы
+    init_pair(9, COLOR_BLUE, COLOR_BLACK); // PDF и документы
     list_directory();
+    max_scroll_position = std::max(0, static_cast<int>(files.size()) - h + 5);
+    init_tabs();
+    history.push_back(current_dir);
+    frecency_db.add_visit(current_dir);
+}
+
+FilePanel::FilePanel(int start_y, int start_x, int height, int width, const PanelState& state)
+        : y(start_y), x(start_x), h(height), w(width), selected(false), priority(PRIORITY_NORMAL), current_tab_index(0), inotify_fd(-1),
+          tab_clock(0), tab_cache_budget(DEFAULT_TAB_CACHE_BUDGET), scroll_position(0), max_scroll_position(0),
+          sort_mode(SORT_NONE), dir_mtime_ns(0), listing_generation(0),
+          metadata_inbox(std::make_shared<MetadataInbox>()), metadata_generation(0), scroll_direction(1),
+          history_index(0), position_clock(0), layout(compute_column_layout(width)), tree_scroll(0), pack_percent(-1) {
+    win = newwin(h, w, y, x);
+    selected_file = 0;
+
+    init_pair(1, COLOR_WHITE, COLOR_BLACK); // Цвет для файлов
+    init_pair(2, COLOR_CYAN, COLOR_BLACK); // Цвет для директорий
+    init_pair(3, COLOR_YELLOW, COLOR_BLACK); // Цвет для символических ссылок
+    init_pair(4, COLOR_WHITE, COLOR_BLACK); // Новая цветовая пара с более темным фоном
+    init_pair(6, COLOR_MAGENTA, COLOR_BLACK); // Изображения, звук и видео
+    init_pair(7, COLOR_RED, COLOR_BLACK); // Архивы
+    init_pair(8, COLOR_GREEN, COLOR_BLACK); // Исполняемые файлы
+    init_pair(9, COLOR_BLUE, COLOR_BLACK); // PDF и документы
+
+    // Восстанавливаем каталог из сеанса, а если он удален или недоступен, используем рабочий каталог.
+    // Снимок содержимого и позиция курсора относятся к сохраненному каталогу и тогда не нужны
+    bool restored = is_readable_directory(state.current_dir);
+    if (restored) {
+        current_dir = state.current_dir;
+    } else {
+        getcwd(current_dir_cstr, PATH_MAX);
+        current_dir = current_dir_cstr;
+    }
+    strcpy(current_dir_cstr, current_dir.c_str());
+
+    // Восстанавливаем режимы сортировки и фильтрации
+    if (state.sort_mode >= 0 && state.sort_mode < SORT_MODE_COUNT) {
+        sort_mode = static_cast<SortMode>(state.sort_mode);
+    }
+    filter = state.filter;
+
+    // Если есть снимок содержимого каталога, показываем его сразу, не обращаясь к диску,
+    // и проверяем актуальность в фоне. Иначе считываем каталог как обычно
+    if (restored && state.has_entries) {
+        files = state.entries;
+        reset_metadata();
+        dir_mtime_ns = state.dir_mtime_ns;
+        start_revalidation();
+    } else {
+        list_directory();
+    }
+
+    // Восстанавливаем позицию курсора и прокрутки в пределах списка
+    if (restored) {
+        selected_file = state.selected_file;
+        scroll_position = state.scroll_position;
+    }
+    clamp_scroll();
+    history.push_back(current_dir);
+    frecency_db.add_visit(current_dir);
+
+    // Восстанавливаем вкладки. Их содержимое не кешировано и будет прочитано при первом переключении
+    init_tabs();
+    if (state.current_tab_index >= 0 && state.current_tab_index < static_cast<int>(state.tabs.size())) {
+        tabs.clear();
+        for (size_t i = 0; i < state.tabs.size(); ++i) {
+            const TabState& saved = state.tabs[i];
+            Tab tab = make_tab();
+            tab.dir = saved.dir;
+            tab.selected_file = saved.selected_file;
+            tab.scroll_position = saved.scroll_position;
+            if (saved.sort_mode >= 0 && saved.sort_mode < SORT_MODE_COUNT) {
+                tab.sort_mode = static_cast<SortMode>(saved.sort_mode);
+            }
+            tab.filter = saved.filter;
+            tab.cached = false;
+            tabs.push_back(tab);
+        }
+        current_tab_index = state.current_tab_index;
+        tabs[current_tab_index].dir = current_dir;
+        watch_tab(tabs[current_tab_index]);
+    }
 }
 
 FilePanel::~FilePanel() {
+    // Незаконченный архив удаляется; деструктор future дождется завершения упаковки
+    cancel_pack();
+    if (inotify_fd >= 0) {
+        close(inotify_fd);
+    }
     delwin(win);
 }
 
+// Цветовая пара имени обычного файла по типу его содержимого
+static int file_type_color(uint8_t type) {
+    switch (type) {
+        case FILE_TYPE_IMAGE:
+        case FILE_TYPE_AUDIO:
+        case FILE_TYPE_VIDEO:
+            return 6;
+        case FILE_TYPE_ARCHIVE:
+            return 7;
+        case FILE_TYPE_EXECUTABLE:
+            return 8;
+        case FILE_TYPE_PDF:
+        case FILE_TYPE_DOCUMENT:
+            return 9;
+        default:
+            return 1;
+    }
+}
+
 void FilePanel::draw() {
+    if (watch.is_active()) {
+        draw_watch();
+        return;
+    }
+    if (tree.is_open()) {
+        draw_tree();
+        return;
+    }
+    PROFILE_SCOPE("draw");
+
      // Очищаем содержимое окна
     werase(win);
 
@@ -65,17 +240,33 @@ void FilePanel::draw() {
     // Выводим заголовок "File Manager" в центре верхней строки окна
     mvwprintw(win, 0, (w - 13) / 2, "File Manager");
 
+    // Временные строки кадра берутся из арены, которая переиспользует память прошлых кадров
+    frame_arena.reset();
+
     // Выводим текущий путь в первой строке окна
-    std::string current_dir_display = current_dir;
-    if (current_dir_display.back() == '/' && current_dir_display.size() > 1) {
-        current_dir_display.pop_back();
+    size_t dir_length = current_dir.size();
+    if (dir_length > 1 && current_dir[dir_length - 1] == '/') {
+        --dir_length;
+    }
+    // Длинный путь обрезается по ширине окна, иначе ncurses перенес бы его на строку заголовков
+    static const char path_label[] = "Current path: ";
+    size_t line_length = sizeof(path_label) - 1 + dir_length;
+    char* line = frame_arena.allocate(line_length);
+    memcpy(line, path_label, sizeof(path_label) - 1);
+    memcpy(line + sizeof(path_label) - 1, current_dir.data(), dir_length);
+    char* path_text = frame_arena.allocate(std::max(0, w - 2) + 1);
+    fit_column(line, line_length, w - 2, path_text);
+    mvwaddstr(win, 1, 1, path_text);
+
+    // Выводим заголовки колонок во второй строке окна по раскладке для текущей ширины
+    update_layout();
+    mvwprintw(win, 2, layout.name_x, "Filename");
+    if (layout.size_width > 0) {
+        mvwprintw(win, 2, layout.size_x + layout.size_width - 4, "Size");
+    }
+    if (layout.date_width > 0) {
+        mvwprintw(win, 2, layout.date_x, "Last Modified");
     }
-    mvwprintw(win, 1, 1, "Current path: %s", current_dir_display.c_str());
-
-    // Выводим заголовки колонок "Filename", "Size" и "Last Modified" во второй строке окна
-    mvwprintw(win, 2, 1, "Filename");
-    mvwprintw(win, 2, w / 3, "Size");
-    mvwprintw(win, 2, 2 * w / 3, "Last Modified");
 
     // Рисуем горизонтальную линию после заголовков
     mvwhline(win, 3, 1, ACS_HLINE, w - 2);
@@ -88,56 +279,262 @@ void FilePanel::draw() {
         int start_index = scroll_position;
         int end_index = std::min(scroll_position + h - 5, static_cast<int>(files.size()));
 
+        // Метаданные видимых строк и следующих страниц запрашиваются в фоне
+        request_metadata(start_index, end_index);
+
         // Отображаем файлы в соответствующих колонках
         for (int i = start_index; i < end_index; ++i) {
             // Если текущий файл является выбранным, устанавливаем атрибут A_REVERSE для выделения
             if (i == selected_file && selected)
                 wattron(win, A_REVERSE);
 
-            // Получаем информацию о файле
-            struct stat st;
-            std::string file_path = current_dir + "/" + files[i];
-            if (stat(file_path.c_str(), &st) == 0) {
-                // Получаем время последней модификации файла
-                time_t last_modified = st.st_mtime;
-                tm* time_info = localtime(&last_modified);
-
-                // Форматируем время в строку
-                char time_str[20];
-                strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M", time_info);
-
-                // Получаем размер файла
-                std::string size = std::to_string(st.st_size);
-
-                // Устанавливаем цвет текста в зависимости от типа файла
-                if (S_ISDIR(st.st_mode)) {
-                    wattron(win, COLOR_PAIR(2)); // Устанавливаем цвет для директорий
-                } else if (S_ISLNK(st.st_mode)) {
-                    wattron(win, COLOR_PAIR(3)); // Устанавливаем цвет для символических ссылок
-                } else {
-                    wattron(win, COLOR_PAIR(1)); // Устанавливаем цвет для файлов
-                }
+            // Отрисовка не обращается к диску: пока метаданные не получены, выводится только имя
+            const FileEntry& entry = files[i];
+            const CachedRow& row = format_row(i);
+            int row_y = i - scroll_position + 4;
 
-                // Выводим имя файла, размер и время последней модификации в соответствующих колонках
-                mvwprintw(win, i - scroll_position + 4, 1, "%s", files[i].c_str());
-                wattroff(win, COLOR_PAIR(2) | COLOR_PAIR(3)); // Сбрасываем цвет для директорий и символических ссылок
-                mvwprintw(win, i - scroll_position + 4, w / 3, "%s", size.c_str());
-                mvwprintw(win, i - scroll_position + 4, 2 * w / 3, "%s", time_str);
-
-                // Сбрасываем цвет фона
-                wattroff(win, COLOR_PAIR(1));
-            } else {
-                // Если не удалось получить информацию о файле, выводим только имя файла
-                mvwprintw(win, i - scroll_position + 4, 1, "%s", files[i].c_str());
+            // Устанавливаем цвет текста в зависимости от типа файла
+            int color = 0;
+            if (entry.info_valid) {
+                color = S_ISDIR(entry.mode) ? 2 : S_ISLNK(entry.mode) ? 3 : file_type_color(entry.type);
+            }
+            if (color != 0) {
+                wattron(win, COLOR_PAIR(color));
+            }
+            mvwaddstr(win, row_y, layout.name_x, row.name);
+            if (color > 1) {
+                wattroff(win, COLOR_PAIR(color)); // Размер и дата выводятся обычным цветом, цветом выделено только имя
             }
+            if (layout.size_width > 0) {
+                mvwaddstr(win, row_y, layout.size_x, row.size_text);
+            }
+            if (layout.date_width > 0) {
+                mvwaddstr(win, row_y, layout.date_x, row.date_text);
+            }
+            wattroff(win, COLOR_PAIR(1) | COLOR_PAIR(2) | COLOR_PAIR(3));
 
             // Сбрасываем атрибут A_REVERSE
             wattroff(win, A_REVERSE);
         }
     }
+
+    // Выводим режим сортировки и фильтр на нижней рамке окна
+    if (sort_mode != SORT_NONE || !filter.empty()) {
+        mvwprintw(win, h - 1, 2, " sort: %s  filter: %s ", sort_mode_name(sort_mode), filter.empty() ? "-" : filter.c_str());
+    }
+    draw_background_status();
+
+    // Помечаем окно для вывода на экран, сам вывод выполняется одним вызовом doupdate
+    wnoutrefresh(win);
+}
+
+void FilePanel::draw_watch() {
+    PROFILE_SCOPE("draw_watch");
+
+    werase(win);
+    wbkgd(win, COLOR_PAIR(4));
+    box(win, 0, 0);
+    mvwprintw(win, 0, (w - 7) / 2, "Watch");
+    frame_arena.reset();
+    int text_width = std::max(0, w - 2);
+    char* text = frame_arena.allocate(text_width + 1);
+    fit_column(current_dir.data(), current_dir.size(), text_width, text);
+    mvwaddstr(win, 1, 1, text);
+
+    // Скорость поступления и оценка числа файлов; размер выводится тем же форматом, что и в колонке
+    char byte_rate[8];
+    format_size_column(static_cast<off_t>(watch.get_byte_rate()), sizeof(byte_rate) - 1, byte_rate);
+    const char* byte_rate_text = byte_rate;
+    while (*byte_rate_text == ' ') {
+        ++byte_rate_text;
+    }
+    char* status = frame_arena.allocate(128);
+    long file_count = watch.get_file_count();
+    int length = file_count >= 0 ? snprintf(status, 128, "%ld files  ", file_count) : 0;
+    snprintf(status + length, 128 - length, "%.1f files/s  %s/s%s", watch.get_arrival_rate(), byte_rate_text,
+             watch.is_lost() ? "  directory gone" : watch.is_reconciling() ? "  reconciling" : "");
+    fit_column(status, strlen(status), text_width, text);
+    mvwaddstr(win, 2, 1, text);
+    mvwhline(win, 3, 1, ACS_HLINE, w - 2);
+
+    // Последние поступления, самые новые сверху
+    update_layout();
+    int rows = std::min(h - 5, static_cast<int>(watch.get_count()));
+    char* name = frame_arena.allocate(layout.name_width + 1);
+    char* size = frame_arena.allocate(layout.size_width + 1);
+    char* date = frame_arena.allocate(layout.date_width + 1);
+    for (int i = 0; i < rows; ++i) {
+        const WatchArrival& arrival = watch.get_arrival(i);
+        bool directory = S_ISDIR(arrival.mode);
+        fit_column(arrival.name, strlen(arrival.name), layout.name_width, name);
+        if (directory) {
+            wattron(win, COLOR_PAIR(2));
+        }
+        mvwaddstr(win, i + 4, layout.name_x, name);
+        wattroff(win, COLOR_PAIR(2));
+        if (arrival.has_info && layout.size_width > 0) {
+            format_size_column(arrival.size, layout.size_width, size);
+            mvwaddstr(win, i + 4, layout.size_x, size);
+        }
+        if (arrival.has_info && layout.date_width > 0) {
+            format_date_column(arrival.mtime, layout.date_width, date);
+            mvwaddstr(win, i + 4, layout.date_x, date);
+        }
+    }
+    if (watch.get_count() == 0) {
+        mvwprintw(win, h / 2, (w - 20) / 2, "Waiting for new files");
+    }
+    draw_background_status();
+
+    wnoutrefresh(win);
+}
+
+void FilePanel::draw_tree() {
+    PROFILE_SCOPE("draw_tree");
+
+    werase(win);
+    wbkgd(win, COLOR_PAIR(4));
+    box(win, 0, 0);
+    mvwprintw(win, 0, (w - 6) / 2, "Tree");
+    frame_arena.reset();
+    int text_width = std::max(0, w - 2);
+    char* text = frame_arena.allocate(text_width + 1);
+    std::string root = tree.row_path(0);
+    fit_column(root.data(), root.size(), text_width, text);
+    mvwaddstr(win, 1, 1, text);
+    char* status = frame_arena.allocate(128);
+    snprintf(status, 128, "%zu directories%s", tree.node_count(), tree.has_background_work() ? "  loading" : "");
+    fit_column(status, strlen(status), text_width, text);
+    mvwaddstr(win, 2, 1, text);
+    mvwhline(win, 3, 1, ACS_HLINE, w - 2);
+
+    // Курсор дерева должен оставаться в видимой области
+    int rows = std::max(1, h - 5);
+    int selected_row = static_cast<int>(tree.get_selected());
+    if (selected_row < tree_scroll) {
+        tree_scroll = selected_row;
+    } else if (selected_row >= tree_scroll + rows) {
+        tree_scroll = selected_row - rows + 1;
+    }
+    tree_scroll = std::max(0, std::min(tree_scroll, static_cast<int>(tree.row_count()) - rows));
+
+    // Строка: отступ по глубине, признак раскрытия и имя; у корня вместо имени полный путь
+    char* line = frame_arena.allocate(text_width + 1);
+    int end = std::min(tree_scroll + rows, static_cast<int>(tree.row_count()));
+    for (int i = tree_scroll; i < end; ++i) {
+        const TreeNode& node = tree.row_node(i);
+        int indent = std::min(static_cast<int>(node.depth) * 2, text_width / 2);
+        char marker = node.state == TREE_NODE_LOADING ? '*' : node.state == TREE_NODE_FAILED ? '!'
+                      : node.state != TREE_NODE_LOADED ? '+' : node.child_count == 0 ? ' ' : node.expanded ? '-' : '+';
+        int length = snprintf(line, text_width + 1, "%*s%c %.*s", indent, "", marker, static_cast<int>(node.name_length),
+                              tree.node_name(node));
+        fit_column(line, std::min(length, text_width), text_width, text);
+        if (i == selected_row && selected) {
+            wattron(win, A_REVERSE);
+        }
+        wattron(win, COLOR_PAIR(2));
+        mvwaddstr(win, i - tree_scroll + 4, 1, text);
+        wattroff(win, COLOR_PAIR(2) | A_REVERSE);
+    }
+    draw_background_status();
+
+    wnoutrefresh(win);
+}
+
+void FilePanel::update_layout() {
+    // Раскладка пересчитывается только при изменении ширины, кеш строк - и при изменении высоты
+    size_t rows = static_cast<size_t>(std::max(1, h - 5));
+    if (layout.width == w && row_cache.size() == rows) {
+        return;
+    }
+    layout = compute_column_layout(w);
+    // У каждой строки кеша по буферу на колонку с местом под завершающий ноль
+    size_t row_stride = layout.name_width + layout.size_width + layout.date_width + 3;
+    row_text.assign(rows * row_stride, '\0');
+    row_cache.assign(rows, CachedRow());
+    for (size_t i = 0; i < row_cache.size(); ++i) {
+        row_cache[i].index = -1;
+        row_cache[i].name = &row_text[i * row_stride];
+        row_cache[i].size_text = row_cache[i].name + layout.name_width + 1;
+        row_cache[i].date_text = row_cache[i].size_text + layout.size_width + 1;
+    }
+}
+
+const FilePanel::CachedRow& FilePanel::format_row(int index) {
+    const FileEntry& entry = files[index];
+    CachedRow& row = row_cache[index % row_cache.size()];
+    // Строка переформатируется, только если запись в этой позиции изменилась
+    if (row.index == index && row.has_info == entry.has_info && row.info_valid == entry.info_valid &&
+        row.size == entry.size && row.mtime == entry.mtime && row.mode == entry.mode &&
+        row.names_id == files.names_id() && row.name_offset == entry.name_offset) {
+        return row;
+    }
+    row.index = index;
+    row.names_id = files.names_id();
+    row.name_offset = entry.name_offset;
+    row.size = entry.size;
+    row.mtime = entry.mtime;
+    row.mode = entry.mode;
+    row.has_info = entry.has_info;
+    row.info_valid = entry.info_valid;
+    const char* name = files.name(index);
+    fit_column(name, strlen(name), layout.name_width, row.name);
+    if (entry.info_valid) {
+        format_size_column(entry.size, layout.size_width, row.size_text);
+        format_date_column(entry.mtime, layout.date_width, row.date_text);
+    } else {
+        // Пока метаданные не получены, в колонке размера выводится многоточие
+        fit_column("...", entry.has_info ? 0 : 3, layout.size_width, row.size_text);
+        row.date_text[0] = '\0';
+    }
+    return row;
+}
+
+void FilePanel::draw_preview(const std::string& path, const Preview* preview) {
+    PROFILE_SCOPE("draw_preview");
+
+    // Вместо списка файлов панель показывает предпросмотр выбранного в соседней панели
+    werase(win);
+    wbkgd(win, COLOR_PAIR(4));
+    box(win, 0, 0);
+    mvwprintw(win, 0, (w - 9) / 2, "Preview");
+    mvwprintw(win, 1, 1, "%.*s", std::max(0, w - 2), path.c_str());
+
+    if (preview == nullptr) {
+        // Загрузка идет в фоне, отрисовка ее не ждет
+        mvwprintw(win, 2, 1, "Loading...");
+    } else {
+        mvwprintw(win, 2, 1, "%.*s", std::max(0, w - 2), preview->summary.c_str());
+    }
+    mvwhline(win, 3, 1, ACS_HLINE, w - 2);
+
+    if (preview != nullptr) {
+        int rows = std::min(h - 5, static_cast<int>(preview->lines.size()));
+        for (int i = 0; i < rows; ++i) {
+            // Подкаталоги в списке каталога выделяются тем же цветом, что и в панели
+            const std::string& line = preview->lines[i];
+            bool directory = preview->kind == PREVIEW_DIRECTORY && !line.empty() && line[line.size() - 1] == '/';
+            if (directory) {
+                wattron(win, COLOR_PAIR(2));
+            }
+            mvwprintw(win, i + 4, 1, "%.*s", std::max(0, w - 2), line.c_str());
+            wattroff(win, COLOR_PAIR(2));
+        }
+    }
+
+    wnoutrefresh(win);
 }
 
 void FilePanel::update() {
+    // После операций раскрытые каталоги дерева сверяются с диском в фоне
+    if (tree.is_open()) {
+        tree.revalidate();
+    }
+
+    // Накопленные события inotify относятся к содержимому, которое сейчас будет перечитано
+    drain_watch_events();
+    tabs[current_tab_index].dirty = false;
+
     // Обновляем список файлов в текущем каталоге
     list_directory();
 
@@ -152,8 +549,17 @@ void FilePanel::update() {
 }
 
 void FilePanel::move_selection(int dir) {
+    if (tree.is_open()) {
+        // Курсор дерева ходит по кругу так же, как курсор списка
+        int count = static_cast<int>(tree.row_count());
+        tree.select(static_cast<size_t>(((static_cast<int>(tree.get_selected()) + dir) % count + count) % count));
+        draw();
+        return;
+    }
     // Изменяем индекс выделенного элемента на dir
     selected_file += dir;
+    // Направление прокрутки определяет, какие строки запрашивать заранее
+    scroll_direction = dir < 0 ? -1 : 1;
 
     // Если индекс выделенного элемента выходит за пределы списка файлов, переходим к первому или последнему элементу
     if (selected_file < 0)
@@ -173,6 +579,21 @@ void FilePanel::move_selection(int dir) {
 
 
 void FilePanel::change_directory(int dir) {
+    // В режиме дерева вправо раскрывает и сворачивает каталог, влево сворачивает его
+    // или переводит курсор к родителю
+    if (tree.is_open()) {
+        size_t row = tree.get_selected();
+        if (dir == 1 && !tree.row_node(row).expanded) {
+            tree.expand(row);
+        } else if (dir == 1 || tree.row_node(row).expanded) {
+            tree.collapse(row);
+        } else {
+            tree.select(tree.parent_row(row));
+        }
+        draw();
+        return;
+    }
+
     // Если список файлов пуст, выходим из функции
     if (files.empty()) {
         return;
@@ -195,59 +616,425 @@ void FilePanel::change_directory(int dir) {
     // Если dir равно 1, переходим в выбранный каталог
     else if (dir == 1) {
         // Если выбранный элемент выходит за пределы списка файлов или является "." или "..", выходим из функции
-        if (selected_file >= static_cast<int>(files.size()) || files[selected_file] == ".." || files[selected_file] == ".")
+        if (selected_file >= static_cast<int>(files.size()) || strcmp(files.name(selected_file), "..") == 0 ||
+            strcmp(files.name(selected_file), ".") == 0)
             return;
         // Иначе формируем путь к выбранному каталогу
         new_dir = current_dir;
         if (new_dir != "/") {
             new_dir += "/";
         }
-        new_dir += files[selected_file];
+        new_dir += files.name(selected_file);
     }
 
+    // Переходим в новый каталог, записывая переход в историю
+    navigate_to(new_dir, true);
+
+    // Выводим отладочную информацию
+    printw("Dir: %d, Selected file: %d, Current dir: %s, New dir: %s\n", dir, selected_file, current_dir.c_str(), new_dir.c_str());
+    refresh();
+}
+
+bool FilePanel::navigate_to(const std::string& new_dir, bool record_history) {
     // Проверяем, существует ли каталог по новому пути и является ли он директорией
     struct stat st;
-    if (stat(new_dir.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
-        // Если да, обновляем текущий каталог и перерисовываем содержимое окна
-        current_dir = new_dir;
-        strcpy(current_dir_cstr, current_dir.c_str());
-        update();
-    } else {
-        // Иначе выводим сообщение об ошибке
+    if (new_dir.size() >= PATH_MAX || stat(new_dir.c_str(), &st) != 0 || !S_ISDIR(st.st_mode)) {
+        // Если нет, выводим сообщение об ошибке
         printw("Error: cannot change directory to %s\n", new_dir.c_str());
         refresh();
+        return false;
     }
 
-    // Выводим отладочную информацию
-    printw("Dir: %d, Selected file: %d, Current dir: %s, New dir: %s\n", dir, selected_file, current_dir.c_str(), new_dir.c_str());
-    refresh();
+    // Запоминаем, где стоял курсор в покидаемом каталоге
+    remember_position();
+    std::string previous_dir = current_dir;
+
+    // Новый переход отбрасывает историю "вперед"
+    if (record_history) {
+        history.erase(history.begin() + history_index + 1, history.end());
+        history.push_back(new_dir);
+        if (history.size() > MAX_HISTORY) {
+            history.erase(history.begin());
+        }
+        history_index = history.size() - 1;
+    }
+
+    // Обновляем текущий каталог и перечитываем его содержимое
+    current_dir = new_dir;
+    strcpy(current_dir_cstr, current_dir.c_str());
+    // Текущая вкладка теперь наблюдает за новым каталогом
+    tabs[current_tab_index].dir = current_dir;
+    watch_tab(tabs[current_tab_index]);
+    update();
+
+    // Возвращаем курсор туда, где он был при прошлом посещении каталога
+    restore_position(previous_dir);
+    frecency_db.add_visit(current_dir);
+    return true;
+}
+
+void FilePanel::remember_position() {
+    DirPosition& position = positions[current_dir];
+    position.selected_name = get_selected_file();
+    position.scroll_position = scroll_position;
+    position.stamp = ++position_clock;
+
+    // Ограничиваем число запомненных позиций, забывая самую старую
+    if (positions.size() > MAX_POSITIONS) {
+        std::unordered_map<std::string, DirPosition>::iterator oldest = positions.begin();
+        for (std::unordered_map<std::string, DirPosition>::iterator it = positions.begin(); it != positions.end(); ++it) {
+            if (it->second.stamp < oldest->second.stamp) {
+                oldest = it;
+            }
+        }
+        positions.erase(oldest);
+    }
+}
+
+void FilePanel::restore_position(const std::string& previous_dir) {
+    selected_file = 0;
+    scroll_position = 0;
+
+    std::string selected_name;
+    std::unordered_map<std::string, DirPosition>::const_iterator it = positions.find(current_dir);
+    if (it != positions.end()) {
+        // Каталог уже посещался: восстанавливаем выделение и прокрутку
+        selected_name = it->second.selected_name;
+        scroll_position = it->second.scroll_position;
+    } else {
+        // Если мы поднялись из подкаталога, ставим курсор на него
+        std::string prefix = current_dir == "/" ? "/" : current_dir + "/";
+        if (previous_dir.size() > prefix.size() && previous_dir.compare(0, prefix.size(), prefix) == 0) {
+            size_t end = previous_dir.find('/', prefix.size());
+            selected_name = previous_dir.substr(prefix.size(), end == std::string::npos ? std::string::npos : end - prefix.size());
+        }
+    }
+
+    size_t index = selected_name.empty() ? files.size() : files.find(selected_name);
+    if (index < files.size()) {
+        selected_file = static_cast<int>(index);
+    }
+    clamp_scroll();
+}
+
+void FilePanel::clamp_scroll() {
+    // Приводим курсор и прокрутку к границам списка так, чтобы курсор был виден
+    max_scroll_position = std::max(0, static_cast<int>(files.size()) - h + 5);
+    selected_file = std::max(0, std::min(selected_file, static_cast<int>(files.size()) - 1));
+    scroll_position = std::max(0, std::min(scroll_position, max_scroll_position));
+    if (selected_file < scroll_position || selected_file >= scroll_position + h - 5) {
+        scroll_position = std::max(0, selected_file - h + 6);
+    }
+}
+
+void FilePanel::go_back() {
+    // Переходим к предыдущему каталогу в истории
+    while (history_index > 0) {
+        if (navigate_to(history[history_index - 1], false)) {
+            history_index--;
+            return;
+        }
+        // Каталог больше не существует, убираем его из истории
+        history.erase(history.begin() + history_index - 1);
+        history_index--;
+    }
+}
+
+void FilePanel::go_forward() {
+    // Переходим к следующему каталогу в истории
+    while (history_index + 1 < history.size()) {
+        if (navigate_to(history[history_index + 1], false)) {
+            history_index++;
+            return;
+        }
+        // Каталог больше не существует, убираем его из истории
+        history.erase(history.begin() + history_index + 1);
+    }
+}
+
+bool FilePanel::jump_to(const std::string& dir) {
+    // Если каталог исчез, убираем его из базы посещений
+    if (!navigate_to(dir, true)) {
+        frecency_db.remove(dir);
+        return false;
+    }
+    return true;
+}
+
+bool FilePanel::go_to_path(const std::string& path) {
+    // Путь приводится к каноническому виду, чтобы в заголовке и истории не было ".." и "//"
+    char resolved[PATH_MAX];
+    struct stat st;
+    if (realpath(path.c_str(), resolved) == nullptr || stat(resolved, &st) != 0) {
+        printw("Error: cannot find %s: %s\n", path.c_str(), strerror(errno));
+        refresh();
+        return false;
+    }
+    std::string target = resolved;
+    if (S_ISDIR(st.st_mode)) {
+        return navigate_to(target, true);
+    }
+    size_t slash = target.rfind('/');
+    if (!navigate_to(slash == 0 ? "/" : target.substr(0, slash), true)) {
+        return false;
+    }
+    select_file(target.substr(slash + 1));
+    return true;
 }
 
 void FilePanel::list_directory() {
     // Очищаем список файлов
     files.clear();
 
-    // Открываем текущий каталог
-    DIR* dir = opendir(current_dir_cstr);
-    // Если не удалось открыть каталог, выходим из функции
-    if (!dir)
-        return;
+    // Результат незавершенной фоновой проверки после нового чтения уже не нужен
+    ++listing_generation;
+
+    // Считываем содержимое текущего каталога с учетом фильтра и сортировки
+    read_directory(current_dir, sort_mode, filter, files, dir_mtime_ns);
+    reset_metadata();
+}
+
+void FilePanel::start_revalidation() {
+    // Копируем параметры, чтобы фоновый поток не обращался к полям панели
+    std::string path = current_dir;
+    SortMode mode = sort_mode;
+    std::string name_filter = filter;
+    int64_t known_mtime_ns = dir_mtime_ns;
+    unsigned generation = ++listing_generation;
+
+    // Проверка идет в общем пуле с приоритетом панели, поэтому у панели в фокусе она начнется
+    // раньше, чем проверки остальных панелей
+    typedef std::packaged_task<Revalidation()> RevalidationTask;
+    std::shared_ptr<RevalidationTask> task = std::make_shared<RevalidationTask>([path, mode, name_filter, known_mtime_ns, generation]() {
+        Revalidation result;
+        result.generation = generation;
+        result.changed = false;
+        result.ok = true;
+        result.mtime_ns = known_mtime_ns;
+
+        // Если время модификации каталога не изменилось, список имен в снимке актуален
+        struct stat st;
+        if (stat(path.c_str(), &st) == 0 && stat_mtime_ns(st) == known_mtime_ns) {
+            return result;
+        }
+
+        // Иначе перечитываем каталог целиком
+        result.changed = true;
+        result.ok = read_directory(path, mode, name_filter, result.entries, result.mtime_ns);
+        return result;
+    });
+    revalidation = task->get_future();
+    io_pool().submit([task]() { (*task)(); }, priority);
+}
+
+bool FilePanel::has_background_work() const {
+    // Наблюдаемый каталог меняется сам по себе, поэтому цикл ввода должен регулярно опрашивать панель
+    return revalidation.valid() || metadata_inbox->in_flight > 0 || watch.is_active() || pack_job.valid() ||
+           !operations.empty() || tree.has_background_work();
+}
+
+bool FilePanel::poll_background() {
+    bool changed = poll_metadata();
+    changed = poll_pack() || changed;
+    changed = poll_operations() || changed;
+    changed = tree.poll() || changed;
 
-    // Читаем содержимое каталога по одному элементу за раз
-    dirent* entry;
-    while ((entry = readdir(dir)) != nullptr) {
-        // Если элемент является "..", добавляем его в начало списка
-        if (strcmp(entry->d_name, "..") == 0) {
-            files.insert(files.begin(), entry->d_name);
+    // Наблюдение следует за панелью, если она перешла в другой каталог или вкладку
+    if (watch.is_active()) {
+        if (watch.get_dir() != current_dir) {
+            watch.start(current_dir);
         }
-        // Если элемент не является ".", добавляем его в конец списка
-        else if (strcmp(entry->d_name, ".") != 0) {
-            files.push_back(entry->d_name);
+        changed = watch.poll() || changed;
+    }
+
+    // Проверяем, завершилась ли фоновая проверка, не блокируя цикл обработки ввода
+    if (!revalidation.valid() || revalidation.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        return changed;
+    }
+
+    Revalidation result = revalidation.get();
+    // Если каталог с тех пор был перечитан, результат устарел
+    if (result.generation != listing_generation) {
+        return changed;
+    }
+
+    if (!result.changed) {
+        // Имена актуальны, но размеры и даты файлов могли измениться, поэтому видимые
+        // строки будут запрошены заново, а до ответа показываются прежние значения
+        for (size_t i = 0; i < files.size(); ++i) {
+            files[i].has_info = false;
         }
+        reset_metadata();
+        return true;
     }
 
-    // Закрываем каталог
-    closedir(dir);
+    // Каталог удален или стал недоступен: переходим к ближайшему доступному родителю,
+    // а если такого нет, в рабочий каталог, чтобы панель не застряла в пустом списке
+    if (!result.ok) {
+        std::string fallback = current_dir;
+        while (fallback != "/" && !is_readable_directory(fallback)) {
+            size_t slash = fallback.rfind('/');
+            fallback = slash == 0 || slash == std::string::npos ? "/" : fallback.substr(0, slash);
+        }
+        if (!is_readable_directory(fallback)) {
+            char cwd[PATH_MAX];
+            fallback = getcwd(cwd, PATH_MAX) != nullptr ? cwd : "/";
+        }
+        navigate_to(fallback, true);
+        return true;
+    }
+
+    // Подменяем список, сохраняя курсор на том же файле, если он еще существует
+    std::string selected_name = get_selected_file();
+    files.swap(result.entries);
+    reset_metadata();
+    dir_mtime_ns = result.mtime_ns;
+    size_t index = files.find(selected_name);
+    selected_file = index < files.size() ? static_cast<int>(index) : 0;
+    clamp_scroll();
+    return true;
+}
+
+void FilePanel::reset_metadata() {
+    // Список заменен: ответы на прежние запросы относятся к другим записям и будут отброшены
+    ++metadata_generation;
+    metadata_requested.assign(files.size(), false);
+}
+
+void FilePanel::request_metadata(int start_index, int end_index) {
+    if (metadata_requested.size() != files.size()) {
+        reset_metadata();
+    }
+
+    // Сначала видимые строки, затем несколько страниц в направлении прокрутки
+    int prefetch = std::max(1, h - 5) * METADATA_PREFETCH_PAGES;
+    int prefetch_start = scroll_direction > 0 ? end_index : std::max(0, start_index - prefetch);
+    int prefetch_end = scroll_direction > 0 ? std::min(end_index + prefetch, static_cast<int>(files.size())) : start_index;
+
+    std::vector<size_t> indices;
+    for (int pass = 0; pass < 2; ++pass) {
+        int begin = pass == 0 ? start_index : prefetch_start;
+        int end = pass == 0 ? end_index : prefetch_end;
+        for (int i = begin; i < end; ++i) {
+            // Тип содержимого нужен и записям, метаданные которых уже получены без него
+            const FileEntry& entry = files[i];
+            bool needs_type = entry.info_valid && S_ISREG(entry.mode) && entry.type == FILE_TYPE_NONE;
+            if ((!entry.has_info || needs_type) && !metadata_requested[i]) {
+                metadata_requested[i] = true;
+                indices.push_back(i);
+            }
+        }
+    }
+
+    // Задачи пула держат ссылку на пул имен списка: если панель тем временем заменит список,
+    // пул останется жив, а имена в нем неизменны. Результаты складываются в общую очередь
+    for (size_t first = 0; first < indices.size(); first += METADATA_BATCH_SIZE) {
+        size_t last = std::min(first + METADATA_BATCH_SIZE, indices.size());
+        std::vector<MetadataResult> batch;
+        for (size_t i = first; i < last; ++i) {
+            MetadataResult result;
+            result.generation = metadata_generation;
+            result.index = indices[i];
+            result.entry = files[indices[i]];
+            batch.push_back(result);
+        }
+
+        std::shared_ptr<MetadataInbox> inbox = metadata_inbox;
+        std::shared_ptr<const EntryList::NamePool> names = files.shared_names();
+        std::string dir = current_dir;
+        inbox->in_flight += batch.size();
+        io_pool().submit([inbox, names, dir, batch]() mutable {
+            int dir_fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+            std::vector<FileEntry*> entries;
+            for (size_t i = 0; i < batch.size(); ++i) {
+                entries.push_back(&batch[i].entry);
+            }
+            fill_entries_info_at(dir_fd, names->data(), &entries[0], entries.size());
+            // Тип обычных файлов определяется по первым байтам; чтение идет здесь же, в пуле
+            for (size_t i = 0; i < batch.size(); ++i) {
+                FileEntry& entry = batch[i].entry;
+                bool regular = dir_fd >= 0 && entry.info_valid && S_ISREG(entry.mode);
+                entry.type = regular ? detect_file_type_at(dir_fd, names->data() + entry.name_offset) : FILE_TYPE_NONE;
+            }
+            if (dir_fd >= 0) {
+                close(dir_fd);
+            }
+            std::lock_guard<std::mutex> lock(inbox->mutex);
+            inbox->results.insert(inbox->results.end(), batch.begin(), batch.end());
+        }, priority);
+    }
+}
+
+bool FilePanel::poll_metadata() {
+    std::vector<MetadataResult> results;
+    {
+        std::lock_guard<std::mutex> lock(metadata_inbox->mutex);
+        results.swap(metadata_inbox->results);
+    }
+    // Запрос считается завершенным, только когда его ответ забран, иначе цикл ввода
+    // мог бы заснуть между появлением ответа в очереди и его применением
+    metadata_inbox->in_flight -= results.size();
+
+    // Применяем только ответы для текущего списка, сверяя смещение имени на случай перестановок
+    bool changed = false;
+    for (size_t i = 0; i < results.size(); ++i) {
+        const MetadataResult& result = results[i];
+        if (result.generation == metadata_generation && result.index < files.size() &&
+            files[result.index].name_offset == result.entry.name_offset) {
+            files[result.index] = result.entry;
+            changed = true;
+        }
+    }
+    return changed;
+}
+
+void FilePanel::cycle_sort_mode() {
+    // Переключаемся на следующий режим сортировки и перечитываем каталог
+    sort_mode = static_cast<SortMode>((sort_mode + 1) % SORT_MODE_COUNT);
+    selected_file = 0;
+    update();
+}
+
+void FilePanel::set_filter(const std::string& new_filter) {
+    // Устанавливаем новый фильтр имен и перечитываем каталог
+    filter = new_filter;
+    selected_file = 0;
+    update();
+}
+
+PanelState FilePanel::save_state(bool with_entries) const {
+    PanelState state;
+    state.current_dir = current_dir;
+    state.selected_file = selected_file;
+    state.scroll_position = scroll_position;
+    state.sort_mode = sort_mode;
+    state.filter = filter;
+    for (size_t i = 0; i < tabs.size(); ++i) {
+        TabState tab;
+        tab.dir = tabs[i].dir;
+        tab.selected_file = tabs[i].selected_file;
+        tab.scroll_position = tabs[i].scroll_position;
+        tab.sort_mode = tabs[i].sort_mode;
+        tab.filter = tabs[i].filter;
+        // Для текущей вкладки сохраняем живое состояние панели
+        if (static_cast<int>(i) == current_tab_index) {
+            tab.dir = current_dir;
+            tab.selected_file = selected_file;
+            tab.scroll_position = scroll_position;
+            tab.sort_mode = sort_mode;
+            tab.filter = filter;
+        }
+        state.tabs.push_back(tab);
+    }
+    state.current_tab_index = current_tab_index;
+
+    // Снимок содержимого каталога сохраняем только по запросу
+    state.has_entries = with_entries;
+    state.dir_mtime_ns = dir_mtime_ns;
+    if (with_entries) {
+        state.entries = files;
+    }
+    return state;
 }
 
 
@@ -259,31 +1046,435 @@ void FilePanel::set_selected(bool selected) {
     this->selected = selected;
 }
 
-void FilePanel::create_tab() {
-    // Итерируемся по всем вкладкам
-    for (int i = 0; i < MAX_TABS; ++i) {
-        // Если вкладка пуста, добавляем на нее текущий каталог и устанавливаем ее как текущую
-        if (tabs[i].empty()) {
-            tabs[i] = current_dir;
-            current_tab_index = i;
+void FilePanel::set_priority(TaskPriority priority) {
+    this->priority = priority;
+    watch.set_priority(priority);
+    tree.set_priority(priority);
+}
+
+void FilePanel::toggle_tree() {
+    if (tree.is_open()) {
+        std::string target = tree.row_path(tree.get_selected());
+        tree.close();
+        if (target == current_dir || !navigate_to(target, true)) {
+            update();
+        }
+        return;
+    }
+    // Дерево и наблюдение занимают панель целиком, поэтому наблюдение прекращается
+    if (watch.is_active()) {
+        watch.stop();
+    }
+    tree.set_priority(priority);
+    tree.open(current_dir);
+    tree_scroll = 0;
+    draw();
+}
+
+bool FilePanel::is_tree_mode() const {
+    return tree.is_open();
+}
+
+void FilePanel::toggle_watch() {
+    if (watch.is_active()) {
+        // Список каталога за время наблюдения устарел и перечитывается один раз при выходе
+        watch.stop();
+        update();
+        return;
+    }
+    tree.close();
+    if (!watch.start(current_dir)) {
+        printw("Error: cannot watch %s\n", current_dir.c_str());
+        refresh();
+    }
+}
+
+bool FilePanel::is_watching() const {
+    return watch.is_active();
+}
+
+void FilePanel::set_watch_capacity(size_t capacity) {
+    watch.set_capacity(capacity);
+}
+
+void FilePanel::pack_selected(const std::string& archive_name) {
+    if (is_packing() || files.empty() || strcmp(files.name(selected_file), "..") == 0) {
+        return;
+    }
+    std::vector<std::string> sources(1, current_dir + "/" + get_selected_file());
+    pack_archive = archive_name[0] == '/' ? archive_name : current_dir + "/" + archive_name;
+    pack_progress = std::make_shared<PackProgress>();
+    pack_percent = -1;
+    std::shared_ptr<PackProgress> progress = pack_progress;
+    std::string archive = pack_archive;
+    // Упаковка держит свой пул сжатия и долго читает файлы, поэтому идет в отдельном потоке,
+    // а не в пуле ввода-вывода, где заняла бы рабочий поток у метаданных и предпросмотра.
+    // Поток - фоновое задание планировщика: при замедлении просмотра каталогов он уступает диск
+    pack_job = std::async(std::launch::async, [sources, archive, progress]() {
+        BackgroundIoScope io_scope(std::make_shared<IoJob>(io_scheduler().get_default_limits()), true);
+        return pack_paths(sources, archive, OVERWRITE_FAIL, PackOptions(), progress.get());
+    });
+}
+
+bool FilePanel::is_packing() const {
+    return pack_job.valid();
+}
+
+void FilePanel::cancel_pack() {
+    if (pack_job.valid()) {
+        pack_progress->cancel = true;
+    }
+}
+
+void FilePanel::draw_background_status() {
+    if (!pack_job.valid() && operations.empty()) {
+        return;
+    }
+    char* status = frame_arena.allocate(w + 1);
+    int length;
+    if (pack_job.valid()) {
+        const char* name = pack_archive.c_str() + pack_archive.find_last_of('/') + 1;
+        length = pack_percent < 0 ? snprintf(status, w + 1, " pack %s: scanning ", name)
+                                  : snprintf(status, w + 1, " pack %s: %d%% ", name, pack_percent);
+    } else {
+        // Выводится первая из операций и число остальных
+        length = operations.size() > 1 ? snprintf(status, w + 1, " %s (+%zu) ", operations[0].status.c_str(), operations.size() - 1)
+                                        : snprintf(status, w + 1, " %s ", operations[0].status.c_str());
+    }
+    // Ход выводится справа на нижней рамке, чтобы не закрывать сортировку и фильтр
+    length = std::min(length, std::max(0, w - 4));
+    mvwaddnstr(win, h - 1, std::max(2, w - 2 - length), status, length);
+}
+
+// Размер без выравнивания для сообщений; буфер на 16 байт
+static const char* short_size(uint64_t size, char* buffer) {
+    format_size_column(static_cast<off_t>(size), 15, buffer);
+    return buffer + strspn(buffer, " ");
+}
+
+void FilePanel::start_operation(const std::string& label, const std::shared_ptr<OperationProgress>& progress,
+                                const std::function<OperationResult()>& work,
+                                const std::function<void(const OperationResult&)>& finish) {
+    Operation operation;
+    operation.label = label;
+    operation.progress = progress;
+    operation.finish = finish;
+    operation.started = std::chrono::steady_clock::now();
+    // Свой поток, а не пул ввода-вывода: долгая операция не должна занимать рабочие потоки
+    // метаданных и предпросмотра. Задание с пониженным приоритетом уступает диск просмотру
+    operation.job = std::async(std::launch::async, [work]() {
+        IoLimits limits = io_scheduler().get_default_limits();
+        limits.low_priority = true;
+        BackgroundIoScope io_scope(std::make_shared<IoJob>(limits), true);
+        return work();
+    });
+    operation.status = operation_status(operation);
+    operations.push_back(std::move(operation));
+}
+
+bool FilePanel::has_operations() const {
+    return !operations.empty();
+}
+
+// Строка хода операции: доля по объему, сколько сделано и оставшееся время
+std::string FilePanel::operation_status(const Operation& operation) const {
+    const OperationProgress* progress = operation.progress.get();
+    uint64_t total = progress != nullptr ? progress->total_bytes.load() : 0;
+    if (total == 0) {
+        return operation.label + (progress != nullptr ? ": scanning" : "...");
+    }
+    uint64_t copied = std::min(progress->done.copied_bytes.load(), total);
+    double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - operation.started).count();
+    double bytes_per_second = elapsed > 0 ? copied / elapsed : 0;
+    char done[16];
+    char all[16];
+    char text[128];
+    int length = snprintf(text, sizeof(text), ": %d%% %s of %s", static_cast<int>(copied * 100 / total),
+                          short_size(copied, done), short_size(total, all));
+    if (bytes_per_second > 0 && copied < total) {
+        long eta = static_cast<long>((total - copied) / bytes_per_second);
+        snprintf(text + length, sizeof(text) - length, ", ETA %ld:%02ld", eta / 60, eta % 60);
+    }
+    return operation.label + text;
+}
+
+bool FilePanel::poll_operations() {
+    bool changed = false;
+    for (size_t i = 0; i < operations.size();) {
+        Operation& operation = operations[i];
+        if (operation.job.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            // Панель перерисовывается, только если строка хода изменилась
+            std::string status = operation_status(operation);
+            if (status != operation.status) {
+                operation.status = status;
+                changed = true;
+            }
+            ++i;
+            continue;
+        }
+        OperationResult result = operation.job.get();
+        std::function<void(const OperationResult&)> finish = operation.finish;
+        operations.erase(operations.begin() + i);
+        if (finish) {
+            finish(result);
+        }
+        // Операция могла изменить каталог: список перечитывается, курсор остается на том же файле
+        std::string selected_name = get_selected_file();
+        update();
+        select_file(selected_name);
+        changed = true;
+    }
+    return changed;
+}
+
+bool FilePanel::poll_pack() {
+    if (!pack_job.valid()) {
+        return false;
+    }
+    if (pack_job.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+        uint64_t total = pack_progress->total_bytes;
+        int percent = total == 0 ? -1 : static_cast<int>(std::min<uint64_t>(100, pack_progress->read_bytes * 100 / total));
+        if (percent == pack_percent) {
+            return false;
+        }
+        pack_percent = percent;
+        return true;
+    }
+
+    OperationResult result = pack_job.get();
+    if (!result.ok) {
+        printw("Error: %s\n", result.error.c_str());
+        refresh();
+    }
+    // Архив сохраняется и при ошибках чтения отдельных файлов, поэтому курсор ставится на него,
+    // если он появился в текущем каталоге
+    update();
+    size_t slash = pack_archive.find_last_of('/');
+    if (pack_archive.substr(0, slash) == current_dir) {
+        select_file(pack_archive.substr(slash + 1));
+    }
+    return true;
+}
+
+void FilePanel::init_tabs() {
+    // Создаем дескриптор inotify, через который узнаем об изменениях в каталогах вкладок
+    if (inotify_fd < 0) {
+        inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    }
+
+    // Текущее содержимое панели становится первой вкладкой
+    tabs.clear();
+    tabs.push_back(make_tab());
+    current_tab_index = 0;
+    watch_tab(tabs[0]);
+}
+
+Tab FilePanel::make_tab() const {
+    // Новая вкладка повторяет текущее состояние просмотра, но без копии списка файлов
+    Tab tab;
+    tab.dir = current_dir;
+    tab.selected_file = selected_file;
+    tab.scroll_position = scroll_position;
+    tab.sort_mode = sort_mode;
+    tab.filter = filter;
+    tab.dir_mtime_ns = dir_mtime_ns;
+    tab.cached = false;
+    tab.dirty = false;
+    tab.watch = -1;
+    tab.last_used = tab_clock;
+    return tab;
+}
+
+void FilePanel::store_view(Tab& tab) {
+    // Переносим состояние просмотра во вкладку без копирования списка файлов
+    tab.dir = current_dir;
+    tab.files.swap(files);
+    files.clear();
+    tab.selected_file = selected_file;
+    tab.scroll_position = scroll_position;
+    tab.sort_mode = sort_mode;
+    tab.filter = filter;
+    tab.dir_mtime_ns = dir_mtime_ns;
+    tab.cached = true;
+    tab.last_used = ++tab_clock;
+
+    // Если фоновая проверка снимка еще не завершилась, список мог устареть
+    if (revalidation.valid()) {
+        tab.dirty = true;
+        ++listing_generation;
+    }
+}
+
+void FilePanel::load_view(Tab& tab) {
+    // Восстанавливаем каталог и режимы просмотра вкладки
+    current_dir = tab.dir;
+    strcpy(current_dir_cstr, current_dir.c_str());
+    sort_mode = tab.sort_mode;
+    filter = tab.filter;
+    selected_file = tab.selected_file;
+    scroll_position = tab.scroll_position;
+
+    // Без inotify об изменениях узнаем по времени модификации каталога
+    if (tab.cached && !tab.dirty && inotify_fd < 0) {
+        struct stat st;
+        tab.dirty = stat(current_dir.c_str(), &st) != 0 || stat_mtime_ns(st) != tab.dir_mtime_ns;
+    }
+
+    if (tab.cached && !tab.dirty) {
+        // Кеш актуален: переключение мгновенное, каталог не перечитывается
+        files.swap(tab.files);
+        reset_metadata();
+        dir_mtime_ns = tab.dir_mtime_ns;
+    } else {
+        // Кеш вытеснен или устарел: перечитываем каталог, стараясь оставить курсор на том же файле
+        std::string selected_name;
+        if (tab.cached && selected_file >= 0 && selected_file < static_cast<int>(tab.files.size())) {
+            selected_name = tab.files.name(selected_file);
+        }
+        list_directory();
+        size_t index = selected_name.empty() ? files.size() : files.find(selected_name);
+        if (index < files.size()) {
+            selected_file = static_cast<int>(index);
+        }
+    }
+    tab.files.release();
+    tab.cached = false;
+    tab.dirty = false;
+    tab.last_used = ++tab_clock;
+
+    // Приводим курсор и прокрутку к границам списка
+    clamp_scroll();
+
+    // Если вкладка наблюдала за другим каталогом, переставляем наблюдение
+    if (tab.watch < 0) {
+        watch_tab(tab);
+    }
+}
+
+void FilePanel::watch_tab(Tab& tab) {
+    unwatch_tab(tab);
+    if (inotify_fd >= 0) {
+        tab.watch = inotify_add_watch(inotify_fd, tab.dir.c_str(), TAB_WATCH_MASK);
+    }
+}
+
+void FilePanel::unwatch_tab(Tab& tab) {
+    if (tab.watch < 0) {
+        return;
+    }
+
+    // Для одного каталога inotify выдает один дескриптор, поэтому снимаем наблюдение,
+    // только если им больше не пользуется ни одна вкладка
+    bool shared = false;
+    for (size_t i = 0; i < tabs.size(); ++i) {
+        if (&tabs[i] != &tab && tabs[i].watch == tab.watch) {
+            shared = true;
             break;
         }
-        // Если вкладка уже содержит текущий каталог, устанавливаем ее как текущую и выходим из функции
-        else if (tabs[i] == current_dir) {
-            current_tab_index = i;
-            return;
+    }
+    if (!shared) {
+        inotify_rm_watch(inotify_fd, tab.watch);
+    }
+    tab.watch = -1;
+}
+
+void FilePanel::drain_watch_events() {
+    if (inotify_fd < 0) {
+        return;
+    }
+
+    // Вычитываем все накопившиеся события и помечаем соответствующие вкладки как устаревшие
+    alignas(struct inotify_event) char buffer[4096];
+    while (true) {
+        ssize_t length = read(inotify_fd, buffer, sizeof(buffer));
+        if (length <= 0) {
+            break;
+        }
+        for (char* ptr = buffer; ptr < buffer + length;) {
+            const struct inotify_event* event = reinterpret_cast<const struct inotify_event*>(ptr);
+            for (size_t i = 0; i < tabs.size(); ++i) {
+                if (tabs[i].watch == event->wd) {
+                    tabs[i].dirty = true;
+                    // Наблюдение снято ядром (каталог удален или файловая система отмонтирована)
+                    if (event->mask & IN_IGNORED) {
+                        tabs[i].watch = -1;
+                    }
+                }
+            }
+            ptr += sizeof(struct inotify_event) + event->len;
         }
     }
 }
 
+static size_t tab_memory(const Tab& tab) {
+    // Оцениваем память, занятую кешем вкладки
+    return tab.files.memory_usage();
+}
+
+void FilePanel::evict_tabs() {
+    // Считаем память, занятую кешами неактивных вкладок
+    size_t total = 0;
+    for (size_t i = 0; i < tabs.size(); ++i) {
+        if (static_cast<int>(i) != current_tab_index && tabs[i].cached) {
+            total += tab_memory(tabs[i]);
+        }
+    }
+
+    // Пока бюджет превышен, освобождаем кеш давнее всего использованной вкладки
+    while (total > tab_cache_budget) {
+        int oldest = -1;
+        for (size_t i = 0; i < tabs.size(); ++i) {
+            if (static_cast<int>(i) != current_tab_index && tabs[i].cached &&
+                (oldest < 0 || tabs[i].last_used < tabs[oldest].last_used)) {
+                oldest = static_cast<int>(i);
+            }
+        }
+        if (oldest < 0) {
+            break;
+        }
+
+        Tab& tab = tabs[oldest];
+        total -= tab_memory(tab);
+        tab.files.release();
+        tab.cached = false;
+        tab.dirty = false;
+        // Наблюдение за каталогом вытесненной вкладки больше не нужно
+        unwatch_tab(tab);
+    }
+}
+
+void FilePanel::set_tab_cache_budget(size_t bytes) {
+    tab_cache_budget = bytes;
+    evict_tabs();
+}
+
+void FilePanel::create_tab() {
+    // Новая вкладка открывается в текущем каталоге, а текущая сохраняет копию своего списка
+    Tab& current = tabs[current_tab_index];
+    store_view(current);
+    files = current.files;
+    reset_metadata();
+
+    Tab tab = make_tab();
+    tab.last_used = ++tab_clock;
+    tabs.push_back(tab);
+    current_tab_index = static_cast<int>(tabs.size()) - 1;
+    watch_tab(tabs[current_tab_index]);
+    evict_tabs();
+}
+
 void FilePanel::switch_to_tab(int tab_index) {
-    // Если индекс вкладки находится в допустимых пределах и вкладка не пуста,
-    // устанавливаем текущий каталог на каталог вкладки и обновляем содержимое окна
-    if (tab_index >= 0 && tab_index < 10 && !tabs[tab_index].empty()) {
-        current_dir = tabs[tab_index];
-        strcpy(current_dir_cstr, current_dir.c_str());
-        update();
+    // Если индекс вкладки выходит за допустимые пределы или вкладка уже активна, выходим из функции
+    if (tab_index < 0 || tab_index >= static_cast<int>(tabs.size()) || tab_index == current_tab_index) {
+        return;
     }
+
+    // Узнаем, какие каталоги изменились, сохраняем текущую вкладку и показываем выбранную
+    drain_watch_events();
+    store_view(tabs[current_tab_index]);
+    current_tab_index = tab_index;
+    load_view(tabs[current_tab_index]);
+    evict_tabs();
 }
 
 void FilePanel::show_tabs() {
@@ -298,16 +1489,12 @@ void FilePanel::show_tabs() {
 
     mvwprintw(tab_win, 0, (tab_win_w - 4) / 2, "Tabs"); // Добавляем надпись "Tabs" вверху окна
 
-    bool has_tabs = false; // Флаг, указывающий наличие вкладок
-    for (int i = 0; i < 10; ++i) {
-        if (!tabs[i].empty()) {
-            mvwprintw(tab_win, i + 1, 1, "%d: %s", i, tabs[i].c_str());
-            has_tabs = true; // Устанавливаем флаг в true, если вкладка найдена
-        }
-    }
-
-    if (!has_tabs) {
-        mvwprintw(tab_win, tab_win_h / 2, (tab_win_w - 14) / 2, "Here is no tabs"); // Выводим сообщение "Here is no tabs", если вкладок нет
+    // Если вкладок больше, чем помещается в окне, показываем те, что рядом с текущей
+    int rows = tab_win_h - 2;
+    int first = std::max(0, std::min(current_tab_index - rows / 2, static_cast<int>(tabs.size()) - rows));
+    for (int i = first; i < static_cast<int>(tabs.size()) && i < first + rows; ++i) {
+        const char* dir = i == current_tab_index ? current_dir.c_str() : tabs[i].dir.c_str();
+        mvwprintw(tab_win, i - first + 1, 1, "%c%d: %s", i == current_tab_index ? '*' : ' ', i, dir);
     }
 
     wrefresh(tab_win);
@@ -318,23 +1505,20 @@ void FilePanel::show_tabs() {
 }
 
 void FilePanel::delete_tab(int index) {
-    // Если индекс вкладки выходит за пределы допустимых значений, выходим из функции
-    if (index < 0 || index >= MAX_TABS) {
+    // Если индекс вкладки выходит за пределы допустимых значений или это последняя вкладка, выходим из функции
+    if (index < 0 || index >= static_cast<int>(tabs.size()) || tabs.size() == 1) {
         return;
     }
 
-    // Если вкладка пуста, выходим из функции
-    if (tabs[index].empty()) {
-        return;
-    }
+    // Удаляем вкладку вместе с наблюдением за ее каталогом
+    unwatch_tab(tabs[index]);
+    tabs.erase(tabs.begin() + index);
 
-    // Удаляем вкладку, устанавливая ее значение в пустую строку
-    tabs[index] = "";
-
-    // Если удаленная вкладка была текущей, устанавливаем текущей первую вкладку и переходим в ее каталог
+    // Если удаленная вкладка была текущей, показываем соседнюю вкладку
     if (index == current_tab_index) {
-        current_tab_index = 0;
-        change_directory(0);
+        current_tab_index = std::min(index, static_cast<int>(tabs.size()) - 1);
+        drain_watch_events();
+        load_view(tabs[current_tab_index]);
     }
     // Если удаленная вкладка была не текущей и находилась перед текущей, сдвигаем текущую вкладку на одну позицию влево
     else if (index < current_tab_index) {
@@ -342,19 +1526,18 @@ void FilePanel::delete_tab(int index) {
     }
 }
 
-
 std::string FilePanel::get_tab_by_index(int index) const {
-    if (index >= 0 && index < 9) {
-        return tabs[index];
+    if (index == current_tab_index) {
+        return current_dir;
+    }
+    if (index >= 0 && index < static_cast<int>(tabs.size())) {
+        return tabs[index].dir;
     }
     return "";
 }
 
-void FilePanel::set_current_tab_index(int index) {
-    if (index >= 0 && index < 9) {
-        current_tab_index = index;
-        change_directory(0);
-    }
+int FilePanel::get_tab_count() const {
+    return tabs.size();
 }
 
 int FilePanel::get_current_tab_index() const {
@@ -384,10 +1567,7 @@ void FilePanel::rename_file_or_directory() {
         new_name = input_window.show(message);
 
         // Проверяем, что новое имя не пустое и не совпадает с именем другого файла или каталога в текущем каталоге
-        if (new_name.empty() || std::find_if(files.begin(), files.end(),
-                                             [&new_name](const std::string& file) {
-                                                 return file == new_name;
-                                             }) != files.end()) {
+        if (new_name.empty() || files.find(new_name) < files.size()) {
             message = "Invalid name. Enter new name: ";
             continue;
         }
@@ -416,7 +1596,7 @@ void FilePanel::rename_file_or_directory() {
 void FilePanel::copy_file_or_directory() {
     // Если выбран файл или каталог, копируем его путь и указатель на текущий объект FilePanel в глобальную переменную copied_file_or_directory
     if (selected_file >= 0 && selected_file < static_cast<int>(files.size())) {
-        copied_file_or_directory.file_path = current_dir + "/" + files[selected_file];
+        copied_file_or_directory.file_path = current_dir + "/" + files.name(selected_file);
         copied_file_or_directory.source_panel = this;
         printw("Copied: %s\n", copied_file_or_directory.file_path.c_str());
         refresh();
@@ -428,61 +1608,84 @@ void FilePanel::copy_file_or_directory() {
     }
 }
 
-void FilePanel::paste_file_or_directory() {
+void FilePanel::paste_file_or_directory(const CopyOptions& options) {
     // Если скопированный файл или каталог не пуст, выполняем операцию вставки
     if (!copied_file_or_directory.file_path.empty()) {
-        // Формируем путь к целевому каталогу
-        std::string destination = current_dir;
         // Получаем информацию о скопированном файле или каталоге
         struct stat st;
-        if (stat(copied_file_or_directory.file_path.c_str(), &st) == 0) {
+        if (lstat(copied_file_or_directory.file_path.c_str(), &st) == 0) {
             // Формируем путь к целевому файлу или каталогу
-            std::string target_file = destination + "/" + copied_file_or_directory.file_path.substr(copied_file_or_directory.file_path.find_last_of('/') + 1);
+            std::string target_file = current_dir + "/" + copied_file_or_directory.file_path.substr(copied_file_or_directory.file_path.find_last_of('/') + 1);
+            OverwritePolicy policy = OVERWRITE_FAIL;
+            // Вставка, прерванная на середине, оставляет рядом с целью журнал. Повторная вставка
+            // того же источника продолжает ее без вопроса о перезаписи
+            bool resume = CopyJournal::exists(copied_file_or_directory.file_path, target_file);
+            struct stat target_st;
+            if (resume) {
+                policy = OVERWRITE_REPLACE;
+            }
             // Проверяем, существует ли целевой файл или каталог
-            if (stat(target_file.c_str(), &st) == 0) {
+            else if (lstat(target_file.c_str(), &target_st) == 0) {
                 // Если существует, запрашиваем у пользователя разрешение на перезапись
                 InputWindow input_window(120, 8);
                 std::string message = "File already exists. Overwrite? (y/n)";
                 std::string response = input_window.show(message);
-                // Если пользователь разрешил перезапись, выполняем операцию вставки
-                if (response == "y" || response == "Y") {
-                    // Если скопированный элемент является каталогом, копируем его рекурсивно
-                    if (S_ISDIR(st.st_mode)) {
-                        std::string command = "cp -r '" + copied_file_or_directory.file_path + "' '" + destination + "'";
-                        printw("Pasting directory: %s\n", command.c_str());
-                        refresh();
-                        system(command.c_str());
-                    }
-                    // Если скопированный элемент является файлом, копируем его
-                    else {
-                        std::string command = "cp '" + copied_file_or_directory.file_path + "' '" + destination + "'";
-                        printw("Pasting file: %s\n", command.c_str());
-                        refresh();
-                        system(command.c_str());
-                    }
-                    // Обновляем содержимое окна
-                    update();
+                if (response != "y" && response != "Y") {
+                    return;
                 }
+                policy = OVERWRITE_REPLACE;
             }
-            // Если целевой файл или каталог не существует, выполняем операцию вставки
-            else {
-                // Если скопированный элемент является каталогом, копируем его рекурсивно
-                if (S_ISDIR(st.st_mode)) {
-                    std::string command = "cp -r '" + copied_file_or_directory.file_path + "' '" + destination + "'";
-                    printw("Pasting directory: %s\n", command.c_str());
-                    refresh();
-                    system(command.c_str());
+
+            // Вставка идет в фоне: сначала план (объем источника, жесткие ссылки и место в цели;
+            // если копия не поместится, копирование не начинается и не оставляет половину дерева),
+            // затем копирование по нему. Ход и оставшееся время считаются по объему из плана
+            std::string source = copied_file_or_directory.file_path;
+            std::string name = target_file.substr(target_file.find_last_of('/') + 1);
+            bool directory = S_ISDIR(st.st_mode);
+            CopyOptions paste_options = options;
+            std::shared_ptr<OperationProgress> progress = std::make_shared<OperationProgress>();
+            std::shared_ptr<CopyPlan> plan = std::make_shared<CopyPlan>();
+            printw("%s %s%s in the background: %s\n", resume ? "Resuming paste of" : "Pasting",
+                   directory ? "directory" : "file", options.verify ? " with verification" : "", target_file.c_str());
+            refresh();
+            start_operation((resume ? "resume " : "paste ") + name, progress,
+                            [source, target_file, policy, paste_options, progress, plan]() {
+                OperationResult planned = plan_copy(source, target_file, *plan, policy);
+                if (!planned.ok) {
+                    planned.files = planned.bytes = 0;
+                    return planned;
                 }
-                // Если скопированный элемент является файлом, копируем его
-                else {
-                    std::string command = "cp '" + copied_file_or_directory.file_path + "' '" + destination + "'";
-                    printw("Pasting file: %s\n", command.c_str());
-                    refresh();
-                    system(command.c_str());
+                progress->total_bytes = std::max<uint64_t>(plan->bytes, 1);
+                // Без журнала (например, каталог цели только для чтения) копирование идет как обычно
+                CopyJournal journal;
+                CopyOptions copy_options = paste_options;
+                if (journal.open(source, target_file)) {
+                    copy_options.journal = &journal;
                 }
-                // Обновляем содержимое окна
-                update();
-            }
+                copy_options.plan = plan.get();
+                copy_options.progress = &progress->done;
+                OperationResult result = copy_path(source, target_file, policy, copy_options);
+                // Журнал остается, только если после ошибки есть что продолжать
+                if (result.ok || journal.is_empty()) {
+                    journal.finish();
+                }
+                return result;
+            }, [target_file, plan](const OperationResult& result) {
+                char total[16];
+                printw("%s %s (%llu files, %s", result.ok ? "Pasted" : "Paste incomplete:", target_file.c_str(),
+                       static_cast<unsigned long long>(plan->files), short_size(plan->bytes, total));
+                if (plan->hardlinks > 0) {
+                    printw(", %llu hard links", static_cast<unsigned long long>(plan->hardlinks));
+                }
+                if (plan->unreadable > 0) {
+                    printw(", %llu unreadable", static_cast<unsigned long long>(plan->unreadable));
+                }
+                printw(")\n");
+                if (!result.ok) {
+                    printw("Error: %s\n", result.error.c_str());
+                }
+                refresh();
+            });
         }
         // Если не удалось получить информацию о скопированном файле или каталоге, выводим сообщение об ошибке
         else {
@@ -497,11 +1700,55 @@ void FilePanel::paste_file_or_directory() {
     }
 }
 
+void FilePanel::edit_attributes() {
+    if (files.empty() || strcmp(files.name(selected_file), "..") == 0) {
+        printw("No file or directory selected\n");
+        refresh();
+        return;
+    }
+    std::string path = current_dir + "/" + get_selected_file();
+    InputWindow input_window(120, 8);
+    std::string response = input_window.show("chmod MODE | chown USER[:GROUP] | touch (directories recursively): ");
+    size_t space = response.find(' ');
+    std::string command = response.substr(0, space);
+    // Строка может кончаться пробелами без аргумента: тогда аргумент пустой и команда неверна
+    size_t argument_start = space == std::string::npos ? space : response.find_first_not_of(' ', space);
+    std::string argument = argument_start == std::string::npos ? "" : response.substr(argument_start);
+
+    AttributeChange change;
+    if (command == "chmod" && parse_mode_change(argument, change.mode)) {
+        change.change_mode = true;
+    } else if (command == "chown" && parse_owner(argument, change.uid, change.gid)) {
+    } else if (command == "touch" && argument.empty()) {
+        // Все элементы получают одно и то же время
+        change.touch = true;
+        clock_gettime(CLOCK_REALTIME, &change.time);
+    } else {
+        if (!response.empty()) {
+            printw("Error: cannot parse '%s'\n", response.c_str());
+            refresh();
+        }
+        return;
+    }
+
+    // Рекурсивный обход большого дерева идет в фоне, чтобы панель не замирала
+    start_operation(command + " " + get_selected_file(), nullptr, [path, change]() {
+        return change_attributes(path, change);
+    }, [command](const OperationResult& result) {
+        printw("%s: %llu changed, %llu already matching\n", command.c_str(), static_cast<unsigned long long>(result.files),
+               static_cast<unsigned long long>(result.skipped));
+        if (!result.ok) {
+            printw("Error: %s\n", result.error.c_str());
+        }
+        refresh();
+    });
+}
+
 void FilePanel::open_file() {
     // Если выбран файл, выполняем операцию открытия
     if (selected_file >= 0 && selected_file < static_cast<int>(files.size())) {
         // Формируем путь к файлу
-        std::string file_path = current_dir + "/" + files[selected_file];
+        std::string file_path = current_dir + "/" + files.name(selected_file);
         // Получаем информацию о файле
         struct stat st;
         if (stat(file_path.c_str(), &st) == 0) {
@@ -510,37 +1757,30 @@ void FilePanel::open_file() {
                 printw("Cannot open directory as a file.\n");
                 refresh();
             }
-            // Если файл является файлом, определяем его тип и выполняем соответствующую операцию открытия
+            // Программа выбирается по типу содержимого. Обычно он уже определен в фоне вместе с
+            // метаданными, иначе (например, у ссылки) начало файла читается сейчас
             else {
-                std::string command;
-                size_t dot_pos = file_path.find_last_of(".");
-                std::string extension = (dot_pos != std::string::npos) ? file_path.substr(dot_pos + 1) : "";
-
-                // В зависимости от типа файла, формируем команду открытия
-                if (extension == "txt" || extension == "cpp" || extension == "h" || extension == "c") {
-                    command = "gedit ";
-                } else if (extension == "pdf") {
-                    command = "evince ";
-                } else if (extension == "jpg" || extension == "jpeg" || extension == "png" || extension == "bmp") {
-                    command = "eog ";
-                } else if (extension == "mp4" || extension == "mkv" || extension == "avi") {
-                    command = "vlc ";
-                } else if (extension == "docx") {
-                    command = "libreoffice ";
-                } else if (extension.empty()) {
-                    command = "gedit ";
-                } else {
-                    // Если тип файла не поддерживается, выводим сообщение об ошибке и выходим из функции
-                    printw("Unsupported file type: %s\n", extension.c_str());
+                FileType type = static_cast<FileType>(files[selected_file].type);
+                if (type == FILE_TYPE_NONE) {
+                    type = detect_file_type_at(AT_FDCWD, file_path.c_str(), true);
+                }
+
+                std::vector<std::string> command = opener_table().command_for(file_path, type);
+                if (command.empty()) {
+                    // Если для типа нет программы, выводим сообщение об ошибке и выходим из функции
+                    printw("No program to open %s file: %s\n", file_type_name(type), file_path.c_str());
                     refresh();
                     return;
                 }
 
-                // Добавляем путь к файлу к команде открытия и выполняем ее
-                command += "'" + file_path + "'";
-                printw("Opening file: %s\n", command.c_str());
+                // Программа запускается отдельно, и интерфейс не ждет ее завершения
+                std::string error;
+                if (launch_detached(command, error)) {
+                    printw("Opening %s file with %s\n", file_type_name(type), command[0].c_str());
+                } else {
+                    printw("Error: Unable to start %s\n", error.c_str());
+                }
                 refresh();
-                system(command.c_str());
             }
         }
         // Если не удалось получить информацию о файле, выводим сообщение об ошибке
@@ -556,23 +1796,43 @@ void FilePanel::open_file() {
     }
 }
 
+// Права в виде ls -l: тип и три тройки rwx с учетом setuid, setgid и sticky
+static std::string format_mode(mode_t mode) {
+    std::string text = S_ISDIR(mode) ? "d" : S_ISLNK(mode) ? "l" : S_ISCHR(mode) ? "c" : S_ISBLK(mode) ? "b"
+                       : S_ISFIFO(mode) ? "p" : S_ISSOCK(mode) ? "s" : "-";
+    const char letters[] = "rwxrwxrwx";
+    for (int i = 0; i < 9; ++i) {
+        text += (mode & (0400 >> i)) != 0 ? letters[i] : '-';
+    }
+    if ((mode & S_ISUID) != 0) {
+        text[3] = text[3] == 'x' ? 's' : 'S';
+    }
+    if ((mode & S_ISGID) != 0) {
+        text[6] = text[6] == 'x' ? 's' : 'S';
+    }
+    if ((mode & S_ISVTX) != 0) {
+        text[9] = text[9] == 'x' ? 't' : 'T';
+    }
+    return text;
+}
+
 void FilePanel::show_file_info() {
     // Если выбран файл, выполняем операцию отображения информации о файле
     if (selected_file >= 0 && selected_file < static_cast<int>(files.size())) {
         // Формируем путь к файлу
-        std::string file_path = current_dir + "/" + files[selected_file];
+        std::string file_path = current_dir + "/" + files.name(selected_file);
         // Получаем информацию о файле
         struct stat st;
         if (stat(file_path.c_str(), &st) == 0) {
             // Извлекаем информацию о файле
-            std::string name = files[selected_file];
+            std::string name = files.name(selected_file);
             std::string extension = name.substr(name.find_last_of(".") + 1);
             std::string access_time = ctime(&st.st_atime);
             std::string modification_time = ctime(&st.st_mtime);
             off_t size = st.st_size;
 
             // Создаем окно для отображения информации о файле
-            int height = 10;
+            int height = 11;
             int width = 60;
             int x = (COLS - width) / 2;
             int y = (LINES - height) / 2;
@@ -587,6 +1847,17 @@ void FilePanel::show_file_info() {
             mvwprintw(win, 4, 2, "Modification Time: %s", modification_time.c_str());
             mvwprintw(win, 5, 2, "Size: %ld bytes", size);
             mvwprintw(win, 6, 2, "Path: %s", file_path.c_str());
+            mvwprintw(win, 7, 2, "Mode: %s (%04o)", format_mode(st.st_mode).c_str(), st.st_mode & 07777);
+            struct passwd* user = getpwuid(st.st_uid);
+            struct group* group = getgrgid(st.st_gid);
+            mvwprintw(win, 8, 2, "Owner: %s:%s", user != nullptr ? user->pw_name : std::to_string(st.st_uid).c_str(),
+                      group != nullptr ? group->gr_name : std::to_string(st.st_gid).c_str());
+            // Тип содержимого обычно уже определен в фоне; у ссылок он определяется по цели
+            FileType type = static_cast<FileType>(files[selected_file].type);
+            if (S_ISREG(st.st_mode) && type == FILE_TYPE_NONE) {
+                type = detect_file_type_at(AT_FDCWD, file_path.c_str(), true);
+            }
+            mvwprintw(win, 9, 2, "Content: %s", S_ISREG(st.st_mode) ? file_type_name(type) : "-");
 
             // Обновляем содержимое окна и ожидаем нажатия клавиши Esc для закрытия окна
             wrefresh(win);
@@ -11,8 +11,25 @@
 #include <ncurses.h>
 #include <sys/types.h>
 #include <fcntl.h>
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include "file_entry.h"
+#include "file_engine.h"
+#include "column_layout.h"
+#include "arena.h"
+#include "worker_pool.h"
+#include "dir_watch.h"
+#include "dir_tree.h"
+#include "archive.h"
+#include "session.h"
 
 class FilePanel;
+struct Preview;
 
 struct CopiedFile {
     std::string file_path;
@@ -21,37 +38,103 @@ struct CopiedFile {
 
 extern CopiedFile copied_file_or_directory;
 
+// Вкладка панели: каталог, состояние просмотра и кеш содержимого каталога
+struct Tab {
+    std::string dir;
+    EntryList files;
+    int selected_file;
+    int scroll_position;
+    SortMode sort_mode;
+    std::string filter;
+    int64_t dir_mtime_ns;
+    bool cached;             // files содержит список каталога
+    bool dirty;              // inotify сообщил об изменениях в каталоге
+    int watch;               // Дескриптор наблюдения inotify или -1
+    unsigned long last_used; // Отметка последнего использования для вытеснения
+};
+
+// Ход фоновой операции панели, общий с ее потоком. Пока объем работы неизвестен (например,
+// идет план копирования), total_bytes равен нулю и доля не выводится
+struct OperationProgress {
+    OperationProgress() : total_bytes(0) {}
+
+    CopyProgress done;
+    std::atomic<uint64_t> total_bytes;
+};
+
 class FilePanel {
 public:
     FilePanel(int start_y, int start_x, int height, int width);
+    FilePanel(int start_y, int start_x, int height, int width, const PanelState& state);
     ~FilePanel();
     void draw();
+    void draw_preview(const std::string& path, const Preview* preview);
     void update();
     void move_selection(int dir);
     void change_directory(int dir);
+    void go_back();
+    void go_forward();
+    bool jump_to(const std::string& dir);
+    // Переход по пути: в каталог или в каталог файла с курсором на нем
+    bool go_to_path(const std::string& path);
     bool is_selected() const;
     void set_selected(bool selected);
     int get_selected_file_index() const;
     int get_files_size() const;
     std::string get_current_dir() const;
     std::string get_selected_file() const;
+    const FileEntry* get_selected_entry() const;
+    bool select_file(const std::string& name);
     void delete_tab(int index);
     void create_tab();
     void switch_to_tab(int tab_index);
     void show_tabs();
     std::string get_tab_by_index(int index) const;
-    void set_current_tab_index(int index);
+    int get_tab_count() const;
     int get_current_tab_index() const;
+    void set_tab_cache_budget(size_t bytes);
     void rename_file_or_directory();
     void copy_file_or_directory();
-    void paste_file_or_directory();
+    void paste_file_or_directory(const CopyOptions& options = CopyOptions());
     void open_file();
     void show_file_info();
+    // Смена прав, владельца или времени выбранного элемента, для каталога - рекурсивно
+    void edit_attributes();
+    void cycle_sort_mode();
+    void set_filter(const std::string& new_filter);
+    PanelState save_state(bool with_entries) const;
+    bool has_background_work() const;
+    bool poll_background();
+    // Приоритет фоновых задач панели в пуле ввода-вывода
+    void set_priority(TaskPriority priority);
+    // Режим наблюдения: вместо списка каталога панель показывает последние поступившие файлы
+    void toggle_watch();
+    bool is_watching() const;
+    void set_watch_capacity(size_t capacity);
+    // Режим дерева: подкаталоги текущего каталога раскрываются на месте. При выходе из режима
+    // панель переходит в каталог под курсором дерева
+    void toggle_tree();
+    bool is_tree_mode() const;
+    // Упаковка выбранного элемента в архив tar.gz текущего каталога. Упаковка идет в фоне,
+    // ход показывается на нижней рамке панели
+    void pack_selected(const std::string& archive_name);
+    bool is_packing() const;
+    void cancel_pack();
+    // Фоновая операция панели (вставка, удаление, подсчет сумм, смена атрибутов): work выполняется
+    // в отдельном потоке как низкоприоритетное задание планировщика ввода-вывода, поэтому
+    // просмотр каталогов не ждет ее и не замедляется ею. Ход показывается на нижней рамке,
+    // а по завершении poll_background вызывает finish в потоке интерфейса и перечитывает каталог
+    void start_operation(const std::string& label, const std::shared_ptr<OperationProgress>& progress,
+                         const std::function<OperationResult()>& work,
+                         const std::function<void(const OperationResult&)>& finish);
+    bool has_operations() const;
     void set_size(int height, int width) {
         h = height;
         w = width;
         werase(win);
         wresize(win, h, w);
+        // Курсор должен остаться видимым при изменившемся числе строк
+        clamp_scroll();
     }
 
     void set_position(int y, int x) {
@@ -62,16 +145,123 @@ public:
 private:
     int y, x, h, w;
     WINDOW* win;
-    std::vector<std::string> files;
+    EntryList files;
     int selected_file;
     std::string current_dir;
     char current_dir_cstr[PATH_MAX];
     bool selected;
-    std::string tabs[10];
+    TaskPriority priority;
+    std::vector<Tab> tabs;
     int current_tab_index;
+    int inotify_fd;
+    unsigned long tab_clock;
+    size_t tab_cache_budget;
+    void init_tabs();
+    Tab make_tab() const;
+    void store_view(Tab& tab);
+    void load_view(Tab& tab);
+    void watch_tab(Tab& tab);
+    void unwatch_tab(Tab& tab);
+    void drain_watch_events();
+    void evict_tabs();
     void list_directory();
+    void start_revalidation();
     int scroll_position;
     int max_scroll_position;
+    SortMode sort_mode;
+    std::string filter;
+    int64_t dir_mtime_ns;
+    // Фоновая проверка снимка каталога, восстановленного из сеанса
+    struct Revalidation {
+        unsigned generation;
+        bool changed;
+        bool ok;
+        int64_t mtime_ns;
+        EntryList entries;
+    };
+    std::future<Revalidation> revalidation;
+    unsigned listing_generation;
+    // Метаданные, полученные в пуле ввода-вывода. Очередь принадлежит и панели, и задачам
+    // пула, поэтому переживает панель, если та закрылась раньше, чем закончился stat
+    struct MetadataResult {
+        unsigned generation;
+        size_t index;
+        FileEntry entry; // name_offset указывает в пул имен списка, для которого сделан запрос
+    };
+    struct MetadataInbox {
+        MetadataInbox() : in_flight(0) {}
+        std::mutex mutex;
+        std::vector<MetadataResult> results;
+        std::atomic<size_t> in_flight; // Запрошено, но еще не забрано панелью
+    };
+    std::shared_ptr<MetadataInbox> metadata_inbox;
+    std::vector<bool> metadata_requested;
+    unsigned metadata_generation;
+    int scroll_direction;
+    void reset_metadata();
+    void request_metadata(int start_index, int end_index);
+    bool poll_metadata();
+    // Запомненная позиция курсора и прокрутки в каталоге
+    struct DirPosition {
+        std::string selected_name;
+        int scroll_position;
+        unsigned long stamp;
+    };
+    std::vector<std::string> history;
+    size_t history_index;
+    std::unordered_map<std::string, DirPosition> positions;
+    unsigned long position_clock;
+    bool navigate_to(const std::string& new_dir, bool record_history);
+    void remember_position();
+    void restore_position(const std::string& previous_dir);
+    void clamp_scroll();
+    // Раскладка колонок и отформатированные строки видимой области. Строка i хранится в ячейке
+    // i % row_cache.size(), поэтому при прокрутке на строку форматируется только новая строка.
+    // Текст строк лежит в row_text, который выделяется заново только при смене раскладки
+    struct CachedRow {
+        int index;
+        uint64_t names_id; // Пул имен и смещение имени, по которым отформатирована строка
+        uint32_t name_offset;
+        off_t size;
+        time_t mtime;
+        mode_t mode;
+        bool has_info;
+        bool info_valid;
+        char* name;
+        char* size_text;
+        char* date_text;
+    };
+    ColumnLayout layout;
+    std::vector<CachedRow> row_cache;
+    std::vector<char> row_text;
+    ScratchArena frame_arena; // Временные строки кадра
+    DirectoryWatch watch;
+    void draw_watch();
+    DirectoryTree tree;
+    int tree_scroll;
+    void draw_tree();
+    // Фоновая упаковка: ход общий с потоком упаковки, процент запоминается, чтобы
+    // перерисовывать панель только при его изменении
+    std::shared_ptr<PackProgress> pack_progress;
+    std::future<OperationResult> pack_job;
+    std::string pack_archive;
+    int pack_percent;
+    bool poll_pack();
+    struct Operation {
+        std::string label;
+        std::shared_ptr<OperationProgress> progress; // Может быть пустым: тогда доля не выводится
+        std::future<OperationResult> job;
+        std::function<void(const OperationResult&)> finish;
+        std::chrono::steady_clock::time_point started;
+        std::string status; // Последняя выведенная строка хода
+    };
+    std::vector<Operation> operations;
+    std::string operation_status(const Operation& operation) const;
+    bool poll_operations();
+    // Ход упаковки и фоновых операций справа на нижней рамке
+    void draw_background_status();
+    void update_layout();
+    const CachedRow& format_row(int index);
 };
 
 #endif // FILEPANEL_H
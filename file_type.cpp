@@ -0,0 +1,400 @@
+#include "file_type.h"
+#include "binary_io.h"
+#include "file_entry.h"
+#include "profiler.h"
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <signal.h>
+#include <spawn.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+// Сколько файлов помнит кеш типов; при переполнении кеш очищается целиком
+#define FILE_TYPE_CACHE_ENTRIES 65536
+
+static const char* const FILE_TYPE_NAMES[FILE_TYPE_COUNT] = {
+    "none", "unknown", "text", "image", "audio", "video", "pdf", "document", "archive", "executable", "binary"
+};
+
+const char* file_type_name(FileType type) {
+    return type >= 0 && type < FILE_TYPE_COUNT ? FILE_TYPE_NAMES[type] : "unknown";
+}
+
+bool parse_file_type(const std::string& name, FileType& type) {
+    for (int i = FILE_TYPE_UNKNOWN; i < FILE_TYPE_COUNT; ++i) {
+        if (name == FILE_TYPE_NAMES[i]) {
+            type = static_cast<FileType>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool looks_binary(const char* data, size_t size) {
+    size_t control = 0;
+    for (size_t i = 0; i < size; ++i) {
+        unsigned char c = static_cast<unsigned char>(data[i]);
+        if (c == 0) {
+            return true;
+        }
+        if (c < 32 && c != '\n' && c != '\r' && c != '\t' && c != '\f' && c != '\b' && c != 27) {
+            control++;
+        }
+    }
+    return control * 10 > size;
+}
+
+// Сигнатура: байты magic по смещению offset
+struct Signature {
+    size_t offset;
+    const char* magic;
+    size_t length;
+    FileType type;
+};
+
+#define SIGNATURE(offset, magic, type) { offset, magic, sizeof(magic) - 1, type }
+
+// Надежные сигнатуры проверяются до разделения на текст и двоичные данные
+static const Signature SIGNATURES[] = {
+    SIGNATURE(0, "\x89PNG\r\n\x1a\n", FILE_TYPE_IMAGE),
+    SIGNATURE(0, "\xff\xd8\xff", FILE_TYPE_IMAGE),
+    SIGNATURE(0, "GIF87a", FILE_TYPE_IMAGE),
+    SIGNATURE(0, "GIF89a", FILE_TYPE_IMAGE),
+    SIGNATURE(0, "II*\0", FILE_TYPE_IMAGE),
+    SIGNATURE(0, "MM\0*", FILE_TYPE_IMAGE),
+    SIGNATURE(8, "WEBP", FILE_TYPE_IMAGE),
+    SIGNATURE(8, "AVI ", FILE_TYPE_VIDEO),
+    SIGNATURE(8, "WAVE", FILE_TYPE_AUDIO),
+    SIGNATURE(0, "\x1a\x45\xdf\xa3", FILE_TYPE_VIDEO), // Matroska и WebM
+    SIGNATURE(0, "\0\0\x01\xba", FILE_TYPE_VIDEO),     // MPEG-PS
+    SIGNATURE(0, "ID3", FILE_TYPE_AUDIO),
+    SIGNATURE(0, "OggS", FILE_TYPE_AUDIO),
+    SIGNATURE(0, "fLaC", FILE_TYPE_AUDIO),
+    SIGNATURE(0, "%PDF-", FILE_TYPE_PDF),
+    SIGNATURE(0, "\xd0\xcf\x11\xe0\xa1\xb1\x1a\xe1", FILE_TYPE_DOCUMENT), // doc, xls, ppt
+    SIGNATURE(0, "{\\rtf", FILE_TYPE_DOCUMENT),
+    SIGNATURE(0, "\x1f\x8b", FILE_TYPE_ARCHIVE),
+    SIGNATURE(0, "BZh", FILE_TYPE_ARCHIVE),
+    SIGNATURE(0, "\xfd" "7zXZ\0", FILE_TYPE_ARCHIVE),
+    SIGNATURE(0, "\x28\xb5\x2f\xfd", FILE_TYPE_ARCHIVE), // zstd
+    SIGNATURE(0, "7z\xbc\xaf\x27\x1c", FILE_TYPE_ARCHIVE),
+    SIGNATURE(0, "Rar!\x1a\x07", FILE_TYPE_ARCHIVE),
+    SIGNATURE(257, "ustar", FILE_TYPE_ARCHIVE),
+    SIGNATURE(0, "\x7f" "ELF", FILE_TYPE_EXECUTABLE),
+};
+
+// Ненадежные сигнатуры: короткие, поэтому учитываются только у двоичного содержимого
+static const Signature WEAK_SIGNATURES[] = {
+    SIGNATURE(0, "BM", FILE_TYPE_IMAGE),
+    SIGNATURE(0, "\xff\xfb", FILE_TYPE_AUDIO), // Кадр MPEG audio без тега ID3
+    SIGNATURE(0, "\xff\xf3", FILE_TYPE_AUDIO),
+    SIGNATURE(0, "MZ", FILE_TYPE_EXECUTABLE),
+};
+
+static bool matches(const char* data, size_t size, const Signature& signature) {
+    return size >= signature.offset + signature.length &&
+           memcmp(data + signature.offset, signature.magic, signature.length) == 0;
+}
+
+static bool has_extension(const char* name, const char* const* extensions) {
+    const char* dot = name != nullptr ? strrchr(name, '.') : nullptr;
+    for (size_t i = 0; dot != nullptr && extensions[i] != nullptr; ++i) {
+        if (strcasecmp(dot + 1, extensions[i]) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+FileType detect_file_type(const char* data, size_t size, const char* name) {
+    if (size == 0) {
+        return FILE_TYPE_TEXT;
+    }
+    // Документы Office Open XML, OpenDocument и EPUB - это ZIP-архивы
+    static const char* const zip_documents[] = {"docx", "xlsx", "pptx", "odt", "ods", "odp", "epub", nullptr};
+    if (size >= 4 && memcmp(data, "PK\x03\x04", 4) == 0) {
+        return has_extension(name, zip_documents) ? FILE_TYPE_DOCUMENT : FILE_TYPE_ARCHIVE;
+    }
+    // Контейнер ISO BMFF (mp4, m4a, heic): тип уточняет бренд после "ftyp"
+    if (size >= 12 && memcmp(data + 4, "ftyp", 4) == 0) {
+        if (memcmp(data + 8, "M4A ", 4) == 0) {
+            return FILE_TYPE_AUDIO;
+        }
+        if (memcmp(data + 8, "heic", 4) == 0 || memcmp(data + 8, "avif", 4) == 0) {
+            return FILE_TYPE_IMAGE;
+        }
+        return FILE_TYPE_VIDEO;
+    }
+    for (size_t i = 0; i < sizeof(SIGNATURES) / sizeof(SIGNATURES[0]); ++i) {
+        // Сигнатуры по смещению 8 относятся к контейнеру RIFF
+        if (matches(data, size, SIGNATURES[i]) && (SIGNATURES[i].offset != 8 || memcmp(data, "RIFF", 4) == 0)) {
+            return SIGNATURES[i].type;
+        }
+    }
+    if (!looks_binary(data, size)) {
+        return FILE_TYPE_TEXT;
+    }
+    for (size_t i = 0; i < sizeof(WEAK_SIGNATURES) / sizeof(WEAK_SIGNATURES[0]); ++i) {
+        if (matches(data, size, WEAK_SIGNATURES[i])) {
+            return WEAK_SIGNATURES[i].type;
+        }
+    }
+    return FILE_TYPE_BINARY;
+}
+
+// Ключ кеша типов: содержимое файла меняется вместе со временем изменения
+struct FileTypeKey {
+    dev_t dev;
+    ino_t ino;
+    int64_t mtime_ns;
+
+    bool operator==(const FileTypeKey& other) const {
+        return dev == other.dev && ino == other.ino && mtime_ns == other.mtime_ns;
+    }
+};
+
+struct FileTypeKeyHash {
+    size_t operator()(const FileTypeKey& key) const {
+        uint64_t hash = static_cast<uint64_t>(key.ino) * 0x9e3779b97f4a7c15ULL;
+        hash ^= static_cast<uint64_t>(key.dev) + (hash >> 29);
+        hash ^= static_cast<uint64_t>(key.mtime_ns) * 0xbf58476d1ce4e5b9ULL;
+        return static_cast<size_t>(hash ^ (hash >> 32));
+    }
+};
+
+static std::mutex type_cache_mutex;
+static std::unordered_map<FileTypeKey, FileType, FileTypeKeyHash> type_cache;
+
+FileType detect_file_type_at(int dir_fd, const char* name, bool follow_links) {
+    // O_NONBLOCK: если на месте файла успел появиться FIFO, открытие не повиснет
+    int fd = openat(dir_fd, name, O_RDONLY | O_CLOEXEC | O_NOCTTY | O_NONBLOCK | (follow_links ? 0 : O_NOFOLLOW));
+    if (fd < 0) {
+        return FILE_TYPE_UNKNOWN;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        close(fd);
+        return FILE_TYPE_UNKNOWN;
+    }
+
+    FileTypeKey key = {st.st_dev, st.st_ino, stat_mtime_ns(st)};
+    {
+        std::lock_guard<std::mutex> lock(type_cache_mutex);
+        std::unordered_map<FileTypeKey, FileType, FileTypeKeyHash>::const_iterator it = type_cache.find(key);
+        if (it != type_cache.end()) {
+            close(fd);
+            return it->second;
+        }
+    }
+
+    char data[FILE_TYPE_SNIFF_BYTES];
+    ssize_t got;
+    do {
+        got = pread(fd, data, sizeof(data), 0);
+    } while (got < 0 && errno == EINTR);
+    close(fd);
+    if (got < 0) {
+        return FILE_TYPE_UNKNOWN;
+    }
+
+    FileType type = detect_file_type(data, static_cast<size_t>(got), name);
+    std::lock_guard<std::mutex> lock(type_cache_mutex);
+    if (type_cache.size() >= FILE_TYPE_CACHE_ENTRIES) {
+        type_cache.clear();
+    }
+    type_cache[key] = type;
+    return type;
+}
+
+// Разбивает строку на слова по пробелам; кавычки не поддерживаются
+static std::vector<std::string> split_words(const std::string& line) {
+    std::vector<std::string> words;
+    size_t position = 0;
+    while (position < line.size()) {
+        size_t start = line.find_first_not_of(" \t", position);
+        if (start == std::string::npos) {
+            break;
+        }
+        size_t end = line.find_first_of(" \t", start);
+        if (end == std::string::npos) {
+            end = line.size();
+        }
+        words.push_back(line.substr(start, end - start));
+        position = end;
+    }
+    return words;
+}
+
+static std::string lowercase(std::string text) {
+    for (size_t i = 0; i < text.size(); ++i) {
+        text[i] = static_cast<char>(tolower(static_cast<unsigned char>(text[i])));
+    }
+    return text;
+}
+
+OpenerTable::OpenerTable() {
+    static const char* const defaults[] = {
+        "text gedit",
+        "image eog",
+        "audio vlc",
+        "video vlc",
+        "pdf evince",
+        "document libreoffice",
+        "archive file-roller",
+    };
+    for (size_t i = 0; i < sizeof(defaults) / sizeof(defaults[0]); ++i) {
+        parse_line(defaults[i]);
+    }
+}
+
+bool OpenerTable::parse_line(const std::string& line) {
+    std::vector<std::string> words = split_words(line);
+    if (words.empty() || words[0][0] == '#') {
+        return true;
+    }
+    if (words.size() < 2) {
+        return false;
+    }
+    std::vector<std::string> command(words.begin() + 1, words.end());
+    if (words[0].compare(0, 2, "*.") == 0 && words[0].size() > 2) {
+        by_extension[lowercase(words[0].substr(2))] = command;
+        return true;
+    }
+    FileType type;
+    if (!parse_file_type(words[0], type)) {
+        return false;
+    }
+    by_type[type] = command;
+    return true;
+}
+
+bool OpenerTable::load(const std::string& path) {
+    MappedFile file;
+    if (path.empty() || !file.open(path)) {
+        return false;
+    }
+    const char* data = file.data();
+    size_t start = 0;
+    bool ok = true;
+    for (size_t i = 0; i <= file.size(); ++i) {
+        if (i == file.size() || data[i] == '\n') {
+            ok = parse_line(std::string(data + start, i - start)) && ok;
+            start = i + 1;
+        }
+    }
+    return ok;
+}
+
+std::vector<std::string> OpenerTable::command_for(const std::string& path, FileType type) const {
+    std::vector<std::string> command;
+    size_t slash = path.find_last_of('/');
+    size_t dot = path.find_last_of('.');
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+        std::unordered_map<std::string, std::vector<std::string> >::const_iterator it =
+                by_extension.find(lowercase(path.substr(dot + 1)));
+        if (it != by_extension.end()) {
+            command = it->second;
+        }
+    }
+    if (command.empty() && type > FILE_TYPE_NONE && type < FILE_TYPE_COUNT) {
+        command = by_type[type];
+    }
+    if (command.empty()) {
+        return command;
+    }
+
+    bool substituted = false;
+    for (size_t i = 1; i < command.size(); ++i) {
+        if (command[i] == "%f") {
+            command[i] = path;
+            substituted = true;
+        }
+    }
+    if (!substituted) {
+        command.push_back(path);
+    }
+    return command;
+}
+
+std::string default_openers_path() {
+    const char* home = getenv("HOME");
+    if (home == nullptr || home[0] == '\0') {
+        return "";
+    }
+    return std::string(home) + "/.file_manager_openers";
+}
+
+const OpenerTable& opener_table() {
+    static OpenerTable table;
+    static bool loaded = false;
+    if (!loaded) {
+        table.load(default_openers_path());
+        loaded = true;
+    }
+    return table;
+}
+
+static std::mutex launched_mutex;
+static std::vector<pid_t> launched;
+
+bool launch_detached(const std::vector<std::string>& argv, std::string& error) {
+    PROFILE_COUNT(COUNTER_SUBPROCESS, 1);
+    reap_launched();
+
+    std::vector<char*> args;
+    for (size_t i = 0; i < argv.size(); ++i) {
+        args.push_back(const_cast<char*>(argv[i].c_str()));
+    }
+    args.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
+    posix_spawn_file_actions_addopen(&actions, STDIN_FILENO, "/dev/null", O_RDONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    posix_spawn_file_actions_addopen(&actions, STDERR_FILENO, "/dev/null", O_WRONLY, 0);
+
+    // Обработчики и маска сигналов интерфейса программе не нужны
+    posix_spawnattr_t attributes;
+    posix_spawnattr_init(&attributes);
+    sigset_t signals;
+    sigemptyset(&signals);
+    posix_spawnattr_setsigmask(&attributes, &signals);
+    sigaddset(&signals, SIGPIPE);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGQUIT);
+    sigaddset(&signals, SIGTSTP);
+    posix_spawnattr_setsigdefault(&attributes, &signals);
+    posix_spawnattr_setflags(&attributes, POSIX_SPAWN_SETSID | POSIX_SPAWN_SETSIGMASK | POSIX_SPAWN_SETSIGDEF);
+
+    pid_t pid;
+    int result = posix_spawnp(&pid, args[0], &actions, &attributes, &args[0], environ);
+    posix_spawnattr_destroy(&attributes);
+    posix_spawn_file_actions_destroy(&actions);
+    if (result != 0) {
+        error = argv[0] + ": " + strerror(result);
+        return false;
+    }
+
+    std::lock_guard<std::mutex> lock(launched_mutex);
+    launched.push_back(pid);
+    return true;
+}
+
+void reap_launched() {
+    std::lock_guard<std::mutex> lock(launched_mutex);
+    for (size_t i = 0; i < launched.size();) {
+        int status;
+        pid_t result = waitpid(launched[i], &status, WNOHANG);
+        if (result == launched[i] || (result < 0 && errno == ECHILD)) {
+            launched[i] = launched.back();
+            launched.pop_back();
+        } else {
+            ++i;
+        }
+    }
+}
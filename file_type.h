@@ -0,0 +1,71 @@
+#ifndef FILE_TYPE_H
+#define FILE_TYPE_H
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <cstddef>
+
+// Сколько байт начала файла читается для определения типа
+#define FILE_TYPE_SNIFF_BYTES 512
+
+// Тип содержимого файла, определенный по сигнатуре начала файла, а не по расширению
+enum FileType {
+    FILE_TYPE_NONE = 0, // Тип еще не определялся
+    FILE_TYPE_UNKNOWN,  // Начало файла прочитать не удалось
+    FILE_TYPE_TEXT,
+    FILE_TYPE_IMAGE,
+    FILE_TYPE_AUDIO,
+    FILE_TYPE_VIDEO,
+    FILE_TYPE_PDF,
+    FILE_TYPE_DOCUMENT,
+    FILE_TYPE_ARCHIVE,
+    FILE_TYPE_EXECUTABLE,
+    FILE_TYPE_BINARY,
+    FILE_TYPE_COUNT
+};
+
+const char* file_type_name(FileType type);
+bool parse_file_type(const std::string& name, FileType& type);
+// Двоичным считается содержимое с нулевыми байтами или с большой долей управляющих символов
+bool looks_binary(const char* data, size_t size);
+// Определяет тип по первым байтам файла. Имя нужно только для контейнеров ZIP:
+// по сигнатуре docx и odt не отличить от обычного архива
+FileType detect_file_type(const char* data, size_t size, const char* name);
+// Определяет тип обычного файла name в каталоге dir_fd; символическая ссылка по умолчанию не
+// считается обычным файлом. Результат кешируется по устройству, inode и времени изменения,
+// поэтому повторный запрос того же содержимого не читает файл. Вызывается из потоков пула
+FileType detect_file_type_at(int dir_fd, const char* name, bool follow_links = false);
+
+// Таблица программ для открытия файлов. Программа выбирается сначала по расширению, затем
+// по типу содержимого. Таблицу можно дополнить файлом ~/.file_manager_openers, строки которого
+// имеют вид "ТИП программа [аргументы]" или "*.расширение программа [аргументы]"; аргумент %f
+// заменяется путем к файлу, без него путь передается последним аргументом
+class OpenerTable {
+public:
+    OpenerTable();
+
+    // Дополняет таблицу строками файла настроек; строки файла заменяют встроенные
+    bool load(const std::string& path);
+    // Аргументы запуска для файла или пустой вектор, если программы для него нет
+    std::vector<std::string> command_for(const std::string& path, FileType type) const;
+
+private:
+    bool parse_line(const std::string& line);
+
+    std::vector<std::string> by_type[FILE_TYPE_COUNT];
+    std::unordered_map<std::string, std::vector<std::string> > by_extension;
+};
+
+std::string default_openers_path();
+// Общая таблица программ, при первом обращении загружается из файла настроек
+const OpenerTable& opener_table();
+
+// Запускает программу, не дожидаясь ее завершения: posix_spawnp в отдельном сеансе, чтобы
+// программа не получала сигналы терминала, а ввод и вывод перенаправлены в /dev/null, чтобы
+// она не рисовала поверх интерфейса
+bool launch_detached(const std::vector<std::string>& argv, std::string& error);
+// Забирает статус завершившихся запущенных программ, не блокируясь
+void reap_launched();
+
+#endif // FILE_TYPE_H
@@ -0,0 +1,217 @@
+#include "frecency.h"
+#include "binary_io.h"
+#include <algorithm>
+#include <cctype>
+#include <cstdlib>
+
+// Сигнатура и версия формата файла базы
+static const uint32_t FRECENCY_MAGIC = 0x52464d46; // "FMFR"
+static const uint32_t FRECENCY_VERSION = 1;
+
+// Когда суммарное число посещений превышает этот предел, счетчики уменьшаются,
+// чтобы давние привычки постепенно уступали место новым
+static const uint64_t MAX_TOTAL_VISITS = 10000;
+
+FrecencyDb frecency_db;
+
+// Возвращает путь к файлу базы в домашнем каталоге пользователя
+std::string default_frecency_path() {
+    const char* home = getenv("HOME");
+    if (home == nullptr || home[0] == '\0') {
+        return "";
+    }
+    return std::string(home) + "/.file_manager_frecency";
+}
+
+FrecencyDb::FrecencyDb() : total_visits(0) {}
+
+// Загружает базу из файла, отображая его в память
+bool FrecencyDb::load(const std::string& path) {
+    MappedFile file;
+    if (path.empty() || !file.open(path)) {
+        return false;
+    }
+
+    BinaryReader reader(file.data(), file.size());
+    if (reader.get_u32() != FRECENCY_MAGIC || reader.get_u32() != FRECENCY_VERSION) {
+        return false;
+    }
+
+    std::vector<Record> loaded;
+    uint32_t count = reader.get_u32();
+    for (uint32_t i = 0; i < count && reader.good(); ++i) {
+        Record record;
+        record.visits = reader.get_u32();
+        record.last_visit = reader.get_i64();
+        record.path = reader.get_short_string();
+        loaded.push_back(record);
+    }
+    if (!reader.good()) {
+        return false;
+    }
+
+    // Заменяем содержимое базы и перестраиваем индекс по путям
+    records.swap(loaded);
+    index.clear();
+    total_visits = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        index[records[i].path] = i;
+        total_visits += records[i].visits;
+    }
+    return true;
+}
+
+// Сохраняет базу: каждая запись занимает 14 байт плюс длина пути
+bool FrecencyDb::save(const std::string& path) const {
+    BinaryWriter writer;
+    writer.put_u32(FRECENCY_MAGIC);
+    writer.put_u32(FRECENCY_VERSION);
+    writer.put_u32(static_cast<uint32_t>(records.size()));
+    for (size_t i = 0; i < records.size(); ++i) {
+        writer.put_u32(records[i].visits);
+        writer.put_i64(records[i].last_visit);
+        writer.put_short_string(records[i].path);
+    }
+    return write_file_atomic(path, writer.data());
+}
+
+// Учитывает посещение каталога
+void FrecencyDb::add_visit(const std::string& dir) {
+    // Пути длиннее 16-битного поля длины в базу не попадают
+    if (dir.empty() || dir.size() > 0xffff) {
+        return;
+    }
+
+    std::unordered_map<std::string, size_t>::iterator it = index.find(dir);
+    if (it == index.end()) {
+        Record record;
+        record.path = dir;
+        record.visits = 0;
+        record.last_visit = 0;
+        index[dir] = records.size();
+        records.push_back(record);
+        it = index.find(dir);
+    }
+
+    Record& record = records[it->second];
+    record.visits++;
+    record.last_visit = time(nullptr);
+    total_visits++;
+
+    if (total_visits > MAX_TOTAL_VISITS) {
+        age();
+    }
+}
+
+// Удаляет каталог из базы, например если он больше не существует
+void FrecencyDb::remove(const std::string& dir) {
+    std::unordered_map<std::string, size_t>::iterator it = index.find(dir);
+    if (it == index.end()) {
+        return;
+    }
+
+    // Переносим последнюю запись на место удаляемой, чтобы не сдвигать массив
+    size_t position = it->second;
+    total_visits -= records[position].visits;
+    index.erase(it);
+    if (position != records.size() - 1) {
+        records[position] = records.back();
+        index[records[position].path] = position;
+    }
+    records.pop_back();
+}
+
+// Уменьшает счетчики посещений и забывает каталоги, которые давно не посещались
+void FrecencyDb::age() {
+    std::vector<Record> kept;
+    total_visits = 0;
+    for (size_t i = 0; i < records.size(); ++i) {
+        Record record = records[i];
+        record.visits = record.visits * 9 / 10;
+        if (record.visits > 0) {
+            total_visits += record.visits;
+            kept.push_back(record);
+        }
+    }
+
+    records.swap(kept);
+    index.clear();
+    for (size_t i = 0; i < records.size(); ++i) {
+        index[records[i].path] = i;
+    }
+}
+
+// Оценка каталога: число посещений, умноженное на вес давности последнего посещения
+double FrecencyDb::score(const Record& record, time_t now) const {
+    int64_t age_seconds = now - record.last_visit;
+    double weight;
+    if (age_seconds < 3600) {
+        weight = 4.0;
+    } else if (age_seconds < 86400) {
+        weight = 2.0;
+    } else if (age_seconds < 7 * 86400) {
+        weight = 0.5;
+    } else {
+        weight = 0.25;
+    }
+    return record.visits * weight;
+}
+
+// Проверяет, что все слова шаблона встречаются в пути в том же порядке без учета регистра
+static bool matches(const std::string& path, const std::vector<std::string>& words) {
+    size_t position = 0;
+    for (size_t i = 0; i < words.size(); ++i) {
+        std::string::const_iterator found = std::search(path.begin() + position, path.end(), words[i].begin(), words[i].end(),
+                                                        [](char a, char b) {
+                                                            return tolower(static_cast<unsigned char>(a)) == b;
+                                                        });
+        if (found == path.end()) {
+            return false;
+        }
+        position = (found - path.begin()) + words[i].size();
+    }
+    return true;
+}
+
+// Возвращает не более limit каталогов, подходящих под шаблон, в порядке убывания оценки
+std::vector<std::string> FrecencyDb::query(const std::string& pattern, size_t limit) const {
+    // Разбиваем шаблон на слова в нижнем регистре
+    std::vector<std::string> words;
+    std::string word;
+    for (size_t i = 0; i <= pattern.size(); ++i) {
+        if (i == pattern.size() || pattern[i] == ' ') {
+            if (!word.empty()) {
+                words.push_back(word);
+                word.clear();
+            }
+        } else {
+            word.push_back(tolower(static_cast<unsigned char>(pattern[i])));
+        }
+    }
+
+    // Оцениваем подходящие каталоги
+    time_t now = time(nullptr);
+    std::vector<std::pair<double, const Record*> > ranked;
+    for (size_t i = 0; i < records.size(); ++i) {
+        if (matches(records[i].path, words)) {
+            ranked.push_back(std::make_pair(score(records[i], now), &records[i]));
+        }
+    }
+
+    // Частично сортируем, так как нужны только лучшие результаты.
+    // При равной оценке выше стоит более короткий путь
+    size_t count = std::min(limit, ranked.size());
+    std::partial_sort(ranked.begin(), ranked.begin() + count, ranked.end(),
+                      [](const std::pair<double, const Record*>& a, const std::pair<double, const Record*>& b) {
+                          if (a.first != b.first) {
+                              return a.first > b.first;
+                          }
+                          return a.second->path.size() < b.second->path.size();
+                      });
+
+    std::vector<std::string> result;
+    for (size_t i = 0; i < count; ++i) {
+        result.push_back(ranked[i].second->path);
+    }
+    return result;
+}
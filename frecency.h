@@ -0,0 +1,40 @@
+#ifndef FRECENCY_H
+#define FRECENCY_H
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <ctime>
+
+// База посещенных каталогов, ранжированных по частоте и давности посещений
+class FrecencyDb {
+public:
+    FrecencyDb();
+
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+    void add_visit(const std::string& dir);
+    void remove(const std::string& dir);
+    std::vector<std::string> query(const std::string& pattern, size_t limit) const;
+
+private:
+    struct Record {
+        std::string path;
+        uint32_t visits;
+        int64_t last_visit;
+    };
+
+    double score(const Record& record, time_t now) const;
+    void age();
+
+    std::vector<Record> records;
+    std::unordered_map<std::string, size_t> index;
+    uint64_t total_visits;
+};
+
+extern FrecencyDb frecency_db;
+
+std::string default_frecency_path();
+
+#endif // FRECENCY_H
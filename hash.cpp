@@ -0,0 +1,675 @@
+#include "hash.h"
+#include "io_scheduler.h"
+#include "profiler.h"
+#include "tree_walker.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <mutex>
+#include <unordered_map>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <cpuid.h>
+#include <immintrin.h>
+#define HASH_X86 1
+#endif
+
+// Размер буфера чтения при хешировании файлов
+#define HASH_BUFFER_SIZE (1024 * 1024)
+// Сколько сумм хранит кеш
+#define HASH_CACHE_CAPACITY 16384
+
+const char* hash_algorithm_name(HashAlgorithm algorithm) {
+    switch (algorithm) {
+        case HASH_BLAKE3:
+            return "blake3";
+        case HASH_CRC32C:
+            return "crc32c";
+        default:
+            return "sha256";
+    }
+}
+
+bool parse_hash_algorithm(const std::string& name, HashAlgorithm& algorithm) {
+    for (int i = 0; i < HASH_ALGORITHM_COUNT; ++i) {
+        if (name == hash_algorithm_name(static_cast<HashAlgorithm>(i))) {
+            algorithm = static_cast<HashAlgorithm>(i);
+            return true;
+        }
+    }
+    return false;
+}
+
+// Возможности процессора, определяются один раз через cpuid
+struct CpuFeatures {
+    bool sha;
+    bool sse42;
+};
+
+static CpuFeatures detect_cpu_features() {
+    CpuFeatures features = {false, false};
+#ifdef HASH_X86
+    unsigned eax, ebx, ecx, edx;
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        bool ssse3 = (ecx & (1u << 9)) != 0;
+        bool sse41 = (ecx & (1u << 19)) != 0;
+        features.sse42 = (ecx & (1u << 20)) != 0;
+        if (ssse3 && sse41 && __get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+            features.sha = (ebx & (1u << 29)) != 0;
+        }
+    }
+#endif
+    return features;
+}
+
+static const CpuFeatures& cpu_features() {
+    static const CpuFeatures features = detect_cpu_features();
+    return features;
+}
+
+static std::string to_hex(const uint8_t* bytes, size_t size) {
+    static const char digits[] = "0123456789abcdef";
+    std::string hex(size * 2, '0');
+    for (size_t i = 0; i < size; ++i) {
+        hex[i * 2] = digits[bytes[i] >> 4];
+        hex[i * 2 + 1] = digits[bytes[i] & 15];
+    }
+    return hex;
+}
+
+// ---- SHA-256 ----
+
+static const uint32_t SHA256_K[64] = {
+    0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+    0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+    0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+    0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+    0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+    0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+    0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+    0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+static inline uint32_t rotr32(uint32_t value, int bits) {
+    return (value >> bits) | (value << (32 - bits));
+}
+
+static void sha256_compress_portable(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    for (; blocks > 0; --blocks, data += 64) {
+        uint32_t w[64];
+        for (int i = 0; i < 16; ++i) {
+            w[i] = (static_cast<uint32_t>(data[i * 4]) << 24) | (static_cast<uint32_t>(data[i * 4 + 1]) << 16) |
+                   (static_cast<uint32_t>(data[i * 4 + 2]) << 8) | data[i * 4 + 3];
+        }
+        for (int i = 16; i < 64; ++i) {
+            uint32_t s0 = rotr32(w[i - 15], 7) ^ rotr32(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            uint32_t s1 = rotr32(w[i - 2], 17) ^ rotr32(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+
+        uint32_t a = state[0], b = state[1], c = state[2], d = state[3];
+        uint32_t e = state[4], f = state[5], g = state[6], h = state[7];
+        for (int i = 0; i < 64; ++i) {
+            uint32_t s1 = rotr32(e, 6) ^ rotr32(e, 11) ^ rotr32(e, 25);
+            uint32_t ch = (e & f) ^ (~e & g);
+            uint32_t t1 = h + s1 + ch + SHA256_K[i] + w[i];
+            uint32_t s0 = rotr32(a, 2) ^ rotr32(a, 13) ^ rotr32(a, 22);
+            uint32_t maj = (a & b) ^ (a & c) ^ (b & c);
+            uint32_t t2 = s0 + maj;
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#ifdef HASH_X86
+// SHA-256 на инструкциях SHA-NI: четыре раунда на пару sha256rnds2, расписание сообщения
+// строится sha256msg1/sha256msg2 по скользящему окну из четырех групп слов
+__attribute__((target("sha,ssse3,sse4.1")))
+static void sha256_compress_shani(uint32_t state[8], const uint8_t* data, size_t blocks) {
+    const __m128i byte_swap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+
+    // Перекладываем состояние в порядок ABEF/CDGH, которого ждут инструкции
+    __m128i tmp = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[0]));
+    __m128i state1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&state[4]));
+    tmp = _mm_shuffle_epi32(tmp, 0xB1);
+    state1 = _mm_shuffle_epi32(state1, 0x1B);
+    __m128i state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks > 0; --blocks, data += 64) {
+        __m128i abef_save = state0;
+        __m128i cdgh_save = state1;
+        __m128i words[4];
+        for (int group = 0; group < 16; ++group) {
+            __m128i& current = words[group % 4];
+            if (group < 4) {
+                current = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + group * 16)), byte_swap);
+            } else {
+                const __m128i& previous = words[(group + 3) % 4];
+                __m128i mixed = _mm_sha256msg1_epu32(current, words[(group + 1) % 4]);
+                mixed = _mm_add_epi32(mixed, _mm_alignr_epi8(previous, words[(group + 2) % 4], 4));
+                current = _mm_sha256msg2_epu32(mixed, previous);
+            }
+            __m128i message = _mm_add_epi32(current, _mm_loadu_si128(reinterpret_cast<const __m128i*>(&SHA256_K[group * 4])));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, message);
+            message = _mm_shuffle_epi32(message, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, message);
+        }
+        state0 = _mm_add_epi32(state0, abef_save);
+        state1 = _mm_add_epi32(state1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    state0 = _mm_blend_epi16(tmp, state1, 0xF0);
+    state1 = _mm_alignr_epi8(state1, tmp, 8);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[0]), state0);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(&state[4]), state1);
+}
+#endif
+
+static void sha256_compress(uint32_t state[8], const uint8_t* data, size_t blocks) {
+#ifdef HASH_X86
+    if (cpu_features().sha) {
+        sha256_compress_shani(state, data, blocks);
+        return;
+    }
+#endif
+    sha256_compress_portable(state, data, blocks);
+}
+
+static void sha256_init(Sha256State& state) {
+    static const uint32_t iv[8] = {0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+                                   0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19};
+    memcpy(state.h, iv, sizeof(iv));
+    state.buffered = 0;
+    state.length = 0;
+}
+
+static void sha256_update(Sha256State& state, const uint8_t* data, size_t size) {
+    state.length += size;
+    if (state.buffered > 0) {
+        size_t take = std::min(size, 64 - state.buffered);
+        memcpy(state.buffer + state.buffered, data, take);
+        state.buffered += take;
+        data += take;
+        size -= take;
+        if (state.buffered < 64) {
+            return;
+        }
+        sha256_compress(state.h, state.buffer, 1);
+        state.buffered = 0;
+    }
+    // Полные блоки обрабатываются прямо из входных данных
+    size_t blocks = size / 64;
+    if (blocks > 0) {
+        sha256_compress(state.h, data, blocks);
+        data += blocks * 64;
+        size -= blocks * 64;
+    }
+    memcpy(state.buffer, data, size);
+    state.buffered = size;
+}
+
+static std::string sha256_final(Sha256State& state) {
+    uint64_t bits = state.length * 8;
+    uint8_t padding[72] = {0x80};
+    size_t pad = (state.buffered < 56 ? 56 : 120) - state.buffered;
+    for (int i = 0; i < 8; ++i) {
+        padding[pad + i] = static_cast<uint8_t>(bits >> (56 - i * 8));
+    }
+    sha256_update(state, padding, pad + 8);
+
+    uint8_t digest[32];
+    for (int i = 0; i < 8; ++i) {
+        digest[i * 4] = static_cast<uint8_t>(state.h[i] >> 24);
+        digest[i * 4 + 1] = static_cast<uint8_t>(state.h[i] >> 16);
+        digest[i * 4 + 2] = static_cast<uint8_t>(state.h[i] >> 8);
+        digest[i * 4 + 3] = static_cast<uint8_t>(state.h[i]);
+    }
+    return to_hex(digest, sizeof(digest));
+}
+
+// ---- BLAKE3 (режим хеширования без ключа, 256-битный результат) ----
+
+static const uint32_t BLAKE3_IV[8] = {0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A,
+                                      0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+static const uint8_t BLAKE3_PERMUTATION[16] = {2, 6, 3, 10, 7, 0, 4, 13, 1, 11, 12, 5, 9, 14, 15, 8};
+
+enum Blake3Flags {
+    BLAKE3_CHUNK_START = 1,
+    BLAKE3_CHUNK_END = 2,
+    BLAKE3_PARENT = 4,
+    BLAKE3_ROOT = 8
+};
+
+#define BLAKE3_CHUNK_LEN 1024
+
+static inline void blake3_g(uint32_t* s, int a, int b, int c, int d, uint32_t mx, uint32_t my) {
+    s[a] = s[a] + s[b] + mx;
+    s[d] = rotr32(s[d] ^ s[a], 16);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 12);
+    s[a] = s[a] + s[b] + my;
+    s[d] = rotr32(s[d] ^ s[a], 8);
+    s[c] = s[c] + s[d];
+    s[b] = rotr32(s[b] ^ s[c], 7);
+}
+
+static void blake3_compress(const uint32_t cv[8], const uint8_t block[64], uint32_t block_len, uint64_t counter,
+                            uint32_t flags, uint32_t out[16]) {
+    uint32_t m[16];
+    for (int i = 0; i < 16; ++i) {
+        m[i] = static_cast<uint32_t>(block[i * 4]) | (static_cast<uint32_t>(block[i * 4 + 1]) << 8) |
+               (static_cast<uint32_t>(block[i * 4 + 2]) << 16) | (static_cast<uint32_t>(block[i * 4 + 3]) << 24);
+    }
+    uint32_t s[16] = {cv[0], cv[1], cv[2], cv[3], cv[4], cv[5], cv[6], cv[7],
+                      BLAKE3_IV[0], BLAKE3_IV[1], BLAKE3_IV[2], BLAKE3_IV[3],
+                      static_cast<uint32_t>(counter), static_cast<uint32_t>(counter >> 32), block_len, flags};
+    for (int round = 0; round < 7; ++round) {
+        blake3_g(s, 0, 4, 8, 12, m[0], m[1]);
+        blake3_g(s, 1, 5, 9, 13, m[2], m[3]);
+        blake3_g(s, 2, 6, 10, 14, m[4], m[5]);
+        blake3_g(s, 3, 7, 11, 15, m[6], m[7]);
+        blake3_g(s, 0, 5, 10, 15, m[8], m[9]);
+        blake3_g(s, 1, 6, 11, 12, m[10], m[11]);
+        blake3_g(s, 2, 7, 8, 13, m[12], m[13]);
+        blake3_g(s, 3, 4, 9, 14, m[14], m[15]);
+        if (round < 6) {
+            uint32_t permuted[16];
+            for (int i = 0; i < 16; ++i) {
+                permuted[i] = m[BLAKE3_PERMUTATION[i]];
+            }
+            memcpy(m, permuted, sizeof(m));
+        }
+    }
+    for (int i = 0; i < 8; ++i) {
+        out[i] = s[i] ^ s[i + 8];
+        out[i + 8] = s[i + 8] ^ cv[i];
+    }
+}
+
+static void blake3_chunk_reset(Blake3State& state, uint64_t counter) {
+    memcpy(state.chunk_cv, BLAKE3_IV, sizeof(BLAKE3_IV));
+    state.chunk_counter = counter;
+    memset(state.block, 0, sizeof(state.block));
+    state.block_len = 0;
+    state.blocks_compressed = 0;
+}
+
+static void blake3_init(Blake3State& state) {
+    blake3_chunk_reset(state, 0);
+    state.cv_stack_len = 0;
+}
+
+static uint32_t blake3_chunk_start_flag(const Blake3State& state) {
+    return state.blocks_compressed == 0 ? BLAKE3_CHUNK_START : 0;
+}
+
+// Значение цепочки родительского узла по двум дочерним
+static void blake3_parent_cv(const uint32_t left[8], const uint32_t right[8], uint32_t flags, uint32_t out_cv[8]) {
+    uint8_t block[64];
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            block[i * 4 + j] = static_cast<uint8_t>(left[i] >> (j * 8));
+            block[32 + i * 4 + j] = static_cast<uint8_t>(right[i] >> (j * 8));
+        }
+    }
+    uint32_t out[16];
+    blake3_compress(BLAKE3_IV, block, 64, 0, BLAKE3_PARENT | flags, out);
+    memcpy(out_cv, out, 8 * sizeof(uint32_t));
+}
+
+static void blake3_update(Blake3State& state, const uint8_t* data, size_t size) {
+    while (size > 0) {
+        // Заполненный фрагмент сворачивается в значение цепочки и сливается с соседями по дереву
+        if (state.blocks_compressed * 64 + state.block_len == BLAKE3_CHUNK_LEN) {
+            uint32_t out[16];
+            blake3_compress(state.chunk_cv, state.block, state.block_len, state.chunk_counter,
+                            blake3_chunk_start_flag(state) | BLAKE3_CHUNK_END, out);
+            uint32_t cv[8];
+            memcpy(cv, out, sizeof(cv));
+            uint64_t total_chunks = state.chunk_counter + 1;
+            while ((total_chunks & 1) == 0) {
+                state.cv_stack_len--;
+                blake3_parent_cv(state.cv_stack[state.cv_stack_len], cv, 0, cv);
+                total_chunks >>= 1;
+            }
+            memcpy(state.cv_stack[state.cv_stack_len++], cv, sizeof(cv));
+            blake3_chunk_reset(state, state.chunk_counter + 1);
+        }
+
+        // Заполненный блок внутри фрагмента сжимается, только когда известно, что он не последний
+        if (state.block_len == 64) {
+            uint32_t out[16];
+            blake3_compress(state.chunk_cv, state.block, 64, state.chunk_counter, blake3_chunk_start_flag(state), out);
+            memcpy(state.chunk_cv, out, 8 * sizeof(uint32_t));
+            state.blocks_compressed++;
+            memset(state.block, 0, sizeof(state.block));
+            state.block_len = 0;
+        }
+        size_t take = std::min(size, static_cast<size_t>(64) - state.block_len);
+        memcpy(state.block + state.block_len, data, take);
+        state.block_len += take;
+        data += take;
+        size -= take;
+    }
+}
+
+static std::string blake3_final(Blake3State& state) {
+    // Выход последнего фрагмента поднимается по стеку до корня
+    uint32_t input_cv[8];
+    uint8_t block[64];
+    uint32_t block_len = state.block_len;
+    uint32_t flags = blake3_chunk_start_flag(state) | BLAKE3_CHUNK_END;
+    uint64_t counter = state.chunk_counter;
+    memcpy(input_cv, state.chunk_cv, sizeof(input_cv));
+    memcpy(block, state.block, sizeof(block));
+
+    for (size_t remaining = state.cv_stack_len; remaining > 0; --remaining) {
+        uint32_t out[16];
+        blake3_compress(input_cv, block, block_len, counter, flags, out);
+        const uint32_t* left = state.cv_stack[remaining - 1];
+        for (int i = 0; i < 8; ++i) {
+            for (int j = 0; j < 4; ++j) {
+                block[i * 4 + j] = static_cast<uint8_t>(left[i] >> (j * 8));
+                block[32 + i * 4 + j] = static_cast<uint8_t>(out[i] >> (j * 8));
+            }
+        }
+        memcpy(input_cv, BLAKE3_IV, sizeof(input_cv));
+        block_len = 64;
+        counter = 0;
+        flags = BLAKE3_PARENT;
+    }
+
+    uint32_t out[16];
+    blake3_compress(input_cv, block, block_len, counter, flags | BLAKE3_ROOT, out);
+    uint8_t digest[32];
+    for (int i = 0; i < 8; ++i) {
+        for (int j = 0; j < 4; ++j) {
+            digest[i * 4 + j] = static_cast<uint8_t>(out[i] >> (j * 8));
+        }
+    }
+    return to_hex(digest, sizeof(digest));
+}
+
+// ---- CRC32C (полином Кастаньоли) ----
+
+static uint32_t crc32c_table[256];
+
+static void crc32c_init_table() {
+    for (uint32_t i = 0; i < 256; ++i) {
+        uint32_t crc = i;
+        for (int j = 0; j < 8; ++j) {
+            crc = (crc >> 1) ^ (0x82F63B78 & (0 - (crc & 1)));
+        }
+        crc32c_table[i] = crc;
+    }
+}
+
+static uint32_t crc32c_portable(uint32_t crc, const uint8_t* data, size_t size) {
+    static std::once_flag table_ready;
+    std::call_once(table_ready, crc32c_init_table);
+    for (size_t i = 0; i < size; ++i) {
+        crc = crc32c_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc;
+}
+
+#ifdef HASH_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t* data, size_t size) {
+#ifdef __x86_64__
+    uint64_t crc64 = crc;
+    for (; size >= 8; size -= 8, data += 8) {
+        uint64_t word;
+        memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<uint32_t>(crc64);
+#endif
+    for (; size > 0; --size, ++data) {
+        crc = _mm_crc32_u8(crc, *data);
+    }
+    return crc;
+}
+#endif
+
+static uint32_t crc32c_update(uint32_t crc, const uint8_t* data, size_t size) {
+#ifdef HASH_X86
+    if (cpu_features().sse42) {
+        return crc32c_sse42(crc, data, size);
+    }
+#endif
+    return crc32c_portable(crc, data, size);
+}
+
+// ---- Hasher ----
+
+Hasher::Hasher(HashAlgorithm algorithm) : algorithm(algorithm), crc32c(0xFFFFFFFF) {
+    sha256_init(sha256);
+    blake3_init(blake3);
+}
+
+void Hasher::update(const void* data, size_t size) {
+    const uint8_t* bytes = static_cast<const uint8_t*>(data);
+    switch (algorithm) {
+        case HASH_BLAKE3:
+            blake3_update(blake3, bytes, size);
+            break;
+        case HASH_CRC32C:
+            crc32c = crc32c_update(crc32c, bytes, size);
+            break;
+        default:
+            sha256_update(sha256, bytes, size);
+            break;
+    }
+}
+
+std::string Hasher::hex_digest() {
+    switch (algorithm) {
+        case HASH_BLAKE3:
+            return blake3_final(blake3);
+        case HASH_CRC32C: {
+            uint32_t value = ~crc32c;
+            uint8_t digest[4] = {static_cast<uint8_t>(value >> 24), static_cast<uint8_t>(value >> 16),
+                                 static_cast<uint8_t>(value >> 8), static_cast<uint8_t>(value)};
+            return to_hex(digest, sizeof(digest));
+        }
+        default:
+            return sha256_final(sha256);
+    }
+}
+
+// ---- Кеш сумм ----
+
+// Ключ кеша: файл считается тем же, пока не изменились устройство, inode, размер и время модификации
+struct HashKey {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    int64_t mtime_ns;
+    int algorithm;
+
+    bool operator==(const HashKey& other) const {
+        return dev == other.dev && ino == other.ino && size == other.size && mtime_ns == other.mtime_ns &&
+               algorithm == other.algorithm;
+    }
+};
+
+struct HashKeyHasher {
+    size_t operator()(const HashKey& key) const {
+        uint64_t value = static_cast<uint64_t>(key.ino) * 0x9E3779B97F4A7C15ULL;
+        value ^= static_cast<uint64_t>(key.dev) + (value << 6) + (value >> 2);
+        value ^= static_cast<uint64_t>(key.mtime_ns) + (value << 6) + (value >> 2);
+        value ^= static_cast<uint64_t>(key.size) * 31 + key.algorithm;
+        return static_cast<size_t>(value);
+    }
+};
+
+static std::mutex cache_mutex;
+static std::unordered_map<HashKey, std::string, HashKeyHasher> hash_cache;
+static std::deque<HashKey> cache_order;
+
+static HashKey make_key(const struct stat& st, HashAlgorithm algorithm) {
+    HashKey key;
+    key.dev = st.st_dev;
+    key.ino = st.st_ino;
+    key.size = st.st_size;
+    key.mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1000000000LL + st.st_mtim.tv_nsec;
+    key.algorithm = algorithm;
+    return key;
+}
+
+void remember_hash(const struct stat& st, HashAlgorithm algorithm, const std::string& digest) {
+    HashKey key = make_key(st, algorithm);
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    if (hash_cache.insert(std::make_pair(key, digest)).second) {
+        cache_order.push_back(key);
+        // Самые старые записи вытесняются первыми
+        if (cache_order.size() > HASH_CACHE_CAPACITY) {
+            hash_cache.erase(cache_order.front());
+            cache_order.pop_front();
+        }
+    } else {
+        hash_cache[key] = digest;
+    }
+}
+
+static bool lookup_hash(const struct stat& st, HashAlgorithm algorithm, std::string& digest) {
+    std::lock_guard<std::mutex> lock(cache_mutex);
+    std::unordered_map<HashKey, std::string, HashKeyHasher>::const_iterator it = hash_cache.find(make_key(st, algorithm));
+    if (it == hash_cache.end()) {
+        return false;
+    }
+    digest = it->second;
+    return true;
+}
+
+bool hash_file(const std::string& path, HashAlgorithm algorithm, FileHash& result) {
+    PROFILE_SCOPE("hash_file");
+    result.path = path;
+    result.cached = false;
+    result.digest.clear();
+    result.error.clear();
+
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        result.error = strerror(errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        return false;
+    }
+    if (lookup_hash(st, algorithm, result.digest)) {
+        result.cached = true;
+        close(fd);
+        return true;
+    }
+
+    posix_fadvise(fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+    Hasher hasher(algorithm);
+    std::vector<char> buffer(HASH_BUFFER_SIZE);
+    while (true) {
+        ssize_t got = read(fd, &buffer[0], io_chunk_size(buffer.size()));
+        if (got < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            result.error = strerror(errno);
+            close(fd);
+            return false;
+        }
+        if (got == 0) {
+            break;
+        }
+        hasher.update(&buffer[0], got);
+        io_throttle(got, 1);
+    }
+    result.digest = hasher.hex_digest();
+
+    // Файл, измененный во время чтения, в кеш не попадает
+    struct stat after;
+    if (fstat(fd, &after) == 0 && make_key(after, algorithm) == make_key(st, algorithm)) {
+        remember_hash(st, algorithm, result.digest);
+    }
+    close(fd);
+    return true;
+}
+
+// Собирает обычные файлы дерева без перехода по символическим ссылкам
+class CollectVisitor : public TreeVisitor {
+public:
+    CollectVisitor(std::vector<std::string>& files, std::vector<FileHash>& errors) : files(files), errors(errors) {}
+
+    bool enter_directory(const std::string&, const struct stat&) {
+        return true;
+    }
+
+    void visit_files(const std::string& dir, int, const std::vector<WalkEntry>& entries) {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (size_t i = 0; i < entries.size(); ++i) {
+            if (S_ISREG(entries[i].st.st_mode)) {
+                files.push_back(walk_path(dir, entries[i].name));
+            }
+        }
+    }
+
+    void walk_error(const std::string& path, int error) {
+        std::lock_guard<std::mutex> lock(mutex);
+        FileHash failed = {path, "", strerror(error), false};
+        errors.push_back(failed);
+    }
+
+private:
+    std::mutex mutex;
+    std::vector<std::string>& files;
+    std::vector<FileHash>& errors;
+};
+
+static void collect_files(const std::string& path, std::vector<std::string>& files, std::vector<FileHash>& errors) {
+    // Обход параллельный, поэтому файлы каждого аргумента упорядочиваются после него
+    size_t first = files.size();
+    WalkOptions options;
+    options.stat_files = false;
+    CollectVisitor visitor(files, errors);
+    walk_tree(path, options, visitor);
+    std::sort(files.begin() + first, files.end());
+}
+
+void hash_paths(const std::vector<std::string>& paths, HashAlgorithm algorithm, std::vector<FileHash>& results) {
+    std::vector<std::string> files;
+    std::vector<FileHash> errors;
+    for (size_t i = 0; i < paths.size(); ++i) {
+        collect_files(paths[i], files, errors);
+    }
+
+    // Каждый файл хешируется отдельной задачей, порядок результатов совпадает с порядком файлов
+    results.assign(files.size(), FileHash());
+    io_pool().parallel_for(files.size(), 1, [&files, &results, algorithm](size_t begin, size_t end) {
+        for (size_t i = begin; i < end; ++i) {
+            hash_file(files[i], algorithm, results[i]);
+        }
+    });
+    results.insert(results.end(), errors.begin(), errors.end());
+}
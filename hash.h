@@ -0,0 +1,70 @@
+#ifndef HASH_H
+#define HASH_H
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <sys/stat.h>
+
+// Поддерживаемые алгоритмы контрольных сумм
+enum HashAlgorithm {
+    HASH_SHA256 = 0,
+    HASH_BLAKE3,
+    HASH_CRC32C,
+    HASH_ALGORITHM_COUNT
+};
+
+const char* hash_algorithm_name(HashAlgorithm algorithm);
+bool parse_hash_algorithm(const std::string& name, HashAlgorithm& algorithm);
+
+// Состояние SHA-256
+struct Sha256State {
+    uint32_t h[8];
+    uint8_t buffer[64];
+    size_t buffered;
+    uint64_t length;
+};
+
+// Состояние BLAKE3: текущий фрагмент (chunk) по 1024 байта и стек значений цепочки дерева
+struct Blake3State {
+    uint32_t chunk_cv[8];
+    uint64_t chunk_counter;
+    uint8_t block[64];
+    size_t block_len;
+    size_t blocks_compressed;
+    uint32_t cv_stack[54][8];
+    size_t cv_stack_len;
+};
+
+// Потоковое вычисление контрольной суммы: данные подаются частями, результат - в шестнадцатеричном виде.
+// SHA-256 и CRC32C используют инструкции SHA-NI и SSE4.2, если процессор их поддерживает
+class Hasher {
+public:
+    explicit Hasher(HashAlgorithm algorithm);
+
+    void update(const void* data, size_t size);
+    std::string hex_digest();
+
+private:
+    HashAlgorithm algorithm;
+    Sha256State sha256;
+    Blake3State blake3;
+    uint32_t crc32c;
+};
+
+// Результат хеширования одного файла
+struct FileHash {
+    std::string path;
+    std::string digest;
+    std::string error;
+    bool cached;
+};
+
+// Хеширует файл, используя кеш по (устройство, inode, размер, время модификации)
+bool hash_file(const std::string& path, HashAlgorithm algorithm, FileHash& result);
+// Хеширует файлы и все файлы внутри каталогов параллельно в пуле ввода-вывода
+void hash_paths(const std::vector<std::string>& paths, HashAlgorithm algorithm, std::vector<FileHash>& results);
+// Запоминает сумму, посчитанную при копировании, чтобы потом не читать файл заново
+void remember_hash(const struct stat& st, HashAlgorithm algorithm, const std::string& digest);
+
+#endif // HASH_H
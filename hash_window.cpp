@@ -0,0 +1,74 @@
+#include "hash_window.h"
+#include <ncurses.h>
+#include <string>
+
+// Конструктор класса HashWindow, инициализирует ncurses и создает окно контрольных сумм
+HashWindow::HashWindow(int height, int width) {
+    initscr();
+    raw();
+    keypad(stdscr, TRUE);
+    noecho();
+    start_color();
+
+    init_pair(2, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(3, COLOR_WHITE, COLOR_BLACK);
+
+    x = (COLS - width) / 2;
+    y = (LINES - height) / 2;
+
+    win = newwin(height, width, y, x);
+    keypad(win, TRUE);
+    box(win, 0, 0);
+}
+
+// Деструктор класса HashWindow, удаляет окно и завершает ncurses
+HashWindow::~HashWindow() {
+    delwin(win);
+    endwin();
+}
+
+// Метод класса HashWindow, показывает посчитанные суммы списком с прокруткой
+void HashWindow::show(HashAlgorithm algorithm, const std::vector<FileHash>& results, double seconds) {
+    size_t cached = 0;
+    for (size_t i = 0; i < results.size(); ++i) {
+        if (results[i].cached) {
+            cached++;
+        }
+    }
+
+    int width = getmaxx(win);
+    int rows = getmaxy(win) - 7;
+    int top = 0;
+    while (true) {
+        werase(win);
+        box(win, 0, 0);
+        wattron(win, COLOR_PAIR(2));
+        mvwprintw(win, 1, 1, "Checksums (%s):", hash_algorithm_name(algorithm));
+        wattroff(win, COLOR_PAIR(2));
+
+        wattron(win, COLOR_PAIR(3));
+        mvwhline(win, 2, 1, '-', width - 2);
+        for (int row = 0; row < rows && top + row < static_cast<int>(results.size()); ++row) {
+            const FileHash& result = results[top + row];
+            std::string line = result.error.empty() ? result.digest + "  " + result.path
+                                                    : "error: " + result.path + ": " + result.error;
+            mvwprintw(win, 3 + row, 2, "%.*s", width - 4, line.c_str());
+        }
+        mvwhline(win, 3 + rows, 1, '-', width - 2);
+        mvwprintw(win, 4 + rows, 2, "%zu file(s), %zu from cache, %.3f s", results.size(), cached, seconds);
+        mvwprintw(win, 5 + rows, 2, "Use Up/Down to scroll, any other key to close.");
+        wattroff(win, COLOR_PAIR(3));
+        wrefresh(win);
+
+        int ch = wgetch(win);
+        if (ch == KEY_UP) {
+            top = top > 0 ? top - 1 : 0;
+        } else if (ch == KEY_DOWN) {
+            if (top + rows < static_cast<int>(results.size())) {
+                top++;
+            }
+        } else {
+            break;
+        }
+    }
+}
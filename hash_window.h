@@ -0,0 +1,22 @@
+#ifndef HASH_WINDOW_H
+#define HASH_WINDOW_H
+
+#include <ncurses.h>
+#include <string>
+#include <vector>
+#include "hash.h"
+
+class HashWindow {
+public:
+    HashWindow(int height, int width);
+    ~HashWindow();
+
+    // Список уже посчитанных сумм; seconds - сколько длился подсчет
+    void show(HashAlgorithm algorithm, const std::vector<FileHash>& results, double seconds);
+
+private:
+    WINDOW* win;
+    int x, y;
+};
+
+#endif // HASH_WINDOW_H
@@ -37,23 +37,41 @@ void HelpWindow::show() {
     mvwhline(win, 3, 1, '-', getmaxx(win) - 2);
 
     // Выводим список команд и их описаний в окне помощи
-    mvwprintw(win, 4, 2, "Press Tab to switch between panels.");
+    mvwprintw(win, 4, 2, "Press Tab and Shift+Tab to move focus between panels.");
     mvwprintw(win, 5, 2, "Press Enter to open a file or enter a directory.");
     mvwprintw(win, 6, 2, "Press Backspace to go back to the parent directory.");
-    mvwhline(win, 7, 1, '-', getmaxx(win) - 2);
-
-    mvwprintw(win, 8, 2, "Press 't' to create a new tab.");
-    mvwprintw(win, 9, 2, "Press '0'-'9' to switch to a specific tab.");
-    mvwprintw(win, 10, 2, "Press 'T' to show all tabs.");
+    mvwprintw(win, 7, 2, "Press '<' and '>' to go back and forward in history.");
+    mvwprintw(win, 8, 2, "Press 'j' to jump to a frequently visited directory.");
+    mvwprintw(win, 9, 2, "Press 'g' to go to a path (Tab completes names, also in 'n'/'m').");
+    mvwprintw(win, 10, 2, "Press 'e' for a directory tree ('e' again enters the selected one).");
     mvwhline(win, 11, 1, '-', getmaxx(win) - 2);
 
-    mvwprintw(win, 12, 2, "Press 'c' to copy a file or directory.");
-    mvwprintw(win, 13, 2, "Press 'v' to paste a file or directory.");
-    mvwprintw(win, 14, 2, "Press 'o' to open a file.");
-    mvwprintw(win, 15, 2, "Press 'i' to get info about file.");
-    mvwhline(win, 16, 1, '-', getmaxx(win) - 2);
+    mvwprintw(win, 12, 2, "Press 't' to create a new tab.");
+    mvwprintw(win, 13, 2, "Press '0'-'9' to switch to a tab, '[' and ']' for previous/next.");
+    mvwprintw(win, 14, 2, "Press 'T' to show all tabs.");
+    mvwhline(win, 15, 1, '-', getmaxx(win) - 2);
+
+    mvwprintw(win, 16, 2, "Press 'c' to copy a file or directory.");
+    mvwprintw(win, 17, 2, "Press 'v' to paste a file or directory.");
+    mvwprintw(win, 18, 2, "Press 'o' to open a file.");
+    mvwprintw(win, 19, 2, "Press 'i' to get info about file.");
+    mvwprintw(win, 20, 2, "Press 'a' to chmod, chown or touch (recursively for directories).");
+    mvwprintw(win, 21, 2, "Press 'P' to preview the selected file in the next panel.");
+    mvwhline(win, 22, 1, '-', getmaxx(win) - 2);
+
+    mvwprintw(win, 23, 2, "Press 's' to change the sort mode.");
+    mvwprintw(win, 24, 2, "Press 'f' to filter files by name.");
+    mvwprintw(win, 25, 2, "Press 'w' to watch the directory for newly arriving files.");
+    mvwhline(win, 26, 1, '-', getmaxx(win) - 2);
+
+    mvwprintw(win, 27, 2, "Press 'V' to toggle checksum verification on paste.");
+    mvwprintw(win, 28, 2, "Press '#' to compute checksums of the selected file or directory.");
+    mvwprintw(win, 29, 2, "Press 'z' to pack the selection into .tar.gz ('z' again cancels).");
+    mvwprintw(win, 30, 2, "Press 'd' to compare the selected file with the next panel's.");
+    mvwhline(win, 31, 1, '-', getmaxx(win) - 2);
 
-    mvwprintw(win, 17, 2, "Press 'q' to quit the program.");
+    mvwprintw(win, 32, 2, "Press 'p' to show profiling statistics.");
+    mvwprintw(win, 33, 2, "Press 'q' to quit the program (the session is saved).");
     wattroff(win, COLOR_PAIR(3));
 
     // Устанавливаем цвет заголовка и выводим его в окне помощи
@@ -1,6 +1,12 @@
 #include "input_window.h"
+#include <climits>
 #include <ncurses.h>
 
+// Как часто проверяется, прочитан ли список каталога для дополнения
+#define COMPLETION_POLL_MS 50
+// Сколько подходящих имен показывается под строкой ввода
+#define COMPLETION_SHOWN 16
+
 // Конструктор класса InputWindow, инициализирует ncurses и создает окно ввода
 InputWindow::InputWindow(int width, int height) {
     // Инициализируем ncurses
@@ -37,6 +43,36 @@ InputWindow::~InputWindow() {
 
 // Метод класса InputWindow, отображает окно ввода с сообщением и возвращает введенную пользователем строку
 std::string InputWindow::show(const std::string& message) {
+    return read_line(message, nullptr);
+}
+
+// Метод класса InputWindow, отображает окно ввода пути с дополнением имен
+std::string InputWindow::show_path(const std::string& message, const std::string& base_dir) {
+    return read_line(message, &base_dir);
+}
+
+// Выводит под строкой ввода имена, подходящие под последнее имя пути
+void InputWindow::draw_suggestions(const CompletionResult& result, bool loading) {
+    int row = getmaxy(win) - 2;
+    int width = getmaxx(win) - 4;
+    std::string line;
+    if (loading) {
+        line = "Reading directory...";
+    } else {
+        for (size_t i = 0; i < result.names.size(); ++i) {
+            line += result.names[i].name + (result.names[i].directory ? "/  " : "  ");
+        }
+        if (result.total > result.names.size()) {
+            line += "(+" + std::to_string(result.total - result.names.size()) + " more)";
+        }
+    }
+    mvwhline(win, row, 2, ' ', width);
+    mvwprintw(win, row, 2, "%.*s", width, line.c_str());
+    wrefresh(win);
+}
+
+// Общий цикл ввода строки; при base_dir != nullptr строка - путь, и Tab дополняет имена
+std::string InputWindow::read_line(const std::string& message, const std::string* base_dir) {
     // Отключаем эхо ввода на экран
     noecho();
 
@@ -69,13 +105,38 @@ std::string InputWindow::show(const std::string& message) {
     std::string input;
     std::string::size_type max_input_length = static_cast<std::string::size_type>(input_box_width - 2);
 
+    // Список каталога для дополнения читается в фоне. Пока он не готов, ввод опрашивается
+    // с таймаутом, чтобы показать имена сразу по готовности; нажатый за это время Tab
+    // применяется, когда список прочитан
+    CompletionResult completion;
+    std::string ghost;
+    bool tab_pending = false;
+    if (base_dir != nullptr) {
+        max_input_length = PATH_MAX - 1;
+        keypad(input_box, TRUE);
+    }
+
     // Цикл обработки ввода пользователя
+    bool first = true;
     while (true) {
-        // Получаем символ ввода пользователя
-        int ch = wgetch(input_box);
-
+        int ch = 0;
+        if (!first || base_dir == nullptr) {
+            wtimeout(input_box, base_dir != nullptr && !completion.ready ? COMPLETION_POLL_MS : -1);
+            // Получаем символ ввода пользователя
+            ch = wgetch(input_box);
+        }
+        first = false;
+
+        // ERR без таймаута означает, что ввода больше не будет (терминал закрыт): ввод отменяется,
+        // а не повторяется бесконечно
+        if (ch == ERR) {
+            if (base_dir == nullptr || completion.ready) {
+                input.clear();
+                break;
+            }
+        }
         // Если символ является символом новой строки, завершаем ввод
-        if (ch == '\n') {
+        else if (ch == '\n') {
             break;
         }
         // Если символ является символом escape, очищаем строку ввода и завершаем ввод
@@ -89,6 +150,16 @@ std::string InputWindow::show(const std::string& message) {
                 input.pop_back();
             }
         }
+        // Tab дополняет путь до общего начала подходящих имен, а единственное имя - целиком
+        else if (ch == '\t' && base_dir != nullptr) {
+            tab_pending = true;
+        }
+        // Стрелка вправо и End принимают подсказку целиком
+        else if ((ch == KEY_RIGHT || ch == KEY_END) && base_dir != nullptr) {
+            if (input.length() + ghost.length() <= max_input_length) {
+                input += ghost;
+            }
+        }
         // Если символ является печатным символом, добавляем его в строку ввода, если длина строки ввода не превышает максимальную длину ввода
         else if (ch >= ' ' && ch <= '~') {
             if (input.length() < max_input_length) {
@@ -96,12 +167,52 @@ std::string InputWindow::show(const std::string& message) {
             }
         }
 
-        // Вычисляем начальную позицию строки ввода, чтобы она была по центру окна ввода строки ввода пользователя
-        int input_start_pos = (input_box_width - input.length()) / 2;
+        ghost.clear();
+        if (base_dir != nullptr) {
+            std::string dir, prefix;
+            split_input_path(*base_dir, input, dir, prefix);
+            path_completer().complete(dir, prefix, COMPLETION_SHOWN, completion);
+            if (tab_pending && completion.ready) {
+                tab_pending = false;
+                std::string addition;
+                if (completion.common.length() > prefix.length()) {
+                    addition = completion.common.substr(prefix.length());
+                    if (completion.total == 1 && completion.names[0].directory) {
+                        addition += '/';
+                    }
+                } else if (completion.total == 1) {
+                    addition = completion.names[0].name.substr(prefix.length()) +
+                               (completion.names[0].directory ? "/" : "");
+                }
+                if (!addition.empty() && input.length() + addition.length() <= max_input_length) {
+                    input += addition;
+                    split_input_path(*base_dir, input, dir, prefix);
+                    path_completer().complete(dir, prefix, COMPLETION_SHOWN, completion);
+                }
+            }
+            // Подсказка - остаток первого подходящего имени, показанный за введенным текстом
+            if (completion.ready && !completion.names.empty()) {
+                ghost = completion.names[0].name.substr(prefix.length()) + (completion.names[0].directory ? "/" : "");
+            }
+            draw_suggestions(completion, !completion.ready);
+        }
+
+        // Вычисляем начальную позицию строки ввода, чтобы она была по центру окна ввода строки ввода пользователя.
+        // Длинный путь не помещается: тогда видно его окончание от левого края
+        std::string::size_type visible = static_cast<std::string::size_type>(input_box_width - 2);
+        std::string shown = input.length() > visible ? input.substr(input.length() - visible) : input;
+        std::string hint = ghost.substr(0, visible - shown.length());
+        int input_start_pos = input.length() + hint.length() < visible ? (input_box_width - shown.length() - hint.length()) / 2 : 1;
 
         // Очищаем строку ввода и выводим ее в центре окна ввода строки ввода пользователя
         mvwhline(input_box, 1, 1, ' ', input_box_width - 2);
-        mvwprintw(input_box, 1, input_start_pos, "%s", input.c_str());
+        mvwprintw(input_box, 1, input_start_pos, "%s", shown.c_str());
+        if (!hint.empty()) {
+            wattron(input_box, A_DIM);
+            wprintw(input_box, "%s", hint.c_str());
+            wattroff(input_box, A_DIM);
+            wmove(input_box, 1, input_start_pos + static_cast<int>(shown.length()));
+        }
         // Обновляем содержимое окна ввода строки ввода пользователя на экране
         wrefresh(input_box);
     }
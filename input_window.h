@@ -3,6 +3,7 @@
 
 #include <ncurses.h>
 #include <string>
+#include "path_completion.h"
 
 class InputWindow {
 public:
@@ -10,8 +11,14 @@ public:
     ~InputWindow();
 
     std::string show(const std::string& message);
+    // Ввод пути с дополнением имен по Tab. Относительный путь отсчитывается от base_dir;
+    // возвращается введенная строка, путь из нее получает resolve_input_path
+    std::string show_path(const std::string& message, const std::string& base_dir);
 
 private:
+    std::string read_line(const std::string& message, const std::string* base_dir);
+    void draw_suggestions(const CompletionResult& result, bool loading);
+
     WINDOW* win;
     int x, y;
 };
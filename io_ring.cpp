@@ -0,0 +1,264 @@
+#include "io_ring.h"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// Глубина очереди кольца: ограничивает число операций в одной пачке
+#define IO_RING_DEPTH 64
+
+// Выключен по умолчанию: statx, openat и unlinkat ядро выполняет в своих рабочих потоках,
+// и на локальном диске с прогретым кешем пачки оказываются медленнее обычных вызовов
+static std::atomic<bool> io_uring_enabled(false);
+
+static int io_uring_setup(unsigned entries, struct io_uring_params* params) {
+    return static_cast<int>(syscall(__NR_io_uring_setup, entries, params));
+}
+
+static int io_uring_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+    return static_cast<int>(syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, nullptr, 0));
+}
+
+static int io_uring_register(int fd, unsigned opcode, void* arg, unsigned count) {
+    return static_cast<int>(syscall(__NR_io_uring_register, fd, opcode, arg, count));
+}
+
+IoRing::IoRing()
+        : ring_fd(-1), entries(0), sqe_count(0), pending(0), sq_local_tail(0), sq_ring(nullptr), cq_ring(nullptr),
+          sq_ring_size(0), cq_ring_size(0), sqes(nullptr), sq_tail(nullptr), sq_mask(nullptr), sq_array(nullptr),
+          cq_head(nullptr), cq_tail(nullptr), cq_mask(nullptr), cqes(nullptr) {}
+
+IoRing::~IoRing() {
+    release();
+}
+
+void IoRing::release() {
+    if (sqes != nullptr) {
+        munmap(sqes, sqe_count * sizeof(struct io_uring_sqe));
+        sqes = nullptr;
+    }
+    if (cq_ring != nullptr && cq_ring != sq_ring) {
+        munmap(cq_ring, cq_ring_size);
+    }
+    if (sq_ring != nullptr) {
+        munmap(sq_ring, sq_ring_size);
+    }
+    sq_ring = cq_ring = nullptr;
+    if (ring_fd >= 0) {
+        close(ring_fd);
+        ring_fd = -1;
+    }
+    entries = 0;
+}
+
+bool IoRing::ok() const {
+    return ring_fd >= 0;
+}
+
+// Создает кольцо и проверяет, что ядро поддерживает все нужные операции
+bool IoRing::init(unsigned requested_entries) {
+    struct io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    ring_fd = io_uring_setup(requested_entries, &params);
+    if (ring_fd < 0) {
+        return false;
+    }
+    entries = params.sq_entries;
+
+    // Операции statx, openat, read, write и close появились в 5.6, unlinkat - в 5.11
+    std::vector<char> probe_buffer(sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op), 0);
+    struct io_uring_probe* probe = reinterpret_cast<struct io_uring_probe*>(&probe_buffer[0]);
+    if (io_uring_register(ring_fd, IORING_REGISTER_PROBE, probe, 256) < 0) {
+        release();
+        return false;
+    }
+    const uint8_t required[] = {IORING_OP_STATX, IORING_OP_OPENAT, IORING_OP_READ,
+                                IORING_OP_WRITE, IORING_OP_CLOSE, IORING_OP_UNLINKAT};
+    for (size_t i = 0; i < sizeof(required); ++i) {
+        if (required[i] > probe->last_op || !(probe->ops[required[i]].flags & IO_URING_OP_SUPPORTED)) {
+            release();
+            return false;
+        }
+    }
+
+    // Отображаем в память очереди отправки и завершения и массив запросов
+    sq_ring_size = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cq_ring_size = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    bool single_mmap = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single_mmap && cq_ring_size > sq_ring_size) {
+        sq_ring_size = cq_ring_size;
+    }
+    sq_ring = mmap(nullptr, sq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQ_RING);
+    if (sq_ring == MAP_FAILED) {
+        sq_ring = nullptr;
+        release();
+        return false;
+    }
+    if (single_mmap) {
+        cq_ring = sq_ring;
+    } else {
+        cq_ring = mmap(nullptr, cq_ring_size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_CQ_RING);
+        if (cq_ring == MAP_FAILED) {
+            cq_ring = nullptr;
+            release();
+            return false;
+        }
+    }
+    void* sqe_memory = mmap(nullptr, entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE,
+                            MAP_SHARED | MAP_POPULATE, ring_fd, IORING_OFF_SQES);
+    if (sqe_memory == MAP_FAILED) {
+        release();
+        return false;
+    }
+    sqes = static_cast<struct io_uring_sqe*>(sqe_memory);
+    sqe_count = entries;
+
+    char* sq = static_cast<char*>(sq_ring);
+    char* cq = static_cast<char*>(cq_ring);
+    sq_tail = reinterpret_cast<unsigned*>(sq + params.sq_off.tail);
+    sq_mask = reinterpret_cast<unsigned*>(sq + params.sq_off.ring_mask);
+    sq_array = reinterpret_cast<unsigned*>(sq + params.sq_off.array);
+    cq_head = reinterpret_cast<unsigned*>(cq + params.cq_off.head);
+    cq_tail = reinterpret_cast<unsigned*>(cq + params.cq_off.tail);
+    cq_mask = reinterpret_cast<unsigned*>(cq + params.cq_off.ring_mask);
+    cqes = reinterpret_cast<struct io_uring_cqe*>(cq + params.cq_off.cqes);
+    sq_local_tail = *sq_tail;
+    return true;
+}
+
+unsigned IoRing::space() const {
+    return entries - pending;
+}
+
+struct io_uring_sqe* IoRing::next_sqe(uint8_t opcode, int fd, uint64_t user_data) {
+    unsigned index = sq_local_tail & *sq_mask;
+    struct io_uring_sqe* sqe = &sqes[index];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->opcode = opcode;
+    sqe->fd = fd;
+    sqe->user_data = user_data;
+    sq_array[index] = index;
+    sq_local_tail++;
+    pending++;
+    return sqe;
+}
+
+void IoRing::prep_statx(int dir_fd, const char* path, int flags, unsigned mask, struct statx* buffer, uint64_t user_data) {
+    struct io_uring_sqe* sqe = next_sqe(IORING_OP_STATX, dir_fd, user_data);
+    sqe->addr = reinterpret_cast<uintptr_t>(path);
+    sqe->len = mask;
+    sqe->off = reinterpret_cast<uintptr_t>(buffer);
+    sqe->statx_flags = flags;
+}
+
+void IoRing::prep_openat(int dir_fd, const char* path, int flags, mode_t mode, uint64_t user_data) {
+    struct io_uring_sqe* sqe = next_sqe(IORING_OP_OPENAT, dir_fd, user_data);
+    sqe->addr = reinterpret_cast<uintptr_t>(path);
+    sqe->len = mode;
+    sqe->open_flags = flags;
+}
+
+void IoRing::prep_read(int fd, void* buffer, unsigned size, uint64_t offset, uint64_t user_data) {
+    struct io_uring_sqe* sqe = next_sqe(IORING_OP_READ, fd, user_data);
+    sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len = size;
+    sqe->off = offset;
+}
+
+void IoRing::prep_write(int fd, const void* buffer, unsigned size, uint64_t offset, uint64_t user_data) {
+    struct io_uring_sqe* sqe = next_sqe(IORING_OP_WRITE, fd, user_data);
+    sqe->addr = reinterpret_cast<uintptr_t>(buffer);
+    sqe->len = size;
+    sqe->off = offset;
+}
+
+void IoRing::prep_close(int fd, uint64_t user_data) {
+    next_sqe(IORING_OP_CLOSE, fd, user_data);
+}
+
+void IoRing::prep_unlinkat(int dir_fd, const char* path, int flags, uint64_t user_data) {
+    struct io_uring_sqe* sqe = next_sqe(IORING_OP_UNLINKAT, dir_fd, user_data);
+    sqe->addr = reinterpret_cast<uintptr_t>(path);
+    sqe->unlink_flags = flags;
+}
+
+bool IoRing::submit_and_wait(std::vector<IoCompletion>& completions) {
+    completions.clear();
+    unsigned expected = pending;
+    if (expected == 0) {
+        return true;
+    }
+
+    // Публикуем хвост очереди отправки: запросы должны быть видны ядру до нового значения
+    __atomic_store_n(sq_tail, sq_local_tail, __ATOMIC_RELEASE);
+    unsigned to_submit = expected;
+    while (completions.size() < expected) {
+        int ret = io_uring_enter(ring_fd, to_submit, 1, IORING_ENTER_GETEVENTS);
+        if (ret < 0) {
+            if (errno == EINTR || errno == EAGAIN || errno == EBUSY) {
+                continue;
+            }
+            // Без ответов на отправленные запросы кольцо дальше использовать нельзя
+            pending = 0;
+            release();
+            return false;
+        }
+        to_submit -= std::min<unsigned>(to_submit, static_cast<unsigned>(ret));
+
+        unsigned head = *cq_head;
+        unsigned tail = __atomic_load_n(cq_tail, __ATOMIC_ACQUIRE);
+        while (head != tail) {
+            const struct io_uring_cqe& cqe = cqes[head & *cq_mask];
+            IoCompletion completion;
+            completion.user_data = cqe.user_data;
+            completion.result = cqe.res;
+            completions.push_back(completion);
+            head++;
+        }
+        __atomic_store_n(cq_head, head, __ATOMIC_RELEASE);
+    }
+    pending = 0;
+    return true;
+}
+
+// Проверка один раз за процесс: удается ли создать кольцо с нужными операциями
+bool io_uring_available() {
+    static std::once_flag checked;
+    static bool available = false;
+    std::call_once(checked, []() {
+        IoRing ring;
+        available = ring.init(4);
+    });
+    return available;
+}
+
+void set_io_uring_enabled(bool enabled) {
+    io_uring_enabled = enabled;
+}
+
+IoRing* thread_io_ring() {
+    static thread_local std::unique_ptr<IoRing> ring;
+    static thread_local bool failed = false;
+    if (ring && !ring->ok()) {
+        ring.reset();
+        failed = true;
+    }
+    if (!io_uring_enabled || failed || !io_uring_available()) {
+        return nullptr;
+    }
+    if (!ring) {
+        ring.reset(new IoRing());
+        if (!ring->init(IO_RING_DEPTH)) {
+            ring.reset();
+            failed = true;
+            return nullptr;
+        }
+    }
+    return ring.get();
+}
@@ -0,0 +1,70 @@
+#ifndef IO_RING_H
+#define IO_RING_H
+
+#include <cstdint>
+#include <vector>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Результат одной операции io_uring: user_data из запроса и код возврата (-errno при ошибке)
+struct IoCompletion {
+    uint64_t user_data;
+    int32_t result;
+};
+
+// Минимальная обертка над io_uring на системных вызовах, без liburing. Кольцо принадлежит
+// одному потоку; операции копятся пачкой и отправляются одним вызовом io_uring_enter
+class IoRing {
+public:
+    IoRing();
+    ~IoRing();
+
+    bool init(unsigned entries);
+    bool ok() const;
+    // Сколько операций еще можно добавить в текущую пачку
+    unsigned space() const;
+
+    void prep_statx(int dir_fd, const char* path, int flags, unsigned mask, struct statx* buffer, uint64_t user_data);
+    void prep_openat(int dir_fd, const char* path, int flags, mode_t mode, uint64_t user_data);
+    void prep_read(int fd, void* buffer, unsigned size, uint64_t offset, uint64_t user_data);
+    void prep_write(int fd, const void* buffer, unsigned size, uint64_t offset, uint64_t user_data);
+    void prep_close(int fd, uint64_t user_data);
+    void prep_unlinkat(int dir_fd, const char* path, int flags, uint64_t user_data);
+
+    // Отправляет пачку и ждет завершения всех ее операций
+    bool submit_and_wait(std::vector<IoCompletion>& completions);
+
+private:
+    IoRing(const IoRing&);
+    IoRing& operator=(const IoRing&);
+
+    struct io_uring_sqe* next_sqe(uint8_t opcode, int fd, uint64_t user_data);
+    void release();
+
+    int ring_fd;
+    unsigned entries;
+    unsigned sqe_count;
+    unsigned pending;
+    unsigned sq_local_tail;
+    void* sq_ring;
+    void* cq_ring;
+    size_t sq_ring_size;
+    size_t cq_ring_size;
+    struct io_uring_sqe* sqes;
+    unsigned* sq_tail;
+    unsigned* sq_mask;
+    unsigned* sq_array;
+    unsigned* cq_head;
+    unsigned* cq_tail;
+    unsigned* cq_mask;
+    struct io_uring_cqe* cqes;
+};
+
+// Кольцо текущего потока или nullptr, если io_uring не включен (--io-uring) либо недоступен:
+// старое ядро, запрет seccomp или io_uring_disabled. Тогда вызывающий использует обычные вызовы
+IoRing* thread_io_ring();
+bool io_uring_available();
+void set_io_uring_enabled(bool enabled);
+
+#endif // IO_RING_H
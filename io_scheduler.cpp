@@ -0,0 +1,262 @@
+#include "io_scheduler.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <thread>
+#include <unistd.h>
+
+// Сколько жетонов может накопиться в ведре простаивающего задания
+#define BUCKET_BURST_MS 250
+// Ниже этой доли скорости фоновые задания не замедляются
+#define BACKGROUND_MIN_SHARE_DIVISOR 32
+// Чтение каталога считается замедленным, если на элемент уходит во столько раз больше обычного
+// и при этом оно заняло не меньше LISTING_SLOW_NS
+#define LISTING_SLOW_FACTOR 4
+#define LISTING_SLOW_NS 2000000ULL
+// Доля уменьшается не чаще раза в BACKOFF_INTERVAL_NS и растет на 1/RECOVERY_STEPS каждые RECOVERY_INTERVAL_NS
+#define BACKOFF_INTERVAL_NS 100000000ULL
+#define RECOVERY_INTERVAL_NS 500000000ULL
+#define RECOVERY_STEPS 16
+// Самый долгий сон задания за один учет: задание должно быстро замечать отмену
+#define MAX_THROTTLE_SLEEP_NS 200000000ULL
+
+// Приоритет ввода-вывода: класс best-effort, уровень 7 - низший. В glibc обертки нет
+#define IOPRIO_CLASS_SHIFT 13
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_WHO_PROCESS 1
+#define BACKGROUND_IOPRIO ((IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | 7)
+#define BACKGROUND_NICE 10
+
+// Задание, которое выполняет поток: указатель для быстрой проверки в io_throttle и владеющая ссылка
+static thread_local IoJob* thread_job = nullptr;
+static thread_local std::shared_ptr<IoJob> thread_job_ref;
+// Конец предыдущего учета работы в этом потоке и задание, к которому он относится. Задание
+// выполняют несколько потоков, поэтому время работы между вызовами меряется в каждом потоке
+// отдельно: общая отметка одного потока сдвигалась бы в будущее для остальных
+static thread_local const IoJob* thread_last_job = nullptr;
+static thread_local uint64_t thread_last_ns = 0;
+
+static uint64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+               std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+bool parse_rate(const std::string& text, uint64_t& rate) {
+    if (text.empty() || text[0] < '0' || text[0] > '9') {
+        return false;
+    }
+    char* end = nullptr;
+    unsigned long long value = strtoull(text.c_str(), &end, 10);
+    int shift = 0;
+    switch (*end) {
+        case '\0':
+            break;
+        case 'k':
+        case 'K':
+            shift = 10;
+            break;
+        case 'm':
+        case 'M':
+            shift = 20;
+            break;
+        case 'g':
+        case 'G':
+            shift = 30;
+            break;
+        default:
+            return false;
+    }
+    if (*end != '\0' && end[1] != '\0') {
+        return false;
+    }
+    rate = static_cast<uint64_t>(value) << shift;
+    return true;
+}
+
+TokenBucket::TokenBucket() : rate(0), tokens(0), last_ns(0) {}
+
+void TokenBucket::set_rate(uint64_t value) {
+    rate = value;
+    tokens = static_cast<double>(rate) * BUCKET_BURST_MS / 1000;
+    last_ns = now_ns();
+}
+
+uint64_t TokenBucket::get_rate() const {
+    return rate;
+}
+
+uint64_t TokenBucket::take(uint64_t amount, uint64_t now, double scale) {
+    if (rate == 0) {
+        return 0;
+    }
+    double effective = static_cast<double>(rate) * scale;
+    if (now > last_ns) {
+        tokens = std::min(tokens + effective * (now - last_ns) / 1e9, effective * BUCKET_BURST_MS / 1000);
+        last_ns = now;
+    }
+    tokens -= amount;
+    return tokens >= 0 ? 0 : static_cast<uint64_t>(-tokens / effective * 1e9);
+}
+
+IoJob::IoJob(const IoLimits& limits) : limits(limits), total_sleep_ns(0) {
+    bytes.set_rate(limits.bytes_per_second);
+    ops.set_rate(limits.ops_per_second);
+    io_scheduler().jobs++;
+}
+
+IoJob::~IoJob() {
+    io_scheduler().jobs--;
+}
+
+const IoLimits& IoJob::get_limits() const {
+    return limits;
+}
+
+void IoJob::throttle(uint64_t byte_count, uint64_t op_count) {
+    double share = io_scheduler().background_share();
+    uint64_t sleep_ns;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        uint64_t now = now_ns();
+        sleep_ns = std::max(bytes.take(byte_count, now, share), ops.take(op_count, now, share));
+        // Задание без ограничений уступает долей времени: после работы длительностью t оно спит
+        // t * (1 - share) / share, то есть работает share всего времени
+        if (share < 1 && bytes.get_rate() == 0 && ops.get_rate() == 0) {
+            uint64_t worked = thread_last_job == this && now > thread_last_ns ? now - thread_last_ns : 0;
+            worked = std::min<uint64_t>(worked, MAX_THROTTLE_SLEEP_NS);
+            sleep_ns = static_cast<uint64_t>(worked * (1 - share) / share);
+        }
+        sleep_ns = std::min<uint64_t>(sleep_ns, MAX_THROTTLE_SLEEP_NS);
+        total_sleep_ns += sleep_ns;
+        thread_last_job = this;
+        thread_last_ns = now + sleep_ns;
+    }
+    if (sleep_ns > 0) {
+        std::this_thread::sleep_for(std::chrono::nanoseconds(sleep_ns));
+    }
+}
+
+size_t IoJob::chunk_size(size_t preferred) const {
+    // Кусок не больше восьмой части секундной скорости, но и не мельче 64 КиБ
+    if (limits.bytes_per_second == 0) {
+        return preferred;
+    }
+    return std::min<size_t>(preferred, std::max<uint64_t>(64 * 1024, limits.bytes_per_second / 8));
+}
+
+uint64_t IoJob::throttled_ns() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return total_sleep_ns;
+}
+
+IoScheduler::IoScheduler()
+    : jobs(0), baseline_ns(0), share(1), last_backoff_ns(0), last_recovery_ns(0), backoffs(0) {}
+
+void IoScheduler::set_default_limits(const IoLimits& limits) {
+    std::lock_guard<std::mutex> lock(mutex);
+    default_limits = limits;
+}
+
+IoLimits IoScheduler::get_default_limits() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return default_limits;
+}
+
+void IoScheduler::record_listing(uint64_t duration_ns, size_t entries) {
+    uint64_t per_entry = duration_ns / (entries + 1);
+    uint64_t now = now_ns();
+    std::lock_guard<std::mutex> lock(mutex);
+    if (baseline_ns == 0) {
+        baseline_ns = per_entry;
+    }
+    bool slow = jobs > 0 && duration_ns >= LISTING_SLOW_NS && per_entry > baseline_ns * LISTING_SLOW_FACTOR;
+    if (!slow) {
+        // Замедленные замеры в среднее не входят, иначе оно подтянулось бы к ним
+        baseline_ns = (baseline_ns * 7 + per_entry) / 8;
+        return;
+    }
+    if (now - last_backoff_ns >= BACKOFF_INTERVAL_NS) {
+        share = std::max(share / 2, 1.0 / BACKGROUND_MIN_SHARE_DIVISOR);
+        last_backoff_ns = now;
+        backoffs++;
+    }
+    last_recovery_ns = now;
+}
+
+double IoScheduler::background_share() {
+    std::lock_guard<std::mutex> lock(mutex);
+    if (share < 1) {
+        uint64_t now = now_ns();
+        uint64_t steps = (now - last_recovery_ns) / RECOVERY_INTERVAL_NS;
+        if (steps > 0) {
+            share = std::min(1.0, share + static_cast<double>(steps) / RECOVERY_STEPS);
+            last_recovery_ns += steps * RECOVERY_INTERVAL_NS;
+        }
+    }
+    return share;
+}
+
+size_t IoScheduler::active_jobs() const {
+    return jobs;
+}
+
+uint64_t IoScheduler::backoff_count() const {
+    std::lock_guard<std::mutex> lock(mutex);
+    return backoffs;
+}
+
+IoScheduler& io_scheduler() {
+    static IoScheduler scheduler;
+    return scheduler;
+}
+
+BackgroundIoScope::BackgroundIoScope(const std::shared_ptr<IoJob>& job, bool dedicated)
+    : active(job != nullptr), previous_ioprio(-1) {
+    if (!active) {
+        return;
+    }
+    previous = thread_job_ref;
+    thread_job_ref = job;
+    thread_job = job.get();
+    if (job->get_limits().low_priority) {
+        // Уровень приоритета меняется только у текущего потока (which = 0)
+        int current = static_cast<int>(syscall(SYS_ioprio_get, IOPRIO_WHO_PROCESS, 0));
+        if (current >= 0 && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, BACKGROUND_IOPRIO) == 0) {
+            previous_ioprio = current;
+        }
+        if (dedicated) {
+            setpriority(PRIO_PROCESS, static_cast<id_t>(syscall(SYS_gettid)), BACKGROUND_NICE);
+        }
+    }
+}
+
+BackgroundIoScope::~BackgroundIoScope() {
+    if (!active) {
+        return;
+    }
+    thread_job_ref = previous;
+    thread_job = previous.get();
+    if (previous_ioprio >= 0) {
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, previous_ioprio);
+    }
+}
+
+std::shared_ptr<IoJob> current_io_job() {
+    return thread_job_ref;
+}
+
+bool in_io_job() {
+    return thread_job != nullptr;
+}
+
+void io_throttle(uint64_t bytes, uint64_t ops) {
+    if (thread_job != nullptr) {
+        thread_job->throttle(bytes, ops);
+    }
+}
+
+size_t io_chunk_size(size_t preferred) {
+    return thread_job != nullptr ? thread_job->chunk_size(preferred) : preferred;
+}
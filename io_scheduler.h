@@ -0,0 +1,125 @@
+#ifndef IO_SCHEDULER_H
+#define IO_SCHEDULER_H
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+// Ограничения фонового задания; 0 - без ограничения
+struct IoLimits {
+    IoLimits() : bytes_per_second(0), ops_per_second(0), low_priority(true) {}
+
+    uint64_t bytes_per_second;
+    uint64_t ops_per_second;    // Операции: чтение или запись куска, открытие файла, удаление, чтение каталога
+    bool low_priority;          // Низший приоритет ввода-вывода best-effort для потоков задания
+};
+
+// Скорость вида 512K, 50M или 1G (степени 1024) в байтах или операциях в секунду
+bool parse_rate(const std::string& text, uint64_t& rate);
+
+// Ведро жетонов: за секунду добавляется rate жетонов, но копится не больше чем на BUCKET_BURST_MS.
+// Операция списывает жетоны после выполнения и может увести баланс в минус: тогда следующая
+// операция ждет, пока долг не погасится. Так крупный кусок не нужно дробить под размер ведра
+class TokenBucket {
+public:
+    TokenBucket();
+
+    void set_rate(uint64_t rate);
+    uint64_t get_rate() const;
+    // Списывает amount жетонов при скорости rate * scale и возвращает, сколько наносекунд
+    // подождать до неотрицательного баланса
+    uint64_t take(uint64_t amount, uint64_t now_ns, double scale);
+
+private:
+    uint64_t rate;
+    double tokens;
+    uint64_t last_ns;
+};
+
+// Фоновое задание (копирование, удаление, хеширование, поиск): свои ведра для байтов и операций.
+// Задание разделяется потоками, которые его выполняют, включая помощников из пула
+class IoJob {
+public:
+    explicit IoJob(const IoLimits& limits);
+    ~IoJob();
+
+    const IoLimits& get_limits() const;
+    // Учитывает выполненную работу и усыпляет поток, если задание превысило свои ограничения
+    // или интерактивное чтение каталогов замедлилось и фоновая работа должна уступить
+    void throttle(uint64_t bytes, uint64_t ops);
+    // Размер куска чтения или копирования, при котором задание не засыпает надолго
+    size_t chunk_size(size_t preferred) const;
+    uint64_t throttled_ns() const;
+
+private:
+    IoJob(const IoJob&);
+    IoJob& operator=(const IoJob&);
+
+    IoLimits limits;
+    mutable std::mutex mutex;
+    TokenBucket bytes;
+    TokenBucket ops;
+    uint64_t total_sleep_ns;
+};
+
+// Общее состояние планировщика: задержка интерактивного чтения каталогов и доля скорости,
+// которую получают фоновые задания. Когда чтение каталога при активных заданиях идет заметно
+// дольше обычного, доля уменьшается вдвое; пока задержка в норме, она понемногу растет обратно
+class IoScheduler {
+public:
+    IoScheduler();
+
+    void set_default_limits(const IoLimits& limits);
+    IoLimits get_default_limits() const;
+    // Задержка чтения каталога из entries элементов в потоке интерфейса или его задачах
+    void record_listing(uint64_t duration_ns, size_t entries);
+    // Доля от 1/BACKGROUND_MIN_SHARE_DIVISOR до 1
+    double background_share();
+    size_t active_jobs() const;
+    uint64_t backoff_count() const;
+
+private:
+    friend class IoJob;
+
+    mutable std::mutex mutex;
+    IoLimits default_limits;
+    std::atomic<size_t> jobs;
+    uint64_t baseline_ns;     // Скользящее среднее задержки на элемент каталога
+    double share;
+    uint64_t last_backoff_ns;
+    uint64_t last_recovery_ns;
+    uint64_t backoffs;
+};
+
+IoScheduler& io_scheduler();
+
+// Выполнение задания в текущем потоке: задание становится текущим для io_throttle, а поток
+// получает пониженный приоритет ввода-вывода (ioprio), который восстанавливается при выходе.
+// Поток, созданный только под фоновую работу (dedicated), дополнительно получает nice:
+// вернуть nice обратно без привилегий нельзя, поэтому потокам общего пула он не ставится.
+// Пустое задание ничего не меняет
+class BackgroundIoScope {
+public:
+    explicit BackgroundIoScope(const std::shared_ptr<IoJob>& job, bool dedicated = false);
+    ~BackgroundIoScope();
+
+private:
+    BackgroundIoScope(const BackgroundIoScope&);
+    BackgroundIoScope& operator=(const BackgroundIoScope&);
+
+    bool active;
+    std::shared_ptr<IoJob> previous;
+    int previous_ioprio;
+};
+
+// Задание, которое выполняет текущий поток, или пустой указатель
+std::shared_ptr<IoJob> current_io_job();
+bool in_io_job();
+// Учет работы текущего задания; вне задания ничего не делает
+void io_throttle(uint64_t bytes, uint64_t ops);
+size_t io_chunk_size(size_t preferred);
+
+#endif // IO_SCHEDULER_H
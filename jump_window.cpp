@@ -0,0 +1,100 @@
+#include "jump_window.h"
+#include "frecency.h"
+#include <ncurses.h>
+#include <vector>
+#include <algorithm>
+
+// Конструктор класса JumpWindow, инициализирует ncurses и создает окно перехода
+JumpWindow::JumpWindow(int width, int height) {
+    initscr();
+    raw();
+    keypad(stdscr, TRUE);
+    noecho();
+    start_color();
+
+    init_pair(5, COLOR_RED, COLOR_BLACK);
+
+    // Вычисляем координаты окна, чтобы оно было по центру экрана
+    x = (COLS - width) / 2;
+    y = (LINES - height) / 2;
+
+    win = newwin(height, width, y, x);
+    keypad(win, TRUE);
+    box(win, 0, 0);
+}
+
+// Деструктор класса JumpWindow, удаляет окно и завершает ncurses
+JumpWindow::~JumpWindow() {
+    delwin(win);
+    endwin();
+}
+
+// Метод класса JumpWindow, показывает строку поиска и подходящие каталоги из базы посещений.
+// Список пересчитывается после каждого нажатия, возвращается выбранный каталог или пустая строка
+std::string JumpWindow::show() {
+    std::string input;
+    int choice = 0;
+    int max_results = getmaxy(win) - 4;
+    int width = getmaxx(win) - 4;
+
+    while (true) {
+        // Ранжируем каталоги под текущий ввод
+        std::vector<std::string> results = frecency_db.query(input, max_results);
+        if (choice >= static_cast<int>(results.size())) {
+            choice = std::max(0, static_cast<int>(results.size()) - 1);
+        }
+
+        // Рисуем строку ввода и список результатов
+        werase(win);
+        box(win, 0, 0);
+        wattron(win, COLOR_PAIR(5));
+        mvwprintw(win, 1, 2, "Jump to: %s", input.c_str());
+        wattroff(win, COLOR_PAIR(5));
+        mvwhline(win, 2, 1, ACS_HLINE, getmaxx(win) - 2);
+
+        if (results.empty()) {
+            mvwprintw(win, 3, 2, "No matching directories");
+        }
+        for (size_t i = 0; i < results.size(); ++i) {
+            if (static_cast<int>(i) == choice) {
+                wattron(win, A_REVERSE);
+            }
+            // Длинные пути показываем с конца, так как там обычно самая важная часть
+            std::string path = results[i];
+            if (static_cast<int>(path.size()) > width) {
+                path = "..." + path.substr(path.size() - width + 3);
+            }
+            mvwprintw(win, 3 + i, 2, "%s", path.c_str());
+            wattroff(win, A_REVERSE);
+        }
+        wrefresh(win);
+
+        int ch = wgetch(win);
+        // Enter выбирает подсвеченный каталог
+        if (ch == '\n') {
+            return results.empty() ? "" : results[choice];
+        }
+        // Escape отменяет переход
+        else if (ch == 27) {
+            return "";
+        }
+        // Стрелки перемещают выделение по списку
+        else if (ch == KEY_UP) {
+            choice = std::max(0, choice - 1);
+        } else if (ch == KEY_DOWN) {
+            choice = std::min(static_cast<int>(results.size()) - 1, choice + 1);
+        }
+        // Backspace удаляет последний символ ввода
+        else if (ch == KEY_BACKSPACE || ch == 127) {
+            if (!input.empty()) {
+                input.pop_back();
+                choice = 0;
+            }
+        }
+        // Печатные символы добавляются к вводу
+        else if (ch >= ' ' && ch <= '~' && static_cast<int>(input.size()) < width - 10) {
+            input.push_back(ch);
+            choice = 0;
+        }
+    }
+}
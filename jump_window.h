@@ -0,0 +1,19 @@
+#ifndef JUMP_WINDOW_H
+#define JUMP_WINDOW_H
+
+#include <ncurses.h>
+#include <string>
+
+class JumpWindow {
+public:
+    JumpWindow(int width, int height);
+    ~JumpWindow();
+
+    std::string show();
+
+private:
+    WINDOW* win;
+    int x, y;
+};
+
+#endif // JUMP_WINDOW_H
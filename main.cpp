@@ -1,13 +1,125 @@
+#include <chrono>
 #include <iostream>
 #include <ncurses.h>
 #include <string>
 #include <vector>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
 #include "input_window.h"
+#include "path_completion.h"
 #include "help_window.h"
 #include "file_panel.h"
+#include "panel_manager.h"
 #include "file_operations.h"
+#include "session.h"
+#include "frecency.h"
+#include "jump_window.h"
+#include "stats_window.h"
+#include "hash_window.h"
+#include "compare_window.h"
+#include "preview.h"
+#include "profiler.h"
+#include "batch.h"
+#include "worker_pool.h"
+#include "io_ring.h"
+#include "io_scheduler.h"
+#include "file_type.h"
+
+int main(int argc, char* argv[]) {
+    // Разбор параметров командной строки
+    bool use_session = true;
+    bool snapshot_entries = true;
+    long tab_cache_mb = -1;
+    long watch_entries = -1;
+    int panel_count = 2;
+    PanelLayout panel_layout = LAYOUT_GRID;
+    const char* batch_script = nullptr;
+    BatchOptions batch_options;
+    batch_options.overwrite = OVERWRITE_FAIL;
+    batch_options.jobs = default_worker_count();
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--no-session") == 0) {
+            // Не восстанавливать и не сохранять сеанс
+            use_session = false;
+        } else if (strcmp(argv[i], "--no-entry-cache") == 0) {
+            // Не сохранять снимок содержимого каталогов в файле сеанса
+            snapshot_entries = false;
+        } else if (strncmp(argv[i], "--tab-cache-mb=", 15) == 0) {
+            // Объем памяти для кешей неактивных вкладок
+            tab_cache_mb = atol(argv[i] + 15);
+        } else if (strncmp(argv[i], "--watch-entries=", 16) == 0) {
+            // Сколько последних поступлений показывает режим наблюдения
+            watch_entries = atol(argv[i] + 16);
+        } else if (strncmp(argv[i], "--panels=", 9) == 0) {
+            // Число панелей на экране, например для наблюдения за несколькими каталогами сразу
+            long count = atol(argv[i] + 9);
+            panel_count = count < 1 ? 1 : (count > MAX_PANELS ? MAX_PANELS : static_cast<int>(count));
+        } else if (strncmp(argv[i], "--layout=", 9) == 0) {
+            // Расположение панелей: сеткой или одна под другой
+            if (!parse_panel_layout(argv[i] + 9, panel_layout)) {
+                fprintf(stderr, "Unknown panel layout: %s\n", argv[i] + 9);
+                return 2;
+            }
+        } else if (strcmp(argv[i], "--io-uring") == 0) {
+            // Пачки операций через io_uring, если ядро его поддерживает
+            set_io_uring_enabled(true);
+        } else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            // Пакетный режим: команды из файла или из стандартного ввода ("-")
+            batch_script = argv[++i];
+        } else if (strncmp(argv[i], "--jobs=", 7) == 0) {
+            // Число потоков для фоновых команд пакетного режима
+            long jobs = atol(argv[i] + 7);
+            batch_options.jobs = jobs > 0 ? static_cast<unsigned>(jobs) : 1;
+        } else if (strncmp(argv[i], "--bg-bwlimit=", 13) == 0 || strncmp(argv[i], "--bg-iops=", 10) == 0) {
+            // Ограничения скорости фоновых заданий: упаковки и фоновых команд пакетного режима
+            bool bytes = argv[i][5] == 'b';
+            const char* rate = strchr(argv[i], '=') + 1;
+            if (!parse_rate(rate, bytes ? batch_options.io_limits.bytes_per_second
+                                        : batch_options.io_limits.ops_per_second)) {
+                fprintf(stderr, "Invalid rate: %s\n", rate);
+                return 2;
+            }
+            io_scheduler().set_default_limits(batch_options.io_limits);
+        } else if (strncmp(argv[i], "--overwrite=", 12) == 0) {
+            // Политика перезаписи по умолчанию для пакетного режима
+            if (!parse_overwrite_policy(argv[i] + 12, batch_options.overwrite)) {
+                fprintf(stderr, "Unknown overwrite policy: %s\n", argv[i] + 12);
+                return 2;
+            }
+        }
+    }
+
+    // В пакетном режиме терминал не инициализируется
+    if (batch_script != nullptr) {
+        if (strcmp(batch_script, "-") == 0) {
+            return run_batch(std::cin, "<stdin>", batch_options);
+        }
+        std::ifstream script(batch_script);
+        if (!script) {
+            fprintf(stderr, "Unable to open batch script: %s\n", batch_script);
+            return 2;
+        }
+        return run_batch(script, batch_script, batch_options);
+    }
+
+    // Загрузка сохраненного сеанса, если он есть
+    std::string session_path = default_session_path();
+    SessionState session;
+    if (!use_session || !load_session(session_path, session)) {
+        session.active_panel = 0;
+        session.panels.clear();
+    }
+    // Сеанс мог быть сохранен с другим числом панелей: лишние отбрасываются, недостающие открывают рабочий каталог
+    session.panels.resize(panel_count, empty_panel_state());
+
+    // Загрузка базы посещенных каталогов
+    std::string frecency_path = default_frecency_path();
+    if (use_session) {
+        frecency_db.load(frecency_path);
+    }
 
-int main() {
     // Инициализация ncurses
     initscr();
     // Перевод терминала в сырой режим, где каждый символ с клавиатуры передается сразу же
@@ -27,62 +139,81 @@ int main() {
     // Обновление экрана для отображения изменений
     refresh();
 
-    // Размеры для левой и правой панели, а также последующая инициализация
-    int y = 0;
-    int x = 0;
-    int h = LINES;
-    int w = COLS / 2;
-
-    FilePanel left_panel(y, x, h, w);
-    FilePanel right_panel(y, x + w, h, w);
+    // Панели располагаются по всему экрану; фокус получает панель, бывшая в фокусе при выходе
+    PanelManager panels(panel_layout, session.panels, session.active_panel);
+    if (tab_cache_mb >= 0) {
+        panels.set_tab_cache_budget(static_cast<size_t>(tab_cache_mb) * 1024 * 1024);
+    }
+    if (watch_entries > 0) {
+        panels.set_watch_capacity(static_cast<size_t>(watch_entries));
+    }
 
-    // Переменная для отслеживания активной панели
-    bool active_panel = true;
+    // Параметры вставки: сверка копии включается клавишей 'V'
+    CopyOptions paste_options;
+    // Режим предпросмотра: панель, следующая за панелью в фокусе, показывает содержимое выбранного в ней
+    bool preview_mode = false;
+    PreviewLoader preview_loader;
 
     // Цикл обработки ввода пользователя
     while (true) {
-        // Установка активной панели
-        left_panel.set_selected(active_panel);
-        right_panel.set_selected(!active_panel);
+        // Подхват результатов фоновой работы панелей и статуса завершившихся программ открытия файлов
+        panels.poll_background();
+        reap_launched();
+
+        // Запрос предпросмотра выбранного файла: загрузка идет в фоне, а устаревшая отменяется
+        std::string preview_path;
+        if (preview_mode && panels.get_preview_index() >= 0) {
+            FilePanel& source = panels.active();
+            preview_path = source.get_current_dir() + "/" + source.get_selected_file();
+            preview_loader.request(preview_path, source.get_selected_entry());
+            preview_loader.poll();
+        }
 
         // Отрисовка панелей
-        left_panel.draw();
-        right_panel.draw();
+        {
+            PROFILE_SCOPE("frame");
+            panels.draw(preview_mode, preview_path, preview_loader.current());
+            PROFILE_SCOPE("doupdate");
+            doupdate();
+        }
+        PROFILE_FRAME_PRESENTED();
 
+        // Пока у панелей есть фоновая работа, ждем ввод с таймаутом, чтобы вовремя показать ее результат
+        bool background = panels.has_background_work() || (preview_mode && preview_loader.has_background_work());
+        timeout(background ? 50 : -1);
         // Обработка ввода пользователя
         int ch = getch();
+        timeout(-1);
+        if (ch == ERR) {
+            continue;
+        }
+        PROFILE_KEY_PRESSED();
         switch (ch) {
             case KEY_UP:
                 // Перемещение выделения вверх
-                (active_panel ? left_panel : right_panel).move_selection(-1);
+                panels.active().move_selection(-1);
                 break;
             case KEY_DOWN:
                 // Перемещение выделения вниз
-                (active_panel ? left_panel : right_panel).move_selection(1);
+                panels.active().move_selection(1);
                 break;
             case KEY_LEFT:
                 // Переход в родительский каталог
-                (active_panel ? left_panel : right_panel).change_directory(-1);
+                panels.active().change_directory(-1);
                 break;
             case KEY_RIGHT:
                 // Переход в выбранный каталог
-                if (active_panel) {
-                    if (left_panel.is_selected()) {
-                        left_panel.change_directory(1);
-                    }
-                } else {
-                    if (right_panel.is_selected()) {
-                        right_panel.change_directory(1);
-                    }
+                if (panels.active().is_selected()) {
+                    panels.active().change_directory(1);
                 }
                 break;
             case KEY_DC:
                 // Удаление выбранного файла или каталога
                 {
-                    FilePanel* current_panel = active_panel ? &left_panel : &right_panel;
+                    FilePanel* current_panel = &panels.active();
                     std::string file_path = current_panel->get_current_dir() + "/" + current_panel->get_selected_file();
                     struct stat st;
-                    if (stat(file_path.c_str(), &st) == 0) {
+                    if (lstat(file_path.c_str(), &st) == 0) {
                         InputWindow input_window(100, 10);
                         std::string message;
                         if (S_ISDIR(st.st_mode)) {
@@ -92,36 +223,67 @@ int main() {
                         }
                         std::string response = input_window.show(message);
                         if (response == "yes" || response == "y") {
-                            std::string command = "rm -r '" + file_path + "'";
-                            system(command.c_str());
-                            current_panel->update();
+                            // Удаление большого дерева идет в фоне, и панель обновится по его завершении
+                            current_panel->start_operation("delete " + current_panel->get_selected_file(), nullptr, [file_path]() {
+                                return delete_path(file_path);
+                            }, [](const OperationResult& result) {
+                                if (!result.ok) {
+                                    printw("Error: %s\n", result.error.c_str());
+                                    refresh();
+                                }
+                            });
                         }
                     }
                 }
                 break;
             case '\t':
-                // Переключение активной панели
-                active_panel = !active_panel;
+                // Переход к следующей панели
+                panels.focus_next(1);
+                break;
+            case KEY_BTAB:
+                // Переход к предыдущей панели
+                panels.focus_next(-1);
                 break;
             case KEY_BACKSPACE:
                 // Переход в родительский каталог
-                if (active_panel) {
-                    left_panel.change_directory(-1);
-                } else {
-                    right_panel.change_directory(-1);
-                }
+                panels.active().change_directory(-1);
                 break;
             case 10:
                 // Переход в выбранный каталог
-                if (active_panel) {
-                    left_panel.change_directory(1);
-                } else {
-                    right_panel.change_directory(1);
+                panels.active().change_directory(1);
+                break;
+            case '<':
+                // Возврат к предыдущему каталогу в истории панели
+                panels.active().go_back();
+                break;
+            case '>':
+                // Переход к следующему каталогу в истории панели
+                panels.active().go_forward();
+                break;
+            case 'j':
+                // Быстрый переход к часто посещаемому каталогу
+                {
+                    JumpWindow jump_window(100, 16);
+                    std::string target = jump_window.show();
+                    if (!target.empty()) {
+                        panels.active().jump_to(target);
+                    }
+                }
+                break;
+            case 'g':
+                // Переход по введенному пути: в каталог или к файлу в его каталоге
+                {
+                    FilePanel& panel = panels.active();
+                    InputWindow input_window(120, 8);
+                    std::string response = input_window.show_path("Go to path: ", panel.get_current_dir());
+                    if (!response.empty()) {
+                        panel.go_to_path(resolve_input_path(panel.get_current_dir(), response));
+                    }
                 }
                 break;
             case 't':
                 // Создание новой вкладки
-                (active_panel ? left_panel : right_panel).create_tab();
+                panels.active().create_tab();
                 break;
             case '0':
             case '1':
@@ -134,28 +296,34 @@ int main() {
             case '8':
             case '9':
                 // Переключение на выбранную вкладку
-                (active_panel ? left_panel : right_panel).switch_to_tab(ch - '0');
+                panels.active().switch_to_tab(ch - '0');
+                break;
+            case '[':
+            case ']':
+                // Переключение на предыдущую или следующую вкладку
+                {
+                    FilePanel& panel = panels.active();
+                    int count = panel.get_tab_count();
+                    panel.switch_to_tab((panel.get_current_tab_index() + (ch == ']' ? 1 : count - 1)) % count);
+                }
                 break;
             case 'T':
                 // Отображение списка вкладок
-                (active_panel ? left_panel : right_panel).show_tabs();
+                panels.active().show_tabs();
                 break;
             case KEY_F(12):
                 // Удаление выбранной вкладки
                 {
                     InputWindow input_window(100, 10);
-                    std::string message = "Enter the tab number to delete (0-9): ";
+                    FilePanel& panel = panels.active();
+                    std::string message = "Enter the tab number to delete (0-" + std::to_string(panel.get_tab_count() - 1) + "): ";
                     std::string response = input_window.show(message);
 
-                    int tab_index = std::stoi(response);
+                    char* end = nullptr;
+                    long tab_index = strtol(response.c_str(), &end, 10);
 
-                    if (tab_index >= 0 && tab_index < 9) {
-                        std::string tab_path = active_panel ? left_panel.get_tab_by_index(tab_index) : right_panel.get_tab_by_index(tab_index);
-                        if (!tab_path.empty()) {
-                            active_panel ? left_panel.delete_tab(tab_index) : right_panel.delete_tab(tab_index);
-                            active_panel ? left_panel.set_current_tab_index(0) : right_panel.set_current_tab_index(0);
-                            active_panel ? left_panel.update() : right_panel.update();
-                        }
+                    if (!response.empty() && *end == '\0' && tab_index >= 0 && tab_index < panel.get_tab_count()) {
+                        panel.delete_tab(static_cast<int>(tab_index));
                     }
 
                     int y, x;
@@ -166,16 +334,20 @@ int main() {
                 break;
             case KEY_F(2):
                 // Переименование выбранного файла или каталога
-                (active_panel ? left_panel : right_panel).rename_file_or_directory();
+                panels.active().rename_file_or_directory();
                 break;
             case 'n':
                 // Создание нового файла
                 {
-                    FilePanel* current_panel = active_panel ? &left_panel : &right_panel;
+                    FilePanel* current_panel = &panels.active();
                     InputWindow input_window(120, 8);
-                    std::string message = "Enter new file name: ";
-                    std::string response = input_window.show(message);
-                    std::string file_path = current_panel->get_current_dir() + "/" + response;
+                    std::string message = "Enter new file name or path: ";
+                    std::string response = input_window.show_path(message, current_panel->get_current_dir());
+                    // Пустой ввод (или Esc) ничего не создает: иначе путем стал бы сам текущий каталог
+                    if (response.empty()) {
+                        break;
+                    }
+                    std::string file_path = resolve_input_path(current_panel->get_current_dir(), response);
                     create_file(file_path);
                     current_panel->update();
                 }
@@ -183,26 +355,96 @@ int main() {
             case 'm':
                 // Создание нового каталога
                 {
-                    FilePanel* current_panel = active_panel ? &left_panel : &right_panel;
+                    FilePanel* current_panel = &panels.active();
                     InputWindow input_window(120, 8);
-                    std::string message = "Enter new directory name: ";
-                    std::string response = input_window.show(message);
-                    std::string dir_path = current_panel->get_current_dir() + "/" + response;
+                    std::string message = "Enter new directory name or path: ";
+                    std::string response = input_window.show_path(message, current_panel->get_current_dir());
+                    // Пустой ввод (или Esc) ничего не создает: иначе путем стал бы сам текущий каталог
+                    if (response.empty()) {
+                        break;
+                    }
+                    std::string dir_path = resolve_input_path(current_panel->get_current_dir(), response);
                     create_directory(dir_path);
                     current_panel->update();
                 }
                 break;
             case 'c':
                 // Копирование выбранного файла или каталога
-                (active_panel ? left_panel : right_panel).copy_file_or_directory();
+                panels.active().copy_file_or_directory();
                 break;
             case 'v':
                 // Вставка скопированного файла или каталога
-                (active_panel ? left_panel : right_panel).paste_file_or_directory();
+                panels.active().paste_file_or_directory(paste_options);
+                break;
+            case 'V':
+                // Включение и выключение сверки контрольных сумм при вставке
+                paste_options.verify = !paste_options.verify;
+                printw("Verify on paste: %s\n", paste_options.verify ? "on (crc32c)" : "off");
+                refresh();
+                break;
+            case '#':
+                // Подсчет контрольных сумм выбранного файла или всех файлов выбранного каталога
+                {
+                    FilePanel& panel = panels.active();
+                    InputWindow input_window(120, 8);
+                    std::string response = input_window.show("Hash algorithm (sha256, blake3, crc32c; empty for sha256): ");
+                    HashAlgorithm algorithm = HASH_SHA256;
+                    if (!response.empty() && !parse_hash_algorithm(response, algorithm)) {
+                        printw("Error: Unknown hash algorithm '%s'.\n", response.c_str());
+                        refresh();
+                        break;
+                    }
+                    // Суммы считаются в фоне, а окно со списком открывается, когда они готовы
+                    std::vector<std::string> paths(1, panel.get_current_dir() + "/" + panel.get_selected_file());
+                    std::shared_ptr<std::vector<FileHash> > hashes = std::make_shared<std::vector<FileHash> >();
+                    std::chrono::steady_clock::time_point started = std::chrono::steady_clock::now();
+                    panel.start_operation("hash " + panel.get_selected_file(), nullptr, [paths, algorithm, hashes]() {
+                        hash_paths(paths, algorithm, *hashes);
+                        OperationResult result;
+                        result.ok = true;
+                        result.files = hashes->size();
+                        result.bytes = result.skipped = 0;
+                        return result;
+                    }, [algorithm, hashes, started](const OperationResult&) {
+                        double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - started).count();
+                        HashWindow hash_window(24, 100);
+                        hash_window.show(algorithm, *hashes, seconds);
+                    });
+                }
+                break;
+            case 'd':
+                // Сравнение выбранного файла панели в фокусе с выбранным файлом следующей панели
+                {
+                    int other = panels.get_preview_index();
+                    if (other < 0) {
+                        printw("Error: Comparing needs a second panel.\n");
+                        refresh();
+                        break;
+                    }
+                    FilePanel& panel = panels.active();
+                    FilePanel& other_panel = panels.get(other);
+                    CompareWindow compare_window(LINES - 2, COLS - 2);
+                    compare_window.show(panel.get_current_dir() + "/" + panel.get_selected_file(),
+                                        other_panel.get_current_dir() + "/" + other_panel.get_selected_file());
+                }
+                break;
+            case 'z':
+                // Упаковка выбранного файла или каталога в архив; повторное нажатие прерывает упаковку
+                {
+                    FilePanel& panel = panels.active();
+                    if (panel.is_packing()) {
+                        panel.cancel_pack();
+                        break;
+                    }
+                    InputWindow input_window(120, 8);
+                    std::string message = "Archive name (empty for " + panel.get_selected_file() + ".tar.gz): ";
+                    std::string response = input_window.show(message);
+                    panel.pack_selected(response.empty() ? panel.get_selected_file() + ".tar.gz" : response);
+                }
                 break;
             case 'o':
                 // Открытие выбранного файла
-                (active_panel ? left_panel : right_panel).open_file();
+                panels.active().open_file();
                 break;
             case 'h':
                 // Отображение окна помощи
@@ -211,26 +453,67 @@ int main() {
                     help_window.show();
                 }
                 break;
+            case 'P':
+                // Включение и выключение предпросмотра в неактивной панели
+                preview_mode = !preview_mode;
+                break;
             case 'i':
                 // Отображение информации о выбранном файле
-                (active_panel ? left_panel : right_panel).show_file_info();
+                panels.active().show_file_info();
+                break;
+            case 'a':
+                // Смена прав, владельца или времени выбранного элемента
+                panels.active().edit_attributes();
+                break;
+            case 's':
+                // Переключение режима сортировки
+                panels.active().cycle_sort_mode();
+                break;
+            case 'e':
+                // Включение и выключение режима дерева каталогов
+                panels.active().toggle_tree();
+                break;
+            case 'w':
+                // Включение и выключение наблюдения за поступлением файлов в каталог
+                panels.active().toggle_watch();
+                break;
+            case 'f':
+                // Установка фильтра имен файлов
+                {
+                    InputWindow input_window(120, 8);
+                    std::string message = "Enter name filter (empty to reset): ";
+                    std::string response = input_window.show(message);
+                    panels.active().set_filter(response);
+                }
+                break;
+            case 'p':
+                // Отображение статистики профилировщика
+                {
+                    StatsWindow stats_window(24, 80);
+                    stats_window.show();
+                }
                 break;
             case 'q':
-                // Выход из программы
+                // Сохранение сеанса и выход из программы
+                if (use_session) {
+                    session.active_panel = panels.get_active_index();
+                    session.panels = panels.save_state(snapshot_entries);
+                    save_session(session_path, session);
+                    frecency_db.save(frecency_path);
+                }
                 endwin();
                 return 0;
+            case KEY_RESIZE:
             case KEY_F(5):
-                // Сброс размеров и положений панелей
-                left_panel.set_size(LINES, COLS / 2);
-                right_panel.set_size(LINES, COLS / 2);
-
-                left_panel.set_position(0, 0);
-                right_panel.set_position(0, COLS / 2);
-
-                clear();
-                refresh();
-                right_panel.draw();
-                left_panel.draw();
+                // Перестроение панелей под текущий размер терминала. При KEY_RESIZE ncurses уже
+                // обновил LINES и COLS; раскладка колонок пересчитается при следующей отрисовке,
+                // а полная перерисовка экрана через clear() не нужна
+                panels.resize(LINES, COLS);
+                // F5 дополнительно перерисовывает весь экран, если вывод на нем был испорчен
+                if (ch == KEY_F(5)) {
+                    clear();
+                    refresh();
+                }
                 break;
             default:
                 break;
@@ -0,0 +1,138 @@
+#include "panel_manager.h"
+#include <algorithm>
+#include <cmath>
+#include <ncurses.h>
+
+bool parse_panel_layout(const std::string& name, PanelLayout& layout) {
+    if (name == "grid") {
+        layout = LAYOUT_GRID;
+    } else if (name == "stacked") {
+        layout = LAYOUT_STACKED;
+    } else {
+        return false;
+    }
+    return true;
+}
+
+PanelManager::PanelManager(PanelLayout layout, const std::vector<PanelState>& states, int active_index)
+        : layout(layout), active_index(0) {
+    for (size_t i = 0; i < states.size(); ++i) {
+        PanelRect rect = panel_rect(static_cast<int>(i), static_cast<int>(states.size()), LINES, COLS);
+        panels.push_back(std::unique_ptr<FilePanel>(new FilePanel(rect.y, rect.x, rect.h, rect.w, states[i])));
+    }
+    focus(active_index);
+}
+
+int PanelManager::get_count() const {
+    return static_cast<int>(panels.size());
+}
+
+int PanelManager::get_active_index() const {
+    return active_index;
+}
+
+FilePanel& PanelManager::active() {
+    return *panels[active_index];
+}
+
+FilePanel& PanelManager::get(int index) {
+    return *panels[index];
+}
+
+void PanelManager::focus(int index) {
+    if (index < 0 || index >= get_count()) {
+        index = 0;
+    }
+    active_index = index;
+    for (int i = 0; i < get_count(); ++i) {
+        panels[i]->set_selected(i == active_index);
+        panels[i]->set_priority(i == active_index ? PRIORITY_HIGH : PRIORITY_LOW);
+    }
+}
+
+void PanelManager::focus_next(int step) {
+    int count = get_count();
+    focus(((active_index + step) % count + count) % count);
+}
+
+void PanelManager::set_tab_cache_budget(size_t bytes) {
+    for (size_t i = 0; i < panels.size(); ++i) {
+        panels[i]->set_tab_cache_budget(bytes);
+    }
+}
+
+void PanelManager::set_watch_capacity(size_t capacity) {
+    for (size_t i = 0; i < panels.size(); ++i) {
+        panels[i]->set_watch_capacity(capacity);
+    }
+}
+
+bool PanelManager::poll_background() {
+    // Сначала забираем результаты панели в фокусе
+    bool changed = panels[active_index]->poll_background();
+    for (int i = 0; i < get_count(); ++i) {
+        if (i != active_index) {
+            changed = panels[i]->poll_background() || changed;
+        }
+    }
+    return changed;
+}
+
+bool PanelManager::has_background_work() const {
+    for (size_t i = 0; i < panels.size(); ++i) {
+        if (panels[i]->has_background_work()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Сетка: колонок ceil(sqrt(n)), строк сколько нужно. Панели неполной последней строки
+// делят ее ширину между собой, а остаток от деления размеров отдается последней строке и колонке
+PanelManager::PanelRect PanelManager::panel_rect(int index, int count, int height, int width) const {
+    int columns = layout == LAYOUT_STACKED ? 1 : static_cast<int>(std::ceil(std::sqrt(static_cast<double>(count))));
+    int rows = (count + columns - 1) / columns;
+    int row = index / columns;
+    int row_columns = std::min(columns, count - row * columns);
+    int column = index % columns;
+
+    int row_height = std::max(1, height / rows);
+    int column_width = std::max(1, width / row_columns);
+    PanelRect rect;
+    rect.y = row * row_height;
+    rect.x = column * column_width;
+    rect.h = row == rows - 1 ? std::max(1, height - rect.y) : row_height;
+    rect.w = column == row_columns - 1 ? std::max(1, width - rect.x) : column_width;
+    return rect;
+}
+
+void PanelManager::resize(int height, int width) {
+    for (int i = 0; i < get_count(); ++i) {
+        PanelRect rect = panel_rect(i, get_count(), height, width);
+        panels[i]->set_size(rect.h, rect.w);
+        panels[i]->set_position(rect.y, rect.x);
+    }
+}
+
+int PanelManager::get_preview_index() const {
+    return get_count() > 1 ? (active_index + 1) % get_count() : -1;
+}
+
+void PanelManager::draw(bool preview_mode, const std::string& preview_path, const Preview* preview) {
+    int preview_index = preview_mode ? get_preview_index() : -1;
+    for (int i = 0; i < get_count(); ++i) {
+        if (i == preview_index) {
+            panels[i]->draw_preview(preview_path, preview);
+        } else {
+            panels[i]->draw();
+        }
+    }
+}
+
+std::vector<PanelState> PanelManager::save_state(bool with_entries) const {
+    std::vector<PanelState> states;
+    for (size_t i = 0; i < panels.size(); ++i) {
+        states.push_back(panels[i]->save_state(with_entries));
+    }
+    return states;
+}
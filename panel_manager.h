@@ -0,0 +1,62 @@
+#ifndef PANEL_MANAGER_H
+#define PANEL_MANAGER_H
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "file_panel.h"
+#include "session.h"
+
+// Наибольшее число панелей на экране
+#define MAX_PANELS 9
+
+// Расположение панелей на экране
+enum PanelLayout {
+    LAYOUT_GRID,   // сетка, близкая к квадратной; две панели стоят рядом
+    LAYOUT_STACKED // панели во всю ширину одна под другой
+};
+
+bool parse_panel_layout(const std::string& name, PanelLayout& layout);
+
+// Набор панелей на экране и панель в фокусе. Фоновая работа панели в фокусе ставится в пул
+// ввода-вывода с высоким приоритетом, остальных - с низким, поэтому при смене фокуса новые
+// запросы панели, на которую смотрит пользователь, выполняются раньше уже стоящих в очереди
+class PanelManager {
+public:
+    // По панели на каждое сохраненное состояние
+    PanelManager(PanelLayout layout, const std::vector<PanelState>& states, int active_index);
+
+    int get_count() const;
+    int get_active_index() const;
+    FilePanel& active();
+    FilePanel& get(int index);
+    void focus(int index);
+    // Переводит фокус на step панелей вперед или назад по кругу
+    void focus_next(int step);
+    void set_tab_cache_budget(size_t bytes);
+    void set_watch_capacity(size_t capacity);
+
+    bool poll_background();
+    bool has_background_work() const;
+    // Перестраивает раскладку под новый размер экрана
+    void resize(int height, int width);
+    // Панель, в которой показывается предпросмотр: следующая за панелью в фокусе, или -1
+    int get_preview_index() const;
+    // Отрисовывает все панели; при включенном предпросмотре одна из них показывает preview
+    void draw(bool preview_mode, const std::string& preview_path, const Preview* preview);
+    std::vector<PanelState> save_state(bool with_entries) const;
+
+private:
+    // Положение и размер одной панели
+    struct PanelRect {
+        int y, x, h, w;
+    };
+
+    PanelRect panel_rect(int index, int count, int height, int width) const;
+
+    PanelLayout layout;
+    std::vector<std::unique_ptr<FilePanel> > panels;
+    int active_index;
+};
+
+#endif // PANEL_MANAGER_H
@@ -0,0 +1,250 @@
+#include "path_completion.h"
+#include "file_entry.h"
+#include "profiler.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+PathCompleter::PathCompleter() : cache(std::make_shared<Cache>()) {}
+
+// Читает имена каталога вместе с признаком каталога. Символическая ссылка на каталог тоже
+// считается каталогом: в нее можно перейти. Если время изменения каталога совпало
+// с известным, список не читается и changed остается false
+bool PathCompleter::read_listing(const std::string& dir, int64_t known_mtime_ns, Listing& listing, bool& changed) {
+    PROFILE_COUNT(COUNTER_OPENDIR, 1);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    struct stat st;
+    PROFILE_COUNT(COUNTER_STAT, 1);
+    if (fstat(fd, &st) != 0) {
+        close(fd);
+        return false;
+    }
+    listing.mtime_ns = stat_mtime_ns(st);
+    changed = listing.mtime_ns != known_mtime_ns;
+    if (!changed) {
+        close(fd);
+        return true;
+    }
+    DIR* handle = fdopendir(fd);
+    if (handle == nullptr) {
+        close(fd);
+        return false;
+    }
+
+    std::vector<char> pool;
+    std::vector<uint32_t> offsets;
+    std::vector<bool> directories;
+    dirent* entry;
+    while ((entry = readdir(handle)) != nullptr) {
+        PROFILE_COUNT(COUNTER_READDIR, 1);
+        const char* name = entry->d_name;
+        if (strcmp(name, ".") == 0 || strcmp(name, "..") == 0) {
+            continue;
+        }
+        bool directory = entry->d_type == DT_DIR;
+        if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+            struct stat child;
+            PROFILE_COUNT(COUNTER_STAT, 1);
+            directory = fstatat(dirfd(handle), name, &child, 0) == 0 && S_ISDIR(child.st_mode);
+        }
+        offsets.push_back(static_cast<uint32_t>(pool.size()));
+        directories.push_back(directory);
+        pool.insert(pool.end(), name, name + strlen(name) + 1);
+    }
+    closedir(handle);
+
+    // Сортируются номера записей, чтобы признак каталога остался при своем имени
+    std::vector<uint32_t> order(offsets.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        order[i] = static_cast<uint32_t>(i);
+    }
+    const char* base = pool.data();
+    std::sort(order.begin(), order.end(), [base, &offsets](uint32_t a, uint32_t b) {
+        return strcmp(base + offsets[a], base + offsets[b]) < 0;
+    });
+    listing.names.swap(pool);
+    listing.offsets.resize(order.size());
+    listing.directories.resize(order.size());
+    for (size_t i = 0; i < order.size(); ++i) {
+        listing.offsets[i] = offsets[order[i]];
+        listing.directories[i] = directories[order[i]];
+    }
+    return true;
+}
+
+void PathCompleter::load(const std::shared_ptr<Cache>& cache, const std::string& dir, int64_t known_mtime_ns) {
+    std::shared_ptr<Listing> listing = std::make_shared<Listing>();
+    bool changed = true;
+    bool ok = read_listing(dir, known_mtime_ns, *listing, changed);
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    std::unordered_map<std::string, CacheEntry>::iterator found = cache->entries.find(dir);
+    if (found == cache->entries.end()) {
+        return;
+    }
+    CacheEntry& entry = found->second;
+    entry.loading = false;
+    entry.checked_ns = profiler_now_ns();
+    // Несуществующий каталог получает пустой список: ответ готов, подходящих имен нет
+    if (!ok) {
+        entry.listing = std::make_shared<Listing>();
+    } else if (changed) {
+        entry.listing = listing;
+    }
+}
+
+std::shared_ptr<const PathCompleter::Listing> PathCompleter::lookup(const std::string& dir) {
+    uint64_t now = profiler_now_ns();
+    CacheEntry& entry = cache->entries[dir];
+    entry.used = ++cache->clock;
+    if (!entry.loading && (!entry.listing || now - entry.checked_ns > COMPLETION_REVALIDATE_MS * 1000000ULL)) {
+        entry.loading = true;
+        std::shared_ptr<Cache> shared = cache;
+        int64_t known_mtime_ns = entry.listing ? entry.listing->mtime_ns : -1;
+        io_pool().submit([shared, dir, known_mtime_ns]() {
+            load(shared, dir, known_mtime_ns);
+        }, PRIORITY_HIGH);
+    }
+    std::shared_ptr<const Listing> listing = entry.listing;
+
+    // Вытесняется давно не нужный список; читаемый сейчас остается, чтобы ответ нашел свою запись
+    if (cache->entries.size() > COMPLETION_CACHE_DIRS) {
+        std::unordered_map<std::string, CacheEntry>::iterator oldest = cache->entries.end();
+        for (std::unordered_map<std::string, CacheEntry>::iterator it = cache->entries.begin();
+             it != cache->entries.end(); ++it) {
+            if (!it->second.loading && (oldest == cache->entries.end() || it->second.used < oldest->second.used)) {
+                oldest = it;
+            }
+        }
+        if (oldest != cache->entries.end()) {
+            cache->entries.erase(oldest);
+        }
+    }
+    return listing;
+}
+
+void PathCompleter::prefetch(const std::string& dir) {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    lookup(dir);
+}
+
+size_t PathCompleter::cached_dirs() const {
+    std::lock_guard<std::mutex> lock(cache->mutex);
+    return cache->entries.size();
+}
+
+// Диапазон отсортированных имен, начинающихся с prefix: имена с общим началом лежат подряд
+static void prefix_range(const std::vector<char>& names, const std::vector<uint32_t>& offsets,
+                         const std::string& prefix, size_t& begin, size_t& end) {
+    const char* base = names.data();
+    const char* text = prefix.c_str();
+    size_t length = prefix.size();
+    begin = std::lower_bound(offsets.begin(), offsets.end(), text, [base](uint32_t offset, const char* value) {
+        return strcmp(base + offset, value) < 0;
+    }) - offsets.begin();
+    end = std::partition_point(offsets.begin() + begin, offsets.end(), [base, text, length](uint32_t offset) {
+        return strncmp(base + offset, text, length) == 0;
+    }) - offsets.begin();
+}
+
+void PathCompleter::complete(const std::string& dir, const std::string& prefix, size_t limit,
+                             CompletionResult& result) {
+    std::shared_ptr<const Listing> listing;
+    {
+        std::lock_guard<std::mutex> lock(cache->mutex);
+        listing = lookup(dir);
+    }
+    result.ready = listing != nullptr;
+    result.total = 0;
+    result.common.clear();
+    result.names.clear();
+    if (!listing) {
+        return;
+    }
+
+    size_t begin, end;
+    prefix_range(listing->names, listing->offsets, prefix, begin, end);
+    // Без точки в начале префикса скрытые имена пропускаются; все они лежат одним диапазоном
+    size_t hidden_begin = begin, hidden_end = begin;
+    if (prefix.empty()) {
+        prefix_range(listing->names, listing->offsets, ".", hidden_begin, hidden_end);
+    }
+    result.total = (end - begin) - (hidden_end - hidden_begin);
+    if (result.total == 0) {
+        return;
+    }
+
+    const char* base = listing->names.data();
+    const char* first = nullptr;
+    const char* last = nullptr;
+    for (size_t i = begin; i < end; ++i) {
+        if (i == hidden_begin) {
+            i = hidden_end;
+            if (i == end) {
+                break;
+            }
+        }
+        const char* name = base + listing->offsets[i];
+        if (first == nullptr) {
+            first = name;
+        }
+        if (result.names.size() >= limit) {
+            break;
+        }
+        PathCompletion completion;
+        completion.name = name;
+        completion.directory = listing->directories[i];
+        result.names.push_back(completion);
+    }
+    size_t last_index = end - 1;
+    if (last_index >= hidden_begin && last_index < hidden_end) {
+        last_index = hidden_begin - 1;
+    }
+    last = base + listing->offsets[last_index];
+
+    // Общее начало отсортированного диапазона - общее начало его первого и последнего имени
+    size_t common = 0;
+    while (first[common] != '\0' && first[common] == last[common]) {
+        common++;
+    }
+    result.common.assign(first, common);
+}
+
+PathCompleter& path_completer() {
+    static PathCompleter completer;
+    return completer;
+}
+
+std::string resolve_input_path(const std::string& base_dir, const std::string& input) {
+    if (input.empty()) {
+        return base_dir;
+    }
+    if (input[0] == '/') {
+        return input;
+    }
+    if (input[0] == '~' && (input.size() == 1 || input[1] == '/')) {
+        const char* home = getenv("HOME");
+        if (home != nullptr) {
+            return std::string(home) + input.substr(1);
+        }
+    }
+    return base_dir == "/" ? "/" + input : base_dir + "/" + input;
+}
+
+void split_input_path(const std::string& base_dir, const std::string& input, std::string& dir, std::string& prefix) {
+    size_t slash = input.rfind('/');
+    if (slash == std::string::npos) {
+        dir = base_dir;
+        prefix = input;
+        return;
+    }
+    dir = resolve_input_path(base_dir, input.substr(0, slash + 1));
+    prefix = input.substr(slash + 1);
+}
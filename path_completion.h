@@ -0,0 +1,90 @@
+#ifndef PATH_COMPLETION_H
+#define PATH_COMPLETION_H
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+// Сколько каталогов хранит кеш дополнения
+#define COMPLETION_CACHE_DIRS 32
+// Список каталога старше этого сверяется со временем изменения каталога в фоне
+#define COMPLETION_REVALIDATE_MS 2000
+
+// Имя, подходящее под введенное начало
+struct PathCompletion {
+    std::string name;
+    bool directory;
+};
+
+// Ответ на запрос дополнения
+struct CompletionResult {
+    CompletionResult() : ready(false), total(0) {}
+
+    bool ready;                        // Список каталога прочитан; иначе он читается в фоне
+    size_t total;                      // Сколько имен начинается с префикса
+    std::string common;                // Общее начало всех таких имен
+    std::vector<PathCompletion> names; // Первые из них по порядку
+};
+
+// Дополнение путей по спискам каталогов. Список читается в пуле ввода-вывода при первом
+// запросе, поэтому ввод в строке не ждет большой или медленный каталог: пока список читается,
+// запрос возвращает ready = false. Имена в списке отсортированы, и имена с общим началом
+// находятся двоичным поиском. Списки хранятся в кеше на COMPLETION_CACHE_DIRS каталогов и
+// после COMPLETION_REVALIDATE_MS перечитываются в фоне, если каталог изменился; до тех пор
+// ответы даются по старому списку. Методы можно вызывать из любого потока
+class PathCompleter {
+public:
+    PathCompleter();
+
+    // Имена каталога dir, начинающиеся с prefix; не больше limit имен в result.names.
+    // Скрытые имена подходят, только если prefix тоже начинается с точки
+    void complete(const std::string& dir, const std::string& prefix, size_t limit, CompletionResult& result);
+    // Начинает чтение списка заранее, например каталога панели при открытии строки ввода
+    void prefetch(const std::string& dir);
+    size_t cached_dirs() const;
+
+private:
+    // Имена через нули и смещения имен в порядке strcmp
+    struct Listing {
+        Listing() : mtime_ns(0) {}
+        std::vector<char> names;
+        std::vector<uint32_t> offsets;
+        std::vector<bool> directories;
+        int64_t mtime_ns;
+    };
+    struct CacheEntry {
+        CacheEntry() : loading(false), checked_ns(0), used(0) {}
+        std::shared_ptr<const Listing> listing;
+        bool loading;
+        uint64_t checked_ns; // Когда список прочитан или сверен в последний раз
+        uint64_t used;       // Номер последнего обращения: по нему вытесняется давно не нужный список
+    };
+    // Кеш общий с задачами пула и переживает их
+    struct Cache {
+        Cache() : clock(0) {}
+        std::mutex mutex;
+        std::unordered_map<std::string, CacheEntry> entries;
+        uint64_t clock;
+    };
+
+    // Список каталога из кеша или пустой указатель; при необходимости ставит чтение в пул.
+    // Вызывается под мьютексом кеша
+    std::shared_ptr<const Listing> lookup(const std::string& dir);
+    static void load(const std::shared_ptr<Cache>& cache, const std::string& dir, int64_t known_mtime_ns);
+    static bool read_listing(const std::string& dir, int64_t known_mtime_ns, Listing& listing, bool& changed);
+
+    std::shared_ptr<Cache> cache;
+};
+
+PathCompleter& path_completer();
+
+// Путь из строки ввода: абсолютный, от домашнего каталога (~/) или от каталога base_dir
+std::string resolve_input_path(const std::string& base_dir, const std::string& input);
+// Каталог, в котором ищутся имена для дополнения, и начало последнего имени
+void split_input_path(const std::string& base_dir, const std::string& input, std::string& dir, std::string& prefix);
+
+#endif // PATH_COMPLETION_H
@@ -0,0 +1,298 @@
+#include "preview.h"
+#include "file_type.h"
+#include "profiler.h"
+#include "worker_pool.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+// Сколько байт начала файла читается для предпросмотра и порциями какого размера:
+// между порциями задача проверяет, не отменен ли запрос
+#define PREVIEW_READ_BYTES (64 * 1024)
+#define PREVIEW_READ_CHUNK (16 * 1024)
+// Для двоичных файлов показывается дамп только этого числа байт; по 8 байт в строке дамп
+// вместе с колонкой символов помещается в панель на половине экрана шириной 80 колонок
+#define PREVIEW_HEX_BYTES 2048
+#define PREVIEW_HEX_WIDTH 8
+#define PREVIEW_MAX_LINES 256
+#define PREVIEW_MAX_LINE_LENGTH 512
+// Из больших каталогов читаются только первые записи, чтобы не ждать полного обхода
+#define PREVIEW_MAX_ENTRIES 1000
+#define PREVIEW_CANCEL_CHECK_ENTRIES 64
+// Число предпросмотров в LRU-кеше
+#define PREVIEW_CACHE_ENTRIES 32
+
+static bool cancelled(const std::atomic<unsigned>& generation, unsigned expected) {
+    return generation.load() != expected;
+}
+
+static void format_text(const std::vector<char>& data, Preview& preview) {
+    std::string line;
+    for (size_t i = 0; i < data.size() && preview.lines.size() < PREVIEW_MAX_LINES; ++i) {
+        char c = data[i];
+        if (c == '\n') {
+            preview.lines.push_back(line);
+            line.clear();
+        } else if (line.size() >= PREVIEW_MAX_LINE_LENGTH) {
+            continue;
+        } else if (c == '\t') {
+            line.append(4 - line.size() % 4, ' ');
+        } else if (c == '\r') {
+            continue;
+        } else if (static_cast<unsigned char>(c) < 32 || c == 127) {
+            // Управляющие символы сбили бы вывод ncurses
+            line += '.';
+        } else {
+            line += c;
+        }
+    }
+    if (!line.empty() && preview.lines.size() < PREVIEW_MAX_LINES) {
+        preview.lines.push_back(line);
+    }
+}
+
+static void format_hex(const std::vector<char>& data, Preview& preview) {
+    size_t size = std::min(data.size(), static_cast<size_t>(PREVIEW_HEX_BYTES));
+    for (size_t offset = 0; offset < size; offset += PREVIEW_HEX_WIDTH) {
+        char line[64];
+        int length = snprintf(line, sizeof(line), "%08zx ", offset);
+        std::string ascii;
+        for (size_t i = offset; i < offset + PREVIEW_HEX_WIDTH; ++i) {
+            if (i < size) {
+                unsigned char c = static_cast<unsigned char>(data[i]);
+                length += snprintf(line + length, sizeof(line) - length, " %02x", c);
+                ascii += c >= 32 && c < 127 ? static_cast<char>(c) : '.';
+            } else {
+                length += snprintf(line + length, sizeof(line) - length, "   ");
+            }
+        }
+        preview.lines.push_back(std::string(line, length) + "  |" + ascii + "|");
+    }
+}
+
+// Читает начало файла; возвращает false, если запрос отменили во время чтения
+static bool load_file(const std::string& path, const std::atomic<unsigned>& generation, unsigned expected,
+                      Preview& preview) {
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NOCTTY);
+    if (fd < 0) {
+        preview.kind = PREVIEW_MESSAGE;
+        preview.summary = strerror(errno);
+        return true;
+    }
+    std::vector<char> data(PREVIEW_READ_BYTES);
+    size_t filled = 0;
+    while (filled < data.size()) {
+        if (cancelled(generation, expected)) {
+            close(fd);
+            return false;
+        }
+        ssize_t got = read(fd, &data[filled], std::min(static_cast<size_t>(PREVIEW_READ_CHUNK), data.size() - filled));
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got < 0) {
+            preview.kind = PREVIEW_MESSAGE;
+            preview.summary = strerror(errno);
+            close(fd);
+            return true;
+        }
+        if (got == 0) {
+            break;
+        }
+        filled += got;
+    }
+    close(fd);
+    data.resize(filled);
+
+    if (looks_binary(data.data(), data.size())) {
+        preview.kind = PREVIEW_HEX;
+        preview.summary = "binary, " + std::to_string(preview.size) + " bytes";
+        format_hex(data, preview);
+    } else {
+        preview.kind = PREVIEW_TEXT;
+        preview.summary = "text, " + std::to_string(preview.size) + " bytes";
+        format_text(data, preview);
+    }
+    return true;
+}
+
+static bool load_directory(const std::string& path, const std::atomic<unsigned>& generation, unsigned expected,
+                           Preview& preview) {
+    DIR* dir = opendir(path.c_str());
+    if (dir == nullptr) {
+        preview.kind = PREVIEW_MESSAGE;
+        preview.summary = strerror(errno);
+        return true;
+    }
+    preview.kind = PREVIEW_DIRECTORY;
+    std::vector<std::string> names;
+    bool truncated = false;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        if (names.size() >= PREVIEW_MAX_ENTRIES) {
+            truncated = true;
+            break;
+        }
+        if (names.size() % PREVIEW_CANCEL_CHECK_ENTRIES == 0 && cancelled(generation, expected)) {
+            closedir(dir);
+            return false;
+        }
+        // Каталоги помечаются косой чертой по d_type, без stat для каждой записи
+        names.push_back(std::string(entry->d_name) + (entry->d_type == DT_DIR ? "/" : ""));
+    }
+    closedir(dir);
+
+    std::sort(names.begin(), names.end());
+    preview.lines.swap(names);
+    preview.summary = std::to_string(preview.lines.size()) + (truncated ? "+" : "") + " entries";
+    return true;
+}
+
+// Строит предпросмотр пути; возвращает false, если запрос устарел раньше, чем закончилась загрузка
+static bool load_preview(const std::string& path, const std::atomic<unsigned>& generation, unsigned expected,
+                         Preview& preview) {
+    PROFILE_SCOPE("preview");
+    preview.path = path;
+    preview.kind = PREVIEW_MESSAGE;
+    preview.lines.clear();
+    preview.summary.clear();
+    preview.mtime = 0;
+    preview.size = 0;
+
+    // Ключ кеша берется из lstat, как и метаданные записей панели, а содержимое - у цели ссылки
+    struct stat st;
+    if (lstat(path.c_str(), &st) != 0) {
+        preview.summary = strerror(errno);
+        return true;
+    }
+    preview.mtime = st.st_mtime;
+    preview.size = st.st_size;
+    if (S_ISLNK(st.st_mode) && stat(path.c_str(), &st) != 0) {
+        preview.summary = std::string("broken link: ") + strerror(errno);
+        return true;
+    }
+    if (S_ISDIR(st.st_mode)) {
+        return load_directory(path, generation, expected, preview);
+    }
+    if (S_ISREG(st.st_mode)) {
+        return load_file(path, generation, expected, preview);
+    }
+    // Открытие FIFO или устройства могло бы заблокировать задачу, поэтому их не читаем
+    preview.summary = "special file";
+    return true;
+}
+
+PreviewLoader::PreviewLoader() : shared(std::make_shared<SharedState>()), current_generation(0), loading(false) {}
+
+void PreviewLoader::request(const std::string& path, const FileEntry* entry) {
+    std::unordered_map<std::string, std::list<Preview>::iterator>::iterator cached = cache_index.find(path);
+    bool stale = cached != cache_index.end() && entry != nullptr && entry->info_valid &&
+                 (cached->second->mtime != entry->mtime || cached->second->size != entry->size);
+    if (path == current_path && !stale) {
+        return;
+    }
+    current_path = path;
+
+    // Кешированный предпросмотр показывается сразу и поднимается в начало списка
+    if (cached != cache_index.end() && !stale) {
+        cache.splice(cache.begin(), cache, cached->second);
+        if (loading) {
+            // Запрос, который еще выполняется, больше не нужен
+            current_generation = ++shared->generation;
+            loading = false;
+        }
+        return;
+    }
+
+    current_generation = ++shared->generation;
+    loading = true;
+    std::shared_ptr<SharedState> state = shared;
+    std::lock_guard<std::mutex> lock(state->mutex);
+    state->has_request = true;
+    state->request_path = path;
+    if (state->running) {
+        // Работающая задача заберет новый запрос, как только прервет текущий
+        return;
+    }
+    state->running = true;
+    // Предпросмотр следует за курсором панели в фокусе, поэтому идет впереди работы остальных панелей
+    io_pool().submit([state]() {
+        while (true) {
+            std::string path;
+            unsigned generation;
+            {
+                std::lock_guard<std::mutex> lock(state->mutex);
+                if (!state->has_request) {
+                    state->running = false;
+                    return;
+                }
+                state->has_request = false;
+                path = state->request_path;
+                generation = state->generation;
+            }
+            Preview preview;
+            if (!load_preview(path, state->generation, generation, preview)) {
+                continue;
+            }
+            std::lock_guard<std::mutex> lock(state->mutex);
+            state->has_result = true;
+            state->result_generation = generation;
+            state->result = std::move(preview);
+        }
+    }, PRIORITY_HIGH);
+}
+
+bool PreviewLoader::poll() {
+    if (!loading) {
+        return false;
+    }
+    Preview preview;
+    {
+        std::lock_guard<std::mutex> lock(shared->mutex);
+        if (!shared->has_result) {
+            return false;
+        }
+        shared->has_result = false;
+        if (shared->result_generation != current_generation) {
+            return false;
+        }
+        preview = std::move(shared->result);
+    }
+    loading = false;
+    remember(preview);
+    return true;
+}
+
+void PreviewLoader::remember(const Preview& preview) {
+    std::unordered_map<std::string, std::list<Preview>::iterator>::iterator cached = cache_index.find(preview.path);
+    if (cached != cache_index.end()) {
+        cache.erase(cached->second);
+    }
+    cache.push_front(preview);
+    cache_index[preview.path] = cache.begin();
+    if (cache.size() > PREVIEW_CACHE_ENTRIES) {
+        cache_index.erase(cache.back().path);
+        cache.pop_back();
+    }
+}
+
+const Preview* PreviewLoader::current() const {
+    std::unordered_map<std::string, std::list<Preview>::iterator>::const_iterator cached = cache_index.find(current_path);
+    if (cached == cache_index.end()) {
+        return nullptr;
+    }
+    return &*cached->second;
+}
+
+bool PreviewLoader::has_background_work() const {
+    return loading;
+}
@@ -0,0 +1,72 @@
+#ifndef PREVIEW_H
+#define PREVIEW_H
+
+#include <atomic>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "file_entry.h"
+
+// Вид содержимого предпросмотра
+enum PreviewKind {
+    PREVIEW_TEXT,      // начало текстового файла
+    PREVIEW_HEX,       // шестнадцатеричный дамп начала двоичного файла
+    PREVIEW_DIRECTORY, // список содержимого каталога
+    PREVIEW_MESSAGE    // специальный файл или ошибка чтения
+};
+
+// Готовый к выводу предпросмотр: строки уже отформатированы, отрисовка только обрезает их по окну
+struct Preview {
+    std::string path;
+    PreviewKind kind;
+    std::vector<std::string> lines;
+    std::string summary;
+    time_t mtime; // Время изменения и размер на момент загрузки: по ним кеш замечает изменения
+    off_t size;
+};
+
+// Загрузка предпросмотров в пуле ввода-вывода. На загрузчик приходится не больше одной задачи
+// пула: она берет самый свежий запрос, а запросы, устаревшие из-за движения курсора,
+// пропускаются или прерываются посреди чтения. Готовые предпросмотры хранятся в LRU-кеше.
+// Все методы вызываются из потока интерфейса
+class PreviewLoader {
+public:
+    PreviewLoader();
+
+    // Запрашивает предпросмотр пути; повторный запрос того же пути ничего не делает.
+    // Если у записи панели уже есть метаданные, кешированный предпросмотр сверяется с ними
+    void request(const std::string& path, const FileEntry* entry);
+    // Забирает готовый результат, возвращает true, если он относится к текущему запросу
+    bool poll();
+    // Предпросмотр текущего пути или nullptr, пока он загружается
+    const Preview* current() const;
+    bool has_background_work() const;
+
+private:
+    // Общее с задачей пула состояние: переживает загрузчик, если задача еще выполняется
+    struct SharedState {
+        SharedState() : generation(0), running(false), has_request(false), has_result(false) {}
+        std::atomic<unsigned> generation; // Номер последнего запроса, по нему задача видит отмену
+        std::mutex mutex;
+        bool running;
+        bool has_request;
+        std::string request_path;
+        bool has_result;
+        unsigned result_generation;
+        Preview result;
+    };
+
+    void remember(const Preview& preview);
+
+    std::shared_ptr<SharedState> shared;
+    std::string current_path;
+    unsigned current_generation;
+    bool loading;
+    std::list<Preview> cache; // В начале - самые недавно использованные
+    std::unordered_map<std::string, std::list<Preview>::iterator> cache_index;
+};
+
+#endif // PREVIEW_H
@@ -0,0 +1,207 @@
+#include "profiler.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <mutex>
+#include <vector>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+// Число событий в кольцевом буфере одного потока
+#define TRACE_BUFFER_CAPACITY 8192
+
+// Замер, записанный в кольцевой буфер
+struct TraceEvent {
+    const char* name;
+    uint64_t start_ns;
+    uint64_t duration_ns;
+    uint32_t tid;
+};
+
+// Кольцевой буфер событий. Пишет в него только поток-владелец, поэтому запись не требует блокировок:
+// событие кладется в ячейку, после чего head публикуется с семантикой release
+struct TraceBuffer {
+    std::atomic<uint64_t> head;
+    TraceEvent events[TRACE_BUFFER_CAPACITY];
+};
+
+// Реестр буферов. Мьютекс берется только при выдаче буфера новому потоку и при чтении статистики.
+// Буферы завершившихся потоков не освобождаются, а переиспользуются следующими потоками
+static std::mutex registry_mutex;
+static std::vector<TraceBuffer*> all_buffers;
+static std::vector<TraceBuffer*> free_buffers;
+
+static std::atomic<uint64_t> counters[PROFILE_COUNTER_COUNT];
+static uint64_t key_pressed_ns = 0;
+
+// Привязка буфера к потоку: при завершении потока буфер возвращается в реестр
+class ThreadTraceBuffer {
+public:
+    ThreadTraceBuffer() : buffer(nullptr), tid(static_cast<uint32_t>(syscall(SYS_gettid))) {}
+    ~ThreadTraceBuffer() {
+        if (buffer != nullptr) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            free_buffers.push_back(buffer);
+        }
+    }
+
+    TraceBuffer* get() {
+        if (buffer == nullptr) {
+            std::lock_guard<std::mutex> lock(registry_mutex);
+            if (!free_buffers.empty()) {
+                buffer = free_buffers.back();
+                free_buffers.pop_back();
+            } else {
+                buffer = new TraceBuffer();
+                buffer->head.store(0);
+                all_buffers.push_back(buffer);
+            }
+        }
+        return buffer;
+    }
+
+    uint32_t thread_id() const {
+        return tid;
+    }
+
+private:
+    TraceBuffer* buffer;
+    uint32_t tid;
+};
+
+static thread_local ThreadTraceBuffer thread_buffer;
+
+bool profiler_enabled() {
+#ifdef FM_PROFILE
+    return true;
+#else
+    return false;
+#endif
+}
+
+uint64_t profiler_now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+// Записывает замер в кольцевой буфер текущего потока
+void profiler_record(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    TraceBuffer* buffer = thread_buffer.get();
+    uint64_t head = buffer->head.load(std::memory_order_relaxed);
+    TraceEvent& event = buffer->events[head % TRACE_BUFFER_CAPACITY];
+    event.name = name;
+    event.start_ns = start_ns;
+    event.duration_ns = end_ns - start_ns;
+    event.tid = thread_buffer.thread_id();
+    buffer->head.store(head + 1, std::memory_order_release);
+}
+
+void profiler_count(ProfileCounter counter, uint64_t value) {
+    counters[counter].fetch_add(value, std::memory_order_relaxed);
+}
+
+uint64_t profiler_counter(ProfileCounter counter) {
+    return counters[counter].load(std::memory_order_relaxed);
+}
+
+const char* profiler_counter_name(ProfileCounter counter) {
+    switch (counter) {
+        case COUNTER_STAT:
+            return "stat calls";
+        case COUNTER_OPENDIR:
+            return "opendir calls";
+        case COUNTER_READDIR:
+            return "readdir calls";
+        case COUNTER_SUBPROCESS:
+            return "subprocesses";
+        case COUNTER_BYTES_COPIED:
+            return "bytes copied";
+        case COUNTER_FRAMES:
+            return "frames";
+        default:
+            return "?";
+    }
+}
+
+// Копирует события из всех буферов. Ячейки, которые поток успел перезаписать
+// во время чтения, могут оказаться несогласованными, для статистики это допустимо
+static std::vector<TraceEvent> collect_events() {
+    std::vector<TraceEvent> events;
+    std::lock_guard<std::mutex> lock(registry_mutex);
+    for (size_t i = 0; i < all_buffers.size(); ++i) {
+        TraceBuffer* buffer = all_buffers[i];
+        uint64_t head = buffer->head.load(std::memory_order_acquire);
+        uint64_t first = head > TRACE_BUFFER_CAPACITY ? head - TRACE_BUFFER_CAPACITY : 0;
+        for (uint64_t j = first; j < head; ++j) {
+            events.push_back(buffer->events[j % TRACE_BUFFER_CAPACITY]);
+        }
+    }
+    return events;
+}
+
+// Считает медиану, 99-й перцентиль и максимум длительностей событий с заданным именем
+bool profiler_summary(const char* name, ProfileSummary& summary) {
+    std::vector<TraceEvent> events = collect_events();
+    std::vector<uint64_t> durations;
+    for (size_t i = 0; i < events.size(); ++i) {
+        if (strcmp(events[i].name, name) == 0) {
+            durations.push_back(events[i].duration_ns);
+        }
+    }
+
+    summary.count = durations.size();
+    summary.p50 = summary.p99 = summary.max = 0;
+    if (durations.empty()) {
+        return false;
+    }
+
+    std::sort(durations.begin(), durations.end());
+    summary.p50 = durations[(durations.size() - 1) / 2];
+    summary.p99 = durations[(durations.size() - 1) * 99 / 100];
+    summary.max = durations.back();
+    return true;
+}
+
+// Отметка нажатия клавиши, от которой отсчитывается задержка до вывода кадра
+void profiler_key_pressed() {
+    key_pressed_ns = profiler_now_ns();
+}
+
+// Отметка вывода кадра на терминал
+void profiler_frame_presented() {
+    profiler_count(COUNTER_FRAMES, 1);
+    if (key_pressed_ns != 0) {
+        profiler_record("key_to_frame", key_pressed_ns, profiler_now_ns());
+        key_pressed_ns = 0;
+    }
+}
+
+// Записывает собранные события в формате Chrome trace (chrome://tracing, Perfetto)
+bool profiler_dump_trace(const std::string& path) {
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == nullptr) {
+        return false;
+    }
+
+    std::vector<TraceEvent> events = collect_events();
+    int pid = getpid();
+    fprintf(file, "{\"traceEvents\":[\n");
+    for (size_t i = 0; i < events.size(); ++i) {
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f,\"pid\":%d,\"tid\":%u},\n",
+                events[i].name, events[i].start_ns / 1000.0, events[i].duration_ns / 1000.0, pid, events[i].tid);
+    }
+
+    // Итоговые значения счетчиков выводим как события-счетчики
+    double now_us = profiler_now_ns() / 1000.0;
+    for (int i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+        ProfileCounter counter = static_cast<ProfileCounter>(i);
+        fprintf(file, "{\"name\":\"%s\",\"ph\":\"C\",\"ts\":%.3f,\"pid\":%d,\"args\":{\"value\":%llu}}%s\n",
+                profiler_counter_name(counter), now_us, pid, static_cast<unsigned long long>(profiler_counter(counter)),
+                i + 1 < PROFILE_COUNTER_COUNT ? "," : "");
+    }
+    fprintf(file, "]}\n");
+    return fclose(file) == 0;
+}
@@ -0,0 +1,65 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <string>
+#include <cstdint>
+
+// Счетчики событий, которые собирает профилировщик
+enum ProfileCounter {
+    COUNTER_STAT = 0,
+    COUNTER_OPENDIR,
+    COUNTER_READDIR,
+    COUNTER_SUBPROCESS,
+    COUNTER_BYTES_COPIED,
+    COUNTER_FRAMES,
+    PROFILE_COUNTER_COUNT
+};
+
+// Сводка по длительностям одного вида событий в наносекундах
+struct ProfileSummary {
+    uint64_t count;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t max;
+};
+
+bool profiler_enabled();
+uint64_t profiler_now_ns();
+void profiler_record(const char* name, uint64_t start_ns, uint64_t end_ns);
+void profiler_count(ProfileCounter counter, uint64_t value);
+uint64_t profiler_counter(ProfileCounter counter);
+const char* profiler_counter_name(ProfileCounter counter);
+bool profiler_summary(const char* name, ProfileSummary& summary);
+void profiler_key_pressed();
+void profiler_frame_presented();
+bool profiler_dump_trace(const std::string& path);
+
+// Замер длительности области видимости
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name) : name(name), start_ns(profiler_now_ns()) {}
+    ~ProfileScope() {
+        profiler_record(name, start_ns, profiler_now_ns());
+    }
+
+private:
+    const char* name;
+    uint64_t start_ns;
+};
+
+// Без флага FM_PROFILE (make PROFILE=1) точки замера не компилируются вовсе
+#ifdef FM_PROFILE
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_COUNT(counter, value) profiler_count(counter, value)
+#define PROFILE_KEY_PRESSED() profiler_key_pressed()
+#define PROFILE_FRAME_PRESENTED() profiler_frame_presented()
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_COUNT(counter, value) ((void)sizeof(value))
+#define PROFILE_KEY_PRESSED() ((void)0)
+#define PROFILE_FRAME_PRESENTED() ((void)0)
+#endif
+
+#endif // PROFILER_H
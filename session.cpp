@@ -0,0 +1,142 @@
+#include "session.h"
+#include "binary_io.h"
+#include <cstdlib>
+
+// Сигнатура и версия формата файла сеанса
+static const uint32_t SESSION_MAGIC = 0x53534d46; // "FMSS"
+static const uint32_t SESSION_VERSION = 3;
+
+// Возвращает состояние панели без сохраненных данных, панель откроет рабочий каталог
+PanelState empty_panel_state() {
+    PanelState state;
+    state.selected_file = 0;
+    state.scroll_position = 0;
+    state.sort_mode = SORT_NONE;
+    state.current_tab_index = 0;
+    state.has_entries = false;
+    state.dir_mtime_ns = 0;
+    return state;
+}
+
+// Возвращает путь к файлу сеанса в домашнем каталоге пользователя
+std::string default_session_path() {
+    const char* home = getenv("HOME");
+    if (home == nullptr || home[0] == '\0') {
+        return "";
+    }
+    return std::string(home) + "/.file_manager_session";
+}
+
+// Сохраняет сеанс во временный файл и атомарно подменяет им старый файл сеанса
+bool save_session(const std::string& path, const SessionState& session) {
+    // Сериализуем состояние в буфер
+    BinaryWriter writer;
+    writer.put_u32(SESSION_MAGIC);
+    writer.put_u32(SESSION_VERSION);
+    writer.put_u32(static_cast<uint32_t>(session.active_panel));
+    writer.put_u32(static_cast<uint32_t>(session.panels.size()));
+    for (size_t i = 0; i < session.panels.size(); ++i) {
+        const PanelState& panel = session.panels[i];
+        writer.put_string(panel.current_dir);
+        writer.put_u32(static_cast<uint32_t>(panel.selected_file));
+        writer.put_u32(static_cast<uint32_t>(panel.scroll_position));
+        writer.put_u32(static_cast<uint32_t>(panel.sort_mode));
+        writer.put_string(panel.filter);
+        writer.put_u32(static_cast<uint32_t>(panel.tabs.size()));
+        for (size_t j = 0; j < panel.tabs.size(); ++j) {
+            const TabState& tab = panel.tabs[j];
+            writer.put_string(tab.dir);
+            writer.put_u32(static_cast<uint32_t>(tab.selected_file));
+            writer.put_u32(static_cast<uint32_t>(tab.scroll_position));
+            writer.put_u32(static_cast<uint32_t>(tab.sort_mode));
+            writer.put_string(tab.filter);
+        }
+        writer.put_u32(static_cast<uint32_t>(panel.current_tab_index));
+
+        // Снимок содержимого каталога записываем только если он был запрошен
+        writer.put_u8(panel.has_entries ? 1 : 0);
+        if (panel.has_entries) {
+            writer.put_i64(panel.dir_mtime_ns);
+            writer.put_u32(static_cast<uint32_t>(panel.entries.size()));
+            for (size_t j = 0; j < panel.entries.size(); ++j) {
+                const FileEntry& entry = panel.entries[j];
+                writer.put_string(panel.entries.name(j));
+                writer.put_i64(entry.size);
+                writer.put_i64(entry.mtime);
+                writer.put_u32(entry.mode);
+                // Тип содержимого занимает старшие биты флагов
+                writer.put_u8((entry.has_info ? 1 : 0) | (entry.info_valid ? 2 : 0) | (entry.type << 2));
+            }
+        }
+    }
+
+    return write_file_atomic(path, writer.data());
+}
+
+// Загружает сеанс, отображая файл в память
+bool load_session(const std::string& path, SessionState& session) {
+    if (path.empty()) {
+        return false;
+    }
+
+    MappedFile file;
+    if (!file.open(path)) {
+        return false;
+    }
+
+    // Разбираем содержимое файла, проверяя сигнатуру и версию формата
+    BinaryReader reader(file.data(), file.size());
+    SessionState loaded;
+    bool valid = reader.get_u32() == SESSION_MAGIC && reader.get_u32() == SESSION_VERSION;
+    if (valid) {
+        loaded.active_panel = static_cast<int>(reader.get_u32());
+        uint32_t panel_count = reader.get_u32();
+        for (uint32_t i = 0; i < panel_count && reader.good(); ++i) {
+            PanelState panel;
+            panel.current_dir = reader.get_string();
+            panel.selected_file = static_cast<int>(reader.get_u32());
+            panel.scroll_position = static_cast<int>(reader.get_u32());
+            panel.sort_mode = static_cast<int>(reader.get_u32());
+            panel.filter = reader.get_string();
+            uint32_t tab_count = reader.get_u32();
+            for (uint32_t j = 0; j < tab_count && reader.good(); ++j) {
+                TabState tab;
+                tab.dir = reader.get_string();
+                tab.selected_file = static_cast<int>(reader.get_u32());
+                tab.scroll_position = static_cast<int>(reader.get_u32());
+                tab.sort_mode = static_cast<int>(reader.get_u32());
+                tab.filter = reader.get_string();
+                panel.tabs.push_back(tab);
+            }
+            panel.current_tab_index = static_cast<int>(reader.get_u32());
+
+            panel.has_entries = reader.get_u8() != 0;
+            panel.dir_mtime_ns = 0;
+            if (panel.has_entries) {
+                panel.dir_mtime_ns = reader.get_i64();
+                uint32_t entry_count = reader.get_u32();
+                for (uint32_t j = 0; j < entry_count && reader.good(); ++j) {
+                    std::string name = reader.get_string();
+                    panel.entries.push_back(name.data(), name.size());
+                    FileEntry& entry = panel.entries[panel.entries.size() - 1];
+                    entry.size = reader.get_i64();
+                    entry.mtime = reader.get_i64();
+                    entry.mode = static_cast<uint16_t>(reader.get_u32());
+                    uint8_t flags = reader.get_u8();
+                    entry.has_info = (flags & 1) != 0;
+                    entry.info_valid = (flags & 2) != 0;
+                    entry.type = static_cast<uint8_t>(flags >> 2);
+                }
+            }
+            loaded.panels.push_back(panel);
+        }
+        valid = reader.good();
+    }
+
+    // Поврежденный или устаревший файл сеанса игнорируем целиком
+    if (!valid) {
+        return false;
+    }
+    session = loaded;
+    return true;
+}
@@ -0,0 +1,43 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include "file_entry.h"
+#include <string>
+#include <vector>
+
+// Состояние просмотра одной вкладки
+struct TabState {
+    std::string dir;
+    int selected_file;
+    int scroll_position;
+    int sort_mode;
+    std::string filter;
+};
+
+// Состояние одной панели, сохраняемое между запусками
+struct PanelState {
+    std::string current_dir;
+    int selected_file;
+    int scroll_position;
+    int sort_mode;
+    std::string filter;
+    std::vector<TabState> tabs;
+    int current_tab_index;
+    // Необязательный снимок содержимого каталога для мгновенного первого кадра
+    bool has_entries;
+    int64_t dir_mtime_ns;
+    EntryList entries;
+};
+
+// Состояние всего сеанса: панели и номер панели в фокусе
+struct SessionState {
+    int active_panel;
+    std::vector<PanelState> panels;
+};
+
+PanelState empty_panel_state();
+std::string default_session_path();
+bool save_session(const std::string& path, const SessionState& session);
+bool load_session(const std::string& path, SessionState& session);
+
+#endif // SESSION_H
@@ -0,0 +1,87 @@
+#include "stats_window.h"
+#include "profiler.h"
+#include <ncurses.h>
+#include <string>
+#include <unistd.h>
+
+// Конструктор класса StatsWindow, инициализирует ncurses и создает окно статистики
+StatsWindow::StatsWindow(int height, int width) {
+    initscr();
+    raw();
+    keypad(stdscr, TRUE);
+    noecho();
+    start_color();
+
+    init_pair(2, COLOR_YELLOW, COLOR_BLACK);
+    init_pair(3, COLOR_WHITE, COLOR_BLACK);
+
+    x = (COLS - width) / 2;
+    y = (LINES - height) / 2;
+
+    win = newwin(height, width, y, x);
+    box(win, 0, 0);
+}
+
+// Деструктор класса StatsWindow, удаляет окно и завершает ncurses
+StatsWindow::~StatsWindow() {
+    delwin(win);
+    endwin();
+}
+
+// Метод класса StatsWindow, отображает задержки и счетчики профилировщика
+void StatsWindow::show() {
+    werase(win);
+    box(win, 0, 0);
+
+    wattron(win, COLOR_PAIR(2));
+    mvwprintw(win, 1, 1, "Profiling:");
+    wattroff(win, COLOR_PAIR(2));
+
+    wattron(win, COLOR_PAIR(3));
+    if (!profiler_enabled()) {
+        // Без флага сборки точки замера отсутствуют, показывать нечего
+        mvwprintw(win, 3, 2, "Profiling is disabled in this build.");
+        mvwprintw(win, 4, 2, "Rebuild with 'make clean && make PROFILE=1' to enable it.");
+        wattroff(win, COLOR_PAIR(3));
+        wrefresh(win);
+        getch();
+        return;
+    }
+
+    // Перцентили длительностей в миллисекундах
+    const char* names[] = {"key_to_frame", "frame", "draw", "doupdate", "list_directory", "system"};
+    mvwprintw(win, 3, 2, "%-16s %8s %10s %10s %10s", "event", "count", "p50 ms", "p99 ms", "max ms");
+    mvwhline(win, 4, 1, '-', getmaxx(win) - 2);
+    int row = 5;
+    for (size_t i = 0; i < sizeof(names) / sizeof(names[0]); ++i) {
+        ProfileSummary summary;
+        profiler_summary(names[i], summary);
+        mvwprintw(win, row++, 2, "%-16s %8llu %10.3f %10.3f %10.3f", names[i], static_cast<unsigned long long>(summary.count),
+                  summary.p50 / 1e6, summary.p99 / 1e6, summary.max / 1e6);
+    }
+    mvwhline(win, row++, 1, '-', getmaxx(win) - 2);
+
+    // Значения счетчиков
+    for (int i = 0; i < PROFILE_COUNTER_COUNT; ++i) {
+        ProfileCounter counter = static_cast<ProfileCounter>(i);
+        mvwprintw(win, row++, 2, "%-16s %llu", profiler_counter_name(counter),
+                  static_cast<unsigned long long>(profiler_counter(counter)));
+    }
+    mvwhline(win, row++, 1, '-', getmaxx(win) - 2);
+    mvwprintw(win, row, 2, "Press 'd' to dump a Chrome trace, any other key to close.");
+    wattroff(win, COLOR_PAIR(3));
+    wrefresh(win);
+
+    // По нажатию 'd' сохраняем трассу для анализа в chrome://tracing или Perfetto
+    if (getch() == 'd') {
+        std::string path = "/tmp/file_manager-" + std::to_string(getpid()) + ".trace.json";
+        mvwhline(win, row, 1, ' ', getmaxx(win) - 2);
+        if (profiler_dump_trace(path)) {
+            mvwprintw(win, row, 2, "Trace written to %s", path.c_str());
+        } else {
+            mvwprintw(win, row, 2, "Failed to write %s", path.c_str());
+        }
+        wrefresh(win);
+        getch();
+    }
+}
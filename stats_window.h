@@ -0,0 +1,18 @@
+#ifndef STATS_WINDOW_H
+#define STATS_WINDOW_H
+
+#include <ncurses.h>
+
+class StatsWindow {
+public:
+    StatsWindow(int height, int width);
+    ~StatsWindow();
+
+    void show();
+
+private:
+    WINDOW* win;
+    int x, y;
+};
+
+#endif // STATS_WINDOW_H
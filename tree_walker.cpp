@@ -0,0 +1,298 @@
+#include "tree_walker.h"
+#include "io_scheduler.h"
+#include "profiler.h"
+#include "worker_pool.h"
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <dirent.h>
+#include <fcntl.h>
+#include <memory>
+#include <unistd.h>
+
+// Начальный размер таблицы одного сегмента множества inode
+#define INODE_SHARD_INITIAL_SLOTS 1024
+// Номер inode, который еще помещается в упакованный ключ
+#define INODE_PACKED_MAX ((static_cast<uint64_t>(1) << 48) - 1)
+
+void TreeVisitor::leave_directory(const std::string&, const struct stat&) {}
+
+void TreeVisitor::visit_directories(const std::string&, int, const std::vector<WalkEntry>&) {}
+
+std::string walk_path(const std::string& dir, const std::string& name) {
+    if (dir.empty()) {
+        return name;
+    }
+    if (dir[dir.size() - 1] == '/') {
+        return dir + name;
+    }
+    return dir + "/" + name;
+}
+
+InodeSet::InodeSet() {}
+
+bool InodeSet::pack(dev_t dev, ino_t ino, uint64_t& key) {
+    if (static_cast<uint64_t>(ino) > INODE_PACKED_MAX) {
+        return false;
+    }
+    // Файловых систем в одном обходе единицы, поэтому линейный поиск по списку дешев
+    std::lock_guard<std::mutex> lock(devices_mutex);
+    size_t index = 0;
+    while (index < devices.size() && devices[index] != dev) {
+        ++index;
+    }
+    if (index == devices.size()) {
+        if (devices.size() >= 0xFFFF) {
+            return false;
+        }
+        devices.push_back(dev);
+    }
+    // Номер устройства сдвинут на единицу, чтобы ключ никогда не был нулевым
+    key = (static_cast<uint64_t>(index + 1) << 48) | static_cast<uint64_t>(ino);
+    return true;
+}
+
+static inline size_t mix_key(uint64_t key) {
+    key ^= key >> 33;
+    key *= 0xff51afd7ed558ccdULL;
+    key ^= key >> 33;
+    return static_cast<size_t>(key);
+}
+
+bool InodeSet::insert(dev_t dev, ino_t ino) {
+    uint64_t key;
+    if (!pack(dev, ino, key)) {
+        Shard& shard = shards[mix_key(static_cast<uint64_t>(ino)) % SHARD_COUNT];
+        std::lock_guard<std::mutex> lock(shard.mutex);
+        return shard.overflow.insert(std::make_pair(dev, ino)).second;
+    }
+
+    size_t hash = mix_key(key);
+    Shard& shard = shards[hash % SHARD_COUNT];
+    std::lock_guard<std::mutex> lock(shard.mutex);
+    // Таблица заполняется не более чем наполовину, затем удваивается
+    if ((shard.count + 1) * 2 > shard.slots.size()) {
+        std::vector<uint64_t> old_slots;
+        old_slots.swap(shard.slots);
+        shard.slots.assign(old_slots.empty() ? INODE_SHARD_INITIAL_SLOTS : old_slots.size() * 2, 0);
+        size_t mask = shard.slots.size() - 1;
+        for (size_t i = 0; i < old_slots.size(); ++i) {
+            if (old_slots[i] != 0) {
+                size_t slot = (mix_key(old_slots[i]) / SHARD_COUNT) & mask;
+                while (shard.slots[slot] != 0) {
+                    slot = (slot + 1) & mask;
+                }
+                shard.slots[slot] = old_slots[i];
+            }
+        }
+    }
+    size_t mask = shard.slots.size() - 1;
+    size_t slot = (hash / SHARD_COUNT) & mask;
+    while (shard.slots[slot] != 0) {
+        if (shard.slots[slot] == key) {
+            return false;
+        }
+        slot = (slot + 1) & mask;
+    }
+    shard.slots[slot] = key;
+    shard.count++;
+    return true;
+}
+
+// Каталог, ожидающий обхода или завершения подкаталогов. pending - сам каталог плюс
+// незавершенные подкаталоги; когда счетчик обнуляется, вызывается leave_directory
+struct WalkNode {
+    std::string path;
+    struct stat st;
+    std::shared_ptr<WalkNode> parent;
+    std::atomic<size_t> pending;
+};
+
+// Общее состояние обхода: стек каталогов (обход в глубину держит очередь короткой)
+// и счетчик незавершенных каталогов, по которому потоки узнают об окончании
+struct WalkState {
+    WalkState(const WalkOptions& options, TreeVisitor& visitor)
+        : options(options), visitor(visitor), root_dev(0), unfinished(0) {}
+
+    const WalkOptions& options;
+    TreeVisitor& visitor;
+    InodeSet visited;
+    dev_t root_dev;
+    std::mutex mutex;
+    std::condition_variable changed;
+    std::deque<std::shared_ptr<WalkNode> > stack;
+    size_t unfinished;
+};
+
+// Завершает каталог: после последнего подкаталога вызывает leave_directory и поднимается к родителю
+static void finish_node(WalkState& state, std::shared_ptr<WalkNode> node) {
+    while (node && --node->pending == 0) {
+        state.visitor.leave_directory(node->path, node->st);
+        std::shared_ptr<WalkNode> parent = node->parent;
+        {
+            std::lock_guard<std::mutex> lock(state.mutex);
+            if (--state.unfinished == 0) {
+                state.changed.notify_all();
+            }
+        }
+        node = parent;
+    }
+}
+
+// Проверяет, нужно ли спускаться в каталог
+static bool accept_directory(WalkState& state, const struct stat& st) {
+    if (state.options.one_filesystem && st.st_dev != state.root_dev) {
+        return false;
+    }
+    // Повторная встреча каталога означает петлю или второй путь к нему - второй раз не обходим
+    return state.visited.insert(st.st_dev, st.st_ino);
+}
+
+// Ставит принятый каталог в стек обхода
+static void push_directory(WalkState& state, const std::shared_ptr<WalkNode>& parent, const std::string& path,
+                           const struct stat& st) {
+    if (!state.visitor.enter_directory(path, st)) {
+        return;
+    }
+    std::shared_ptr<WalkNode> node = std::make_shared<WalkNode>();
+    node->path = path;
+    node->st = st;
+    node->parent = parent;
+    node->pending = 1;
+    if (parent) {
+        parent->pending++;
+    }
+    std::lock_guard<std::mutex> lock(state.mutex);
+    state.unfinished++;
+    state.stack.push_back(node);
+    state.changed.notify_one();
+}
+
+// Читает каталог, передает посетителю файлы и ставит в стек подкаталоги
+static void process_directory(WalkState& state, const std::shared_ptr<WalkNode>& node) {
+    PROFILE_COUNT(COUNTER_OPENDIR, 1);
+    int fd = open(node->path.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* dir = fd >= 0 ? fdopendir(fd) : nullptr;
+    if (dir == nullptr) {
+        state.visitor.walk_error(node->path, errno);
+        if (fd >= 0) {
+            close(fd);
+        }
+        finish_node(state, node);
+        return;
+    }
+
+    std::vector<WalkEntry> files;
+    std::vector<WalkEntry> directories;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != nullptr) {
+        PROFILE_COUNT(COUNTER_READDIR, 1);
+        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+        WalkEntry item;
+        item.name = entry->d_name;
+        memset(&item.st, 0, sizeof(item.st));
+        // Каталогам stat нужен всегда: по устройству и inode распознаются петли и границы
+        // файловых систем. Остальным - если тип неизвестен, просили stat или надо идти по ссылке
+        unsigned char type = entry->d_type;
+        bool need_stat = state.options.stat_files || type == DT_UNKNOWN || type == DT_DIR ||
+                         (type == DT_LNK && state.options.follow_links);
+        if (need_stat) {
+            PROFILE_COUNT(COUNTER_STAT, 1);
+            if (fstatat(fd, entry->d_name, &item.st, AT_SYMLINK_NOFOLLOW) != 0) {
+                state.visitor.walk_error(walk_path(node->path, item.name), errno);
+                continue;
+            }
+            struct stat target;
+            if (S_ISLNK(item.st.st_mode) && state.options.follow_links &&
+                fstatat(fd, entry->d_name, &target, 0) == 0 && S_ISDIR(target.st_mode)) {
+                item.st = target;
+            }
+        } else {
+            item.st.st_mode = DTTOIF(type);
+        }
+        (S_ISDIR(item.st.st_mode) ? directories : files).push_back(item);
+    }
+
+    // Чтение каталога и stat его элементов - операции фонового задания, если обход идет в нем
+    io_throttle(0, 1 + (state.options.stat_files ? files.size() : 0) + directories.size());
+    if (!files.empty()) {
+        state.visitor.visit_files(node->path, fd, files);
+    }
+    std::vector<WalkEntry> accepted;
+    for (size_t i = 0; i < directories.size(); ++i) {
+        if (accept_directory(state, directories[i].st)) {
+            accepted.push_back(directories[i]);
+        }
+    }
+    directories.swap(accepted);
+    if (!directories.empty()) {
+        state.visitor.visit_directories(node->path, fd, directories);
+    }
+    closedir(dir);
+
+    for (size_t i = 0; i < directories.size(); ++i) {
+        push_directory(state, node, walk_path(node->path, directories[i].name), directories[i].st);
+    }
+    finish_node(state, node);
+}
+
+// Цикл потока обхода: берет каталоги из стека, пока не завершены все каталоги
+static void run_walk(WalkState& state) {
+    while (true) {
+        std::shared_ptr<WalkNode> node;
+        {
+            std::unique_lock<std::mutex> lock(state.mutex);
+            while (state.stack.empty() && state.unfinished > 0) {
+                state.changed.wait(lock);
+            }
+            if (state.stack.empty()) {
+                return;
+            }
+            node = state.stack.back();
+            state.stack.pop_back();
+        }
+        process_directory(state, node);
+    }
+}
+
+void walk_tree(const std::string& root, const WalkOptions& options, TreeVisitor& visitor) {
+    PROFILE_SCOPE("walk_tree");
+    struct stat st;
+    PROFILE_COUNT(COUNTER_STAT, 1);
+    if (lstat(root.c_str(), &st) != 0) {
+        visitor.walk_error(root, errno);
+        return;
+    }
+    struct stat target;
+    if (S_ISLNK(st.st_mode) && options.follow_links && stat(root.c_str(), &target) == 0 && S_ISDIR(target.st_mode)) {
+        st = target;
+    }
+    if (!S_ISDIR(st.st_mode)) {
+        std::vector<WalkEntry> files(1);
+        files[0].name = root;
+        files[0].st = st;
+        visitor.visit_files("", AT_FDCWD, files);
+        return;
+    }
+
+    // Состояние общее с задачами пула: помощник, запущенный уже после окончания обхода,
+    // должен найти его живым и сразу выйти. К посетителю помощники обращаются только внутри
+    // незавершенных каталогов, поэтому ждать их выхода не нужно - и нельзя, если walk_tree
+    // вызван из задачи того же пула
+    std::shared_ptr<WalkState> state = std::make_shared<WalkState>(options, visitor);
+    state->root_dev = st.st_dev;
+    accept_directory(*state, st);
+    push_directory(*state, std::shared_ptr<WalkNode>(), root, st);
+
+    if (options.parallel) {
+        WorkerPool& pool = io_pool();
+        for (unsigned i = 0; i < pool.size(); ++i) {
+            pool.submit([state]() { run_walk(*state); });
+        }
+    }
+    run_walk(*state);
+}
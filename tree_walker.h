@@ -0,0 +1,88 @@
+#ifndef TREE_WALKER_H
+#define TREE_WALKER_H
+
+#include <cstdint>
+#include <mutex>
+#include <set>
+#include <string>
+#include <utility>
+#include <vector>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+// Параметры обхода дерева каталогов
+struct WalkOptions {
+    WalkOptions() : follow_links(false), one_filesystem(false), parallel(true), stat_files(true) {}
+
+    bool follow_links;   // Спускаться в каталоги по символическим ссылкам, как find -L
+    bool one_filesystem; // Не заходить в каталоги других файловых систем, как du -x
+    bool parallel;       // Обходить каталоги параллельно в пуле ввода-вывода
+    bool stat_files;     // Делать lstat для файлов; без него у файла известен только тип из d_type
+};
+
+// Элемент каталога, переданный посетителю. Для файлов без stat заполнен только тип в st_mode
+struct WalkEntry {
+    std::string name;
+    struct stat st;
+};
+
+// Посетитель обхода. При параллельном обходе методы вызываются одновременно из разных потоков,
+// поэтому общее состояние посетитель защищает сам. Для одного каталога порядок вызовов
+// всегда такой: enter_directory, visit_files, содержимое подкаталогов, leave_directory
+class TreeVisitor {
+public:
+    virtual ~TreeVisitor() {}
+
+    // Каталог перед обходом содержимого; false - содержимое пропускается и leave_directory не вызывается
+    virtual bool enter_directory(const std::string& path, const struct stat& st) = 0;
+    // Все элементы каталога, кроме подкаталогов. dir_fd открыт на время вызова, имена в files
+    // относительно него. Если корень обхода не каталог, он передается с dir пустым и AT_FDCWD
+    virtual void visit_files(const std::string& dir, int dir_fd, const std::vector<WalkEntry>& files) = 0;
+    // Подкаталоги, в которые спустится обход, пока dir_fd родителя еще открыт; вызывается
+    // до enter_directory каждого из них. Корень обхода сюда не попадает
+    virtual void visit_directories(const std::string& dir, int dir_fd, const std::vector<WalkEntry>& directories);
+    // Каталог после обхода всего содержимого
+    virtual void leave_directory(const std::string& path, const struct stat& st);
+    virtual void walk_error(const std::string& path, int error) = 0;
+};
+
+// Полный путь элемента каталога dir (пустой dir означает, что name уже полный путь)
+std::string walk_path(const std::string& dir, const std::string& name);
+
+// Обходит дерево. Символические ссылки по умолчанию не разыменовываются; каталог с уже
+// встречавшейся парой (устройство, inode) пропускается, поэтому петли из ссылок и
+// bind-монтирований не зацикливают обход. Вызывающий поток участвует в обходе, так что
+// вызов из задачи пула ввода-вывода не блокирует его
+void walk_tree(const std::string& root, const WalkOptions& options, TreeVisitor& visitor);
+
+// Потокобезопасное множество пар (устройство, inode). Устройства нумеруются, и пара
+// упаковывается в 64 бита: 16 бит номера устройства и 48 бит inode, в таблице с открытой
+// адресацией. Редкие пары, которые не помещаются в такую упаковку, хранятся отдельно
+class InodeSet {
+public:
+    InodeSet();
+
+    // Добавляет пару; false, если она уже была в множестве
+    bool insert(dev_t dev, ino_t ino);
+
+private:
+    InodeSet(const InodeSet&);
+    InodeSet& operator=(const InodeSet&);
+
+    static const size_t SHARD_COUNT = 16;
+    struct Shard {
+        Shard() : count(0) {}
+        std::mutex mutex;
+        std::vector<uint64_t> slots; // 0 - свободная ячейка
+        size_t count;
+        std::set<std::pair<dev_t, ino_t> > overflow;
+    };
+
+    bool pack(dev_t dev, ino_t ino, uint64_t& key);
+
+    Shard shards[SHARD_COUNT];
+    std::mutex devices_mutex;
+    std::vector<dev_t> devices;
+};
+
+#endif // TREE_WALKER_H
@@ -0,0 +1,173 @@
+#include "worker_pool.h"
+#include "io_scheduler.h"
+#include <algorithm>
+#include <atomic>
+#include <memory>
+
+// Число потоков общего пула ввода-вывода
+#define IO_POOL_THREADS 8
+
+// Приоритет задачи, которую сейчас выполняет поток пула
+static thread_local TaskPriority current_priority = PRIORITY_NORMAL;
+
+// Число потоков по умолчанию: по числу процессоров, но не меньше двух
+unsigned default_worker_count() {
+    unsigned count = std::thread::hardware_concurrency();
+    return count < 2 ? 2 : count;
+}
+
+WorkerPool::WorkerPool(unsigned threads) : active(0), stopping(false) {
+    if (threads == 0) {
+        threads = 1;
+    }
+    for (unsigned i = 0; i < threads; ++i) {
+        workers.push_back(std::thread(&WorkerPool::run, this));
+    }
+}
+
+// Деструктор дожидается выполнения всех поставленных задач
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    task_available.notify_all();
+    for (size_t i = 0; i < workers.size(); ++i) {
+        workers[i].join();
+    }
+}
+
+void WorkerPool::submit(const std::function<void()>& task) {
+    submit(task, current_priority);
+}
+
+void WorkerPool::submit(const std::function<void()>& task, TaskPriority priority) {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        Task item;
+        item.run = task;
+        item.io_job = current_io_job();
+        tasks[priority].push_back(item);
+    }
+    task_available.notify_one();
+}
+
+bool WorkerPool::has_tasks() const {
+    for (int i = 0; i < PRIORITY_COUNT; ++i) {
+        if (!tasks[i].empty()) {
+            return true;
+        }
+    }
+    return false;
+}
+
+// Ждет, пока очередь опустеет и все потоки закончат текущие задачи
+void WorkerPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(mutex);
+    while (has_tasks() || active > 0) {
+        idle.wait(lock);
+    }
+}
+
+// Состояние одного вызова parallel_for, общее для вызывающего потока и помощников из пула
+struct ParallelRange {
+    std::atomic<size_t> next;
+    size_t count;
+    size_t grain;
+    size_t chunks;
+    size_t finished;
+    std::function<void(size_t, size_t)> body;
+    std::mutex mutex;
+    std::condition_variable done;
+};
+
+// Разбирает диапазон кусками по grain элементов, пока он не закончится
+static void run_range(const std::shared_ptr<ParallelRange>& range) {
+    while (true) {
+        size_t begin = range->next.fetch_add(range->grain);
+        if (begin >= range->count) {
+            return;
+        }
+        range->body(begin, std::min(begin + range->grain, range->count));
+        std::lock_guard<std::mutex> lock(range->mutex);
+        if (++range->finished == range->chunks) {
+            range->done.notify_all();
+        }
+    }
+}
+
+// Выполняет body для кусков [begin, end) диапазона [0, count) параллельно и ждет завершения.
+// Вызывающий поток тоже обрабатывает куски, поэтому вызов из задачи этого же пула не блокируется
+void WorkerPool::parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body) {
+    if (count == 0) {
+        return;
+    }
+    if (grain == 0) {
+        grain = 1;
+    }
+
+    std::shared_ptr<ParallelRange> range = std::make_shared<ParallelRange>();
+    range->next = 0;
+    range->count = count;
+    range->grain = grain;
+    range->chunks = (count + grain - 1) / grain;
+    range->finished = 0;
+    range->body = body;
+
+    size_t helpers = std::min(static_cast<size_t>(workers.size()), range->chunks - 1);
+    for (size_t i = 0; i < helpers; ++i) {
+        submit([range]() { run_range(range); });
+    }
+    run_range(range);
+
+    std::unique_lock<std::mutex> lock(range->mutex);
+    while (range->finished < range->chunks) {
+        range->done.wait(lock);
+    }
+}
+
+WorkerPool& io_pool() {
+    static WorkerPool pool(IO_POOL_THREADS);
+    return pool;
+}
+
+unsigned WorkerPool::size() const {
+    return workers.size();
+}
+
+void WorkerPool::run() {
+    while (true) {
+        Task task;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            while (!has_tasks() && !stopping) {
+                task_available.wait(lock);
+            }
+            if (!has_tasks()) {
+                return;
+            }
+            int priority = PRIORITY_COUNT - 1;
+            while (tasks[priority].empty()) {
+                --priority;
+            }
+            task = tasks[priority].front();
+            tasks[priority].pop_front();
+            current_priority = static_cast<TaskPriority>(priority);
+            active++;
+        }
+
+        {
+            BackgroundIoScope io_scope(task.io_job);
+            task.run();
+        }
+        current_priority = PRIORITY_NORMAL;
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            active--;
+            if (!has_tasks() && active == 0) {
+                idle.notify_all();
+            }
+        }
+    }
+}
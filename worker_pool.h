@@ -0,0 +1,67 @@
+#ifndef WORKER_POOL_H
+#define WORKER_POOL_H
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class IoJob;
+
+// Приоритет задачи пула. Потоки берут задачи из очереди самого высокого непустого приоритета,
+// внутри одного приоритета - в порядке постановки
+enum TaskPriority {
+    PRIORITY_LOW,    // фоновая работа панелей без фокуса
+    PRIORITY_NORMAL, // обычные задачи
+    PRIORITY_HIGH,   // работа панели в фокусе: ее результат пользователь ждет на экране
+    PRIORITY_COUNT
+};
+
+// Пул рабочих потоков с очередями задач по приоритетам
+class WorkerPool {
+public:
+    explicit WorkerPool(unsigned threads);
+    ~WorkerPool();
+
+    // Задача без явного приоритета наследует приоритет задачи пула, из которой поставлена
+    // (помощники parallel_for и обхода дерева), а из других потоков получает PRIORITY_NORMAL.
+    // Фоновое задание ввода-вывода (IoJob) задача наследует всегда: помощники копирования
+    // и хеширования подчиняются ограничениям своего задания
+    void submit(const std::function<void()>& task);
+    void submit(const std::function<void()>& task, TaskPriority priority);
+    void wait_idle();
+    void parallel_for(size_t count, size_t grain, const std::function<void(size_t, size_t)>& body);
+    unsigned size() const;
+
+private:
+    WorkerPool(const WorkerPool&);
+    WorkerPool& operator=(const WorkerPool&);
+
+    // Задача вместе с заданием ввода-вывода потока, который ее поставил
+    struct Task {
+        std::function<void()> run;
+        std::shared_ptr<IoJob> io_job;
+    };
+
+    void run();
+    bool has_tasks() const;
+
+    std::vector<std::thread> workers;
+    std::deque<Task> tasks[PRIORITY_COUNT];
+    std::mutex mutex;
+    std::condition_variable task_available;
+    std::condition_variable idle;
+    unsigned active;
+    bool stopping;
+};
+
+unsigned default_worker_count();
+
+// Общий пул для блокирующих обращений к файловой системе (stat, чтение каталогов).
+// Потоков больше, чем процессоров, так как они в основном ждут диск
+WorkerPool& io_pool();
+
+#endif // WORKER_POOL_H